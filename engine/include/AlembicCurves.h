@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "HairModel.h"
+
+// Alembic curves caches (Ogawa), for exchanging grooms and simulation output with other tools.
+// Strands are linear, non-periodic curves; thickness is written as the curve widths, transparency and
+// colors as the vertex-scope arbitrary geometry parameters "transparency" and "Cs", all three once.
+// Available when cgc is built with Alembic (CGC_ALEMBIC); otherwise every call fails with an error.
+
+class AlembicCurvesWriter {
+public:
+    struct Settings {
+        unsigned int encode_threads = 2; // frames converted and bounded in parallel
+        unsigned int queue_frames = 4; // frames in flight before AddFrame waits
+    };
+
+    AlembicCurvesWriter();
+    ~AlembicCurvesWriter(); // closes the file
+
+    // Topology and attributes come from `model`, its points are not written; add them as the first frame.
+    bool Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate);
+    bool Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate, const Settings& settings);
+
+    // Queue a frame and return; conversion to float, bounds and writing happen on the writer threads,
+    // so the simulation only waits when queue_frames frames are still pending.
+    bool AddFrame(std::vector<Eigen::Vector3d> positions, std::string* err); // e.g. HairSimulation::getPositions()
+    bool AddFrame(const std::vector<float>& points, std::string* err); // xyz, like HairModel::points
+
+    // waits for the queued frames, false if any of them failed
+    bool Close(std::string* err);
+
+    double stallSeconds() const; // total time AddFrame waited for the queue
+
+    // one-frame cache of a HairModel
+    static bool SaveToFile(const HairModel& model, std::string* err, const std::string& filename);
+
+private:
+    struct Archive; // Alembic objects, only touched by the writer thread after Open
+
+    struct Frame {
+        std::vector<Eigen::Vector3d> vertices;
+        std::vector<float> points;
+        double bounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}; // min xyz, max xyz
+        bool encoding = false;
+        bool encoded = false;
+    };
+
+    std::unique_ptr<Archive> archive;
+    Settings settings;
+    size_t point_count = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Frame> frames; // in frame order; references stay valid while other frames are added and removed
+    std::vector<std::thread> encoders;
+    std::thread writer;
+    bool stopping = false;
+    std::string error; // first error of the writer threads
+    double stall_seconds = 0.0;
+
+    bool push(Frame frame, std::string* err);
+    void encodeLoop();
+    void writeLoop();
+};
+
+class AlembicCurvesReader {
+public:
+    AlembicCurvesReader();
+    ~AlembicCurvesReader();
+
+    // opens the first curves object of the archive
+    bool Open(const std::string& filename, std::string* err);
+
+    unsigned int frameCount() const;
+    float frameRate() const; // 0 unless the samples are uniform in time
+
+    // the whole groom at `frame`: topology, positions and the attributes cgc can represent
+    bool ReadFrame(unsigned int frame, HairModel* model, std::string* err);
+
+    // frame 0 of a cache
+    static bool LoadFromFile(HairModel* model, std::string* err, const std::string& filename);
+
+private:
+    struct Archive;
+    std::unique_ptr<Archive> archive;
+};
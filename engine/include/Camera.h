@@ -51,6 +51,8 @@ public:
     void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true);
     // マウスホイール入力を処理
     void ProcessMouseScroll(float yoffset);
+    // 画面上の点を通る視線の方向 (ndcX, ndcY は -1..1、aspect は幅/高さ)、ピッキング用
+    glm::vec3 GetRayDirection(float ndcX, float ndcY, float aspect) const;
 
 private:
     // カメラのベクトルを更新
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <glm/glm.hpp>
+
+// Compute shader program, the counterpart of Shader. Needs an OpenGL 4.3 context.
+class ComputeShader {
+public:
+    GLuint ID;
+
+    ComputeShader(const char* computePath);
+    ~ComputeShader();
+    ComputeShader(const ComputeShader&) = delete;
+    ComputeShader& operator=(const ComputeShader&) = delete;
+
+    void use();
+    void dispatch(GLuint groups_x, GLuint groups_y = 1, GLuint groups_z = 1);
+    void setBool(const std::string &name, bool value) const;
+    void setInt(const std::string &name, int value) const;
+    void setFloat(const std::string &name, float value) const;
+    void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    void setVec3(const std::string &name, const glm::vec3 &value) const;
+
+    static bool isSupported(); // the current context provides compute shaders and SSBOs (GL 4.3)
+
+private:
+    void checkCompileErrors(GLuint shader, std::string type);
+};
@@ -14,15 +14,69 @@
 
 class DER {
 public:
-    DER(const std::vector<Eigen::Vector3d>& vertices, double E, double G, const std::vector<double>& a, const std::vector<double>& b);
+    DER(const std::vector<Eigen::Vector3d>& vertices, double E, double G, const std::vector<double>& a, const std::vector<double>& b, double rho = 1.3);
 
     void update(double dt);
 
+    // Adaptive stepping: advances by dt in substeps no larger than computeStableTimestep(cfl),
+    // re-evaluated after every substep so that only fast-moving strands pay for extra steps.
+    // Returns the number of substeps taken. A strand of a single vertex has no edge and no mass: none is taken,
+    // and its stable timestep is unlimited.
+    int advance(double dt, double cfl, int max_substeps);
+    double computeStableTimestep(double cfl) const; // explicit stability limit from stiffness and current speeds
+
+    double computeTotalEnergy(); // sum of stretching, twisting, and bending energies, reuses the per-step caches
+    std::vector<Eigen::Vector3d> computeEnergyGradient(); // vertex, dE/dx at fixed thetas
+
+    // Newton solver on the elastic energy over positions and thetas, see solveStatic / updateImplicit.
+    // At convergence the thetas are at equilibrium, as with the quasistatic update.
+    struct NewtonSettings {
+        int max_iterations = 20;
+        double tolerance = 1e-6; // on the largest residual force relative to the applied forces, or on the Newton step relative to the shortest edge
+        int max_line_search = 20; // backtracking halvings per iteration
+        int hessian_reuse = 4; // quasi-Newton (L-BFGS) iterations on one factorized Hessian before refreshing it
+        bool warm_start = true; // keep the factorized Hessian of the previous solve as the first preconditioner
+    };
+    struct NewtonStats {
+        bool converged = false;
+        int iterations = 0;
+        int factorizations = 0; // finite-difference Hessians built and factorized
+        int energy_evaluations = 0; // line search trials
+        std::vector<double> residuals; // largest residual force before each iteration and at the end, solveStatic: after each continuation step
+    };
+
+    // Static equilibrium under gravity and the external forces, by backward Euler steps from rest with a growing
+    // step (settings.max_iterations of them at most). Vertices 0 and 1 are held in place (at the clamped root if any),
+    // velocities are zeroed.
+    NewtonStats solveStatic();
+    NewtonStats solveStatic(const NewtonSettings& settings);
+    // Fully implicit (backward Euler) step, unconditionally stable for stiff strands.
+    // The inertial prediction x + dt v is the initial guess. Like update, it leaves a single-vertex strand alone.
+    NewtonStats updateImplicit(double dt);
+    NewtonStats updateImplicit(double dt, const NewtonSettings& settings);
+    const NewtonStats& getNewtonStats() const; // of the last solve
+
+    const std::vector<Eigen::Vector3d>& getVertices() const;
+    const std::vector<Eigen::Vector3d>& getVelocities() const;
+    const std::vector<double>& getMasses() const; // vertex, lumped masses
+    const std::vector<Eigen::Vector3d>& getMaterialDirectors1() const; // edge
+    const std::vector<Eigen::Vector3d>& getMaterialDirectors2() const; // edge
+    void setGravity(const Eigen::Vector3d& g);
+    void addExternalForces(const std::vector<Eigen::Vector3d>& forces); // vertex, accumulated until the next update
+    void setState(const std::vector<Eigen::Vector3d>& positions, const std::vector<Eigen::Vector3d>& new_velocities); // e.g. after collision projection, frames are transported
+
+    // Root clamping: vertex 0, vertex 1 and the first material frame follow R * (rest value) + t.
+    // The rest values are the ones at construction, i.e. the identity transform keeps the root in place.
+    void setRootTransform(const Eigen::Matrix3d& R, const Eigen::Vector3d& t);
+    void releaseRoot();
+    bool isRootClamped() const;
+
 private:
     std::vector<Eigen::Vector3d> vertices;
 
     const double E; // Young's modulus
     const double G; // shear modulus
+    const double rho; // density
 
     std::vector<double> a; // edge, major radii of cross-section, edge has an elliptical cross-section
     std::vector<double> b; // edge, minor radii of cross-section
@@ -44,20 +98,62 @@ private:
     std::vector<Eigen::Vector3d> mat_dir_1; // edge, material frame represented in comparison to reference frame
     std::vector<Eigen::Vector3d> mat_dir_2; // edge
     std::vector<double> thetas; // twitst angle, difference between reference and material frame
+
+    // Lazily evaluated per-step caches. updateEdges, updateReferenceFrame and updateMaterialFrame
+    // compare the new values with the old ones and only invalidate the entries of the edges that changed,
+    // so repeated energy/gradient evaluations (theta relaxation, line searches) reuse them.
+    std::vector<double> cache_lengths; // edge
+    std::vector<Eigen::Vector3d> cache_binormals; // vertex
+    std::vector<Eigen::Vector2d> cache_curvatures; // vertex
+    std::vector<double> cache_twists; // vertex
+    std::vector<char> length_valid; // edge
+    std::vector<char> binormal_valid; // vertex
+    std::vector<char> curvature_valid; // vertex
+    std::vector<char> twist_valid; // vertex
     
-    std::vector<double> velocities; // vertex
-    std::vector<double> angular_velocities; // edge
+    std::vector<double> masses; // vertex
+    double stiffness_timestep; // explicit stability limit of the elastic forces, independent of the motion
+    std::vector<Eigen::Vector3d> velocities; // vertex
+    std::vector<Eigen::Vector3d> external_forces; // vertex
+    Eigen::Vector3d gravity = Eigen::Vector3d::Zero();
+
+    bool root_clamped = false;
+    Eigen::Matrix3d root_rotation = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d root_translation = Eigen::Vector3d::Zero();
+    Eigen::Vector3d rest_root_vertices[2]; // vertices 0 and 1
+    Eigen::Vector3d rest_root_director; // mat_dir_1[0]
+
+    // everything a trial configuration of the Newton line search changes
+    struct Configuration {
+        std::vector<Eigen::Vector3d> vertices, edges, tangents, ref_dir_1, ref_dir_2, mat_dir_1, mat_dir_2;
+        std::vector<double> thetas;
+        std::vector<double> cache_lengths, cache_twists;
+        std::vector<Eigen::Vector3d> cache_binormals;
+        std::vector<Eigen::Vector2d> cache_curvatures;
+        std::vector<char> length_valid, binormal_valid, curvature_valid, twist_valid;
+    };
+    NewtonStats newton_stats;
+    std::vector<double> newton_factor; // banded Cholesky factor of the last Newton Hessian, free dofs only
+    int newton_factor_dofs = 0;
+    double newton_factor_dt = -1.0; // time step the factor belongs to, 0 for statics
 
     void updateEdges();
+    void invalidateEdge(int j); // edge j moved: its length and everything at vertices j and j+1
+    void invalidateFrame(int j); // material frame of edge j changed: curvature and twist at vertices j and j+1
+    double cachedLength(int j);
+    const Eigen::Vector3d& cachedCurvatureBinormal(int i);
+    const Eigen::Vector2d& cachedCurvature(int i);
+    double cachedTwist(int i);
 
     double computeLength(int i); // edge
     double computeVoronoiLength(int i); // vertex
-    Eigen::Vector2d DER::computeCurvature(int i); //vertex
+    Eigen::Vector2d computeCurvature(int i); //vertex
     Eigen::Vector3d computeCurvatureBinormal(int i); //vertex
     double computeK_S(int i); // edge
     double computeBeta(int i); // vertex
     Eigen::Matrix2d computeB(int i); // vertex
     double computeTwist(int i); // vertex
+    void computeCurvatureGradient(int i, Eigen::Matrix<double, 2, 3>& dkappa_de_prev, Eigen::Matrix<double, 2, 3>& dkappa_de_next); // vertex, derivatives w.r.t. edges i-1 and i
 
     std::vector<double> computeAllLength(); // edge, lengths of edges
     std::vector<double> computeAllVoronoiLength(); // vertex, voronoi lengths of vertices
@@ -65,15 +161,34 @@ private:
     std::vector<double> computeAllK_Ss();
     std::vector<double> computeAllBetas();
     std::vector<Eigen::Matrix2d> computeAllBs();
+    std::vector<double> computeAllMasses();
+    double computeStiffnessTimestep();
 
     void initializeReferenceFrame();
     void updateReferenceFrame(); // update reference frame and tangents
     void updateMaterialFrame(); // compute material frame from reference frame
+    void clampRootTheta(); // theta_0 aligns mat_dir_1[0] with the transformed rest director
     double computeStretchingEnergy(); // edge
     double computeTwistingEnergy(); // vertex
     double computeBendingEnergy(); // vertex
-    double computeTotalEnergy(); // sum of stretching, twisting, and bending energies
     std::vector<Eigen::Vector3d> computeStretchingEnergyGradient(); // edge
     std::vector<Eigen::Vector3d> computeTwistingEnergyGradient(); // vertex 
     std::vector<Eigen::Vector3d> computeBendingEnergyGradient(); // vertex
+    std::vector<double> computeThetaGradient(); // edge, dE/dtheta of twisting and bending energies
+    std::vector<Eigen::Vector3d> computeForces(); // vertex, -dE/dx plus gravity and external forces
+    void updateThetas(); // quasistatic twist, theta minimizes the energy for the current centerline
+
+    // Newton unknowns: free vertex positions and free thetas, interleaved along the strand so the Hessian is banded
+    struct NewtonLayout {
+        int dofs = 0;
+        std::vector<int> vertex_dofs; // vertex, first of its three dofs, -1 if held in place
+        std::vector<int> theta_dofs; // edge, -1 if clamped
+    };
+    NewtonLayout newtonLayout(int first) const;
+    Eigen::VectorXd gatherNewtonDofs(const NewtonLayout& layout) const;
+    void moveToNewtonDofs(const Configuration& from, const NewtonLayout& layout, const Eigen::VectorXd& x); // frames are transported from `from`
+    Configuration saveConfiguration() const;
+    void restoreConfiguration(const Configuration& c);
+    void factorizeHessian(const NewtonLayout& layout, double inertia); // finite-difference Hessian plus inertia * M
+    NewtonStats newtonSolve(const std::vector<Eigen::Vector3d>& inertial_target, double dt, int first, const NewtonSettings& settings); // dt = 0: statics
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+#include "Shader.h"
+
+// Per-frame timings of named sections for finding out where a frame's milliseconds go.
+// CPU sections are timed with the steady clock, GPU sections with GL_TIME_ELAPSED queries around the
+// commands issued in them. Query results are collected at EndFrame once the GPU has them, usually a frame
+// or two later, so timing never waits for the GPU; until then the GPU times of a frame are unknown (NaN).
+// GL_TIME_ELAPSED queries cannot nest, so GPU sections must not overlap each other; CPU sections may.
+// The last `history` frames are kept for the overlay and for export.
+class FrameProfiler {
+public:
+    enum Clock { CPU, GPU };
+
+    struct Stats {
+        float mean = 0.0f;
+        float min = 0.0f;
+        float max = 0.0f;
+        float p95 = 0.0f;
+        unsigned int frames = 0; // with a known time
+    };
+
+    // Adds the time until it is destroyed to a CPU section of the current frame.
+    class CPUScope {
+    public:
+        CPUScope(FrameProfiler& profiler, const char* name);
+        ~CPUScope();
+
+    private:
+        FrameProfiler& profiler;
+        int section;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Adds the GPU time of the commands issued until it is destroyed to a GPU section of the current frame.
+    class GPUScope {
+    public:
+        GPUScope(FrameProfiler& profiler, const char* name);
+        ~GPUScope();
+
+    private:
+        FrameProfiler& profiler;
+        int section;
+        GLuint query = 0;
+    };
+
+    explicit FrameProfiler(unsigned int history = 600);
+    ~FrameProfiler();
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    void BeginFrame();
+    // records the frame and collects the GPU queries that have finished
+    void EndFrame();
+
+    int sectionCount() const;
+    const std::string& sectionName(int section) const;
+    Clock sectionClock(int section) const;
+    // frames recorded so far, of which the last min(frameCount(), historySize()) are kept
+    uint64_t frameCount() const;
+    unsigned int historySize() const;
+    // age 0 is the last recorded frame
+    float frameMs(unsigned int age) const;
+    float sectionMs(int section, unsigned int age) const;
+    Stats frameStats() const;
+    Stats sectionStats(int section) const;
+    // counts of the kept frames in `bins` equal bins over [0, max_ms], longer ones go to the last bin
+    std::vector<unsigned int> histogram(int section, int bins, float max_ms) const;
+
+    // The kept frames oldest first, one row per frame and one column per section (empty while unknown).
+    bool SaveCSV(const std::string& filename, std::string* err) const;
+    // Statistics of every section followed by the kept per-frame times.
+    bool SaveJSON(const std::string& filename, std::string* err) const;
+
+private:
+    struct Section {
+        std::string name;
+        Clock clock;
+        std::vector<float> ms; // ring of historySize() frames
+    };
+
+    struct PendingQuery {
+        GLuint query;
+        int section;
+        uint64_t frame;
+    };
+
+    unsigned int history;
+    std::vector<Section> sections;
+    std::vector<float> frame_ms; // ring
+    uint64_t frame = 0; // current frame, frames before it are recorded
+    std::chrono::steady_clock::time_point frame_start;
+    bool in_frame = false;
+    std::vector<PendingQuery> pending;
+    std::vector<GLuint> free_queries;
+
+    int findSection(const char* name, Clock clock);
+    void add(int section, uint64_t frame, float ms);
+    Stats stats(const std::vector<float>& ring) const;
+};
+
+// Draws a FrameProfiler into the bottom left corner of the window: one bar per kept frame with the CPU
+// sections stacked up to the frame time and the GPU sections below it, guides at 60 and 30 fps, and a
+// row per section with its mean and 95th percentile in milliseconds and a histogram, in the section's color.
+// The shader is shader/overlay_vertex.glsl and shader/overlay_fragment.glsl.
+class ProfilerOverlay {
+public:
+    ProfilerOverlay() = default;
+    ~ProfilerOverlay();
+    ProfilerOverlay(const ProfilerOverlay&) = delete;
+    ProfilerOverlay& operator=(const ProfilerOverlay&) = delete;
+
+    // width and height of the window in the units of the mouse position (not the framebuffer)
+    void Draw(const FrameProfiler& profiler, Shader& shader, int width, int height);
+
+private:
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    std::vector<float> vertices; // x, y, r, g, b, a per vertex, two triangles per rectangle
+
+    void rect(float x, float y, float w, float h, const float color[4]);
+    void text(float x, float y, const std::string& s, const float color[4]);
+};
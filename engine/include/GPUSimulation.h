@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <glad/gl.h>
+#include <vector>
+#include "ComputeShader.h"
+#include "HairModel.h"
+#include "HairSimulation.h"
+
+// DER on the GPU with OpenGL 4.3 compute shaders (shader/der_compute.glsl), for drivers without CUDA such as Mesa.
+// One invocation simulates one strand the way DER::update does, in single precision. The positions are the
+// render VBO bound as a shader storage buffer, so the simulated strands never leave the GPU.
+class GPUSimulation {
+public:
+    // position_buffer: VBO holding model.points (e.g. HairRenderer::GetPositionBuffer(model)), 0 creates a buffer of its own.
+    // Uses E, G, radius, rho, gravity and substeps of params.
+    GPUSimulation(const HairModel& model, const HairSimulation::Parameters& params, const char* computePath, GLuint position_buffer = 0);
+    ~GPUSimulation();
+    GPUSimulation(const GPUSimulation&) = delete;
+    GPUSimulation& operator=(const GPUSimulation&) = delete;
+
+    void update(double dt);
+
+    int strandCount() const;
+    GLuint getPositionBuffer() const;
+    std::vector<Eigen::Vector3d> getPositions() const; // reads the positions back, for checks and export
+    void setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations); // clamps the roots, see DER::setRootTransform
+
+private:
+    HairSimulation::Parameters params;
+    ComputeShader shader;
+    int num_strands;
+    int num_vertices;
+    bool root_clamped = false;
+
+    GLuint positions; // alias of the render VBO unless owned
+    bool owns_positions = false;
+    GLuint velocities; // vertex, vec4
+    GLuint offsets; // strand + 1
+    GLuint vertex_data; // vertex, rest quantities
+    GLuint edge_data; // edge, frames and thetas
+    GLuint scratch; // vertex, forces and theta solve
+    GLuint roots; // strand, rest root state
+    GLuint root_transforms; // strand, mat4
+
+    void bindBuffers() const;
+    void dispatch(int stage, float dt, int substeps);
+};
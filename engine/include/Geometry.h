@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+enum TriangleFeature {
+    VERTEX_A,
+    VERTEX_B,
+    VERTEX_C,
+    EDGE_AB,
+    EDGE_BC,
+    EDGE_CA,
+    FACE
+};
+
+// closest point on triangle abc, `feature` tells which part of the triangle it lies on
+Eigen::Vector3d closestPointOnTriangle(const Eigen::Vector3d& p, const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c, TriangleFeature& feature);
+
+// barycentric coordinates (u, v, w) of p with respect to triangle abc, p = u a + v b + w c
+Eigen::Vector3d barycentric(const Eigen::Vector3d& p, const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c);
+
+// parallel transport of v along the rotation taking unit vector t0 to unit vector t1 (closed-form Rodrigues, no trig or sqrt)
+Eigen::Vector3d parallelTransport(const Eigen::Vector3d& v, const Eigen::Vector3d& t0, const Eigen::Vector3d& t1);
+
+// transports the frame (d1[i], d2[i]) from from[i] to to[i] for every edge in place,
+// re-orthonormalizing once against the new tangent (sqrt free) so the frames do not drift
+void parallelTransport(const std::vector<Eigen::Vector3d>& from, const std::vector<Eigen::Vector3d>& to, std::vector<Eigen::Vector3d>& d1, std::vector<Eigen::Vector3d>& d2);
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "HairModel.h"
+
+// Time-sampled groom cache (.cgca) for baked simulations.
+// Topology (segments) and the per-point attributes are stored once; every frame is one contiguous range of
+// positions, either a keyframe of float xyz or a delta frame of int16 xyz steps against the previous frame.
+// Keyframes are written every keyframe_interval frames and whenever a delta would not fit into 16 bits,
+// so reading frame N decodes at most the delta frames between N and the keyframe before it.
+// Deltas are taken against the positions the reader reconstructs, so the error does not accumulate
+// and stays below error_bound times the largest extent of the first frame's bounding box.
+
+class GroomAnimationWriter {
+public:
+    struct Settings {
+        unsigned int keyframe_interval = 16;
+        float error_bound = 1e-4f; // of delta frames, relative to the bounding box of the first frame
+    };
+
+    GroomAnimationWriter() = default;
+    ~GroomAnimationWriter();
+
+    // topology and attributes are taken from `model`, its points become frame 0
+    bool Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate);
+    bool Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate, const Settings& settings);
+    // 3 * point_count floats
+    bool AddFrame(const float* positions, std::string* err);
+    // writes the frame table, the file is incomplete until then
+    bool Close(std::string* err);
+
+    unsigned int frameCount() const;
+    unsigned int keyframeCount() const;
+
+private:
+    friend class GroomAnimation;
+
+    struct FrameEntry { // frame table at the end of the file
+        uint64_t offset;
+        uint32_t keyframe; // 1 for keyframes, 0 for delta frames
+        uint32_t reserved;
+    };
+
+    std::ofstream file;
+    size_t value_count = 0; // 3 * point_count
+    float step = 0.0f; // quantization step of delta frames
+    unsigned int keyframe_interval = 1;
+    unsigned int since_keyframe = 0;
+    std::vector<float> state; // positions as the reader reconstructs them
+    std::vector<int16_t> delta;
+    std::vector<FrameEntry> frames;
+
+    bool writeAligned(const void* data, size_t bytes, uint64_t& offset);
+};
+
+class GroomAnimation {
+public:
+    GroomAnimation() = default;
+    ~GroomAnimation();
+    GroomAnimation(const GroomAnimation&) = delete;
+    GroomAnimation& operator=(const GroomAnimation&) = delete;
+
+    // memory maps the file, nothing but the topology and attributes is read up front
+    bool Open(const std::string& filename, std::string* err);
+    void Close();
+
+    // topology and attributes with the positions of frame 0
+    const HairModel& GetModel() const;
+    unsigned int frameCount() const;
+    float frameRate() const;
+    bool isKeyframe(unsigned int frame) const;
+
+    // Writes the positions of `frame` to `positions` (3 * point_count floats), e.g. a mapped vertex buffer,
+    // which is only written to. Consecutive frames cost one delta each; anything else starts over from the
+    // nearest keyframe at or before `frame`.
+    bool ReadFrame(unsigned int frame, float* positions);
+
+    static bool IsAnimationFile(const std::string& filename);
+
+private:
+    struct Frame {
+        const unsigned char* data;
+        bool keyframe;
+        unsigned int base; // keyframe this frame is decoded from
+    };
+
+    const unsigned char* mapping = nullptr;
+    size_t mapping_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+
+    HairModel model;
+    float frame_rate = 0.0f;
+    float step = 0.0f;
+    std::vector<Frame> frames;
+    std::vector<float> state; // decoded positions of state_frame
+    long long state_frame = -1;
+
+    bool map(const std::string& filename);
+};
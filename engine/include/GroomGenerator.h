@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HairModel.h"
+
+// Deterministic synthetic grooms for tests and benchmarks: roots spread over the top of a spherical scalp,
+// strands growing out of it and drooping under their own weight, optionally curled into helices.
+// Every strand draws from its own random stream, so a groom depends only on the settings (seed included),
+// not on the thread count or on whether it is generated in memory or streamed to a file.
+class GroomGenerator {
+public:
+    // bits of Settings::arrays, as in the .hair file header
+    static constexpr unsigned int SEGMENTS = HAIR_FILE_SEGMENTS_BIT;
+    static constexpr unsigned int POINTS = HAIR_FILE_POINTS_BIT;
+    static constexpr unsigned int THICKNESS = HAIR_FILE_THICKNESS_BIT;
+    static constexpr unsigned int TRANSPARENCY = HAIR_FILE_TRANSPARENCY_BIT;
+    static constexpr unsigned int COLORS = HAIR_FILE_COLORS_BIT;
+
+    static constexpr unsigned int max_strands = 10000000;
+    static constexpr unsigned int max_segments = 65535; // per strand, the segments array of a .hair file is 16-bit
+
+    struct Settings {
+        unsigned int strands = 1000; // 1 to max_strands
+        unsigned int segments = 16; // per strand, 1 to max_segments
+        unsigned int segment_jitter = 0; // strands get segments +- jitter (at least 1), which needs the SEGMENTS array
+        float scalp_radius = 10.0f;
+        float length = 30.0f;
+        float length_jitter = 0.0f; // relative, strands get length * (1 +- jitter)
+        float droop = 1.0f; // 0: strands grow straight out of the scalp, 1: they turn downwards over their length
+        float curliness = 0.0f; // helix radius relative to the length, 0 for straight strands
+        float curl_turns = 4.0f; // helix turns per strand
+        float thickness = 1.0f; // at the root, tapering to 20% at the tip
+        float color[3] = {0.35f, 0.22f, 0.12f};
+        unsigned int arrays = POINTS; // POINTS is always written, the other bits add per-strand/per-point arrays
+        uint64_t seed = 1;
+    };
+
+    // false with a message when a setting is out of range; the constructor clamps them into range instead
+    static bool validate(const Settings& settings, std::string* err);
+
+    explicit GroomGenerator(const Settings& settings);
+
+    HairModel generate() const;
+    // Streams the groom to a .hair file in chunks of strands (HairWriter::WriteStrands), for grooms that do not
+    // fit in memory twice. Fails when the points overflow the 32-bit count of the file.
+    bool writeHairFile(const std::string& filename, std::string* err) const;
+
+    unsigned int strandCount() const;
+    unsigned int pointCount() const;
+    unsigned int arrays() const; // Settings::arrays with the bits the settings require
+
+private:
+    Settings settings;
+    std::vector<unsigned short> segment_counts; // strand, empty unless segment_jitter
+    std::vector<uint64_t> point_offsets; // strand + 1
+
+    unsigned int segmentCount(unsigned int strand) const;
+    HairModel header() const;
+    // fills the per-point arrays of one strand, null pointers for arrays that are not wanted
+    void generateStrand(unsigned int strand, float* points, float* thickness, float* transparency, float* colors) const;
+    void generateStrands(unsigned int begin, unsigned int end, HairModel& chunk) const; // strands [begin, end) into chunk, offsets relative to begin
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include "HairModel.h"
+
+// Compact groom cache (.cgch), 3-4x smaller than .hair at the default error bound.
+// Positions are quantized per strand to error_bound times the largest extent of the strand's bounding box
+// and stored as second-order deltas along the strand; thickness, transparency and colors are quantized to
+// 16 bits over their range in the chunk. Strands are grouped into chunks that are entropy coded (rANS)
+// independently, so chunks encode and decode in parallel and a chunk table gives random access to strands.
+// HairLoader::LoadFromFile recognizes cache files by their signature.
+class HairCache {
+public:
+    struct Settings {
+        float error_bound = 1e-4f; // relative to the strand bounding box, at least 1e-7
+        unsigned int chunk_strands = 4096;
+    };
+
+    HairCache() = default;
+    ~HairCache() = default;
+
+    bool SaveToFile(const HairModel& model, std::string* err, const std::string& filename);
+    bool SaveToFile(const HairModel& model, std::string* err, const std::string& filename, const Settings& settings);
+    bool LoadFromFile(HairModel* model, std::string* err, const std::string& filename);
+    // strands [first_strand, first_strand + strand_count), decoding only the chunks they are in
+    bool LoadStrands(HairModel* model, std::string* err, const std::string& filename, unsigned int first_strand, unsigned int strand_count);
+
+    bool IsCacheFile(const std::string& filename);
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+#include "DER.h"
+
+// Eulerian hair-hair interaction (Petrovic et al. 2005, McAdams et al. 2009).
+// Vertex masses and momenta of all strands are splatted to a node grid, the
+// resulting velocity field is pressure-smoothed, and the difference between the
+// grid and strand velocities (friction) plus the density gradient (repulsion)
+// is fed back to each DER as external forces.
+//
+// Nodes are stored in 4x4x4 bricks so that a trilinear stencil mostly stays in one
+// brick. Only bricks that hold vertices are allocated, plus a one-brick halo around
+// them, so memory and the pressure solve scale with the occupied volume instead of the
+// bounding box (a stray strand adds a few bricks, not a slab of empty space).
+// Splatting sorts vertices by brick and processes bricks in 8 colors; bricks of the
+// same color never share nodes, so no atomics or per-thread grids are needed.
+class HairGrid {
+public:
+    explicit HairGrid(double cell_size);
+
+    double friction = 0.1; // 0: no velocity smoothing, 1: strands follow the grid velocity
+    double flip_ratio = 0.95; // blend between FLIP (1) and PIC (0) velocity transfer
+    double repulsion = 0.0; // strength of the density-gradient force
+    int pressure_iterations = 20; // Jacobi iterations of the pressure smoothing
+
+    void transfer(std::vector<DER>& strands, double dt); // splat, solve and applyForces
+
+    void splat(const std::vector<DER>& strands);
+    void solveVelocity();
+    void applyForces(std::vector<DER>& strands, double dt) const;
+
+    double sampleDensity(const Eigen::Vector3d& p) const;
+    Eigen::Vector3d sampleDensityGradient(const Eigen::Vector3d& p) const;
+    Eigen::Vector3d sampleVelocity(const Eigen::Vector3d& p) const;
+
+    // bricks allocated by the last splat
+    int brickCount() const;
+
+private:
+    static constexpr int BRICK = 4; // nodes per brick side
+    static constexpr int BRICK_SIZE = BRICK * BRICK * BRICK;
+    static constexpr int KEY_BITS = 21; // per axis of a brick key, vertices further out are ignored
+
+    const double cell_size;
+    Eigen::Vector3d origin = Eigen::Vector3d::Zero();
+
+    std::vector<int64_t> brick_keys; // by slot
+    std::vector<int64_t> table_keys; // open addressing hash table of the slots, -1 marks free entries
+    std::vector<int> table_slots;
+    std::vector<int> neighbors; // 27 per slot (3x3x3 around it), -1 where no brick is allocated
+
+    std::vector<double> mass; // node, slot-major
+    std::vector<Eigen::Vector3d> velocity; // node, after pressure smoothing
+    std::vector<Eigen::Vector3d> splat_velocity; // node, before pressure smoothing (for FLIP)
+    std::vector<double> pressure; // node
+
+    // vertices sorted by brick slot, rebuilt by every splat
+    std::vector<int> brick_offsets;
+    std::vector<Eigen::Vector3d> sorted_positions;
+    std::vector<Eigen::Vector3d> sorted_momenta;
+    std::vector<double> sorted_masses;
+
+    // last brick looked up, consecutive vertices of a strand mostly share it
+    struct BrickCache {
+        int64_t key = -1;
+        int slot = -1;
+    };
+
+    static int64_t key(const Eigen::Vector3i& brick);
+    static Eigen::Vector3i brickOf(int64_t key);
+    int findBrick(int64_t key) const; // slot, -1 when not allocated
+    void addBrick(int64_t key); // unless allocated already
+    int findBrick(int64_t key, BrickCache& cache) const;
+    // node at (i, j, k) relative to the first node of brick `slot`, at most one brick away; -1 when not allocated
+    int node(int slot, int i, int j, int k) const;
+    void allocate(const std::vector<DER>& strands, std::vector<int>& vertex_slots);
+    bool locate(const Eigen::Vector3d& p, Eigen::Vector3i& base, Eigen::Vector3d& frac) const;
+    // the 8 nodes of the trilinear stencil around p (-1 for missing ones), false outside the allocated bricks
+    bool stencil(const Eigen::Vector3d& p, int nodes[8], Eigen::Vector3d& frac, BrickCache& cache) const;
+    template <typename T>
+    T interpolate(const std::vector<T>& field, const int nodes[8], const Eigen::Vector3d& frac, const T& zero) const;
+    Eigen::Vector3d densityGradient(const int nodes[8], const Eigen::Vector3d& frac) const;
+};
@@ -36,6 +36,13 @@
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include "Shader.h"
@@ -58,8 +65,59 @@ public:
     HairLoader() = default;
     ~HairLoader() = default;
 
+    // Also reads compact caches (.cgch, see HairCache), recognized by their signature.
+    // Array sizes are checked against the file size before allocating, and the segments have to add up to
+    // point_count; recoverable oddities such as trailing bytes are reported through warn.
     bool LoadFromFile(HairModel* model, std::string* err, std::string* warn, const std::string& filename);
 
+    // fraction of the array data read so far, called from the loader threads
+    using ProgressCallback = std::function<void(float)>;
+
+    // Handle of LoadFromFileAsync. Destroying it cancels the load and waits for the loader threads.
+    class AsyncLoad {
+    public:
+        ~AsyncLoad();
+
+        bool IsReady() const; // Get does not block
+        float GetProgress() const;
+        void Cancel();
+        // Every n-th strand, read before the full arrays so that something can be shown early.
+        // Returns false until it is available, and for files small enough to need no proxy.
+        bool GetProxy(HairModel* proxy);
+        // Waits for the load and moves the model out, false on errors and after Cancel.
+        bool Get(HairModel* model, std::string* err, std::string* warn);
+
+    private:
+        friend class HairLoader;
+        AsyncLoad() = default;
+
+        std::string filename;
+        ProgressCallback progress;
+        unsigned int proxy_strands = 0;
+        unsigned int threads = 0;
+
+        std::thread loader;
+        std::atomic<bool> canceled{false};
+        std::atomic<uint64_t> bytes_read{0};
+        std::atomic<uint64_t> bytes_total{1};
+        mutable std::mutex mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+        bool proxy_ready = false;
+        bool ok = false;
+        HairModel model;
+        HairModel proxy;
+        std::string err;
+        std::string warn;
+
+        void run();
+        bool load();
+    };
+
+    // Loads in the background: the arrays are split into blocks read in parallel with positional reads
+    // (pread) on `threads` threads (0: up to 4), after a proxy of about proxy_strands strands (0: none).
+    std::unique_ptr<AsyncLoad> LoadFromFileAsync(const std::string& filename, ProgressCallback progress = nullptr, unsigned int proxy_strands = 10000, unsigned int threads = 0);
+
 private:
     Header header;
     std::vector<unsigned short> segments;
@@ -67,10 +125,4 @@ private:
     std::vector<float> thickness;
     std::vector<float> transparency;
     std::vector<float> colors;
-
-    static constexpr int HAIR_FILE_SEGMENTS_BIT = 1;
-    static constexpr int HAIR_FILE_POINTS_BIT = 2;
-    static constexpr int HAIR_FILE_THICKNESS_BIT = 4;
-    static constexpr int HAIR_FILE_TRANSPARENCY_BIT = 8;
-    static constexpr int HAIR_FILE_COLORS_BIT = 16;
 };
@@ -3,6 +3,13 @@
 #include <vector>
 #include <iostream>
 
+// bits of HairModel::arrays (the arrays field of the .hair file header), set for each array that is present
+constexpr int HAIR_FILE_SEGMENTS_BIT = 1;
+constexpr int HAIR_FILE_POINTS_BIT = 2;
+constexpr int HAIR_FILE_THICKNESS_BIT = 4;
+constexpr int HAIR_FILE_TRANSPARENCY_BIT = 8;
+constexpr int HAIR_FILE_COLORS_BIT = 16;
+
 class HairModel {
 public:
     HairModel() = default;
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "HairModel.h"
+#include "StrandBVH.h"
+
+class Camera;
+
+// CPU path tracer for grooms, the ground truth for lookdev on machines without a GPU.
+// The strands are intersected as ribbons through a StrandBVH and scatter with a Kajiya-Kay fiber model
+// in their color; the scene is lit by a white sky, as hairview's background, and one directional key light.
+// Transparent strands are passed through with the probability of their transparency.
+//
+// Every renderPass adds one sample per pixel to the accumulated image. The image is cut into tiles that
+// the threads take one at a time from a shared counter (parallelFor with grain 1), so that tiles full of
+// hair do not keep the others waiting. Camera rays are traced as 2x2 packets (StrandBVH::intersect4),
+// bounce and shadow rays one by one. A sample depends only on its pixel and pass, not on the thread count.
+class HairPathTracer {
+public:
+    struct Settings {
+        unsigned int width = 800; // hairview's window
+        unsigned int height = 800;
+        unsigned int tile_size = 16; // pixels, rounded up to even
+        unsigned int max_bounces = 4;
+        Eigen::Vector3f light_direction = Eigen::Vector3f(-0.4f, 0.8f, 0.45f); // towards the light
+        float light_intensity = 10.0f; // irradiance, pi^2 lights a fiber as much as the whole sky
+        float sky_intensity = 1.0f;
+        float diffuse = 0.8f; // fiber albedo per strand color
+        float specular = 0.2f; // of the light scattered into the highlight
+        float shininess = 40.0f;
+        StrandBVH::Settings bvh;
+    };
+
+    HairPathTracer() = default;
+    ~HairPathTracer() = default;
+
+    // Builds the BVH and clears the image.
+    void setModel(const HairModel& model, const Settings& settings);
+    void setModel(const HairModel& model);
+    // The view of a hairview camera (position, orientation, Zoom as the vertical field of view), clears the image.
+    void setCamera(const Camera& camera);
+
+    void renderPass();
+    unsigned int passes() const;
+    // average of the passes so far, linear RGB, rows from the top
+    void resolve(std::vector<float>* rgb) const;
+    // .pfm keeps the linear values, anything else is written as 8-bit sRGB .ppm
+    bool saveImage(const std::string& filename, std::string* err) const;
+
+    // rays traced (camera, bounce and shadow) and wall time spent in renderPass since the image was cleared
+    uint64_t rayCount() const;
+    double renderSeconds() const;
+
+private:
+    struct Random; // per pixel and pass
+
+    struct View {
+        Eigen::Vector3f position = Eigen::Vector3f(0.0f, 0.0f, 150.0f);
+        Eigen::Vector3f front = Eigen::Vector3f(0.0f, 0.0f, -1.0f);
+        Eigen::Vector3f right = Eigen::Vector3f(1.0f, 0.0f, 0.0f);
+        Eigen::Vector3f up = Eigen::Vector3f(0.0f, 1.0f, 0.0f);
+        float tan_half = 0.41421356f; // of the vertical field of view, 45 degrees
+    };
+
+    Settings settings;
+    View view;
+    StrandBVH bvh;
+    std::vector<unsigned int> first_point; // strand
+    std::vector<float> colors; // point, 3 floats each
+    std::vector<float> transparency; // point, empty if the model is opaque
+    std::vector<float> accum; // pixel, 3 floats each
+    unsigned int pass_count = 0;
+    uint64_t rays = 0;
+    double seconds = 0.0;
+
+    void clear();
+    void renderTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, uint64_t* ray_count);
+    // light arriving along ray, whose first hit (found, hit) has already been traced
+    Eigen::Vector3f radiance(StrandBVH::Ray ray, bool found, StrandBVH::Hit hit, Random& random, uint64_t* ray_count) const;
+    bool blocked(StrandBVH::Ray ray, Random& random, uint64_t* ray_count) const;
+};
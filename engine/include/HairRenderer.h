@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GroomAnimation.h"
 #include "HairModel.h"
 #include "Shader.h"
 #include <glad/gl.h>
@@ -12,14 +13,18 @@ public:
 
     void CreateVAO(const HairModel& model);
     void Draw(Shader& shader) const;
+    GLuint GetPositionBuffer(const HairModel& model) const; // VBO of model.points, 0 before CreateVAO, e.g. for GPUSimulation
+    // Decodes a frame of `animation` straight into the mapped position VBO of `model` (created with CreateVAO
+    // from animation.GetModel()); model.points is not updated.
+    bool StreamFrame(const HairModel& model, GroomAnimation& animation, unsigned int frame);
 
 private:
     struct VAOData {
-        GLuint VAO;
-        GLuint VBO;
-        GLuint TBO;
-        GLuint TrBO;
-        GLuint CBO;
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint TBO = 0;
+        GLuint TrBO = 0;
+        GLuint CBO = 0;
     };
 
     std::unordered_map<const HairModel*, VAOData> vaoMap;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include "HairModel.h"
+
+// Spatial reordering of strands. Authoring order (as found in most .hair files) scatters neighbouring
+// strands over the whole file; sorting them along a Morton curve keeps strands that are close in space
+// close in memory, which is what the grid transfer and anything else walking neighbourhoods want.
+// An order is a permutation of strand indices, order[i] being the original strand that ends up at i.
+
+enum class StrandKey {
+    Root, // first point, cheap and stable while the groom moves
+    Centroid // mean of the points, better for long strands that leave their roots far behind
+};
+
+// strands sorted by the 63-bit Morton code of their key, quantized to the bounding box of all finite keys;
+// strands whose key is NaN or infinite go last, in their original order
+std::vector<unsigned int> mortonStrandOrder(const HairModel& model, StrandKey key = StrandKey::Root);
+
+// true when `order` holds every index below `count` exactly once
+bool isStrandOrder(const std::vector<unsigned int>& order, unsigned int count);
+
+// Moves the strands of `model` into `order`, permuting segments and every per-point array alike.
+// False, leaving the model alone, when `order` is not an order of its hair_count strands.
+bool reorderStrands(HairModel& model, const std::vector<unsigned int>& order);
+
+// Original index -> new index. reorderStrands(model, invertOrder(order)) restores the original order,
+// e.g. before writing a groom back for other tools. Empty when `order` is not a permutation.
+std::vector<unsigned int> invertOrder(const std::vector<unsigned int>& order);
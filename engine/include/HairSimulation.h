@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+#include "DER.h"
+#include "HairModel.h"
+#include "XPBD.h"
+
+// Simulates every strand of a HairModel with the solver chosen for the scene.
+// DER strands are independent objects (one DER per strand); XPBD keeps the whole groom in flat arrays.
+class HairSimulation {
+public:
+    enum class Solver {
+        DER,
+        XPBD_GaussSeidel,
+        XPBD_Jacobi
+    };
+
+    struct Parameters {
+        Solver solver = Solver::DER;
+        double E = 1.0e7; // Young's modulus
+        double G = 4.0e6; // shear modulus
+        double radius = 0.005; // strand cross-section radius
+        double rho = 1.3; // density
+        Eigen::Vector3d gravity = Eigen::Vector3d(0.0, -981.0, 0.0);
+        int substeps = 1; // solver steps per update
+        bool implicit = false; // DER: backward Euler substeps with DER::updateImplicit, stable at any step
+        bool adaptive = false; // DER: per-strand substeps from DER::computeStableTimestep instead of `substeps`
+        double cfl = 0.5; // DER: safety factor of the adaptive step
+        int max_substeps = 1000; // DER: upper bound of adaptive substeps per update
+        int iterations = 4; // XPBD: constraint iterations per update
+    };
+
+    HairSimulation(const HairModel& model, const Parameters& params);
+
+    void update(double dt);
+    void solveStatics(); // DER: moves every strand to its static equilibrium, e.g. when setting up a groom
+
+    Solver getSolver() const;
+    int strandCount() const;
+    const std::vector<int>& getStrandOffsets() const; // first vertex of each strand, strand_count + 1 entries
+    std::vector<Eigen::Vector3d> getPositions() const; // all strands, flattened
+    void setVelocities(const std::vector<Eigen::Vector3d>& velocities); // all strands, flattened
+    void writeToModel(HairModel& model) const; // copies the positions back into model.points
+
+    std::vector<Eigen::Vector3d> getRoots() const; // first vertex of each strand, e.g. for binding to a ScalpAttachment
+    void setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations); // clamps the roots, see DER::setRootTransform
+
+    std::vector<DER>& getStrands(); // empty unless the solver is DER
+    const std::vector<int>& getSubstepCounts() const; // DER, substeps each strand took in the last update
+
+private:
+    Parameters params;
+    std::vector<int> strand_offsets;
+    std::vector<DER> strands;
+    std::vector<int> substep_counts; // strand
+    std::vector<int> schedule; // strand order of the adaptive update, most expensive first
+    std::unique_ptr<XPBD> xpbd;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HairLoader.h"
+
+// Reads a .hair file in batches of whole strands, for grooms larger than memory.
+// A background thread reads ahead up to `read_ahead` batches, so memory stays bounded by
+// (read_ahead + 1) batches of about `batch_points` points each, whatever the file size.
+// Strand boundaries come from the segments array, which is itself read in windows.
+class HairStreamReader {
+public:
+    struct Batch {
+        unsigned int first_strand = 0;
+        uint64_t first_point = 0;
+        std::vector<unsigned short> segments; // strand of the batch, filled from d_segments without a segments array
+        std::vector<float> points; // xyz
+        std::vector<float> thickness; // empty unless the file has the array, likewise below
+        std::vector<float> transparency;
+        std::vector<float> colors; // rgb
+
+        unsigned int strandCount() const { return static_cast<unsigned int>(segments.size()); }
+        size_t pointCount() const { return points.size() / 3; }
+    };
+
+    HairStreamReader() = default;
+    ~HairStreamReader();
+    HairStreamReader(const HairStreamReader&) = delete;
+    HairStreamReader& operator=(const HairStreamReader&) = delete;
+
+    bool Open(const std::string& filename, std::string* err, size_t batch_points = 1 << 20, int read_ahead = 2);
+    // Moves the next batch into `batch`. Returns false at the end of the file or on an error, which sets err.
+    bool Next(Batch& batch, std::string* err);
+    void Close();
+
+    const HairLoader::Header& GetHeader() const;
+
+private:
+    HairLoader::Header header;
+    std::ifstream file;
+    size_t batch_points = 0;
+    size_t read_ahead = 0;
+
+    uint64_t segments_offset = 0; // byte offsets of the arrays, 0 if absent
+    uint64_t points_offset = 0;
+    uint64_t thickness_offset = 0;
+    uint64_t transparency_offset = 0;
+    uint64_t colors_offset = 0;
+
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable ready_cv; // a batch was queued or the reader finished
+    std::condition_variable space_cv; // a batch was taken or the reader should stop
+    std::deque<Batch> queue;
+    bool finished = false;
+    bool stopping = false;
+    std::string error;
+
+    void readLoop();
+    bool readBatch(unsigned int first_strand, uint64_t first_point, std::vector<unsigned short>& window, size_t& window_begin, Batch& batch);
+    bool readRange(uint64_t offset, void* data, size_t bytes);
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "HairModel.h"
+
+// Writes a HairModel as a .hair file, the counterpart of HairLoader.
+// Only the arrays flagged in model.arrays are written, so their sizes must match hair_count / point_count.
+class HairWriter {
+public:
+    HairWriter() = default;
+    ~HairWriter() = default;
+
+    bool SaveToFile(const HairModel& model, std::string* err, const std::string& filename);
+
+    // Streaming, for models that are never in memory as a whole: Open writes the header of `model` (its counts,
+    // arrays and defaults, its arrays are not used), WriteStrands then writes the arrays of one range of strands
+    // at a time, in any order but each strand once, and Close fails on stream errors and unless the chunks added
+    // up to the strand and point counts of the header.
+    bool Open(const HairModel& model, std::string* err, const std::string& filename);
+    // `chunk` holds the flagged arrays of the strands from first_strand on, the first of whose points is first_point
+    bool WriteStrands(const HairModel& chunk, unsigned int first_strand, uint64_t first_point, std::string* err);
+    bool Close(std::string* err);
+
+private:
+    std::ofstream file;
+    unsigned int arrays = 0;
+    uint64_t hair_count = 0;
+    uint64_t point_count = 0;
+    uint64_t strands_written = 0; // counted with the segments array, without it the points imply the strands
+    uint64_t points_written = 0;
+    uint64_t segments_offset = 0, points_offset = 0, thickness_offset = 0, transparency_offset = 0, colors_offset = 0;
+};
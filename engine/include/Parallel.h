@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker pool shared by the simulation and I/O code.
+// parallelFor hands out chunks of `grain` indices through an atomic counter,
+// so uneven work per index (e.g. strands with different substep counts) stays balanced.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int num_threads = 0); // 0 = hardware_concurrency
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& instance();
+
+    unsigned int size() const; // number of threads including the caller
+
+    // func(chunk_begin, chunk_end) is called for disjoint chunks covering [begin, end).
+    // Calls made from inside a worker run serially on that worker.
+    // When func throws, no further chunks are started; the chunks already running finish and the first
+    // exception is rethrown to the caller.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& func);
+
+private:
+    struct Job {
+        const std::function<void(int, int)>* func = nullptr;
+        int end = 0;
+        int grain = 1;
+        std::atomic<int> next{0};
+        std::exception_ptr error; // first exception thrown by func, guarded by mutex
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    std::mutex submit_mutex; // serializes jobs submitted from different threads
+    Job job;
+    unsigned long long generation = 0;
+    unsigned int busy = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    void runChunks();
+};
+
+// Shorthand for ThreadPool::instance().parallelFor.
+// grain <= 0 picks a chunk size giving each thread several chunks.
+void parallelFor(int begin, int end, const std::function<void(int, int)>& func, int grain = 0);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <unordered_map>
+#include <vector>
+#include "DER.h"
+
+// Signed distance field of a triangle mesh, stored only in a narrow band around the surface.
+// The band is split into bricks of BRICK^3 cells; each brick keeps its own (BRICK+1)^3 nodes,
+// so a trilinear lookup never leaves the brick. Outside the band the collider reports +band.
+//
+// For skinned meshes updateMesh re-bins only the triangles that moved and re-voxelizes
+// only the bricks those triangles touched before or after the move, plus the bricks of
+// the triangles around them, whose pseudonormals change with the move. Bricks that no
+// triangle's band overlaps any more are freed.
+class SDFCollider {
+public:
+    SDFCollider(const std::vector<Eigen::Vector3d>& vertices, const std::vector<Eigen::Vector3i>& triangles, double voxel_size, double band);
+
+    // Vertices closer than `tolerance` to where they were at their last voxelization are
+    // kept there, so slow drifts still get picked up once they add up.
+    // `velocities` (vertex) are the surface velocities collide applies friction against, e.g. the
+    // skinned positions of the next frame minus these over the frame time. A static mesh has none.
+    void updateMesh(const std::vector<Eigen::Vector3d>& vertices, const std::vector<Eigen::Vector3d>& velocities, double tolerance = 0.0);
+
+    // Trilinear lookup of many points, one brick lookup for every run of points in the same brick.
+    // Points that are not finite or not in the band get +band and a zero normal; normals are the
+    // normalized SDF gradient.
+    void query(const std::vector<Eigen::Vector3d>& points, std::vector<double>& distances, std::vector<Eigen::Vector3d>& normals) const;
+    double distance(const Eigen::Vector3d& p) const;
+
+    // pushes strand vertices closer than `thickness` out of the mesh and applies Coulomb friction to
+    // their velocity relative to the surface
+    void collide(std::vector<DER>& strands, double thickness, double friction) const;
+
+    int brickCount() const;
+    int lastDirtyBrickCount() const;
+
+private:
+    static constexpr int BRICK = 8; // cells per brick side
+    static constexpr int BRICK_NODES = BRICK + 1;
+
+    struct Brick {
+        Eigen::Vector3i coord;
+        std::vector<int> triangles; // triangles whose band overlaps this brick
+        std::vector<float> values; // BRICK_NODES^3 signed distances
+    };
+
+    const double voxel_size;
+    const double band;
+    std::vector<Eigen::Vector3d> vertices; // as of the last voxelization
+    std::vector<Eigen::Vector3d> velocities; // vertex, of the last updateMesh
+    bool moving = false; // any velocity is nonzero
+    std::vector<Eigen::Vector3i> triangles;
+    std::vector<Eigen::Vector3d> face_normals; // triangle
+    std::vector<Eigen::Vector3d> vertex_normals; // vertex, angle weighted pseudonormals
+    std::vector<Eigen::Matrix3d> edge_normals; // triangle, columns are the normals of edges (0,1), (1,2), (2,0)
+
+    std::vector<Brick> bricks;
+    std::unordered_map<long long, int> brick_lookup;
+    std::vector<std::vector<int>> triangle_bricks; // triangle, bricks it is binned into
+    std::vector<int> vertex_triangle_offsets; // vertex, into vertex_triangles
+    std::vector<int> vertex_triangles; // triangles around each vertex
+    int dirty_brick_count = 0;
+
+    static long long brickKey(const Eigen::Vector3i& coord);
+    void computeNormals();
+    void binTriangle(int t, std::vector<char>& dirty);
+    void unbinTriangle(int t, std::vector<char>& dirty);
+    void freeEmptyBricks(std::vector<char>& dirty);
+    void voxelizeBrick(Brick& brick) const;
+    double signedDistance(const Eigen::Vector3d& p, const std::vector<int>& candidates) const;
+    // grid coordinates and cell of p, false when p is not finite or beyond the brick coordinates
+    bool locate(const Eigen::Vector3d& p, Eigen::Vector3d& g, Eigen::Vector3i& cell) const;
+    static Eigen::Vector3i brickCoord(const Eigen::Vector3i& cell);
+    const Brick* findBrick(const Eigen::Vector3i& coord) const;
+    void interpolate(const Brick& brick, const Eigen::Vector3d& g, const Eigen::Vector3i& cell, double& dist, Eigen::Vector3d& grad) const;
+    bool sample(const Eigen::Vector3d& p, double& dist, Eigen::Vector3d& grad) const;
+    Eigen::Vector3d surfaceVelocity(const Eigen::Vector3d& p) const;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+// Binds strand roots to triangles of a scalp mesh and turns the animated (e.g. skinned) scalp
+// into per-strand root transforms for DER::setRootTransform / XPBD::setRootTransforms.
+// Bindings are stored as flat arrays and evaluated for all strands at once in parallel.
+class ScalpAttachment {
+public:
+    // binds every root to the closest triangle of the scalp in its rest pose
+    ScalpAttachment(const std::vector<Eigen::Vector3d>& rest_vertices, const std::vector<Eigen::Vector3i>& triangles, const std::vector<Eigen::Vector3d>& roots);
+
+    // R_s * (rest root) + t_s follows the bound point and tangent frame of the deformed scalp
+    void evaluate(const std::vector<Eigen::Vector3d>& scalp_vertices, std::vector<Eigen::Matrix3d>& rotations, std::vector<Eigen::Vector3d>& translations) const;
+
+    int rootCount() const;
+
+private:
+    std::vector<Eigen::Vector3i> triangles;
+
+    std::vector<int> bound_triangles; // root
+    std::vector<Eigen::Vector3d> bound_barycentrics; // root
+    std::vector<Eigen::Matrix3d> rest_frames; // root, triangle frame in the rest pose
+    std::vector<Eigen::Vector3d> rest_points; // root, bound point in the rest pose
+
+    Eigen::Matrix3d triangleFrame(const std::vector<Eigen::Vector3d>& vertices, int t) const;
+};
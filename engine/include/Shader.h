@@ -1,17 +1,20 @@
 #pragma once
 
 #include <glad/gl.h>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Shader {
 public:
     GLuint ID;
 
-    Shader(const char* vertexPath, const char* fragmentPath);
+    // defines ("NAME" or "NAME VALUE") are added to both sources, see InjectDefines
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
     void use();
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
@@ -19,7 +22,23 @@ public:
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
     void setVec3(const std::string &name, const glm::vec3 &value) const;
     void setTexture(const std::string &name, int unit, GLuint texture);
+    // true when the program was loaded from the binary cache instead of being compiled
+    bool loadedFromCache() const { return fromCache; }
+
+    // Linked programs are saved to `directory` (created when missing) with glGetProgramBinary and loaded
+    // from there by later runs instead of compiling. A cached binary is used only for the same sources on
+    // the same driver (vendor, renderer and version string), otherwise the shader is compiled and the cache
+    // entry replaced. Empty disables the cache, the default.
+    static void SetCacheDirectory(const std::string& directory);
+    // `source` with a #define line per define after its #version line
+    static std::string InjectDefines(const std::string& source, const std::vector<std::string>& defines);
 
 private:
+    bool fromCache = false;
+    static std::string cacheDirectory;
+
+    void build(const std::string& vertexCode, const std::string& fragmentCode);
+    bool loadBinary(const std::string& path, uint64_t key);
+    void saveBinary(const std::string& path, uint64_t key);
     void checkCompileErrors(GLuint shader, std::string type);
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include "Shader.h"
+
+// Permutations of one vertex/fragment shader pair, each compiled with its own set of #defines
+// ("NAME" or "NAME VALUE", see Shader::InjectDefines). Sets that differ only in order or repetition are the
+// same variant and compiled once.
+// With a window, variants compile on a worker thread in a hidden context that shares objects with the
+// window's context, so requesting one does not stall the frame; Get hands out a fallback variant until it
+// is ready. Without a window they compile on the calling thread when first requested.
+// Create, use and destroy it on the thread whose context renders (the programs are deleted with it), and
+// destroy or shut it down before glfwTerminate, which the hidden context and the worker must not outlive.
+class ShaderVariants {
+public:
+    using Defines = std::vector<std::string>;
+
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, GLFWwindow* window = nullptr);
+    ~ShaderVariants(); // calls Shutdown
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // queues the variant unless it is compiled or queued already
+    void Request(const Defines& defines);
+    // The variant once it is compiled, until then `fallback`, which is waited for when it is not ready
+    // either (request it early, e.g. with Wait at startup). nullptr when neither compiled successfully.
+    Shader* Get(const Defines& defines, const Defines& fallback = {});
+    bool IsReady(const Defines& defines) const;
+    // blocks until the variant is compiled, false when it failed to compile or link
+    bool Wait(const Defines& defines);
+
+    // Joins the worker, destroys the hidden context and deletes every program. No variant may be used afterwards;
+    // calling it again (or destroying the object) does nothing more.
+    void Shutdown();
+
+    int variantCount() const;
+    bool compilesInBackground() const;
+
+private:
+    enum State { QUEUED, READY, FAILED };
+
+    struct Variant {
+        Defines defines;
+        State state = QUEUED;
+        std::unique_ptr<Shader> shader;
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    GLFWwindow* context = nullptr; // hidden, shared with the window, current on the worker
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable queued_cv;
+    std::condition_variable compiled_cv;
+    std::map<std::string, Variant> variants; // by key(), stable addresses
+    std::deque<std::string> queue;
+    bool stopping = false;
+
+    static std::string key(const Defines& defines);
+    // key of the variant, queued or compiled inline on the first request
+    std::string request(const Defines& defines);
+    std::unique_ptr<Shader> compile(const Defines& defines) const;
+    void compileLoop();
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <limits>
+#include <vector>
+#include "HairModel.h"
+
+// Bounding volume hierarchy over the segments of a HairModel, for picking strands and tracing rays.
+// Every segment is a capsule whose radius goes linearly from one vertex to the next (half the thickness,
+// or d_thickness without a thickness array). Rays hit a segment where they pass closest to its axis, if
+// that distance is inside the radius there; for hair-thin capsules this is the usual ray-facing ribbon.
+//
+// build sorts the segments with a binned SAH. Nodes above a few thousand segments are binned with
+// parallelFor, the subtrees below them are then built in parallel. refit only recomputes the boxes for
+// moved points (simulation steps, animation frames), keeping the tree, and costs a fraction of a build;
+// the tree degrades if the groom deforms a lot, rebuild now and then in that case.
+class StrandBVH {
+public:
+    struct Settings {
+        int bins = 16; // SAH candidates along the longest axis of a node
+        int leaf_size = 4; // segments at most per leaf
+        float radius_scale = 0.5f; // capsule radius per thickness
+    };
+
+    struct Ray {
+        Eigen::Vector3f origin;
+        Eigen::Vector3f direction; // need not be normalized, t is in its units
+        float t_min = 0.0f;
+        float t_max = std::numeric_limits<float>::infinity();
+    };
+
+    struct Hit {
+        unsigned int strand = 0;
+        unsigned int segment = 0; // within the strand
+        float t = 0.0f; // along the ray
+        float u = 0.0f; // along the segment, 0 at its first vertex
+    };
+
+    StrandBVH() = default;
+    ~StrandBVH() = default;
+
+    void build(const HairModel& model);
+    void build(const HairModel& model, const Settings& settings);
+    // Points of the same topology, 3 * point_count floats (HairModel::points, GroomAnimation::ReadFrame).
+    void refit(const float* points);
+
+    // closest hit within [t_min, t_max]
+    bool intersect(const Ray& ray, Hit* hit) const;
+    // As intersect, with every radius grown by `radius`, so that thin strands can be clicked on.
+    bool pick(const Ray& ray, float radius, Hit* hit) const;
+    // any hit within [t_min, t_max], stops at the first one found (shadow rays)
+    bool occluded(const Ray& ray) const;
+    // Four rays at once, for coherent rays such as 2x2 camera pixels: the nodes are tested against all four
+    // with SSE and visited while any of them can still hit. Same hits as four intersect calls.
+    void intersect4(const Ray rays[4], Hit hits[4], bool found[4]) const;
+
+    // positions (3 floats each) and capsule radii of the points as of the last build or refit
+    const std::vector<float>& pointPositions() const;
+    const std::vector<float>& pointRadii() const;
+
+    size_t segmentCount() const;
+    size_t nodeCount() const;
+    bool empty() const;
+
+private:
+    struct Node {
+        float lo[3], hi[3];
+        unsigned int index; // leaf: first segment, interior: left child (the right one follows it)
+        unsigned int count; // segments in a leaf, 0 for interior nodes
+    };
+
+    struct Segment {
+        unsigned int point; // first vertex
+        unsigned int strand;
+        unsigned int segment;
+    };
+
+    Settings settings;
+    std::vector<Node> nodes; // root first, children always after their parent
+    std::vector<Segment> segments; // in leaf order
+    std::vector<float> points; // copy of the positions, refit replaces it
+    std::vector<float> radii; // point
+    unsigned int depth = 0; // of the deepest leaf, bounds the traversal stack
+
+    void segmentBounds(const Segment& s, float lo[3], float hi[3]) const;
+    int buildNode(std::vector<Node>& out, int node, std::vector<float>& centroids, unsigned int begin, unsigned int end, bool parallel);
+    bool hitSegment(const Segment& s, const Ray& ray, float dd, float extra_radius, float best, float* t, float* u) const;
+    bool traverse(const Ray& ray, float extra_radius, bool any, Hit* hit) const;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Trace events for looking at the engine on a timeline, saved as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev). Compiled in with CGC_TRACE defined (cmake -DCGC_TRACE=ON); without it the macros
+// expand to nothing and cost nothing.
+//
+// CGC_TRACE_SCOPE("name") records one event from there to the end of the enclosing scope. The name is
+// stored as a pointer, use string literals. Every thread writes into its own ring buffer of buffer_events
+// events without locking (only the first event of a thread registers its buffer), and overwrites its oldest
+// events once the buffer is full. Save merges the buffers of all threads, also of threads that have exited;
+// call Save and Clear while no traced code runs, e.g. between frames.
+class Trace {
+public:
+    static constexpr size_t buffer_events = 1 << 16; // per thread
+
+    class Scope {
+    public:
+        explicit Scope(const char* name) : name(name), start(now()) {}
+        ~Scope() { record(name, start, now()); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start;
+    };
+
+    static bool Save(const std::string& filename, std::string* err);
+    static void Clear();
+    // shown on the timeline for the calling thread instead of its number
+    static void SetThreadName(const std::string& name);
+
+    static uint64_t now(); // nanoseconds since the first call
+    static void record(const char* name, uint64_t start, uint64_t end);
+};
+
+#ifdef CGC_TRACE
+#define CGC_TRACE_CONCAT_(a, b) a##b
+#define CGC_TRACE_CONCAT(a, b) CGC_TRACE_CONCAT_(a, b)
+#define CGC_TRACE_SCOPE(name) Trace::Scope CGC_TRACE_CONCAT(cgc_trace_scope_, __LINE__)(name)
+#define CGC_TRACE_THREAD_NAME(name) Trace::SetThreadName(name)
+#else
+#define CGC_TRACE_SCOPE(name) ((void)0)
+#define CGC_TRACE_THREAD_NAME(name) ((void)sizeof(name))
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <vector>
+#include "HairModel.h"
+
+// XPBD Cosserat rods (Kugelstadt and Schoemer 2016 with XPBD compliance, Macklin et al. 2016).
+// Cheap alternative to DER for interactive grooming. All strands of a HairModel are stored
+// in flat arrays: vertex v of strand s is strand_offsets[s] + v, and edge e of strand s is
+// strand_offsets[s] - s + e. Each edge carries an orientation quaternion whose third axis
+// follows the tangent; stretch/shear couples positions and orientations, bend/twist couples
+// neighbouring orientations through the Darboux vector.
+class XPBD {
+public:
+    enum class Mode {
+        GaussSeidel, // sequential within a strand, strands in parallel
+        Jacobi // all constraints in parallel, corrections averaged per particle
+    };
+
+    XPBD(const HairModel& model, double E, double G, double radius, double rho = 1.3);
+
+    void update(double dt);
+
+    void setMode(Mode m);
+    void setIterations(int n);
+    void setGravity(const Eigen::Vector3d& g);
+    void setRelaxation(double omega); // Jacobi only
+
+    int strandCount() const;
+    const std::vector<int>& getStrandOffsets() const; // strand_count + 1 entries
+    const std::vector<Eigen::Vector3d>& getPositions() const;
+    const std::vector<Eigen::Vector3d>& getVelocities() const;
+    void setVelocities(const std::vector<Eigen::Vector3d>& new_velocities);
+
+    // root clamping per strand, same convention as DER::setRootTransform
+    void setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations);
+
+private:
+    Mode mode = Mode::GaussSeidel;
+    int iterations = 4;
+    double relaxation = 1.5;
+    Eigen::Vector3d gravity = Eigen::Vector3d::Zero();
+
+    std::vector<int> strand_offsets;
+
+    bool root_clamped = false;
+    std::vector<Eigen::Matrix3d> root_rotations; // strand
+    std::vector<Eigen::Vector3d> root_translations; // strand
+    std::vector<Eigen::Vector3d> rest_root_positions; // strand, vertices 0 and 1
+    std::vector<Eigen::Quaterniond> rest_root_orientations; // strand, first edge
+
+    std::vector<Eigen::Vector3d> positions; // vertex
+    std::vector<Eigen::Vector3d> predicted; // vertex
+    std::vector<Eigen::Vector3d> velocities; // vertex
+    std::vector<double> inv_masses; // vertex, 0 for kinematic vertices
+
+    std::vector<Eigen::Quaterniond> orientations; // edge
+    std::vector<double> inv_inertias; // edge, 0 for kinematic edges
+    std::vector<double> rest_lengths; // edge
+    std::vector<Eigen::Quaterniond> rest_darboux; // edge, between edge e and e+1
+    std::vector<double> stretch_compliance; // edge
+    std::vector<Eigen::Vector3d> bend_twist_compliance; // edge, (bend 1, bend 2, twist)
+    std::vector<Eigen::Vector3d> stretch_lambdas; // edge
+    std::vector<Eigen::Vector3d> bend_twist_lambdas; // edge
+
+    // Jacobi buffers
+    std::vector<Eigen::Vector3d> stretch_dp0, stretch_dp1; // edge
+    std::vector<Eigen::Quaterniond> stretch_dq; // edge
+    std::vector<Eigen::Quaterniond> bend_dq0, bend_dq1; // edge
+
+    int edgeIndex(int s, int local) const;
+    void solveStretchShear(int e, int v0, double dt2, Eigen::Vector3d& dp0, Eigen::Vector3d& dp1, Eigen::Quaterniond& dq);
+    void solveBendTwist(int e, double dt2, Eigen::Quaterniond& dq0, Eigen::Quaterniond& dq1);
+    void solveGaussSeidel(double dt);
+    void solveJacobi(double dt);
+};
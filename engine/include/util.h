@@ -4,7 +4,7 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 
-bool initializeGLFW();
+bool initializeGLFW(int major = 4, int minor = 1); // context version, 4.3 for compute shaders
 bool initializeGLAD();
 GLFWwindow* createWindow(int width, int height, const char* title);
 void cleanup(GLFWwindow* window);
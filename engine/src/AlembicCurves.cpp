@@ -0,0 +1,432 @@
+#include "AlembicCurves.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifdef CGC_ALEMBIC
+#include <Alembic/AbcCoreFactory/All.h>
+#include <Alembic/AbcCoreOgawa/All.h>
+#include <Alembic/AbcGeom/All.h>
+#endif
+
+namespace {
+
+#ifndef CGC_ALEMBIC
+const char* no_alembic = "cgc was built without Alembic";
+#endif
+
+} // namespace
+
+// Alembic reports errors with exceptions; they are caught here and returned through err like everywhere else.
+#ifdef CGC_ALEMBIC
+namespace AbcG = Alembic::AbcGeom;
+
+struct AlembicCurvesWriter::Archive {
+    AbcG::OArchive archive;
+    AbcG::OCurves curves;
+    std::vector<int32_t> vertex_counts; // curve
+    std::vector<float> widths; // point, empty without thickness and once the first sample is written
+};
+
+struct AlembicCurvesReader::Archive {
+    AbcG::IArchive archive;
+    AbcG::ICurves curves;
+};
+
+namespace {
+
+bool findCurves(const AbcG::IObject& object, AbcG::ICurves& curves) {
+    for (size_t i = 0; i < object.getNumChildren(); i++) {
+        const AbcG::ObjectHeader& header = object.getChildHeader(i);
+        if (AbcG::ICurves::matches(header)) {
+            curves = AbcG::ICurves(object, header.getName());
+            return true;
+        }
+        if (findCurves(AbcG::IObject(object, header.getName()), curves)) return true;
+    }
+    return false;
+}
+
+} // namespace
+#else
+struct AlembicCurvesWriter::Archive {};
+struct AlembicCurvesReader::Archive {};
+#endif
+
+// ---- AlembicCurvesWriter ----
+
+AlembicCurvesWriter::AlembicCurvesWriter() = default;
+
+AlembicCurvesWriter::~AlembicCurvesWriter() {
+    Close(nullptr);
+}
+
+bool AlembicCurvesWriter::Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate) {
+    return Open(model, err, filename, frame_rate, Settings());
+}
+
+bool AlembicCurvesWriter::Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate, const Settings& settings) {
+    Close(nullptr);
+    size_t points = model.point_count;
+    if (((model.arrays & HAIR_FILE_SEGMENTS_BIT) && model.segments.size() != model.hair_count)
+        || ((model.arrays & HAIR_FILE_THICKNESS_BIT) && model.thickness.size() != points)
+        || ((model.arrays & HAIR_FILE_TRANSPARENCY_BIT) && model.transparency.size() != points)
+        || ((model.arrays & HAIR_FILE_COLORS_BIT) && model.colors.size() != 3 * points)) {
+        if (err) *err = "Size of an array does not match the header";
+        return false;
+    }
+    if (!(frame_rate > 0.0f)) {
+        if (err) *err = "Frame rate must be positive";
+        return false;
+    }
+
+#ifndef CGC_ALEMBIC
+    (void)filename;
+    (void)settings;
+    if (err) *err = no_alembic;
+    return false;
+#else
+    std::unique_ptr<Archive> out(new Archive());
+    out->vertex_counts.resize(model.hair_count);
+    size_t total = 0;
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        out->vertex_counts[s] = static_cast<int32_t>(((model.arrays & HAIR_FILE_SEGMENTS_BIT) ? model.segments[s] : model.d_segments) + 1);
+        total += out->vertex_counts[s];
+    }
+    if (total != points) {
+        if (err) *err = "Segment counts do not add up to the point count";
+        return false;
+    }
+    if (model.arrays & HAIR_FILE_THICKNESS_BIT) out->widths = model.thickness;
+
+    try {
+        out->archive = AbcG::OArchive(Alembic::AbcCoreOgawa::WriteArchive(), filename);
+        uint32_t sampling = out->archive.addTimeSampling(AbcG::TimeSampling(1.0 / frame_rate, 0.0));
+        out->curves = AbcG::OCurves(out->archive.getTop(), "hair", sampling);
+
+        // static, written once with the default (identity) time sampling
+        AbcG::OCompoundProperty arb = out->curves.getSchema().getArbGeomParams();
+        if (model.arrays & HAIR_FILE_TRANSPARENCY_BIT) {
+            AbcG::OFloatGeomParam transparency(arb, "transparency", false, AbcG::kVertexScope, 1);
+            transparency.set(AbcG::OFloatGeomParam::Sample(AbcG::FloatArraySample(model.transparency), AbcG::kVertexScope));
+        }
+        if (model.arrays & HAIR_FILE_COLORS_BIT) {
+            AbcG::OC3fGeomParam colors(arb, "Cs", false, AbcG::kVertexScope, 1);
+            AbcG::C3fArraySample values(reinterpret_cast<const AbcG::C3f*>(model.colors.data()), points);
+            colors.set(AbcG::OC3fGeomParam::Sample(values, AbcG::kVertexScope));
+        }
+    } catch (const std::exception& e) {
+        if (err) *err = e.what();
+        return false;
+    }
+
+    archive = std::move(out);
+    this->settings = settings;
+    this->settings.queue_frames = std::max(settings.queue_frames, 1u);
+    point_count = points;
+    stopping = false;
+    error.clear();
+    stall_seconds = 0.0;
+    for (unsigned int t = 0; t < std::max(settings.encode_threads, 1u); t++) {
+        encoders.emplace_back(&AlembicCurvesWriter::encodeLoop, this);
+    }
+    writer = std::thread(&AlembicCurvesWriter::writeLoop, this);
+    return true;
+#endif
+}
+
+bool AlembicCurvesWriter::AddFrame(std::vector<Eigen::Vector3d> positions, std::string* err) {
+    if (positions.size() != point_count) {
+        if (err) *err = "Frame does not match the point count";
+        return false;
+    }
+    Frame frame;
+    frame.vertices = std::move(positions);
+    return push(std::move(frame), err);
+}
+
+bool AlembicCurvesWriter::AddFrame(const std::vector<float>& points, std::string* err) {
+    if (points.size() != 3 * point_count) {
+        if (err) *err = "Frame does not match the point count";
+        return false;
+    }
+    Frame frame;
+    frame.points = points;
+    return push(std::move(frame), err);
+}
+
+bool AlembicCurvesWriter::push(Frame frame, std::string* err) {
+    if (!writer.joinable()) {
+        if (err) *err = "Writer is not open";
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return frames.size() < settings.queue_frames || !error.empty(); });
+    stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!error.empty()) {
+        if (err) *err = error;
+        return false;
+    }
+    frames.push_back(std::move(frame));
+    cv.notify_all();
+    return true;
+}
+
+bool AlembicCurvesWriter::Close(std::string* err) {
+    if (!writer.joinable()) return true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread& encoder : encoders) encoder.join();
+    encoders.clear();
+    writer.join();
+    archive.reset(); // the archive is finalized when its last object goes away
+    if (!error.empty()) {
+        if (err) *err = error;
+        return false;
+    }
+    return true;
+}
+
+double AlembicCurvesWriter::stallSeconds() const {
+    return stall_seconds;
+}
+
+// Frames are converted in any order by the encoders and written strictly in order by the writer,
+// which is the only thread using the archive.
+void AlembicCurvesWriter::encodeLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        auto it = std::find_if(frames.begin(), frames.end(), [](const Frame& f) { return !f.encoding; });
+        if (it == frames.end()) {
+            if (stopping) return;
+            cv.wait(lock);
+            continue;
+        }
+        Frame& frame = *it;
+        frame.encoding = true;
+        lock.unlock();
+
+        if (!frame.vertices.empty()) {
+            frame.points.resize(3 * frame.vertices.size());
+            for (size_t v = 0; v < frame.vertices.size(); v++) {
+                for (int c = 0; c < 3; c++) frame.points[3 * v + c] = static_cast<float>(frame.vertices[v][c]);
+            }
+            std::vector<Eigen::Vector3d>().swap(frame.vertices);
+        }
+        for (size_t i = 0; i < frame.points.size(); i++) {
+            int c = static_cast<int>(i % 3);
+            frame.bounds[c] = i < 3 ? frame.points[i] : std::min<double>(frame.bounds[c], frame.points[i]);
+            frame.bounds[3 + c] = i < 3 ? frame.points[i] : std::max<double>(frame.bounds[3 + c], frame.points[i]);
+        }
+
+        lock.lock();
+        frame.encoded = true;
+        cv.notify_all();
+    }
+}
+
+void AlembicCurvesWriter::writeLoop() {
+    while (true) {
+        Frame* frame;
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return (!frames.empty() && frames.front().encoded) || (stopping && frames.empty()); });
+            if (frames.empty()) return;
+            frame = &frames.front();
+            failed = !error.empty();
+        }
+
+#ifdef CGC_ALEMBIC
+        if (!failed) {
+            try {
+                // widths only with the first sample, later samples without them repeat the previous value
+                AbcG::OFloatGeomParam::Sample widths;
+                if (!archive->widths.empty()) widths = AbcG::OFloatGeomParam::Sample(AbcG::FloatArraySample(archive->widths), AbcG::kVertexScope);
+                AbcG::OCurvesSchema::Sample sample(
+                    AbcG::P3fArraySample(reinterpret_cast<const AbcG::V3f*>(frame->points.data()), point_count),
+                    AbcG::Int32ArraySample(archive->vertex_counts), AbcG::kLinear, AbcG::kNonPeriodic, widths);
+                // bounds from the encoders, so that the schema does not compute them here
+                const double* b = frame->bounds;
+                sample.setSelfBounds(AbcG::Box3d(AbcG::V3d(b[0], b[1], b[2]), AbcG::V3d(b[3], b[4], b[5])));
+                archive->curves.getSchema().set(sample);
+                std::vector<float>().swap(archive->widths);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = e.what();
+            }
+        }
+#else
+        (void)frame;
+        (void)failed;
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frames.pop_front();
+        }
+        cv.notify_all();
+    }
+}
+
+bool AlembicCurvesWriter::SaveToFile(const HairModel& model, std::string* err, const std::string& filename) {
+    AlembicCurvesWriter writer;
+    Settings settings;
+    settings.encode_threads = 1;
+    return writer.Open(model, err, filename, 24.0f, settings) && writer.AddFrame(model.points, err) && writer.Close(err);
+}
+
+// ---- AlembicCurvesReader ----
+
+AlembicCurvesReader::AlembicCurvesReader() = default;
+
+AlembicCurvesReader::~AlembicCurvesReader() = default;
+
+bool AlembicCurvesReader::Open(const std::string& filename, std::string* err) {
+    archive.reset();
+#ifndef CGC_ALEMBIC
+    (void)filename;
+    if (err) *err = no_alembic;
+    return false;
+#else
+    try {
+        std::unique_ptr<Archive> in(new Archive());
+        Alembic::AbcCoreFactory::IFactory factory;
+        in->archive = factory.getArchive(filename);
+        if (!in->archive.valid()) {
+            if (err) *err = "Cannot open file";
+            return false;
+        }
+        if (!findCurves(in->archive.getTop(), in->curves)) {
+            if (err) *err = "No curves in the archive";
+            return false;
+        }
+        archive = std::move(in);
+        return true;
+    } catch (const std::exception& e) {
+        if (err) *err = e.what();
+        return false;
+    }
+#endif
+}
+
+unsigned int AlembicCurvesReader::frameCount() const {
+#ifdef CGC_ALEMBIC
+    if (archive) return static_cast<unsigned int>(archive->curves.getSchema().getNumSamples());
+#endif
+    return 0;
+}
+
+float AlembicCurvesReader::frameRate() const {
+#ifdef CGC_ALEMBIC
+    if (archive) {
+        AbcG::TimeSamplingPtr sampling = archive->curves.getSchema().getTimeSampling();
+        if (sampling && sampling->getTimeSamplingType().isUniform()) {
+            return static_cast<float>(1.0 / sampling->getTimeSamplingType().getTimePerCycle());
+        }
+    }
+#endif
+    return 0.0f;
+}
+
+bool AlembicCurvesReader::ReadFrame(unsigned int frame, HairModel* model, std::string* err) {
+#ifndef CGC_ALEMBIC
+    (void)frame;
+    (void)model;
+    if (err) *err = no_alembic;
+    return false;
+#else
+    if (!archive) {
+        if (err) *err = "Reader is not open";
+        return false;
+    }
+    if (frame >= frameCount()) {
+        if (err) *err = "Frame is out of range";
+        return false;
+    }
+    try {
+        AbcG::ICurvesSchema& schema = archive->curves.getSchema();
+        AbcG::ISampleSelector selector(static_cast<AbcG::index_t>(frame));
+        AbcG::ICurvesSchema::Sample sample;
+        schema.get(sample, selector);
+        AbcG::P3fArraySamplePtr positions = sample.getPositions();
+        AbcG::Int32ArraySamplePtr counts = sample.getCurvesNumVertices();
+        if (!positions || !counts) {
+            if (err) *err = "Curves without positions";
+            return false;
+        }
+
+        size_t points = positions->size();
+        size_t total = 0;
+        model->segments.resize(counts->size());
+        for (size_t s = 0; s < counts->size(); s++) {
+            int32_t n = (*counts)[s];
+            if (n < 1 || n > 65536) {
+                if (err) *err = "Curve with an unsupported vertex count";
+                return false;
+            }
+            model->segments[s] = static_cast<unsigned short>(n - 1);
+            total += n;
+        }
+        if (total != points) {
+            if (err) *err = "Vertex counts do not add up to the positions";
+            return false;
+        }
+
+        model->hair_count = static_cast<unsigned int>(counts->size());
+        model->point_count = static_cast<unsigned int>(points);
+        model->arrays = HAIR_FILE_SEGMENTS_BIT | HAIR_FILE_POINTS_BIT;
+        model->d_segments = 0;
+        model->d_thickness = 1.0f;
+        model->d_transparency = 0.0f;
+        std::fill(std::begin(model->d_color), std::end(model->d_color), 1.0f);
+        model->points.resize(3 * points);
+        std::memcpy(model->points.data(), positions->get(), 3 * points * sizeof(float));
+        model->thickness.clear();
+        model->transparency.clear();
+        model->colors.clear();
+
+        AbcG::IFloatGeomParam widths = schema.getWidthsParam();
+        if (widths.valid()) {
+            AbcG::FloatArraySamplePtr values = widths.getExpandedValue(selector).getVals();
+            if (values && values->size() == points) {
+                model->thickness.assign(values->get(), values->get() + points);
+                model->arrays |= HAIR_FILE_THICKNESS_BIT;
+            } else if (values && values->size() == 1) {
+                model->d_thickness = (*values)[0]; // constant width
+            }
+        }
+
+        AbcG::ICompoundProperty arb = schema.getArbGeomParams();
+        const AbcG::PropertyHeader* header = arb.valid() ? arb.getPropertyHeader("transparency") : nullptr;
+        if (header && AbcG::IFloatGeomParam::matches(*header)) {
+            AbcG::FloatArraySamplePtr values = AbcG::IFloatGeomParam(arb, "transparency").getExpandedValue(selector).getVals();
+            if (values && values->size() == points) {
+                model->transparency.assign(values->get(), values->get() + points);
+                model->arrays |= HAIR_FILE_TRANSPARENCY_BIT;
+            }
+        }
+        header = arb.valid() ? arb.getPropertyHeader("Cs") : nullptr;
+        if (header && AbcG::IC3fGeomParam::matches(*header)) {
+            AbcG::C3fArraySamplePtr values = AbcG::IC3fGeomParam(arb, "Cs").getExpandedValue(selector).getVals();
+            if (values && values->size() == points) {
+                const float* rgb = reinterpret_cast<const float*>(values->get());
+                model->colors.assign(rgb, rgb + 3 * points);
+                model->arrays |= HAIR_FILE_COLORS_BIT;
+            }
+        }
+        return true;
+    } catch (const std::exception& e) {
+        if (err) *err = e.what();
+        return false;
+    }
+#endif
+}
+
+bool AlembicCurvesReader::LoadFromFile(HairModel* model, std::string* err, const std::string& filename) {
+    AlembicCurvesReader reader;
+    return reader.Open(filename, err) && reader.ReadFrame(0, model, err);
+}
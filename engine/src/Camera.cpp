@@ -59,6 +59,12 @@ void Camera::ProcessMouseScroll(float yoffset) {
         Zoom = 45.0f;
 }
 
+// 投影行列と同じ視野角 (Zoom) で視線を作る
+glm::vec3 Camera::GetRayDirection(float ndcX, float ndcY, float aspect) const {
+    float tanHalf = tan(glm::radians(Zoom) * 0.5f);
+    return glm::normalize(Front + Right * (ndcX * aspect * tanHalf) + Up * (ndcY * tanHalf));
+}
+
 // カメラベクトルを更新
 void Camera::updateCameraVectors() {
     glm::vec3 front;
@@ -0,0 +1,91 @@
+#include "ComputeShader.h"
+#include "Trace.h"
+
+ComputeShader::ComputeShader(const char* computePath) {
+    CGC_TRACE_SCOPE("ComputeShader::ComputeShader");
+    // シェーダーのコードを読み込む
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+    try {
+        cShaderFile.open(computePath);
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        computeCode = cShaderStream.str();
+        cShaderFile.close();
+    } catch (const std::ifstream::failure& e) {
+        std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    }
+
+    const char* cShaderCode = computeCode.c_str();
+
+    // コンピュートシェーダー
+    CGC_TRACE_SCOPE("ComputeShader compile");
+    GLuint compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, nullptr);
+    glCompileShader(compute);
+    checkCompileErrors(compute, "COMPUTE");
+
+    // シェーダープログラムをリンクする
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+
+    glDeleteShader(compute);
+}
+
+ComputeShader::~ComputeShader() {
+    glDeleteProgram(ID);
+}
+
+void ComputeShader::use() {
+    glUseProgram(ID);
+}
+
+void ComputeShader::dispatch(GLuint groups_x, GLuint groups_y, GLuint groups_z) {
+    glDispatchCompute(groups_x, groups_y, groups_z);
+}
+
+void ComputeShader::setBool(const std::string &name, bool value) const {
+    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+}
+
+void ComputeShader::setInt(const std::string &name, int value) const {
+    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+}
+
+void ComputeShader::setFloat(const std::string &name, float value) const {
+    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+}
+
+void ComputeShader::setMat4(const std::string &name, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+}
+
+void ComputeShader::setVec3(const std::string &name, const glm::vec3 &value) const {
+    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+}
+
+bool ComputeShader::isSupported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+void ComputeShader::checkCompileErrors(GLuint shader, std::string type) {
+    int success;
+    char infoLog[1024];
+    if (type == "PROGRAM") {
+        glGetProgramiv(shader, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+            std::cerr << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+    } else {
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cerr << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
+    }
+}
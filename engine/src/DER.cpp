@@ -1,20 +1,41 @@
 #include "DER.h"
+#include "Geometry.h"
+#include "Trace.h"
+#include <algorithm>
+#include <limits>
 
-constexpr double M_PI = 3.141592653589793;
+constexpr double PI = 3.141592653589793;
 
-DER::DER(const std::vector<Eigen::Vector3d>& vertices, double E, double G, const std::vector<double>& a, const std::vector<double>& b)
-    : vertices(vertices), E(E), G(G), a(a), b(b), num_vertices(vertices.size()), num_edges(vertices.size() - 1)
+DER::DER(const std::vector<Eigen::Vector3d>& vertices, double E, double G, const std::vector<double>& a, const std::vector<double>& b, double rho)
+    : vertices(vertices), E(E), G(G), rho(rho), a(a), b(b), num_vertices(vertices.size()), num_edges(vertices.size() - 1)
        {
-    edges.resize(num_edges);
+    // updateEdges / updateMaterialFrame compare against the stored values; NaN never compares equal, so the
+    // first comparison is defined and invalidates every edge and frame
+    const Eigen::Vector3d unset = Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN());
+    edges.assign(num_edges, unset);
     tangents.resize(num_edges);
     ref_dir_1.resize(num_edges);
     ref_dir_2.resize(num_edges);
-    mat_dir_1.resize(num_edges);
-    mat_dir_2.resize(num_edges);
+    mat_dir_1.assign(num_edges, unset);
+    mat_dir_2.assign(num_edges, unset);
     thetas.resize(num_edges, 0.0);
+    velocities.resize(num_vertices, Eigen::Vector3d::Zero());
+    external_forces.resize(num_vertices, Eigen::Vector3d::Zero());
+    cache_lengths.resize(num_edges);
+    cache_binormals.resize(num_vertices);
+    cache_curvatures.resize(num_vertices);
+    cache_twists.resize(num_vertices);
+    length_valid.assign(num_edges, 0);
+    binormal_valid.assign(num_vertices, 0);
+    curvature_valid.assign(num_vertices, 0);
+    twist_valid.assign(num_vertices, 0);
 
     updateEdges();
 
+    // 曲率はmaterial frameから計算するので、先にframeを初期化する
+    initializeReferenceFrame();
+    updateMaterialFrame();
+
     rest_lengths = computeAllLength();
     rest_curvatures = computeAllCurvature();
     rest_twists = std::vector<double>(num_edges, 0.0);
@@ -22,19 +43,205 @@ DER::DER(const std::vector<Eigen::Vector3d>& vertices, double E, double G, const
     k_Ss = computeAllK_Ss();
     betas = computeAllBetas();
     Bs = computeAllBs();
+    masses = computeAllMasses();
+    stiffness_timestep = computeStiffnessTimestep();
 
-    initializeReferenceFrame();
+    rest_root_vertices[0] = this->vertices[0];
+    rest_root_vertices[1] = num_vertices > 1 ? this->vertices[1] : this->vertices[0];
+    rest_root_director = num_edges > 0 ? mat_dir_1[0] : Eigen::Vector3d::UnitX();
+}
+
+void DER::update(double dt) {
+    CGC_TRACE_SCOPE("DER::update");
+    if (num_edges == 0) return; // a lone vertex has no mass to move
+    std::vector<Eigen::Vector3d> forces = computeForces();
+
+    // symplectic Euler
+    for (int i = 0; i < num_vertices; i++) {
+        external_forces[i].setZero();
+        if (root_clamped && i < 2) {
+            // 根元は外部から与えられた変換に従う
+            Eigen::Vector3d target = root_rotation * rest_root_vertices[i] + root_translation;
+            velocities[i] = (target - vertices[i]) / dt;
+            vertices[i] = target;
+            continue;
+        }
+        velocities[i] += dt * forces[i] / masses[i];
+        vertices[i] += dt * velocities[i];
+    }
+
+    updateEdges();
+    updateReferenceFrame();
+    clampRootTheta();
+    updateMaterialFrame();
+    updateThetas();
+}
+
+int DER::advance(double dt, double cfl, int max_substeps) {
+    CGC_TRACE_SCOPE("DER::advance");
+    if (num_edges == 0) return 0;
+    double t = 0.0;
+    int steps = 0;
+    while (t < dt && steps < max_substeps) {
+        int remaining = max_substeps - steps;
+        double h = std::max(computeStableTimestep(cfl), (dt - t) / remaining);
+        h = std::min(h, dt - t);
+        // 残りが僅かなら最後のステップに含めて極端に小さいステップを避ける
+        if (dt - t - h < 1e-3 * h) h = dt - t;
+        update(h);
+        t += h;
+        steps++;
+    }
+    return steps;
+}
+
+double DER::computeStableTimestep(double cfl) const {
+    // a vertex should not travel more than cfl times the shortest edge per step
+    if (num_edges == 0) return std::numeric_limits<double>::infinity();
+    double max_speed = 0.0;
+    for (const Eigen::Vector3d& v : velocities) {
+        max_speed = std::max(max_speed, v.norm());
+    }
+    double min_length = *std::min_element(rest_lengths.begin(), rest_lengths.end());
+    double motion_timestep = max_speed > 0.0 ? min_length / max_speed : std::numeric_limits<double>::infinity();
+    return cfl * std::min(stiffness_timestep, motion_timestep);
+}
+
+double DER::computeStiffnessTimestep() {
+    // symplectic Euler is stable for dt < 2 / omega, omega^2 = k / m of the stiffest local mode
+    double omega2 = 0.0;
+    for (int j = 0; j < num_edges; j++) {
+        omega2 = std::max(omega2, k_Ss[j] * (1.0 / masses[j] + 1.0 / masses[j + 1]));
+    }
+    for (int i = 1; i < num_vertices - 1; i++) {
+        // bending of a single vertex against its neighbours, kappa ~ 2 * displacement / length
+        double l = std::min(rest_lengths[i - 1], rest_lengths[i]);
+        omega2 = std::max(omega2, 16.0 * Bs[i].diagonal().maxCoeff() / (l * l * masses[i]));
+    }
+    return omega2 > 0.0 ? 2.0 / std::sqrt(omega2) : std::numeric_limits<double>::infinity();
+}
+
+void DER::setRootTransform(const Eigen::Matrix3d& R, const Eigen::Vector3d& t) {
+    root_clamped = num_vertices > 1;
+    root_rotation = R;
+    root_translation = t;
+}
+
+void DER::releaseRoot() {
+    root_clamped = false;
+}
+
+bool DER::isRootClamped() const {
+    return root_clamped;
+}
+
+void DER::clampRootTheta() {
+    if (!root_clamped) return;
+    Eigen::Vector3d d1 = root_rotation * rest_root_director;
+    thetas[0] = std::atan2(d1.dot(ref_dir_2[0]), d1.dot(ref_dir_1[0]));
+}
+
+const std::vector<Eigen::Vector3d>& DER::getVertices() const {
+    return vertices;
+}
+
+const std::vector<Eigen::Vector3d>& DER::getVelocities() const {
+    return velocities;
+}
+
+const std::vector<double>& DER::getMasses() const {
+    return masses;
+}
+
+const std::vector<Eigen::Vector3d>& DER::getMaterialDirectors1() const {
+    return mat_dir_1;
+}
+
+const std::vector<Eigen::Vector3d>& DER::getMaterialDirectors2() const {
+    return mat_dir_2;
+}
+
+void DER::setGravity(const Eigen::Vector3d& g) {
+    gravity = g;
+}
+
+void DER::setState(const std::vector<Eigen::Vector3d>& positions, const std::vector<Eigen::Vector3d>& new_velocities) {
+    // clamped root vertices are kinematic and keep their state
+    int first = root_clamped ? 2 : 0;
+    for (int i = first; i < num_vertices; i++) {
+        vertices[i] = positions[i];
+        velocities[i] = new_velocities[i];
+    }
+    updateEdges();
+    updateReferenceFrame();
+    clampRootTheta();
     updateMaterialFrame();
 }
 
+void DER::addExternalForces(const std::vector<Eigen::Vector3d>& forces) {
+    for (int i = 0; i < num_vertices; i++) {
+        external_forces[i] += forces[i];
+    }
+}
+
 void DER::updateEdges() {
     for (int i = 0; i < num_edges; i++) {
-        edges[i] = vertices[i + 1] - vertices[i];
+        Eigen::Vector3d edge = vertices[i + 1] - vertices[i];
+        if (edge != edges[i]) {
+            edges[i] = edge;
+            invalidateEdge(i);
+        }
     }
 }
 
+void DER::invalidateEdge(int j) {
+    length_valid[j] = 0;
+    binormal_valid[j] = binormal_valid[j + 1] = 0;
+    curvature_valid[j] = curvature_valid[j + 1] = 0;
+    twist_valid[j] = twist_valid[j + 1] = 0;
+}
+
+void DER::invalidateFrame(int j) {
+    curvature_valid[j] = curvature_valid[j + 1] = 0;
+    twist_valid[j] = twist_valid[j + 1] = 0;
+}
+
+double DER::cachedLength(int j) {
+    if (!length_valid[j]) {
+        cache_lengths[j] = computeLength(j);
+        length_valid[j] = 1;
+    }
+    return cache_lengths[j];
+}
+
+const Eigen::Vector3d& DER::cachedCurvatureBinormal(int i) {
+    if (!binormal_valid[i]) {
+        cache_binormals[i] = computeCurvatureBinormal(i);
+        binormal_valid[i] = 1;
+    }
+    return cache_binormals[i];
+}
+
+const Eigen::Vector2d& DER::cachedCurvature(int i) {
+    if (!curvature_valid[i]) {
+        cache_curvatures[i] = computeCurvature(i);
+        curvature_valid[i] = 1;
+    }
+    return cache_curvatures[i];
+}
+
+double DER::cachedTwist(int i) {
+    if (!twist_valid[i]) {
+        cache_twists[i] = computeTwist(i);
+        twist_valid[i] = 1;
+    }
+    return cache_twists[i];
+}
+
 void DER::initializeReferenceFrame() {
+    CGC_TRACE_SCOPE("DER::initializeReferenceFrame");
     // Initialize reference frame using parallel transport
+    if (num_edges == 0) return;
     tangents[0] = edges[0].normalized();
     ref_dir_1[0] = Eigen::Vector3d::UnitX();
     if (ref_dir_1[0].cross(tangents[0]).isZero()){
@@ -45,41 +252,37 @@ void DER::initializeReferenceFrame() {
 
     for (int i = 1; i < num_edges; ++i) {
         tangents[i] = edges[i].normalized();
-        Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors(tangents[i-1], tangents[i]);
-        ref_dir_1[i] = q * ref_dir_1[i-1];
-        ref_dir_2[i] = q * ref_dir_2[i-1];
+        Eigen::Vector3d u = parallelTransport(ref_dir_1[i-1], tangents[i-1], tangents[i]);
 
         // 正規化
-        ref_dir_1[i].normalize();
-        ref_dir_2[i] = (ref_dir_2[i] - ref_dir_2[i].dot(tangents[i]) * tangents[i]).normalized();
-        ref_dir_1[i] = ref_dir_2[i].cross(tangents[i]).normalized();
+        ref_dir_1[i] = (u - u.dot(tangents[i]) * tangents[i]).normalized();
+        ref_dir_2[i] = tangents[i].cross(ref_dir_1[i]);
     }
 }
 
 void DER::updateReferenceFrame() {
+    CGC_TRACE_SCOPE("DER::updateReferenceFrame");
     // Update reference frame using parallel transport
     std::vector<Eigen::Vector3d> new_tangents;
     for (int i = 0; i < num_edges; i++) {
         new_tangents.push_back(edges[i].normalized());
     }
 
-    for (int i = 0; i < num_edges; i++) {
-        Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors(tangents[i], new_tangents[i]);
-        ref_dir_1[i] = q * ref_dir_1[i];
-        ref_dir_2[i] = q * ref_dir_2[i];
-
-        // 正規化
-        ref_dir_1[i].normalize();
-        ref_dir_2[i] = (ref_dir_2[i] - ref_dir_2[i].dot(new_tangents[i]) * new_tangents[i]).normalized();
-        ref_dir_1[i] = ref_dir_2[i].cross(new_tangents[i]).normalized();
-    }
+    // time parallel transport, unchanged edges keep their frame (and cached values)
+    parallelTransport(tangents, new_tangents, ref_dir_1, ref_dir_2);
     tangents = new_tangents;
 }
 
 void DER::updateMaterialFrame() {
+    CGC_TRACE_SCOPE("DER::updateMaterialFrame");
     for (int i = 0; i < num_edges; i++) {
-        mat_dir_1[i] = cos(thetas[i]) * ref_dir_1[i] + sin(thetas[i]) * ref_dir_2[i];
-        mat_dir_2[i] = -sin(thetas[i]) * ref_dir_1[i] + cos(thetas[i]) * ref_dir_2[i];
+        Eigen::Vector3d d1 = cos(thetas[i]) * ref_dir_1[i] + sin(thetas[i]) * ref_dir_2[i];
+        Eigen::Vector3d d2 = -sin(thetas[i]) * ref_dir_1[i] + cos(thetas[i]) * ref_dir_2[i];
+        if (d1 != mat_dir_1[i] || d2 != mat_dir_2[i]) {
+            mat_dir_1[i] = d1;
+            mat_dir_2[i] = d2;
+            invalidateFrame(i);
+        }
     }
 }
 
@@ -93,7 +296,7 @@ double DER::computeVoronoiLength(int i) {
 
 Eigen::Vector2d DER::computeCurvature(int i){
     Eigen::Vector2d kappa;
-    Eigen::Vector3d kb = computeCurvatureBinormal(i);
+    const Eigen::Vector3d& kb = cachedCurvatureBinormal(i);
     kappa(0) = 0.5 * (kb.dot(mat_dir_2[i-1]) + kb.dot(mat_dir_2[i]));
     kappa(1) = -0.5 * (kb.dot(mat_dir_1[i-1]) + kb.dot(mat_dir_1[i]));
     return kappa;
@@ -109,20 +312,20 @@ Eigen::Vector3d DER::computeCurvatureBinormal(int i) {
 }
 
 double DER::computeK_S(int i) {
-    return E * M_PI * a[i] * b[i];
+    return E * PI * a[i] * b[i];
 }
 
 double DER::computeBeta(int i) {
     double ai = (a[i-1] + a[i]) / 2.0; // 頂点での主半径
     double bi = (b[i-1] + b[i]) / 2.0; // 頂点での副半径
-    double Ai = M_PI * ai * bi; // 頂点での断面積
+    double Ai = PI * ai * bi; // 頂点での断面積
     return G * Ai * (ai*ai + bi*bi) / 4.0; //
 }
 
 Eigen::Matrix2d DER::computeB(int i) {
     double ai = (a[i-1] + a[i]) / 2.0; // 頂点での主半径
     double bi = (b[i-1] + b[i]) / 2.0; // 頂点での副半径
-    double Ai = M_PI * ai * bi; // 頂点での断面積
+    double Ai = PI * ai * bi; // 頂点での断面積
     Eigen::Matrix2d B = Eigen::Matrix2d::Zero();
     B(0, 0) = E * Ai * ai * ai / 4.0; //
     B(1, 1) = E * Ai * bi * bi / 4.0; //
@@ -133,8 +336,7 @@ double DER::computeTwist(int i) {
     Eigen::Vector3d prev_tangent = tangents[i-1];
     Eigen::Vector3d cur_tangent = tangents[i];
 
-    Eigen::Quaterniond P = Eigen::Quaterniond::FromTwoVectors(prev_tangent, cur_tangent);
-    Eigen::Vector3d d1_transported = P * mat_dir_1[i-1];
+    Eigen::Vector3d d1_transported = parallelTransport(mat_dir_1[i-1], prev_tangent, cur_tangent);
 
     double transported_angle = std::atan2(d1_transported.cross(mat_dir_1[i]).dot(cur_tangent), d1_transported.dot(mat_dir_1[i]));
 
@@ -202,7 +404,7 @@ std::vector<Eigen::Matrix2d> DER::computeAllBs() {
 double DER::computeStretchingEnergy() {
     double E_s = 0.0;
     for (int j = 0; j < num_edges; j++) {
-        E_s += 0.5 * k_Ss[j] * std::pow(edges[j].norm() - rest_lengths[j], 2);
+        E_s += 0.5 * k_Ss[j] * std::pow(cachedLength(j) - rest_lengths[j], 2);
     }
     return E_s;
 }
@@ -210,7 +412,7 @@ double DER::computeStretchingEnergy() {
 double DER::computeTwistingEnergy() {
     double E_t = 0.0;
     for (int i = 1; i < num_vertices - 1; ++i) {
-        double twist = computeTwist(i);
+        double twist = cachedTwist(i);
         E_t += 0.5 * betas[i] * std::pow(twist - rest_twists[i], 2)/voronoi_lengths[i];
     }
     return E_t;
@@ -219,20 +421,604 @@ double DER::computeTwistingEnergy() {
 double DER::computeBendingEnergy() {
     double E_b = 0.0;
     for (int i = 1; i < num_vertices - 1; ++i) { // endpoints have no bending energy
-        Eigen::Vector2d kappa = computeCurvature(i);
+        const Eigen::Vector2d& kappa = cachedCurvature(i);
         E_b += 0.5 * (kappa - rest_curvatures[i]).transpose() * Bs[i] * (kappa - rest_curvatures[i]);
     }
     return E_b;
 }
 
 double DER::computeTotalEnergy() {
+    CGC_TRACE_SCOPE("DER::computeTotalEnergy");
     return computeStretchingEnergy() + computeTwistingEnergy() + computeBendingEnergy();
 }
 
 std::vector<Eigen::Vector3d> DER::computeStretchingEnergyGradient() {
     std::vector<Eigen::Vector3d> grad(num_edges);
     for (int j = 0; j < num_edges; j++) {
-        grad[j] = k_Ss[j] * (edges[j].norm() - rest_lengths[j]) * edges[j].normalized();
+        grad[j] = k_Ss[j] * (cachedLength(j) - rest_lengths[j]) * tangents[j];
+    }
+    return grad;
+}
+
+std::vector<double> DER::computeAllMasses() {
+    // 各辺の質量を両端の頂点に半分ずつ配分する
+    std::vector<double> ret(num_vertices, 0.0);
+    for (int j = 0; j < num_edges; j++) {
+        double m = rho * PI * a[j] * b[j] * rest_lengths[j];
+        ret[j] += 0.5 * m;
+        ret[j + 1] += 0.5 * m;
+    }
+    return ret;
+}
+
+void DER::computeCurvatureGradient(int i, Eigen::Matrix<double, 2, 3>& dkappa_de_prev, Eigen::Matrix<double, 2, 3>& dkappa_de_next) {
+    // Bergou et al. 2008, derivatives of the material curvatures w.r.t. the adjacent edges
+    const Eigen::Vector3d& t_prev = tangents[i - 1];
+    const Eigen::Vector3d& t_next = tangents[i];
+    double chi = 1.0 + t_prev.dot(t_next);
+    Eigen::Vector3d tilde_t = (t_prev + t_next) / chi;
+    Eigen::Vector3d tilde_d1 = (mat_dir_1[i - 1] + mat_dir_1[i]) / chi;
+    Eigen::Vector3d tilde_d2 = (mat_dir_2[i - 1] + mat_dir_2[i]) / chi;
+    const Eigen::Vector2d& kappa = cachedCurvature(i);
+    double len_prev = cachedLength(i - 1);
+    double len_next = cachedLength(i);
+
+    dkappa_de_prev.row(0) = ((-kappa(0) * tilde_t + t_next.cross(tilde_d2)) / len_prev).transpose();
+    dkappa_de_prev.row(1) = ((-kappa(1) * tilde_t - t_next.cross(tilde_d1)) / len_prev).transpose();
+    dkappa_de_next.row(0) = ((-kappa(0) * tilde_t - t_prev.cross(tilde_d2)) / len_next).transpose();
+    dkappa_de_next.row(1) = ((-kappa(1) * tilde_t + t_prev.cross(tilde_d1)) / len_next).transpose();
+}
+
+std::vector<Eigen::Vector3d> DER::computeTwistingEnergyGradient() {
+    std::vector<Eigen::Vector3d> grad(num_vertices, Eigen::Vector3d::Zero());
+    for (int i = 1; i < num_vertices - 1; ++i) {
+        const Eigen::Vector3d& kb = cachedCurvatureBinormal(i);
+        double coeff = betas[i] * (cachedTwist(i) - rest_twists[i]) / voronoi_lengths[i];
+        // reference twist changes with the centerline: dm/de = kb / (2|e|)
+        Eigen::Vector3d dm_de_prev = kb / (2.0 * cachedLength(i - 1));
+        Eigen::Vector3d dm_de_next = kb / (2.0 * cachedLength(i));
+        grad[i - 1] -= coeff * dm_de_prev;
+        grad[i] += coeff * (dm_de_prev - dm_de_next);
+        grad[i + 1] += coeff * dm_de_next;
+    }
+    return grad;
+}
+
+std::vector<Eigen::Vector3d> DER::computeBendingEnergyGradient() {
+    std::vector<Eigen::Vector3d> grad(num_vertices, Eigen::Vector3d::Zero());
+    for (int i = 1; i < num_vertices - 1; ++i) {
+        Eigen::Matrix<double, 2, 3> dkappa_de_prev, dkappa_de_next;
+        computeCurvatureGradient(i, dkappa_de_prev, dkappa_de_next);
+        Eigen::Vector2d dE_dkappa = Bs[i] * (cachedCurvature(i) - rest_curvatures[i]);
+        Eigen::Vector3d dE_de_prev = dkappa_de_prev.transpose() * dE_dkappa;
+        Eigen::Vector3d dE_de_next = dkappa_de_next.transpose() * dE_dkappa;
+        grad[i - 1] -= dE_de_prev;
+        grad[i] += dE_de_prev - dE_de_next;
+        grad[i + 1] += dE_de_next;
+    }
+    return grad;
+}
+
+std::vector<double> DER::computeThetaGradient() {
+    CGC_TRACE_SCOPE("DER::computeThetaGradient");
+    std::vector<double> grad(num_edges, 0.0);
+    for (int i = 1; i < num_vertices - 1; ++i) {
+        // twist = theta_i - theta_{i-1} + reference twist
+        double dE_dm = betas[i] * (cachedTwist(i) - rest_twists[i]) / voronoi_lengths[i];
+        grad[i - 1] -= dE_dm;
+        grad[i] += dE_dm;
+
+        // dm1/dtheta = m2, dm2/dtheta = -m1
+        const Eigen::Vector3d& kb = cachedCurvatureBinormal(i);
+        Eigen::Vector2d dE_dkappa = Bs[i] * (cachedCurvature(i) - rest_curvatures[i]);
+        for (int j = i - 1; j <= i; ++j) {
+            Eigen::Vector2d dkappa_dtheta(-0.5 * kb.dot(mat_dir_1[j]), -0.5 * kb.dot(mat_dir_2[j]));
+            grad[j] += dE_dkappa.dot(dkappa_dtheta);
+        }
+    }
+    return grad;
+}
+
+std::vector<Eigen::Vector3d> DER::computeEnergyGradient() {
+    CGC_TRACE_SCOPE("DER::computeEnergyGradient");
+    std::vector<Eigen::Vector3d> grad = computeTwistingEnergyGradient();
+    std::vector<Eigen::Vector3d> grad_b = computeBendingEnergyGradient();
+    for (int i = 0; i < num_vertices; i++) {
+        grad[i] += grad_b[i];
+    }
+
+    // the stretching gradient is per edge, dE/de_j
+    std::vector<Eigen::Vector3d> grad_s = computeStretchingEnergyGradient();
+    for (int j = 0; j < num_edges; j++) {
+        grad[j] -= grad_s[j];
+        grad[j + 1] += grad_s[j];
     }
     return grad;
 }
+
+std::vector<Eigen::Vector3d> DER::computeForces() {
+    std::vector<Eigen::Vector3d> forces = computeEnergyGradient();
+    for (int i = 0; i < num_vertices; i++) {
+        forces[i] = masses[i] * gravity + external_forces[i] - forces[i];
+    }
+    return forces;
+}
+
+void DER::updateThetas() {
+    CGC_TRACE_SCOPE("DER::updateThetas");
+    // theta has negligible inertia, so it is relaxed to equilibrium with a few diagonal Newton steps
+    constexpr int max_iterations = 10;
+    constexpr double tolerance = 1e-10;
+
+    std::vector<double> hessian_diag(num_edges, 0.0);
+    for (int i = 1; i < num_vertices - 1; ++i) {
+        double k_t = betas[i] / voronoi_lengths[i];
+        double k_b = 0.25 * cachedCurvatureBinormal(i).squaredNorm() * Bs[i].diagonal().maxCoeff();
+        hessian_diag[i - 1] += k_t + k_b;
+        hessian_diag[i] += k_t + k_b;
+    }
+
+    for (int iter = 0; iter < max_iterations; iter++) {
+        std::vector<double> grad = computeThetaGradient();
+        double max_step = 0.0;
+        for (int j = root_clamped ? 1 : 0; j < num_edges; j++) {
+            if (hessian_diag[j] <= 0.0) continue;
+            double step = grad[j] / hessian_diag[j];
+            thetas[j] -= step;
+            max_step = std::max(max_step, std::abs(step));
+        }
+        updateMaterialFrame();
+        if (max_step < tolerance) break;
+    }
+}
+
+namespace {
+
+// A vertex and the edge after it only interact with the next two vertices and edges. With the dofs
+// interleaved as (x_i, theta_i) the Hessian is banded with this half bandwidth.
+constexpr int hessian_band = 4 * 2 + 2;
+
+double& bandEntry(std::vector<double>& band, int row, int col) {
+    return band[row * (hessian_band + 1) + (row - col)]; // lower triangle, row >= col
+}
+
+// in-place Cholesky of a banded SPD matrix, false if it is not positive definite
+bool bandedCholesky(std::vector<double>& band, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = std::max(0, i - hessian_band); j <= i; j++) {
+            double sum = bandEntry(band, i, j);
+            for (int k = std::max(0, i - hessian_band); k < j; k++) {
+                sum -= bandEntry(band, i, k) * bandEntry(band, j, k);
+            }
+            if (i == j) {
+                if (sum <= 0.0) return false;
+                bandEntry(band, i, i) = std::sqrt(sum);
+            } else {
+                bandEntry(band, i, j) = sum / bandEntry(band, j, j);
+            }
+        }
+    }
+    return true;
+}
+
+void bandedCholeskySolve(std::vector<double>& L, int n, Eigen::VectorXd& x) {
+    for (int i = 0; i < n; i++) {
+        double sum = x[i];
+        for (int k = std::max(0, i - hessian_band); k < i; k++) {
+            sum -= bandEntry(L, i, k) * x[k];
+        }
+        x[i] = sum / bandEntry(L, i, i);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double sum = x[i];
+        for (int k = i + 1; k <= std::min(n - 1, i + hessian_band); k++) {
+            sum -= bandEntry(L, k, i) * x[k];
+        }
+        x[i] = sum / bandEntry(L, i, i);
+    }
+}
+
+} // namespace
+
+DER::NewtonLayout DER::newtonLayout(int first) const {
+    NewtonLayout layout;
+    layout.vertex_dofs.assign(num_vertices, -1);
+    layout.theta_dofs.assign(num_edges, -1);
+    for (int i = 0; i < num_vertices; i++) {
+        if (i >= first) {
+            layout.vertex_dofs[i] = layout.dofs;
+            layout.dofs += 3;
+        }
+        if (i < num_edges && !(root_clamped && i == 0)) {
+            layout.theta_dofs[i] = layout.dofs;
+            layout.dofs += 1;
+        }
+    }
+    return layout;
+}
+
+Eigen::VectorXd DER::gatherNewtonDofs(const NewtonLayout& layout) const {
+    Eigen::VectorXd x(layout.dofs);
+    for (int i = 0; i < num_vertices; i++) {
+        if (layout.vertex_dofs[i] >= 0) x.segment<3>(layout.vertex_dofs[i]) = vertices[i];
+    }
+    for (int j = 0; j < num_edges; j++) {
+        if (layout.theta_dofs[j] >= 0) x[layout.theta_dofs[j]] = thetas[j];
+    }
+    return x;
+}
+
+void DER::moveToNewtonDofs(const Configuration& from, const NewtonLayout& layout, const Eigen::VectorXd& x) {
+    restoreConfiguration(from);
+    for (int i = 0; i < num_vertices; i++) {
+        if (layout.vertex_dofs[i] >= 0) vertices[i] = x.segment<3>(layout.vertex_dofs[i]);
+    }
+    for (int j = 0; j < num_edges; j++) {
+        if (layout.theta_dofs[j] >= 0) thetas[j] = x[layout.theta_dofs[j]];
+    }
+    updateEdges();
+    updateReferenceFrame();
+    clampRootTheta();
+    updateMaterialFrame();
+}
+
+DER::Configuration DER::saveConfiguration() const {
+    return Configuration{vertices, edges, tangents, ref_dir_1, ref_dir_2, mat_dir_1, mat_dir_2, thetas,
+                         cache_lengths, cache_twists, cache_binormals, cache_curvatures,
+                         length_valid, binormal_valid, curvature_valid, twist_valid};
+}
+
+void DER::restoreConfiguration(const Configuration& c) {
+    vertices = c.vertices;
+    edges = c.edges;
+    tangents = c.tangents;
+    ref_dir_1 = c.ref_dir_1;
+    ref_dir_2 = c.ref_dir_2;
+    mat_dir_1 = c.mat_dir_1;
+    mat_dir_2 = c.mat_dir_2;
+    thetas = c.thetas;
+    cache_lengths = c.cache_lengths;
+    cache_twists = c.cache_twists;
+    cache_binormals = c.cache_binormals;
+    cache_curvatures = c.cache_curvatures;
+    length_valid = c.length_valid;
+    binormal_valid = c.binormal_valid;
+    curvature_valid = c.curvature_valid;
+    twist_valid = c.twist_valid;
+}
+
+void DER::factorizeHessian(const NewtonLayout& layout, double inertia) {
+    CGC_TRACE_SCOPE("DER::factorizeHessian");
+    if (num_edges == 0) return; // newtonSolve does not get here without an edge
+    // Forward differences of the analytic gradients. Vertex i and theta i only influence the gradients
+    // within two vertices/edges, so every fifth of them is perturbed at once and the whole band costs
+    // 20 gradient evaluations regardless of the strand length.
+    std::vector<double> band(layout.dofs * (hessian_band + 1), 0.0);
+    Configuration base = saveConfiguration();
+    std::vector<Eigen::Vector3d> grad_x0 = computeEnergyGradient();
+    std::vector<double> grad_theta0 = computeThetaGradient();
+    double h_x = 1e-6 * *std::min_element(rest_lengths.begin(), rest_lengths.end());
+    constexpr double h_theta = 1e-6;
+
+    auto add = [&](int row, int col, double value) {
+        // symmetrized: both (row, col) and (col, row) are visited once
+        if (row == col) {
+            bandEntry(band, row, col) += value;
+        } else {
+            bandEntry(band, std::max(row, col), std::min(row, col)) += 0.5 * value;
+        }
+    };
+
+    for (int color = 0; color < 5; color++) {
+        for (int d = 0; d < 4; d++) {
+            restoreConfiguration(base);
+            double h = d < 3 ? h_x : h_theta;
+            for (int k = color; k < num_vertices; k += 5) {
+                if (d < 3 && layout.vertex_dofs[k] >= 0) vertices[k][d] += h;
+                if (d == 3 && k < num_edges && layout.theta_dofs[k] >= 0) thetas[k] += h;
+            }
+            updateEdges();
+            updateReferenceFrame();
+            clampRootTheta();
+            updateMaterialFrame();
+            std::vector<Eigen::Vector3d> grad_x = computeEnergyGradient();
+            std::vector<double> grad_theta = computeThetaGradient();
+
+            for (int k = color; k < num_vertices; k += 5) {
+                int col = d < 3 ? layout.vertex_dofs[k] + d : (k < num_edges ? layout.theta_dofs[k] : -1);
+                if ((d < 3 && layout.vertex_dofs[k] < 0) || col < 0) continue;
+                for (int i = std::max(0, k - 2); i <= std::min(num_vertices - 1, k + 2); i++) {
+                    if (layout.vertex_dofs[i] >= 0) {
+                        for (int e = 0; e < 3; e++) {
+                            add(layout.vertex_dofs[i] + e, col, (grad_x[i][e] - grad_x0[i][e]) / h);
+                        }
+                    }
+                    if (i < num_edges && layout.theta_dofs[i] >= 0) {
+                        add(layout.theta_dofs[i], col, (grad_theta[i] - grad_theta0[i]) / h);
+                    }
+                }
+            }
+        }
+    }
+    restoreConfiguration(base);
+
+    double max_diagonal = 0.0;
+    for (int i = 0; i < num_vertices; i++) {
+        for (int d = 0; d < 3 && layout.vertex_dofs[i] >= 0; d++) {
+            bandEntry(band, layout.vertex_dofs[i] + d, layout.vertex_dofs[i] + d) += inertia * masses[i];
+        }
+    }
+    for (int row = 0; row < layout.dofs; row++) {
+        max_diagonal = std::max(max_diagonal, bandEntry(band, row, row));
+    }
+
+    // bending is not convex, shift the diagonal until the Hessian is positive definite
+    double shift = 0.0;
+    newton_factor = band;
+    while (!bandedCholesky(newton_factor, layout.dofs)) {
+        shift = shift > 0.0 ? 10.0 * shift : 1e-8 * max_diagonal;
+        newton_factor = band;
+        for (int row = 0; row < layout.dofs; row++) {
+            bandEntry(newton_factor, row, row) += shift;
+        }
+    }
+    newton_factor_dofs = layout.dofs;
+}
+
+DER::NewtonStats DER::newtonSolve(const std::vector<Eigen::Vector3d>& inertial_target, double dt, int first, const NewtonSettings& settings) {
+    CGC_TRACE_SCOPE("DER::newtonSolve");
+    // minimizes  E(x, theta) - f.x + 1/(2 dt^2) |x - inertial_target|_M^2  over the free vertices and thetas
+    NewtonStats stats;
+    NewtonLayout layout = newtonLayout(first);
+    if (layout.dofs == 0 || num_edges == 0) { // nothing free, or a lone vertex without energy or mass
+        stats.converged = true;
+        return stats;
+    }
+    double inertia = dt > 0.0 ? 1.0 / (dt * dt) : 0.0;
+    double min_length = *std::min_element(rest_lengths.begin(), rest_lengths.end());
+
+    double force_scale = 0.0;
+    std::vector<Eigen::Vector3d> applied(num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        applied[i] = masses[i] * gravity + external_forces[i];
+        force_scale = std::max(force_scale, applied[i].norm());
+    }
+
+    // forces and torques / steps in positions and angles are compared through the shortest edge
+    std::vector<double> length_scale(layout.dofs, 1.0);
+    for (int j = 0; j < num_edges; j++) {
+        if (layout.theta_dofs[j] >= 0) length_scale[layout.theta_dofs[j]] = min_length;
+    }
+    auto residualOf = [&](const Eigen::VectorXd& g) {
+        double r = 0.0;
+        for (int k = 0; k < layout.dofs; k++) r = std::max(r, std::abs(g[k]) / length_scale[k]);
+        return r;
+    };
+    auto stepOf = [&](const Eigen::VectorXd& p) {
+        double r = 0.0;
+        for (int k = 0; k < layout.dofs; k++) r = std::max(r, std::abs(p[k]) * length_scale[k] / min_length);
+        return r;
+    };
+
+    auto objective = [&]() {
+        double phi = computeTotalEnergy();
+        for (int i = first; i < num_vertices; i++) {
+            phi += 0.5 * inertia * masses[i] * (vertices[i] - inertial_target[i]).squaredNorm() - applied[i].dot(vertices[i]);
+        }
+        return phi;
+    };
+    auto gradient = [&]() {
+        std::vector<Eigen::Vector3d> grad_x = computeEnergyGradient();
+        std::vector<double> grad_theta = computeThetaGradient();
+        Eigen::VectorXd g(layout.dofs);
+        for (int i = first; i < num_vertices; i++) {
+            g.segment<3>(layout.vertex_dofs[i]) = grad_x[i] + inertia * masses[i] * (vertices[i] - inertial_target[i]) - applied[i];
+        }
+        for (int j = 0; j < num_edges; j++) {
+            if (layout.theta_dofs[j] >= 0) g[layout.theta_dofs[j]] = grad_theta[j];
+        }
+        return g;
+    };
+
+    // Every iteration is linearized around the last accepted iterate and trial configurations
+    // are transported from it, which is what the analytic gradients assume.
+    Configuration accepted = saveConfiguration();
+    Eigen::VectorXd x = gatherNewtonDofs(layout);
+    double phi = objective();
+    Eigen::VectorXd g = gradient();
+    double residual = residualOf(g);
+    stats.residuals.push_back(residual);
+    double scale = std::max(force_scale, residual);
+    if (scale == 0.0) scale = 1.0;
+
+    // the factor of the previous solve is a good preconditioner when the step size did not change
+    bool fresh = false;
+    if (!(settings.warm_start && newton_factor_dofs == layout.dofs && newton_factor_dt == dt)) {
+        factorizeHessian(layout, inertia);
+        newton_factor_dt = dt;
+        stats.factorizations++;
+        fresh = true;
+    }
+    std::vector<Eigen::VectorXd> s_history, y_history; // L-BFGS pairs on top of the factorized Hessian
+
+    while (stats.iterations < settings.max_iterations) {
+        if (residual <= settings.tolerance * scale) {
+            stats.converged = true;
+            break;
+        }
+
+        // two-loop recursion with the factorized Hessian as the initial inverse
+        Eigen::VectorXd q = g;
+        int m = static_cast<int>(s_history.size());
+        std::vector<double> alphas(m);
+        for (int k = m - 1; k >= 0; k--) {
+            alphas[k] = s_history[k].dot(q) / y_history[k].dot(s_history[k]);
+            q -= alphas[k] * y_history[k];
+        }
+        bandedCholeskySolve(newton_factor, layout.dofs, q);
+        for (int k = 0; k < m; k++) {
+            double beta = y_history[k].dot(q) / y_history[k].dot(s_history[k]);
+            q += (alphas[k] - beta) * s_history[k];
+        }
+        Eigen::VectorXd direction = -q;
+        double slope = g.dot(direction);
+        if (fresh && stepOf(direction) <= settings.tolerance) {
+            // the Newton step is negligible, the residual is at the precision of the energy
+            stats.converged = true;
+            break;
+        }
+
+        // backtracking (Armijo) line search
+        double alpha = 1.0;
+        bool found = false;
+        if (slope < 0.0) {
+            for (int ls = 0; ls < settings.max_line_search; ls++, alpha *= 0.5) {
+                moveToNewtonDofs(accepted, layout, x + alpha * direction);
+                stats.energy_evaluations++;
+                double phi_trial = objective();
+                if (phi_trial <= phi + 1e-4 * alpha * slope) {
+                    phi = phi_trial;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        if (!found) {
+            restoreConfiguration(accepted);
+            if (fresh) break; // no descent even with the exact Hessian, give up
+            factorizeHessian(layout, inertia);
+            stats.factorizations++;
+            fresh = true;
+            s_history.clear();
+            y_history.clear();
+            continue;
+        }
+
+        Eigen::VectorXd g_new = gradient();
+        Eigen::VectorXd s = alpha * direction;
+        Eigen::VectorXd y = g_new - g;
+        x += s;
+        g = g_new;
+        accepted = saveConfiguration();
+        residual = residualOf(g);
+        stats.residuals.push_back(residual);
+        stats.iterations++;
+
+        // refresh the Hessian when the old one stops predicting full steps or has been reused enough
+        if (alpha < 1.0 || static_cast<int>(s_history.size()) >= settings.hessian_reuse) {
+            factorizeHessian(layout, inertia);
+            stats.factorizations++;
+            fresh = true;
+            s_history.clear();
+            y_history.clear();
+        } else {
+            fresh = false;
+            if (s.dot(y) > 1e-12 * s.norm() * y.norm()) {
+                s_history.push_back(s);
+                y_history.push_back(y);
+            }
+        }
+    }
+    if (residual <= settings.tolerance * scale) {
+        stats.converged = true;
+    }
+    return stats;
+}
+
+DER::NewtonStats DER::solveStatic() {
+    return solveStatic(NewtonSettings());
+}
+
+DER::NewtonStats DER::solveStatic(const NewtonSettings& settings) {
+    CGC_TRACE_SCOPE("DER::solveStatic");
+    if (root_clamped) {
+        for (int i = 0; i < std::min(2, num_vertices); i++) {
+            vertices[i] = root_rotation * rest_root_vertices[i] + root_translation;
+        }
+        updateEdges();
+        updateReferenceFrame();
+        clampRootTheta();
+        updateMaterialFrame();
+        updateThetas();
+    }
+
+    // Pseudo-transient continuation: backward Euler steps that restart from rest with a growing step.
+    // The mass term keeps every solve well conditioned although bending is not convex, and once the
+    // steps are long each solve is a plain Newton method on the static problem.
+    double force_scale = 0.0;
+    for (int i = 0; i < num_vertices; i++) {
+        force_scale = std::max(force_scale, (masses[i] * gravity + external_forces[i]).norm());
+    }
+    if (force_scale == 0.0) force_scale = 1.0;
+    double h = std::isfinite(stiffness_timestep) ? 100.0 * stiffness_timestep : 1e-2;
+
+    newton_stats = NewtonStats();
+    for (int step = 0; step < settings.max_iterations; step++) {
+        std::vector<Eigen::Vector3d> start = vertices;
+        NewtonStats stats = newtonSolve(start, h, 2, settings);
+        newton_stats.iterations += stats.iterations;
+        newton_stats.factorizations += stats.factorizations;
+        newton_stats.energy_evaluations += stats.energy_evaluations;
+
+        // what is left of the static residual is the inertial force of the step
+        double residual = 0.0;
+        for (int i = 2; i < num_vertices; i++) {
+            residual = std::max(residual, masses[i] * (vertices[i] - start[i]).norm() / (h * h));
+        }
+        newton_stats.residuals.push_back(residual);
+        if (stats.converged && residual <= settings.tolerance * force_scale) {
+            newton_stats.converged = true;
+            break;
+        }
+        h = stats.converged ? 4.0 * h : 0.25 * h;
+    }
+
+    for (Eigen::Vector3d& v : velocities) {
+        v.setZero();
+    }
+    for (Eigen::Vector3d& f : external_forces) {
+        f.setZero();
+    }
+    return newton_stats;
+}
+
+DER::NewtonStats DER::updateImplicit(double dt) {
+    return updateImplicit(dt, NewtonSettings());
+}
+
+DER::NewtonStats DER::updateImplicit(double dt, const NewtonSettings& settings) {
+    CGC_TRACE_SCOPE("DER::updateImplicit");
+    if (num_edges == 0) { // a lone vertex has no mass to move
+        newton_stats = NewtonStats();
+        newton_stats.converged = true;
+        return newton_stats;
+    }
+    std::vector<Eigen::Vector3d> previous = vertices;
+    std::vector<Eigen::Vector3d> inertial_target(num_vertices);
+    for (int i = 0; i < num_vertices; i++) {
+        inertial_target[i] = vertices[i] + dt * velocities[i];
+        vertices[i] = inertial_target[i];
+    }
+    if (root_clamped) {
+        // 根元は外部から与えられた変換に従う
+        for (int i = 0; i < 2; i++) {
+            vertices[i] = root_rotation * rest_root_vertices[i] + root_translation;
+        }
+    }
+    updateEdges();
+    updateReferenceFrame();
+    clampRootTheta();
+    updateMaterialFrame();
+    updateThetas();
+
+    newton_stats = newtonSolve(inertial_target, dt, root_clamped ? 2 : 0, settings);
+    for (int i = 0; i < num_vertices; i++) {
+        velocities[i] = (vertices[i] - previous[i]) / dt;
+        external_forces[i].setZero();
+    }
+    return newton_stats;
+}
+
+const DER::NewtonStats& DER::getNewtonStats() const {
+    return newton_stats;
+}
@@ -0,0 +1,374 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+constexpr float unknown = std::numeric_limits<float>::quiet_NaN();
+constexpr size_t max_pending = 64; // GPU queries in flight, further GPU scopes are skipped
+
+// 3x5 pixel font for the overlay, rows from the top
+const char* const glyph_chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/%_()";
+const char* const glyphs[] = {
+    "####.##.##.####", ".#.##..#..#.###", "###..#####..###", "###..####..####", "#.##.####..#..#",
+    "####..###..####", "####..####.####", "###..#..#..#..#", "####.#####.####", "####.####..####",
+    ".#.#.#####.##.#", "##.#.###.#.###.", ".###..#..#...##", "##.#.##.##.###.", "####..##.#..###",
+    "####..##.#..#..", ".###..#.##.#.##", "#.##.#####.##.#", "###.#..#..#.###", "..#..#..##.#.#.",
+    "#.##.###.#.##.#", "#..#..#..#..###", "#.########.##.#", "##.#.##.##.##.#", ".#.#.##.##.#.#.",
+    "##.#.###.#..#..", ".#.#.##.###..##", "##.#.###.#.##.#", ".###...#...###.", "###.#..#..#..#.",
+    "#.##.##.##.####", "#.##.##.##.#.#.", "#.##.########.#", "#.##.#.#.#.##.#", "#.##.#.#..#..#.",
+    "###..#.#.#..###", ".............#.", "....#.....#....", "......###......", "..#..#.#.#..#..",
+    "#....#.#.#....#", "............###", ".#.#..#..#...#.", ".#...#..#..#.#.",
+};
+
+const float palette[][4] = {
+    {0.35f, 0.65f, 1.0f, 0.9f}, {1.0f, 0.6f, 0.2f, 0.9f}, {0.4f, 0.85f, 0.4f, 0.9f}, {0.95f, 0.35f, 0.4f, 0.9f},
+    {0.75f, 0.5f, 1.0f, 0.9f}, {0.95f, 0.85f, 0.3f, 0.9f}, {0.3f, 0.85f, 0.85f, 0.9f}, {1.0f, 0.5f, 0.8f, 0.9f},
+};
+
+std::string jsonNumber(float value) {
+    if (std::isnan(value)) return "null";
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.4f", value);
+    return buffer;
+}
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+FrameProfiler::CPUScope::CPUScope(FrameProfiler& profiler, const char* name)
+    : profiler(profiler), section(profiler.findSection(name, CPU)), start(std::chrono::steady_clock::now()) {}
+
+FrameProfiler::CPUScope::~CPUScope() {
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    profiler.add(section, profiler.frame, ms);
+}
+
+FrameProfiler::GPUScope::GPUScope(FrameProfiler& profiler, const char* name)
+    : profiler(profiler), section(profiler.findSection(name, GPU)) {
+    if (profiler.pending.size() >= max_pending) return;
+    if (profiler.free_queries.empty()) {
+        glGenQueries(1, &query);
+    } else {
+        query = profiler.free_queries.back();
+        profiler.free_queries.pop_back();
+    }
+    // unknown until the result arrives, rather than 0
+    Section& s = profiler.sections[section];
+    s.ms[profiler.frame % profiler.history] = unknown;
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+FrameProfiler::GPUScope::~GPUScope() {
+    if (!query) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    profiler.pending.push_back({query, section, profiler.frame});
+}
+
+FrameProfiler::FrameProfiler(unsigned int history) : history(std::max(history, 1u)), frame_ms(this->history, 0.0f) {}
+
+FrameProfiler::~FrameProfiler() {
+    for (const PendingQuery& p : pending) glDeleteQueries(1, &p.query);
+    if (!free_queries.empty()) glDeleteQueries(static_cast<GLsizei>(free_queries.size()), free_queries.data());
+}
+
+void FrameProfiler::BeginFrame() {
+    size_t slot = frame % history;
+    for (Section& s : sections) s.ms[slot] = 0.0f;
+    frame_start = std::chrono::steady_clock::now();
+    in_frame = true;
+}
+
+void FrameProfiler::EndFrame() {
+    if (!in_frame) return;
+    in_frame = false;
+    frame_ms[frame % history] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+    frame++;
+
+    // results come in a frame or two late, the slot of their frame gets them if it is still kept
+    size_t kept = 0;
+    for (const PendingQuery& p : pending) {
+        GLint available = 0;
+        glGetQueryObjectiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            pending[kept++] = p;
+            continue;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &ns);
+        add(p.section, p.frame, static_cast<float>(ns * 1e-6));
+        free_queries.push_back(p.query);
+    }
+    pending.resize(kept);
+}
+
+int FrameProfiler::findSection(const char* name, Clock clock) {
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i].clock == clock && sections[i].name == name) return static_cast<int>(i);
+    }
+    // a new section took no time in the frames before it
+    sections.push_back({name, clock, std::vector<float>(history, 0.0f)});
+    return static_cast<int>(sections.size()) - 1;
+}
+
+void FrameProfiler::add(int section, uint64_t at, float ms) {
+    if (frame - at >= history) return; // too old to be kept
+    float& value = sections[section].ms[at % history];
+    value = std::isnan(value) ? ms : value + ms;
+}
+
+int FrameProfiler::sectionCount() const {
+    return static_cast<int>(sections.size());
+}
+
+const std::string& FrameProfiler::sectionName(int section) const {
+    return sections[section].name;
+}
+
+FrameProfiler::Clock FrameProfiler::sectionClock(int section) const {
+    return sections[section].clock;
+}
+
+uint64_t FrameProfiler::frameCount() const {
+    return frame;
+}
+
+unsigned int FrameProfiler::historySize() const {
+    return history;
+}
+
+float FrameProfiler::frameMs(unsigned int age) const {
+    if (age >= std::min<uint64_t>(frame, history)) return unknown;
+    return frame_ms[(frame - 1 - age) % history];
+}
+
+float FrameProfiler::sectionMs(int section, unsigned int age) const {
+    if (age >= std::min<uint64_t>(frame, history)) return unknown;
+    return sections[section].ms[(frame - 1 - age) % history];
+}
+
+FrameProfiler::Stats FrameProfiler::stats(const std::vector<float>& ring) const {
+    std::vector<float> values;
+    unsigned int kept = static_cast<unsigned int>(std::min<uint64_t>(frame, history));
+    for (unsigned int age = 0; age < kept; age++) {
+        float ms = ring[(frame - 1 - age) % history];
+        if (!std::isnan(ms)) values.push_back(ms);
+    }
+    Stats result;
+    if (values.empty()) return result;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (float ms : values) sum += ms;
+    result.mean = static_cast<float>(sum / values.size());
+    result.min = values.front();
+    result.max = values.back();
+    result.p95 = values[static_cast<size_t>(std::ceil(0.95 * values.size())) - 1];
+    result.frames = static_cast<unsigned int>(values.size());
+    return result;
+}
+
+FrameProfiler::Stats FrameProfiler::frameStats() const {
+    return stats(frame_ms);
+}
+
+FrameProfiler::Stats FrameProfiler::sectionStats(int section) const {
+    return stats(sections[section].ms);
+}
+
+std::vector<unsigned int> FrameProfiler::histogram(int section, int bins, float max_ms) const {
+    std::vector<unsigned int> counts(std::max(bins, 1), 0);
+    unsigned int kept = static_cast<unsigned int>(std::min<uint64_t>(frame, history));
+    for (unsigned int age = 0; age < kept; age++) {
+        float ms = sectionMs(section, age);
+        if (std::isnan(ms)) continue;
+        int bin = static_cast<int>(std::max(ms, 0.0f) / max_ms * counts.size());
+        counts[std::min(bin, static_cast<int>(counts.size()) - 1)]++;
+    }
+    return counts;
+}
+
+bool FrameProfiler::SaveCSV(const std::string& filename, std::string* err) const {
+    std::ofstream file(filename);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    file << "frame,frame_ms";
+    for (const Section& s : sections) file << "," << s.name << (s.clock == CPU ? "_cpu_ms" : "_gpu_ms");
+    file << "\n";
+    unsigned int kept = static_cast<unsigned int>(std::min<uint64_t>(frame, history));
+    for (unsigned int age = kept; age-- > 0;) {
+        file << frame - 1 - age << "," << frameMs(age);
+        for (int s = 0; s < sectionCount(); s++) {
+            file << ",";
+            float ms = sectionMs(s, age);
+            if (!std::isnan(ms)) file << ms;
+        }
+        file << "\n";
+    }
+    if (!file) {
+        if (err) *err = "Error writing profile";
+        return false;
+    }
+    return true;
+}
+
+bool FrameProfiler::SaveJSON(const std::string& filename, std::string* err) const {
+    std::ofstream file(filename);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    unsigned int kept = static_cast<unsigned int>(std::min<uint64_t>(frame, history));
+    auto write = [&](const Stats& st, const std::vector<float>& ring) {
+        file << "\"mean_ms\": " << jsonNumber(st.mean) << ", \"min_ms\": " << jsonNumber(st.min) << ", \"max_ms\": " << jsonNumber(st.max)
+             << ", \"p95_ms\": " << jsonNumber(st.p95) << ", \"ms\": [";
+        for (unsigned int age = kept; age-- > 0;) {
+            file << jsonNumber(ring[(frame - 1 - age) % history]) << (age > 0 ? ", " : "");
+        }
+        file << "]";
+    };
+    file << "{\n  \"first_frame\": " << frame - kept << ",\n  \"frames\": " << kept << ",\n  \"frame\": {";
+    write(frameStats(), frame_ms);
+    file << "},\n  \"sections\": [";
+    for (int s = 0; s < sectionCount(); s++) {
+        file << (s > 0 ? ",\n    {" : "\n    {") << "\"name\": " << jsonString(sections[s].name)
+             << ", \"clock\": \"" << (sections[s].clock == CPU ? "cpu" : "gpu") << "\", ";
+        write(sectionStats(s), sections[s].ms);
+        file << "}";
+    }
+    file << "\n  ]\n}\n";
+    if (!file) {
+        if (err) *err = "Error writing profile";
+        return false;
+    }
+    return true;
+}
+
+ProfilerOverlay::~ProfilerOverlay() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void ProfilerOverlay::rect(float x, float y, float w, float h, const float color[4]) {
+    const float corners[6][2] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y}, {x + w, y + h}, {x, y + h}};
+    for (const auto& c : corners) {
+        vertices.insert(vertices.end(), {c[0], c[1]});
+        vertices.insert(vertices.end(), color, color + 4);
+    }
+}
+
+// 2 pixels per font pixel, 8 per character, y is the bottom of the line
+void ProfilerOverlay::text(float x, float y, const std::string& s, const float color[4]) {
+    for (char c : s) {
+        const char* found = std::strchr(glyph_chars, std::toupper(static_cast<unsigned char>(c)));
+        if (c != ' ' && found && *found) {
+            const char* glyph = glyphs[found - glyph_chars];
+            for (int i = 0; glyph[i]; i++) {
+                if (glyph[i] == '#') rect(x + 2.0f * (i % 3), y + 2.0f * (4 - i / 3), 2.0f, 2.0f, color);
+            }
+        }
+        x += 8.0f;
+    }
+}
+
+void ProfilerOverlay::Draw(const FrameProfiler& profiler, Shader& shader, int width, int height) {
+    const float scale = 3.0f; // pixels per millisecond
+    const float graph_ms = 40.0f, gpu_ms = 15.0f;
+    const int bars = std::min<int>(200, profiler.historySize()), bins = 20;
+    const float x0 = 15.0f, y0 = 15.0f, graph_width = 2.0f * bars;
+    const float base = y0 + gpu_ms * scale + 2.0f; // CPU above, GPU below
+    const float row = 14.0f, label_width = 26 * 8.0f;
+    const float white[4] = {1.0f, 1.0f, 1.0f, 0.9f}, gray[4] = {0.55f, 0.55f, 0.55f, 0.8f};
+    const float panel[4] = {0.0f, 0.0f, 0.0f, 0.6f}, fps60[4] = {0.3f, 0.9f, 0.3f, 0.6f}, fps30[4] = {0.9f, 0.8f, 0.2f, 0.6f};
+    int sections = profiler.sectionCount();
+    float graph_height = base + graph_ms * scale - y0, rows_height = (sections + 2) * row;
+    float panel_height = std::max(graph_height, rows_height);
+    vertices.clear();
+    rect(x0 - 6.0f, y0 - 6.0f, graph_width + 20.0f + label_width + 3.0f * bins + 12.0f, panel_height + 12.0f, panel);
+
+    unsigned int kept = static_cast<unsigned int>(std::min<uint64_t>(profiler.frameCount(), profiler.historySize()));
+    for (unsigned int age = 0; age < std::min<unsigned int>(kept, bars); age++) {
+        float x = x0 + 2.0f * (bars - 1 - age);
+        rect(x, base, 2.0f, std::min(profiler.frameMs(age), graph_ms) * scale, gray);
+        float cpu = base, gpu = base - 2.0f;
+        for (int s = 0; s < sections; s++) {
+            float ms = profiler.sectionMs(s, age);
+            if (std::isnan(ms) || ms <= 0.0f) continue;
+            if (profiler.sectionClock(s) == FrameProfiler::CPU) {
+                float h = std::min(ms * scale, base + graph_ms * scale - cpu);
+                rect(x, cpu, 2.0f, h, palette[s % 8]);
+                cpu += h;
+            } else {
+                float h = std::min(ms * scale, gpu - y0);
+                rect(x, gpu - h, 2.0f, h, palette[s % 8]);
+                gpu -= h;
+            }
+        }
+    }
+    rect(x0, base + 1000.0f / 60.0f * scale, graph_width, 1.0f, fps60);
+    rect(x0, base + 1000.0f / 30.0f * scale, graph_width, 1.0f, fps30);
+
+    // a row per section: name, mean and p95 in ms, histogram over [0, graph_ms]
+    float x = x0 + graph_width + 14.0f, y = y0 + panel_height - row;
+    auto line = [&](const std::string& name, const FrameProfiler::Stats& st, const std::vector<unsigned int>& counts, const float color[4]) {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%-13.13s%6.2f%6.2f", name.c_str(), st.mean, st.p95);
+        text(x, y, buffer, color);
+        unsigned int most = std::max(1u, *std::max_element(counts.begin(), counts.end()));
+        for (int b = 0; b < bins; b++) {
+            if (counts[b]) rect(x + label_width + 3.0f * b, y, 2.0f, std::max(1.0f, 10.0f * counts[b] / most), color);
+        }
+        y -= row;
+    };
+    text(x, y, "MS             MEAN   P95", white);
+    y -= row;
+    std::vector<unsigned int> frame_counts(bins, 0);
+    for (unsigned int age = 0; age < kept; age++) {
+        frame_counts[std::min(static_cast<int>(profiler.frameMs(age) / graph_ms * bins), bins - 1)]++;
+    }
+    line("frame", profiler.frameStats(), frame_counts, white);
+    for (int s = 0; s < sections; s++) {
+        std::string name = (profiler.sectionClock(s) == FrameProfiler::GPU ? "gpu " : "") + profiler.sectionName(s);
+        line(name, profiler.sectionStats(s), profiler.histogram(s, bins, graph_ms), palette[s % 8]);
+    }
+
+    if (!VAO) {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+    }
+    GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    shader.use();
+    shader.setMat4("projection", glm::ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height)));
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / 6));
+    glBindVertexArray(0);
+    if (depth_test) glEnable(GL_DEPTH_TEST);
+}
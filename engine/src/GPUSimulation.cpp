@@ -0,0 +1,133 @@
+#include "GPUSimulation.h"
+#include <algorithm>
+
+namespace {
+
+GLuint createBuffer(GLsizeiptr size, const void* data) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+constexpr int work_group_size = 64; // local_size_x of der_compute.glsl
+constexpr int max_substeps_per_dispatch = 32; // keeps single dispatches short for the driver watchdog
+
+} // namespace
+
+GPUSimulation::GPUSimulation(const HairModel& model, const HairSimulation::Parameters& params, const char* computePath, GLuint position_buffer)
+    : params(params), shader(computePath), num_strands(static_cast<int>(model.hair_count)) {
+    std::vector<GLint> strand_offsets(num_strands + 1, 0);
+    for (int s = 0; s < num_strands; s++) {
+        unsigned int segments = !model.segments.empty() ? model.segments[s] : model.d_segments;
+        strand_offsets[s + 1] = strand_offsets[s] + static_cast<GLint>(segments) + 1;
+    }
+    num_vertices = strand_offsets.back();
+    int num_edges = num_vertices - num_strands;
+
+    if (position_buffer == 0) {
+        positions = createBuffer(num_vertices * 3 * sizeof(float), model.points.data());
+        owns_positions = true;
+    } else {
+        positions = position_buffer;
+    }
+    velocities = createBuffer(num_vertices * 4 * sizeof(float), nullptr);
+    offsets = createBuffer(strand_offsets.size() * sizeof(GLint), strand_offsets.data());
+    vertex_data = createBuffer(num_vertices * 8 * sizeof(float), nullptr);
+    edge_data = createBuffer(std::max(num_edges, 1) * 8 * sizeof(float), nullptr);
+    scratch = createBuffer(num_vertices * 8 * sizeof(float), nullptr);
+    roots = createBuffer(num_strands * 12 * sizeof(float), nullptr);
+    std::vector<glm::mat4> identity(num_strands, glm::mat4(1.0f));
+    root_transforms = createBuffer(num_strands * sizeof(glm::mat4), identity.data());
+
+    // rest state and reference frames from the loaded positions
+    dispatch(0, 0.0f, 0);
+}
+
+GPUSimulation::~GPUSimulation() {
+    if (owns_positions) glDeleteBuffers(1, &positions);
+    glDeleteBuffers(1, &velocities);
+    glDeleteBuffers(1, &offsets);
+    glDeleteBuffers(1, &vertex_data);
+    glDeleteBuffers(1, &edge_data);
+    glDeleteBuffers(1, &scratch);
+    glDeleteBuffers(1, &roots);
+    glDeleteBuffers(1, &root_transforms);
+}
+
+void GPUSimulation::bindBuffers() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocities);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, offsets);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, vertex_data);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, edge_data);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, scratch);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, roots);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, root_transforms);
+}
+
+void GPUSimulation::dispatch(int stage, float dt, int substeps) {
+    shader.use();
+    bindBuffers();
+    shader.setInt("stage", stage);
+    shader.setInt("strand_count", num_strands);
+    shader.setFloat("E", static_cast<float>(params.E));
+    shader.setFloat("G", static_cast<float>(params.G));
+    shader.setFloat("radius", static_cast<float>(params.radius));
+    shader.setFloat("rho", static_cast<float>(params.rho));
+    shader.setVec3("gravity", glm::vec3(params.gravity.x(), params.gravity.y(), params.gravity.z()));
+    shader.setFloat("dt", dt);
+    shader.setBool("root_clamped", root_clamped);
+    shader.setInt("substeps", substeps);
+    shader.dispatch((num_strands + work_group_size - 1) / work_group_size);
+    // the next dispatch and the renderer read what this one wrote
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GPUSimulation::update(double dt) {
+    float h = static_cast<float>(dt / params.substeps);
+    for (int done = 0; done < params.substeps; done += max_substeps_per_dispatch) {
+        dispatch(1, h, std::min(max_substeps_per_dispatch, params.substeps - done));
+    }
+}
+
+int GPUSimulation::strandCount() const {
+    return num_strands;
+}
+
+GLuint GPUSimulation::getPositionBuffer() const {
+    return positions;
+}
+
+std::vector<Eigen::Vector3d> GPUSimulation::getPositions() const {
+    std::vector<float> data(num_vertices * 3);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, positions);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(float), data.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    std::vector<Eigen::Vector3d> ret(num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        ret[v] = Eigen::Vector3d(data[3 * v], data[3 * v + 1], data[3 * v + 2]);
+    }
+    return ret;
+}
+
+void GPUSimulation::setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations) {
+    std::vector<glm::mat4> transforms(num_strands);
+    for (int s = 0; s < num_strands; s++) {
+        glm::mat4& m = transforms[s];
+        for (int c = 0; c < 3; c++) {
+            for (int r = 0; r < 3; r++) {
+                m[c][r] = static_cast<float>(rotations[s](r, c));
+            }
+            m[3][c] = static_cast<float>(translations[s][c]);
+        }
+        m[0][3] = m[1][3] = m[2][3] = 0.0f;
+        m[3][3] = 1.0f;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, root_transforms);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    root_clamped = true;
+}
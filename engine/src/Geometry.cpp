@@ -0,0 +1,74 @@
+#include "Geometry.h"
+
+// Ericson, Real-Time Collision Detection 5.1.5
+Eigen::Vector3d closestPointOnTriangle(const Eigen::Vector3d& p, const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c, TriangleFeature& feature) {
+    Eigen::Vector3d ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0.0 && d2 <= 0.0) { feature = VERTEX_A; return a; }
+
+    Eigen::Vector3d bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0.0 && d4 <= d3) { feature = VERTEX_B; return b; }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        feature = EDGE_AB;
+        return a + d1 / (d1 - d3) * ab;
+    }
+
+    Eigen::Vector3d cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0.0 && d5 <= d6) { feature = VERTEX_C; return c; }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        feature = EDGE_CA;
+        return a + d2 / (d2 - d6) * ac;
+    }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        feature = EDGE_BC;
+        return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+    }
+
+    feature = FACE;
+    double denom = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+Eigen::Vector3d barycentric(const Eigen::Vector3d& p, const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c) {
+    Eigen::Vector3d v0 = b - a, v1 = c - a, v2 = p - a;
+    double d00 = v0.dot(v0), d01 = v0.dot(v1), d11 = v1.dot(v1);
+    double d20 = v2.dot(v0), d21 = v2.dot(v1);
+    double denom = d00 * d11 - d01 * d01;
+    if (denom == 0.0) {
+        return Eigen::Vector3d(1.0, 0.0, 0.0);
+    }
+    double v = (d11 * d20 - d01 * d21) / denom;
+    double w = (d00 * d21 - d01 * d20) / denom;
+    return Eigen::Vector3d(1.0 - v - w, v, w);
+}
+
+Eigen::Vector3d parallelTransport(const Eigen::Vector3d& v, const Eigen::Vector3d& t0, const Eigen::Vector3d& t1) {
+    Eigen::Vector3d b = t0.cross(t1);
+    double c = t0.dot(t1);
+    if (1.0 + c < 1e-12) {
+        // antiparallel, the rotation axis is not unique: half turn about any axis perpendicular to t0
+        Eigen::Vector3d n = t0.cross(std::abs(t0.x()) < 0.9 ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY()).normalized();
+        return 2.0 * n.dot(v) * n - v;
+    }
+    // R v = c v + b x v + (b.v) / (1 + c) b with |b| = sin, c = cos
+    return c * v + b.cross(v) + (b.dot(v) / (1.0 + c)) * b;
+}
+
+void parallelTransport(const std::vector<Eigen::Vector3d>& from, const std::vector<Eigen::Vector3d>& to, std::vector<Eigen::Vector3d>& d1, std::vector<Eigen::Vector3d>& d2) {
+    for (size_t i = 0; i < from.size(); i++) {
+        if (from[i] == to[i]) continue;
+        Eigen::Vector3d u = parallelTransport(d1[i], from[i], to[i]);
+        u -= u.dot(to[i]) * to[i];
+        // the rotation keeps |u| = 1 up to rounding, one Newton step on 1/sqrt(|u|^2) restores it without a sqrt
+        d1[i] = (1.5 - 0.5 * u.squaredNorm()) * u;
+        d2[i] = to[i].cross(d1[i]);
+    }
+}
@@ -0,0 +1,379 @@
+#include "GroomAnimation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t animation_version = 1;
+constexpr uint64_t alignment = 64; // of every array and frame
+
+// Layout: AnimationHeader, the segments, thickness, transparency and colors arrays present in `arrays`,
+// the frames, then frame_count FrameEntry; everything starts at a multiple of `alignment`.
+struct AnimationHeader {
+    char signature[4] = {'C', 'G', 'C', 'A'};
+    uint32_t version = animation_version;
+    uint32_t hair_count = 0;
+    uint32_t point_count = 0;
+    uint32_t arrays = 0;
+    uint32_t d_segments = 0;
+    float d_thickness = 1.0f;
+    float d_transparency = 0.0f;
+    float d_color[3] = {1.0f, 1.0f, 1.0f};
+    float frame_rate = 0.0f;
+    float step = 0.0f; // quantization step of delta frames
+    uint32_t frame_count = 0; // written by Close
+    uint64_t frame_table = 0; // written by Close
+};
+
+uint64_t alignUp(uint64_t offset) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// shared by the writer and the reader so that both reconstruct bit-identical positions
+void applyDelta(float* state, const int16_t* delta, size_t n, float step, float* out) {
+    for (size_t i = 0; i < n; i++) {
+        state[i] += static_cast<float>(delta[i]) * step;
+    }
+    if (out) std::memcpy(out, state, n * sizeof(float));
+}
+
+struct AttributeArray {
+    int bit;
+    size_t element_size;
+    size_t components;
+};
+
+const AttributeArray attribute_arrays[] = {
+    {HAIR_FILE_SEGMENTS_BIT, sizeof(unsigned short), 1},
+    {HAIR_FILE_THICKNESS_BIT, sizeof(float), 1},
+    {HAIR_FILE_TRANSPARENCY_BIT, sizeof(float), 1},
+    {HAIR_FILE_COLORS_BIT, sizeof(float), 3},
+};
+
+} // namespace
+
+// ---- GroomAnimationWriter ----
+
+GroomAnimationWriter::~GroomAnimationWriter() {
+    if (file.is_open()) Close(nullptr);
+}
+
+bool GroomAnimationWriter::Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate) {
+    return Open(model, err, filename, frame_rate, Settings());
+}
+
+bool GroomAnimationWriter::Open(const HairModel& model, std::string* err, const std::string& filename, float frame_rate, const Settings& settings) {
+    size_t points = model.point_count;
+    if (model.points.size() != 3 * points || ((model.arrays & HAIR_FILE_SEGMENTS_BIT) && model.segments.size() != model.hair_count)
+        || ((model.arrays & HAIR_FILE_THICKNESS_BIT) && model.thickness.size() != points)
+        || ((model.arrays & HAIR_FILE_TRANSPARENCY_BIT) && model.transparency.size() != points)
+        || ((model.arrays & HAIR_FILE_COLORS_BIT) && model.colors.size() != 3 * points)) {
+        if (err) *err = "Size of an array does not match the header";
+        return false;
+    }
+
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+
+    // the quantization step follows from the bounding box of the first frame
+    float lo[3] = {0.0f, 0.0f, 0.0f}, hi[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t v = 0; v < points; v++) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = v == 0 ? model.points[c] : std::min(lo[c], model.points[3 * v + c]);
+            hi[c] = v == 0 ? model.points[c] : std::max(hi[c], model.points[3 * v + c]);
+        }
+    }
+    float extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+    step = 2.0f * std::max(settings.error_bound, 1e-7f) * (extent > 0.0f && std::isfinite(extent) ? extent : 1.0f);
+    keyframe_interval = std::max(settings.keyframe_interval, 1u);
+    value_count = 3 * points;
+    frames.clear();
+
+    AnimationHeader header;
+    header.hair_count = model.hair_count;
+    header.point_count = model.point_count;
+    header.arrays = (model.arrays & (HAIR_FILE_SEGMENTS_BIT | HAIR_FILE_THICKNESS_BIT | HAIR_FILE_TRANSPARENCY_BIT | HAIR_FILE_COLORS_BIT)) | HAIR_FILE_POINTS_BIT;
+    header.d_segments = model.d_segments;
+    header.d_thickness = model.d_thickness;
+    header.d_transparency = model.d_transparency;
+    std::copy(std::begin(model.d_color), std::end(model.d_color), std::begin(header.d_color));
+    header.frame_rate = frame_rate;
+    header.step = step;
+
+    uint64_t offset;
+    if (!writeAligned(&header, sizeof(header), offset)) {
+        if (err) *err = "Error writing header";
+        return false;
+    }
+    const void* arrays[] = {model.segments.data(), model.thickness.data(), model.transparency.data(), model.colors.data()};
+    size_t counts[] = {model.hair_count, points, points, points};
+    for (int a = 0; a < 4; a++) {
+        const AttributeArray& array = attribute_arrays[a];
+        if (!(header.arrays & array.bit)) continue;
+        if (!writeAligned(arrays[a], counts[a] * array.components * array.element_size, offset)) {
+            if (err) *err = "Error writing attributes";
+            return false;
+        }
+    }
+    return AddFrame(model.points.data(), err);
+}
+
+bool GroomAnimationWriter::AddFrame(const float* positions, std::string* err) {
+    if (!file.is_open()) {
+        if (err) *err = "Writer is not open";
+        return false;
+    }
+
+    bool keyframe = frames.empty() || since_keyframe + 1 >= keyframe_interval;
+    if (!keyframe) {
+        delta.resize(value_count);
+        for (size_t i = 0; i < value_count; i++) {
+            double d = (static_cast<double>(positions[i]) - state[i]) / step;
+            if (!(std::abs(d) <= 32767.0)) { // too fast for a delta frame, or not finite
+                keyframe = true;
+                break;
+            }
+            delta[i] = static_cast<int16_t>(std::lround(d));
+        }
+    }
+
+    uint64_t offset;
+    bool written;
+    if (keyframe) {
+        written = writeAligned(positions, value_count * sizeof(float), offset);
+        state.assign(positions, positions + value_count);
+        since_keyframe = 0;
+    } else {
+        written = writeAligned(delta.data(), value_count * sizeof(int16_t), offset);
+        applyDelta(state.data(), delta.data(), value_count, step, nullptr);
+        since_keyframe++;
+    }
+    if (!written) {
+        if (err) *err = "Error writing frame";
+        return false;
+    }
+    frames.push_back({offset, keyframe ? 1u : 0u, 0});
+    return true;
+}
+
+bool GroomAnimationWriter::Close(std::string* err) {
+    if (!file.is_open()) return true;
+    uint64_t table;
+    bool ok = writeAligned(frames.data(), frames.size() * sizeof(FrameEntry), table);
+    uint32_t frame_count = static_cast<uint32_t>(frames.size());
+    file.seekp(offsetof(AnimationHeader, frame_count));
+    file.write(reinterpret_cast<const char*>(&frame_count), sizeof(frame_count));
+    file.seekp(offsetof(AnimationHeader, frame_table));
+    file.write(reinterpret_cast<const char*>(&table), sizeof(table));
+    ok = ok && static_cast<bool>(file);
+    file.close();
+    if (!ok && err) *err = "Error writing frame table";
+    return ok;
+}
+
+unsigned int GroomAnimationWriter::frameCount() const {
+    return static_cast<unsigned int>(frames.size());
+}
+
+unsigned int GroomAnimationWriter::keyframeCount() const {
+    return static_cast<unsigned int>(std::count_if(frames.begin(), frames.end(), [](const FrameEntry& f) { return f.keyframe != 0; }));
+}
+
+bool GroomAnimationWriter::writeAligned(const void* data, size_t bytes, uint64_t& offset) {
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    offset = alignUp(position);
+    static const char zeros[alignment] = {};
+    file.write(zeros, static_cast<std::streamsize>(offset - position));
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    return static_cast<bool>(file);
+}
+
+// ---- GroomAnimation ----
+
+GroomAnimation::~GroomAnimation() {
+    Close();
+}
+
+bool GroomAnimation::map(const std::string& filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    file_handle = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return false;
+    mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle) return false;
+    mapping = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    mapping_size = mapping ? static_cast<size_t>(size.QuadPart) : 0;
+    return mapping != nullptr;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED) return false;
+    mapping = static_cast<const unsigned char*>(data);
+    mapping_size = static_cast<size_t>(st.st_size);
+    return true;
+#endif
+}
+
+void GroomAnimation::Close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (mapping) munmap(const_cast<unsigned char*>(mapping), mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+    frames.clear();
+    state.clear();
+    state_frame = -1;
+}
+
+bool GroomAnimation::Open(const std::string& filename, std::string* err) {
+    Close();
+    if (!map(filename)) {
+        Close();
+        if (err) *err = "Cannot map file";
+        return false;
+    }
+    auto fail = [&](const char* message) {
+        Close();
+        if (err) *err = message;
+        return false;
+    };
+
+    AnimationHeader header;
+    if (mapping_size < sizeof(header)) return fail("Failed to read header");
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::string(header.signature, 4) != "CGCA") return fail("Invalid file signature");
+    if (header.version != animation_version) return fail("Unsupported animation version");
+    if (header.frame_count == 0) return fail("No frames, the writer was not closed");
+
+    // topology and attributes follow the header, each aligned
+    uint64_t points = header.point_count;
+    uint64_t offset = alignUp(sizeof(header));
+    model.hair_count = header.hair_count;
+    model.point_count = header.point_count;
+    model.arrays = header.arrays;
+    model.d_segments = header.d_segments;
+    model.d_thickness = header.d_thickness;
+    model.d_transparency = header.d_transparency;
+    std::copy(std::begin(header.d_color), std::end(header.d_color), std::begin(model.d_color));
+    model.segments.clear();
+    model.thickness.clear();
+    model.transparency.clear();
+    model.colors.clear();
+    for (const AttributeArray& array : attribute_arrays) {
+        if (!(header.arrays & array.bit)) continue;
+        uint64_t count = (array.bit == HAIR_FILE_SEGMENTS_BIT ? header.hair_count : points) * array.components;
+        uint64_t bytes = count * array.element_size;
+        if (offset + bytes > mapping_size) return fail("File is smaller than its header requires");
+        const unsigned char* data = mapping + offset;
+        switch (array.bit) {
+            case HAIR_FILE_SEGMENTS_BIT: model.segments.resize(count); std::memcpy(model.segments.data(), data, bytes); break;
+            case HAIR_FILE_THICKNESS_BIT: model.thickness.resize(count); std::memcpy(model.thickness.data(), data, bytes); break;
+            case HAIR_FILE_TRANSPARENCY_BIT: model.transparency.resize(count); std::memcpy(model.transparency.data(), data, bytes); break;
+            case HAIR_FILE_COLORS_BIT: model.colors.resize(count); std::memcpy(model.colors.data(), data, bytes); break;
+        }
+        offset = alignUp(offset + bytes);
+    }
+    uint64_t strand_points = 0;
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        strand_points += (model.segments.empty() ? model.d_segments : model.segments[s]) + 1;
+    }
+    if (strand_points != points) return fail("Segment counts do not add up to the point count");
+
+    uint64_t table_bytes = static_cast<uint64_t>(header.frame_count) * sizeof(GroomAnimationWriter::FrameEntry);
+    if (header.frame_table % alignment != 0 || header.frame_table > mapping_size || table_bytes > mapping_size - header.frame_table) {
+        return fail("File is smaller than its header requires");
+    }
+    const GroomAnimationWriter::FrameEntry* table = reinterpret_cast<const GroomAnimationWriter::FrameEntry*>(mapping + header.frame_table);
+    frames.resize(header.frame_count);
+    for (unsigned int f = 0; f < header.frame_count; f++) {
+        bool keyframe = table[f].keyframe != 0;
+        uint64_t bytes = 3 * points * (keyframe ? sizeof(float) : sizeof(int16_t));
+        if (table[f].offset % alignment != 0 || table[f].offset > mapping_size || bytes > mapping_size - table[f].offset) {
+            return fail("Frame is outside the file");
+        }
+        if (f == 0 && !keyframe) return fail("First frame is not a keyframe");
+        frames[f] = {mapping + table[f].offset, keyframe, keyframe ? f : frames[f - 1].base};
+    }
+
+    frame_rate = header.frame_rate;
+    step = header.step;
+    state.resize(3 * points);
+    model.points.resize(3 * points);
+    return ReadFrame(0, model.points.data());
+}
+
+const HairModel& GroomAnimation::GetModel() const {
+    return model;
+}
+
+unsigned int GroomAnimation::frameCount() const {
+    return static_cast<unsigned int>(frames.size());
+}
+
+float GroomAnimation::frameRate() const {
+    return frame_rate;
+}
+
+bool GroomAnimation::isKeyframe(unsigned int frame) const {
+    return frame < frames.size() && frames[frame].keyframe;
+}
+
+bool GroomAnimation::ReadFrame(unsigned int frame, float* positions) {
+    if (frame >= frames.size()) return false;
+    size_t n = state.size();
+    const Frame& target = frames[frame];
+    if (target.keyframe) {
+        std::memcpy(positions, target.data, n * sizeof(float));
+        state_frame = frame; // keyframes are read from the mapping, `state` is loaded lazily
+        return true;
+    }
+
+    // continue from the last decoded frame when it lies between the keyframe and `frame`
+    unsigned int start = state_frame >= target.base && state_frame <= frame ? static_cast<unsigned int>(state_frame) : target.base;
+    if (frames[start].keyframe) {
+        std::memcpy(state.data(), frames[start].data, n * sizeof(float));
+    }
+    for (unsigned int f = start + 1; f <= frame; f++) {
+        applyDelta(state.data(), reinterpret_cast<const int16_t*>(frames[f].data), n, step, f == frame ? positions : nullptr);
+    }
+    if (start == frame) {
+        std::memcpy(positions, state.data(), n * sizeof(float));
+    }
+    state_frame = frame;
+    return true;
+}
+
+bool GroomAnimation::IsAnimationFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char signature[4] = {};
+    file.read(signature, 4);
+    return file.gcount() == 4 && std::string(signature, 4) == "CGCA";
+}
@@ -0,0 +1,208 @@
+#include "GroomGenerator.h"
+#include "Geometry.h"
+#include "HairWriter.h"
+#include "Parallel.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// SplitMix64, one independent stream per strand
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { // [0, 1)
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double symmetric() { // [-1, 1)
+        return 2.0 * uniform() - 1.0;
+    }
+
+private:
+    uint64_t state;
+};
+
+Random strandRandom(uint64_t seed, unsigned int strand, uint64_t stream) {
+    Random mix(seed ^ (0x632be59bd9b4e019ull * (strand + 1)) ^ (stream << 56));
+    return Random(mix.next());
+}
+
+constexpr unsigned int chunk_strands = 1 << 16; // strands per chunk of the streamed file
+const double PI = 3.14159265358979323846;
+
+} // namespace
+
+bool GroomGenerator::validate(const Settings& settings, std::string* err) {
+    if (settings.strands < 1 || settings.strands > max_strands) {
+        if (err) *err = "The strand count must be between 1 and " + std::to_string(max_strands);
+        return false;
+    }
+    if (settings.segments < 1 || uint64_t(settings.segments) + settings.segment_jitter > max_segments) {
+        if (err) *err = "The segment count (plus jitter) must be between 1 and " + std::to_string(max_segments);
+        return false;
+    }
+    if (uint64_t(settings.strands) * (uint64_t(settings.segments) + settings.segment_jitter + 1) > 0xffffffffull) {
+        if (err) *err = "Too many points for the 32-bit point count of a .hair file";
+        return false;
+    }
+    return true;
+}
+
+GroomGenerator::GroomGenerator(const Settings& settings) : settings(settings) {
+    this->settings.strands = std::clamp(settings.strands, 1u, max_strands);
+    this->settings.segments = std::clamp(settings.segments, 1u, max_segments);
+    if (settings.segment_jitter > 0) {
+        segment_counts.resize(this->settings.strands);
+        for (unsigned int s = 0; s < this->settings.strands; s++) {
+            Random random = strandRandom(settings.seed, s, 0);
+            int jitter = static_cast<int>(random.next() % (2 * settings.segment_jitter + 1)) - static_cast<int>(settings.segment_jitter);
+            segment_counts[s] = static_cast<unsigned short>(std::clamp(static_cast<int>(this->settings.segments) + jitter, 1, static_cast<int>(max_segments)));
+        }
+    }
+    point_offsets.resize(this->settings.strands + 1, 0);
+    for (unsigned int s = 0; s < this->settings.strands; s++) {
+        point_offsets[s + 1] = point_offsets[s] + segmentCount(s) + 1;
+    }
+}
+
+unsigned int GroomGenerator::segmentCount(unsigned int strand) const {
+    return segment_counts.empty() ? settings.segments : segment_counts[strand];
+}
+
+unsigned int GroomGenerator::strandCount() const {
+    return settings.strands;
+}
+
+unsigned int GroomGenerator::pointCount() const {
+    return static_cast<unsigned int>(point_offsets.back());
+}
+
+unsigned int GroomGenerator::arrays() const {
+    unsigned int bits = (settings.arrays | POINTS) & (SEGMENTS | POINTS | THICKNESS | TRANSPARENCY | COLORS);
+    if (!segment_counts.empty()) bits |= SEGMENTS;
+    return bits;
+}
+
+HairModel GroomGenerator::header() const {
+    HairModel model;
+    model.hair_count = settings.strands;
+    model.point_count = pointCount();
+    model.arrays = arrays();
+    model.d_segments = settings.segments;
+    model.d_thickness = settings.thickness;
+    model.d_transparency = 0.0f;
+    std::copy(std::begin(settings.color), std::end(settings.color), std::begin(model.d_color));
+    return model;
+}
+
+void GroomGenerator::generateStrand(unsigned int strand, float* points, float* thickness, float* transparency, float* colors) const {
+    Random random = strandRandom(settings.seed, strand, 1);
+    int segments = static_cast<int>(segmentCount(strand));
+
+    // Fibonacci spiral over the upper hemisphere of the scalp, jittered within the spiral spacing
+    double y = 1.0 - (strand + 0.5 + 0.4 * random.symmetric()) / settings.strands;
+    double r = std::sqrt(std::max(0.0, 1.0 - y * y));
+    double phi = strand * PI * (3.0 - std::sqrt(5.0)) + 0.2 * random.symmetric();
+    Eigen::Vector3d normal(r * std::cos(phi), y, r * std::sin(phi));
+    Eigen::Vector3d root = settings.scalp_radius * normal;
+
+    double length = settings.length * std::max(0.05, 1.0 + settings.length_jitter * random.symmetric());
+    double step = length / segments;
+    double curl_radius = settings.curliness * length / 10.0;
+    double curl_phase = 2.0 * PI * random.uniform();
+    double shade = 1.0 + 0.1 * random.symmetric();
+
+    // centerline turning from the normal down to -y in the vertical plane through the normal,
+    // curl offsets in a frame transported along it
+    Eigen::Vector3d up(0.0, 1.0, 0.0);
+    Eigen::Vector3d horizontal(normal.x(), 0.0, normal.z());
+    if (horizontal.norm() < 1e-6) horizontal = Eigen::Vector3d(std::cos(phi), 0.0, std::sin(phi)); // crown
+    horizontal.normalize();
+    double elevation = std::asin(std::clamp(normal.y(), -1.0, 1.0));
+    Eigen::Vector3d center = root;
+    Eigen::Vector3d tangent = normal;
+    Eigen::Vector3d d1 = normal.unitOrthogonal();
+    for (int i = 0; i <= segments; i++) {
+        double u = static_cast<double>(i) / segments;
+        double angle = curl_phase + 2.0 * PI * settings.curl_turns * u;
+        // the curl grows in over the first segment so that the root stays on the scalp
+        double radius = curl_radius * std::min(1.0, u * segments);
+        Eigen::Vector3d p = center + radius * (std::cos(angle) * d1 + std::sin(angle) * tangent.cross(d1));
+        points[3 * i] = static_cast<float>(p.x());
+        points[3 * i + 1] = static_cast<float>(p.y());
+        points[3 * i + 2] = static_cast<float>(p.z());
+        if (thickness) thickness[i] = static_cast<float>(settings.thickness * (1.0 - 0.8 * u));
+        if (transparency) transparency[i] = static_cast<float>(0.8 * u * u);
+        if (colors) {
+            for (int c = 0; c < 3; c++) {
+                colors[3 * i + c] = static_cast<float>(std::clamp(settings.color[c] * shade * (1.0 + 0.3 * u), 0.0, 1.0));
+            }
+        }
+
+        double pitch = elevation - (elevation + 0.5 * PI) * std::min(1.0, 1.5 * settings.droop * (u + 0.5 / segments));
+        Eigen::Vector3d next = std::cos(pitch) * horizontal + std::sin(pitch) * up;
+        d1 = parallelTransport(d1, tangent, next);
+        tangent = next;
+        center += step * tangent;
+    }
+}
+
+void GroomGenerator::generateStrands(unsigned int begin, unsigned int end, HairModel& chunk) const {
+    unsigned int bits = arrays();
+    uint64_t first = point_offsets[begin];
+    size_t count = point_offsets[end] - first;
+    chunk.points.resize(3 * count);
+    chunk.thickness.resize(bits & THICKNESS ? count : 0);
+    chunk.transparency.resize(bits & TRANSPARENCY ? count : 0);
+    chunk.colors.resize(bits & COLORS ? 3 * count : 0);
+    parallelFor(static_cast<int>(begin), static_cast<int>(end), [&](int chunk_begin, int chunk_end) {
+        for (int s = chunk_begin; s < chunk_end; s++) {
+            size_t v = point_offsets[s] - first;
+            generateStrand(s, &chunk.points[3 * v],
+                           chunk.thickness.empty() ? nullptr : &chunk.thickness[v],
+                           chunk.transparency.empty() ? nullptr : &chunk.transparency[v],
+                           chunk.colors.empty() ? nullptr : &chunk.colors[3 * v]);
+        }
+    }, 256);
+}
+
+HairModel GroomGenerator::generate() const {
+    HairModel model = header();
+    if (model.arrays & SEGMENTS) {
+        model.segments = segment_counts.empty() ? std::vector<unsigned short>(settings.strands, static_cast<unsigned short>(settings.segments)) : segment_counts;
+    }
+    generateStrands(0, settings.strands, model);
+    return model;
+}
+
+bool GroomGenerator::writeHairFile(const std::string& filename, std::string* err) const {
+    if (point_offsets.back() > 0xffffffffull) {
+        if (err) *err = "Too many points for the 32-bit point count of a .hair file";
+        return false;
+    }
+    HairModel model = header();
+    HairWriter writer;
+    if (!writer.Open(model, err, filename)) return false;
+
+    HairModel chunk;
+    for (unsigned int begin = 0; begin < settings.strands; begin += chunk_strands) {
+        unsigned int end = std::min(settings.strands, begin + chunk_strands);
+        generateStrands(begin, end, chunk);
+        if (model.arrays & SEGMENTS) {
+            chunk.segments.resize(end - begin);
+            for (unsigned int s = begin; s < end; s++) chunk.segments[s - begin] = static_cast<unsigned short>(segmentCount(s));
+        }
+        if (!writer.WriteStrands(chunk, begin, point_offsets[begin], err)) return false;
+    }
+    return writer.Close(err);
+}
@@ -0,0 +1,803 @@
+#include "HairCache.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t cache_version = 1;
+
+// Layout: CacheHeader, chunk_count ChunkEntry, then the chunk payloads back to back in chunk order.
+struct CacheHeader {
+    char signature[4] = {'C', 'G', 'C', 'H'};
+    uint32_t version = cache_version;
+    uint32_t hair_count = 0;
+    uint32_t point_count = 0;
+    uint32_t arrays = 0;
+    uint32_t d_segments = 0;
+    float d_thickness = 1.0f;
+    float d_transparency = 0.0f;
+    float d_color[3] = {1.0f, 1.0f, 1.0f};
+    float error_bound = 0.0f;
+    uint32_t chunk_strands = 0;
+    uint32_t chunk_count = 0;
+};
+
+struct ChunkEntry {
+    uint32_t first_strand;
+    uint32_t strand_count;
+    uint32_t first_point;
+    uint32_t point_count;
+    uint64_t offset; // from the start of the file
+    uint64_t bytes;
+};
+
+// ---- byte streams ----
+
+void putVarint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+void putFloat(std::vector<uint8_t>& out, float f) {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &f, 4);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+uint32_t zigzag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+int32_t unzigzag(uint32_t v) {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+// bounds checked, every read fails instead of running past the end of a corrupt chunk
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    bool varint(uint32_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (pos >= size) return false;
+            uint8_t b = data[pos++];
+            v |= static_cast<uint32_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool floats(float* f, size_t n) {
+        if (size - pos < 4 * n) return false;
+        std::memcpy(f, data + pos, 4 * n);
+        pos += 4 * n;
+        return true;
+    }
+
+    bool byte(uint8_t& b) {
+        if (pos >= size) return false;
+        b = data[pos++];
+        return true;
+    }
+
+    void skip(size_t n) { pos += std::min(n, size - pos); }
+    const uint8_t* current() const { return data + pos; }
+    size_t remaining() const { return size - pos; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// ---- order-0 rANS over bytes (32-bit state, byte-wise renormalization) ----
+
+constexpr uint32_t rans_prob_bits = 14;
+constexpr uint32_t rans_prob_scale = 1u << rans_prob_bits;
+constexpr uint32_t rans_low = 1u << 23; // lower bound of the normalized state
+
+enum ChunkCoding : uint8_t {
+    STORED = 0,
+    RANS = 1
+};
+
+// frequencies summing to rans_prob_scale, every symbol that occurs keeps at least 1
+std::array<uint32_t, 256> normalizeFrequencies(const std::array<uint64_t, 256>& counts, uint64_t total) {
+    std::array<uint32_t, 256> freq{};
+    uint32_t sum = 0;
+    for (int s = 0; s < 256; s++) {
+        if (counts[s] == 0) continue;
+        freq[s] = std::max<uint32_t>(1, static_cast<uint32_t>(counts[s] * rans_prob_scale / total));
+        sum += freq[s];
+    }
+    while (sum != rans_prob_scale) {
+        int largest = static_cast<int>(std::max_element(freq.begin(), freq.end()) - freq.begin());
+        if (sum < rans_prob_scale) {
+            freq[largest] += rans_prob_scale - sum;
+            sum = rans_prob_scale;
+        } else {
+            uint32_t excess = std::min(sum - rans_prob_scale, freq[largest] - 1);
+            freq[largest] -= excess;
+            sum -= excess;
+        }
+    }
+    return freq;
+}
+
+std::vector<uint8_t> entropyEncode(const std::vector<uint8_t>& raw) {
+    std::vector<uint8_t> out;
+    if (!raw.empty()) {
+        std::array<uint64_t, 256> counts{};
+        for (uint8_t b : raw) counts[b]++;
+        std::array<uint32_t, 256> freq = normalizeFrequencies(counts, raw.size());
+        std::array<uint32_t, 256> start{};
+        uint32_t symbols = 0;
+        for (int s = 0, c = 0; s < 256; s++) {
+            start[s] = c;
+            c += freq[s];
+            symbols += freq[s] > 0;
+        }
+
+        out.push_back(RANS);
+        putVarint(out, static_cast<uint32_t>(raw.size()));
+        putVarint(out, symbols);
+        for (int s = 0; s < 256; s++) {
+            if (freq[s] == 0) continue;
+            out.push_back(static_cast<uint8_t>(s));
+            putVarint(out, freq[s]);
+        }
+
+        // rANS is last in, first out: encode backwards so that the decoder reads forwards
+        std::vector<uint8_t> body(2 * raw.size() + 8);
+        uint8_t* end = body.data() + body.size();
+        uint8_t* ptr = end;
+        uint32_t x = rans_low;
+        for (size_t i = raw.size(); i-- > 0;) {
+            uint32_t f = freq[raw[i]];
+            uint32_t x_max = ((rans_low >> rans_prob_bits) << 8) * f;
+            while (x >= x_max) {
+                *--ptr = static_cast<uint8_t>(x);
+                x >>= 8;
+            }
+            x = ((x / f) << rans_prob_bits) + (x % f) + start[raw[i]];
+        }
+        for (int k = 0; k < 4; k++) {
+            *--ptr = static_cast<uint8_t>(x >> (8 * k)); // final state, most significant byte first
+        }
+        out.insert(out.end(), ptr, end);
+        if (out.size() < raw.size() + 1) return out;
+    }
+
+    // incompressible, e.g. tiny chunks where the frequency table does not pay off
+    out.clear();
+    out.push_back(STORED);
+    out.insert(out.end(), raw.begin(), raw.end());
+    return out;
+}
+
+// max_raw_size guards the allocation against corrupt sizes
+bool entropyDecode(const uint8_t* data, size_t size, size_t max_raw_size, std::vector<uint8_t>& raw) {
+    ByteReader in(data, size);
+    uint8_t coding;
+    if (!in.byte(coding)) return false;
+    if (coding == STORED) {
+        if (in.remaining() > max_raw_size) return false;
+        raw.assign(in.current(), in.current() + in.remaining());
+        return true;
+    }
+    uint32_t raw_size, symbols;
+    if (coding != RANS || !in.varint(raw_size) || !in.varint(symbols) || symbols == 0 || symbols > 256) return false;
+
+    std::array<uint32_t, 256> freq{};
+    std::array<uint32_t, 256> start{};
+    std::vector<uint8_t> slot_symbol(rans_prob_scale);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < symbols; i++) {
+        uint8_t s;
+        uint32_t f;
+        if (!in.byte(s) || !in.varint(f) || f == 0 || freq[s] != 0 || f > rans_prob_scale - sum) return false;
+        freq[s] = f;
+        start[s] = sum;
+        std::fill(slot_symbol.begin() + sum, slot_symbol.begin() + sum + f, s);
+        sum += f;
+    }
+    if (sum != rans_prob_scale || in.remaining() < 4 || raw_size > max_raw_size) return false;
+
+    const uint8_t* ptr = in.current();
+    const uint8_t* end = ptr + in.remaining();
+    uint32_t x = 0;
+    for (int k = 0; k < 4; k++) {
+        x = (x << 8) | *ptr++;
+    }
+    raw.resize(raw_size);
+    for (uint32_t i = 0; i < raw_size; i++) {
+        uint32_t slot = x & (rans_prob_scale - 1);
+        uint8_t s = slot_symbol[slot];
+        raw[i] = s;
+        x = freq[s] * (x >> rans_prob_bits) + slot - start[s];
+        while (x < rans_low) {
+            if (ptr == end) return false;
+            x = (x << 8) | *ptr++;
+        }
+    }
+    return x == rans_low;
+}
+
+// ---- chunks ----
+
+// Per-point attribute with `components` floats, quantized to 16 bits over the range of the chunk.
+struct Attribute {
+    int bit;
+    int components;
+    std::vector<float> HairModel::*array;
+};
+
+const Attribute attributes[] = {
+    {HAIR_FILE_THICKNESS_BIT, 1, &HairModel::thickness},
+    {HAIR_FILE_TRANSPARENCY_BIT, 1, &HairModel::transparency},
+    {HAIR_FILE_COLORS_BIT, 3, &HairModel::colors},
+};
+
+constexpr double attribute_levels = 65535.0;
+
+// Values of a chunk split into three streams. Residuals are coded JPEG style: the bit length of the
+// zigzag value is a token for the rANS coder, which is where the skewed distribution is, and the bits
+// below the leading one go uncoded into `bits` since they are close to uniform.
+class ChunkWriter {
+public:
+    std::vector<uint8_t> fields; // segments, strand frames and attribute ranges, rANS coded
+
+    // Quantized values of one strand, `components` interleaved per point, as residuals against the
+    // linear prediction from the two previous points (the previous point for the second one).
+    // Smooth strands and the linear ramps typical for thickness and color leave residuals near zero.
+    void residuals(const std::vector<int32_t>& q, size_t components) {
+        for (size_t i = 0; i < q.size(); i++) {
+            int32_t predicted = i >= 2 * components ? 2 * q[i - components] - q[i - 2 * components] : i >= components ? q[i - components] : 0;
+            uint32_t v = zigzag(q[i] - predicted);
+            uint8_t length = 0;
+            while (length < 32 && (v >> length) != 0) length++;
+            tokens.push_back(length);
+            if (length > 1) putBits(v & ((1u << (length - 1)) - 1), length - 1);
+        }
+    }
+
+    // varint sizes of the coded fields and tokens, the two coded streams, then the bits
+    std::vector<uint8_t> finish() {
+        if (bit_count > 0) bits.push_back(static_cast<uint8_t>(bit_buffer));
+        std::vector<uint8_t> coded_fields = entropyEncode(fields);
+        std::vector<uint8_t> coded_tokens = entropyEncode(tokens);
+        std::vector<uint8_t> out;
+        out.reserve(coded_fields.size() + coded_tokens.size() + bits.size() + 10);
+        putVarint(out, static_cast<uint32_t>(coded_fields.size()));
+        out.insert(out.end(), coded_fields.begin(), coded_fields.end());
+        putVarint(out, static_cast<uint32_t>(coded_tokens.size()));
+        out.insert(out.end(), coded_tokens.begin(), coded_tokens.end());
+        out.insert(out.end(), bits.begin(), bits.end());
+        return out;
+    }
+
+private:
+    std::vector<uint8_t> tokens;
+    std::vector<uint8_t> bits;
+    uint64_t bit_buffer = 0;
+    int bit_count = 0;
+
+    void putBits(uint32_t value, int n) {
+        bit_buffer |= static_cast<uint64_t>(value) << bit_count;
+        bit_count += n;
+        while (bit_count >= 8) {
+            bits.push_back(static_cast<uint8_t>(bit_buffer));
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+};
+
+class ChunkReader {
+public:
+    ChunkReader(const uint8_t* data, size_t size) : payload(data, size) {}
+
+    // max_fields and token_count bound the decoded sizes, a corrupt chunk fails instead of allocating
+    bool open(size_t max_fields, size_t token_count) {
+        uint32_t bytes;
+        if (!payload.varint(bytes) || bytes > payload.remaining() || !entropyDecode(payload.current(), bytes, max_fields, field_data)) return false;
+        payload.skip(bytes);
+        if (!payload.varint(bytes) || bytes > payload.remaining() || !entropyDecode(payload.current(), bytes, token_count, tokens)) return false;
+        payload.skip(bytes);
+        fields = ByteReader(field_data.data(), field_data.size());
+        return tokens.size() == token_count;
+    }
+
+    ByteReader& getFields() { return fields; }
+
+    bool residuals(std::vector<int32_t>& q, size_t count, size_t components) {
+        q.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            if (next_token == tokens.size()) return false;
+            uint8_t length = tokens[next_token++];
+            uint32_t v = length;
+            if (length > 32) return false;
+            if (length > 1) {
+                uint32_t low;
+                if (!getBits(low, length - 1)) return false;
+                v = (1u << (length - 1)) | low;
+            }
+            int32_t predicted = i >= 2 * components ? 2 * q[i - components] - q[i - 2 * components] : i >= components ? q[i - components] : 0;
+            q[i] = predicted + unzigzag(v);
+        }
+        return true;
+    }
+
+    // every stream consumed, nothing left over
+    bool atEnd() const { return fields.remaining() == 0 && next_token == tokens.size() && payload.remaining() == 0 && bit_count < 8; }
+
+private:
+    ByteReader payload;
+    std::vector<uint8_t> field_data;
+    ByteReader fields{nullptr, 0};
+    std::vector<uint8_t> tokens;
+    size_t next_token = 0;
+    uint64_t bit_buffer = 0;
+    int bit_count = 0;
+
+    bool getBits(uint32_t& value, int n) {
+        while (bit_count < n) {
+            uint8_t b;
+            if (!payload.byte(b)) return false;
+            bit_buffer |= static_cast<uint64_t>(b) << bit_count;
+            bit_count += 8;
+        }
+        value = static_cast<uint32_t>(bit_buffer & ((1ull << n) - 1));
+        bit_buffer >>= n;
+        bit_count -= n;
+        return true;
+    }
+};
+
+// Fields: segments of each strand (segments array only) as varints, per strand the bounding box minimum
+// and quantization step as floats, per attribute the minimum and range of each component as floats.
+// Residuals: per strand the quantized xyz, then per attribute and strand the 16-bit values.
+std::vector<uint8_t> encodeChunk(const HairModel& model, const std::vector<uint32_t>& offsets, uint32_t first, uint32_t count, float error_bound) {
+    ChunkWriter out;
+    uint32_t last = first + count;
+
+    if (model.arrays & HAIR_FILE_SEGMENTS_BIT) {
+        for (uint32_t s = first; s < last; s++) {
+            putVarint(out.fields, model.segments[s]);
+        }
+    }
+
+    if (model.arrays & HAIR_FILE_POINTS_BIT) {
+        std::vector<int32_t> q;
+        for (uint32_t s = first; s < last; s++) {
+            const float* p = model.points.data() + 3 * static_cast<size_t>(offsets[s]);
+            uint32_t n = offsets[s + 1] - offsets[s];
+            float lo[3] = {p[0], p[1], p[2]};
+            float hi[3] = {p[0], p[1], p[2]};
+            for (uint32_t v = 1; v < n; v++) {
+                for (int c = 0; c < 3; c++) {
+                    lo[c] = std::min(lo[c], p[3 * v + c]);
+                    hi[c] = std::max(hi[c], p[3 * v + c]);
+                }
+            }
+            // rounding to a grid of spacing step is off by at most step / 2 = error_bound * extent
+            float extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+            float step = 2.0f * error_bound * extent;
+            if (!(step > 0.0f) || !std::isfinite(step)) step = 1.0f;
+            putFloat(out.fields, lo[0]);
+            putFloat(out.fields, lo[1]);
+            putFloat(out.fields, lo[2]);
+            putFloat(out.fields, step);
+
+            q.resize(3 * n);
+            for (uint32_t i = 0; i < 3 * n; i++) {
+                q[i] = static_cast<int32_t>(std::lround((static_cast<double>(p[i]) - lo[i % 3]) / step));
+            }
+            out.residuals(q, 3);
+        }
+    }
+
+    size_t point_begin = offsets[first];
+    size_t point_end = offsets[last];
+    for (const Attribute& attribute : attributes) {
+        if (!(model.arrays & attribute.bit)) continue;
+        const std::vector<float>& values = model.*attribute.array;
+        int k = attribute.components;
+        float lo[3] = {0.0f, 0.0f, 0.0f};
+        float range[3] = {0.0f, 0.0f, 0.0f};
+        for (int c = 0; c < k && point_end > point_begin; c++) {
+            float hi = lo[c] = values[k * point_begin + c];
+            for (size_t v = point_begin; v < point_end; v++) {
+                lo[c] = std::min(lo[c], values[k * v + c]);
+                hi = std::max(hi, values[k * v + c]);
+            }
+            range[c] = hi - lo[c];
+        }
+        for (int c = 0; c < k; c++) {
+            putFloat(out.fields, lo[c]);
+            putFloat(out.fields, range[c]);
+        }
+        std::vector<int32_t> q;
+        for (uint32_t s = first; s < last; s++) {
+            size_t n = static_cast<size_t>(offsets[s + 1] - offsets[s]) * k;
+            const float* x = values.data() + static_cast<size_t>(offsets[s]) * k;
+            q.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                int c = static_cast<int>(i % k);
+                double t = range[c] > 0.0f ? (x[i] - lo[c]) / static_cast<double>(range[c]) : 0.0;
+                q[i] = static_cast<int32_t>(std::lround(std::min(1.0, std::max(0.0, t)) * attribute_levels));
+            }
+            out.residuals(q, k);
+        }
+    }
+
+    return out.finish();
+}
+
+// Decodes into the arrays of `model`, which hold only this chunk. They are sized once the coded streams opened
+// and the segment counts add up, so a corrupt chunk fails before allocating what its table entry claims.
+bool decodeChunk(const uint8_t* data, const ChunkEntry& chunk, const CacheHeader& header, HairModel& model) {
+    size_t components = 0;
+    if (header.arrays & HAIR_FILE_POINTS_BIT) components += 3;
+    for (const Attribute& attribute : attributes) {
+        if (header.arrays & attribute.bit) components += attribute.components;
+    }
+    ChunkReader in(data, chunk.bytes);
+    size_t max_fields = static_cast<size_t>(chunk.strand_count) * (3 + 16) + 48; // segment varints, strand frames, attribute ranges
+    if (!in.open(max_fields, components * chunk.point_count)) return false;
+    ByteReader& fields = in.getFields();
+
+    // point counts of the strands, checked against the chunk table
+    std::vector<uint32_t> offsets(chunk.strand_count + 1, 0);
+    model.segments.assign(header.arrays & HAIR_FILE_SEGMENTS_BIT ? chunk.strand_count : 0, 0);
+    for (uint32_t i = 0; i < chunk.strand_count; i++) {
+        uint32_t segments = header.d_segments;
+        if (header.arrays & HAIR_FILE_SEGMENTS_BIT) {
+            if (!fields.varint(segments) || segments > 0xffff) return false;
+            model.segments[i] = static_cast<unsigned short>(segments);
+        }
+        offsets[i + 1] = offsets[i] + segments + 1;
+        if (offsets[i + 1] > chunk.point_count) return false;
+    }
+    if (offsets.back() != chunk.point_count) return false;
+
+    size_t points = chunk.point_count;
+    model.points.assign(header.arrays & HAIR_FILE_POINTS_BIT ? 3 * points : 0, 0.0f);
+    model.thickness.assign(header.arrays & HAIR_FILE_THICKNESS_BIT ? points : 0, 0.0f);
+    model.transparency.assign(header.arrays & HAIR_FILE_TRANSPARENCY_BIT ? points : 0, 0.0f);
+    model.colors.assign(header.arrays & HAIR_FILE_COLORS_BIT ? 3 * points : 0, 0.0f);
+
+    if (header.arrays & HAIR_FILE_POINTS_BIT) {
+        std::vector<int32_t> q;
+        for (uint32_t i = 0; i < chunk.strand_count; i++) {
+            float frame[4]; // minimum xyz, step
+            if (!fields.floats(frame, 4)) return false;
+            uint32_t n = offsets[i + 1] - offsets[i];
+            float* p = model.points.data() + 3 * static_cast<size_t>(offsets[i]);
+            if (!in.residuals(q, 3 * n, 3)) return false;
+            for (uint32_t j = 0; j < 3 * n; j++) {
+                p[j] = static_cast<float>(frame[j % 3] + static_cast<double>(q[j]) * frame[3]);
+            }
+        }
+    }
+
+    for (const Attribute& attribute : attributes) {
+        if (!(header.arrays & attribute.bit)) continue;
+        std::vector<float>& values = model.*attribute.array;
+        int k = attribute.components;
+        float range[6]; // minimum, range per component
+        if (!fields.floats(range, 2 * k)) return false;
+        std::vector<int32_t> q;
+        for (uint32_t i = 0; i < chunk.strand_count; i++) {
+            size_t n = static_cast<size_t>(offsets[i + 1] - offsets[i]) * k;
+            if (!in.residuals(q, n, k)) return false;
+            float* x = values.data() + static_cast<size_t>(offsets[i]) * k;
+            for (size_t j = 0; j < n; j++) {
+                int c = static_cast<int>(j % k);
+                x[j] = static_cast<float>(range[2 * c] + q[j] / attribute_levels * range[2 * c + 1]);
+            }
+        }
+    }
+    return in.atEnd();
+}
+
+bool readTable(std::ifstream& file, CacheHeader& header, std::vector<ChunkEntry>& table, std::string* err) {
+    file.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader));
+    if (file.gcount() < static_cast<std::streamsize>(sizeof(CacheHeader))) {
+        if (err) *err = "Failed to read header";
+        return false;
+    }
+    if (std::string(header.signature, 4) != "CGCH") {
+        if (err) *err = "Invalid file signature";
+        return false;
+    }
+    if (header.version != cache_version) {
+        if (err) *err = "Unsupported cache version";
+        return false;
+    }
+    // segments are 16-bit like in .hair files; without the segments array every strand has d_segments
+    bool has_segments = (header.arrays & HAIR_FILE_SEGMENTS_BIT) != 0;
+    if (header.d_segments > 0xffff) {
+        if (err) *err = "Invalid default segment count";
+        return false;
+    }
+    if (!has_segments && static_cast<uint64_t>(header.hair_count) * (header.d_segments + 1) != header.point_count) {
+        if (err) *err = "Point count does not match the strand count";
+        return false;
+    }
+    uint64_t expected_chunks = header.chunk_strands > 0 ? (static_cast<uint64_t>(header.hair_count) + header.chunk_strands - 1) / header.chunk_strands : 0;
+    if (header.chunk_count != expected_chunks || (header.hair_count > 0 && header.chunk_strands == 0)) {
+        if (err) *err = "Invalid chunk table";
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    uint64_t table_end = sizeof(CacheHeader) + static_cast<uint64_t>(header.chunk_count) * sizeof(ChunkEntry);
+    if (table_end > file_size) {
+        if (err) *err = "File is smaller than its header requires";
+        return false;
+    }
+    file.seekg(sizeof(CacheHeader));
+    table.resize(header.chunk_count);
+    file.read(reinterpret_cast<char*>(table.data()), table.size() * sizeof(ChunkEntry));
+    if (!file) {
+        if (err) *err = "Failed to read chunk table";
+        return false;
+    }
+
+    // chunks tile the strands, points and payload bytes without gaps, every strand has 1 to 65536 points
+    uint64_t strand = 0, point = 0, offset = table_end;
+    for (const ChunkEntry& chunk : table) {
+        if (chunk.first_strand != strand || chunk.first_point != point || chunk.offset != offset || chunk.strand_count == 0 || chunk.strand_count > header.chunk_strands) {
+            if (err) *err = "Invalid chunk table";
+            return false;
+        }
+        bool points_valid = has_segments ? chunk.point_count >= chunk.strand_count && chunk.point_count <= static_cast<uint64_t>(chunk.strand_count) * 0x10000
+                                         : chunk.point_count == static_cast<uint64_t>(chunk.strand_count) * (header.d_segments + 1);
+        if (!points_valid) {
+            if (err) *err = "Invalid chunk table";
+            return false;
+        }
+        if (chunk.bytes > file_size - offset) {
+            if (err) *err = "File is smaller than its header requires";
+            return false;
+        }
+        strand += chunk.strand_count;
+        point += chunk.point_count;
+        offset += chunk.bytes;
+    }
+    if (strand != header.hair_count || point != header.point_count) {
+        if (err) *err = "Invalid chunk table";
+        return false;
+    }
+    return true;
+}
+
+// Reads chunks [begin, end) into a model holding exactly their strands. The chunks are read and decoded a window
+// at a time, in parallel within the window, and appended to the model once they decoded, so a file whose table
+// claims more points than it holds fails at its first corrupt chunk instead of allocating them all up front.
+bool loadChunks(std::ifstream& file, const CacheHeader& header, const std::vector<ChunkEntry>& table, size_t begin, size_t end, HairModel* model, std::string* err) {
+    model->hair_count = 0;
+    model->point_count = 0;
+    model->arrays = header.arrays;
+    model->d_segments = header.d_segments;
+    model->d_thickness = header.d_thickness;
+    model->d_transparency = header.d_transparency;
+    std::copy(std::begin(header.d_color), std::end(header.d_color), std::begin(model->d_color));
+    model->segments.clear();
+    model->points.clear();
+    model->thickness.clear();
+    model->transparency.clear();
+    model->colors.clear();
+
+    try {
+        const size_t window = 2 * ThreadPool::instance().size();
+        uint64_t strands = 0, points = 0;
+        std::vector<uint8_t> payload;
+        std::vector<HairModel> chunks(window);
+        for (size_t window_begin = begin; window_begin < end; window_begin += window) {
+            size_t window_end = std::min(end, window_begin + window);
+            uint64_t bytes = 0;
+            for (size_t c = window_begin; c < window_end; c++) {
+                bytes += table[c].bytes;
+            }
+            payload.resize(bytes);
+            file.seekg(table[window_begin].offset);
+            file.read(reinterpret_cast<char*>(payload.data()), bytes);
+            if (!file) {
+                if (err) *err = "Error reading chunks";
+                return false;
+            }
+
+            std::vector<char> ok(window_end - window_begin, 0);
+            std::atomic<bool> out_of_memory{false};
+            parallelFor(static_cast<int>(window_begin), static_cast<int>(window_end), [&](int chunk_begin, int chunk_end) {
+                for (int c = chunk_begin; c < chunk_end; c++) {
+                    const uint8_t* data = payload.data() + (table[c].offset - table[window_begin].offset);
+                    try {
+                        ok[c - window_begin] = decodeChunk(data, table[c], header, chunks[c - window_begin]);
+                    } catch (const std::bad_alloc&) {
+                        out_of_memory = true;
+                    }
+                }
+            }, 1);
+            if (out_of_memory) throw std::bad_alloc();
+
+            for (size_t c = window_begin; c < window_end; c++) {
+                if (!ok[c - window_begin]) {
+                    if (err) *err = "Corrupt chunk " + std::to_string(c);
+                    return false;
+                }
+                HairModel& chunk = chunks[c - window_begin];
+                model->segments.insert(model->segments.end(), chunk.segments.begin(), chunk.segments.end());
+                model->points.insert(model->points.end(), chunk.points.begin(), chunk.points.end());
+                model->thickness.insert(model->thickness.end(), chunk.thickness.begin(), chunk.thickness.end());
+                model->transparency.insert(model->transparency.end(), chunk.transparency.begin(), chunk.transparency.end());
+                model->colors.insert(model->colors.end(), chunk.colors.begin(), chunk.colors.end());
+                strands += table[c].strand_count;
+                points += table[c].point_count;
+            }
+        }
+        model->hair_count = static_cast<unsigned int>(strands);
+        model->point_count = static_cast<unsigned int>(points);
+    } catch (const std::bad_alloc&) {
+        if (err) *err = "Not enough memory to load the groom";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool HairCache::SaveToFile(const HairModel& model, std::string* err, const std::string& filename) {
+    return SaveToFile(model, err, filename, Settings());
+}
+
+bool HairCache::SaveToFile(const HairModel& model, std::string* err, const std::string& filename, const Settings& settings) {
+    size_t points = model.point_count;
+    if ((model.arrays & HAIR_FILE_SEGMENTS_BIT) && model.segments.size() != model.hair_count) {
+        if (err) *err = "Size of the segments array does not match the header";
+        return false;
+    }
+    const std::pair<int, size_t> sizes[] = {
+        {HAIR_FILE_POINTS_BIT, model.points.size() / 3}, {HAIR_FILE_THICKNESS_BIT, model.thickness.size()},
+        {HAIR_FILE_TRANSPARENCY_BIT, model.transparency.size()}, {HAIR_FILE_COLORS_BIT, model.colors.size() / 3}};
+    for (const auto& size : sizes) {
+        if ((model.arrays & size.first) && size.second != points) {
+            if (err) *err = "Size of a point array does not match the header";
+            return false;
+        }
+    }
+
+    std::vector<uint32_t> offsets(model.hair_count + 1, 0);
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        unsigned int segments = (model.arrays & HAIR_FILE_SEGMENTS_BIT) ? model.segments[s] : model.d_segments;
+        offsets[s + 1] = offsets[s] + segments + 1;
+    }
+    if (offsets.back() != points) {
+        if (err) *err = "Segment counts do not add up to the point count";
+        return false;
+    }
+
+    CacheHeader header;
+    header.hair_count = model.hair_count;
+    header.point_count = model.point_count;
+    header.arrays = model.arrays & (HAIR_FILE_SEGMENTS_BIT | HAIR_FILE_POINTS_BIT | HAIR_FILE_THICKNESS_BIT | HAIR_FILE_TRANSPARENCY_BIT | HAIR_FILE_COLORS_BIT);
+    header.d_segments = model.d_segments;
+    header.d_thickness = model.d_thickness;
+    header.d_transparency = model.d_transparency;
+    std::copy(std::begin(model.d_color), std::end(model.d_color), std::begin(header.d_color));
+    header.error_bound = std::max(settings.error_bound, 1e-7f);
+    header.chunk_strands = std::max(settings.chunk_strands, 1u);
+    header.chunk_count = (model.hair_count + header.chunk_strands - 1) / header.chunk_strands;
+
+    std::vector<ChunkEntry> table(header.chunk_count);
+    std::vector<std::vector<uint8_t>> payloads(header.chunk_count);
+    parallelFor(0, static_cast<int>(header.chunk_count), [&](int begin, int end) {
+        for (int c = begin; c < end; c++) {
+            uint32_t first = c * header.chunk_strands;
+            uint32_t count = std::min(header.chunk_strands, model.hair_count - first);
+            payloads[c] = encodeChunk(model, offsets, first, count, header.error_bound);
+            table[c] = {first, count, offsets[first], offsets[first + count] - offsets[first], 0, payloads[c].size()};
+        }
+    }, 1);
+    uint64_t offset = sizeof(CacheHeader) + table.size() * sizeof(ChunkEntry);
+    for (ChunkEntry& chunk : table) {
+        chunk.offset = offset;
+        offset += chunk.bytes;
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(ChunkEntry));
+    for (const std::vector<uint8_t>& payload : payloads) {
+        file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    }
+    if (!file) {
+        if (err) *err = "Error writing chunks";
+        return false;
+    }
+    return true;
+}
+
+bool HairCache::LoadFromFile(HairModel* model, std::string* err, const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    CacheHeader header;
+    std::vector<ChunkEntry> table;
+    if (!readTable(file, header, table, err)) return false;
+    return loadChunks(file, header, table, 0, table.size(), model, err);
+}
+
+bool HairCache::LoadStrands(HairModel* model, std::string* err, const std::string& filename, unsigned int first_strand, unsigned int strand_count) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    CacheHeader header;
+    std::vector<ChunkEntry> table;
+    if (!readTable(file, header, table, err)) return false;
+    if (first_strand > header.hair_count || strand_count > header.hair_count - first_strand) {
+        if (err) *err = "Strand range is out of bounds";
+        return false;
+    }
+    if (strand_count == 0) return loadChunks(file, header, table, 0, 0, model, err);
+
+    size_t begin = first_strand / header.chunk_strands;
+    size_t end = (first_strand + strand_count - 1) / header.chunk_strands + 1;
+    if (!loadChunks(file, header, table, begin, end, model, err)) return false;
+
+    // trim the strands of the first and last chunk that were not asked for
+    uint32_t skip = first_strand - table[begin].first_strand;
+    if (skip == 0 && strand_count == model->hair_count) return true;
+    bool has_segments = (header.arrays & HAIR_FILE_SEGMENTS_BIT) != 0;
+    auto points_of = [&](uint32_t from, uint32_t to) {
+        if (!has_segments) return static_cast<size_t>(to - from) * (header.d_segments + 1);
+        size_t n = 0;
+        for (uint32_t s = from; s < to; s++) n += model->segments[s] + 1;
+        return n;
+    };
+    size_t point_begin = points_of(0, skip);
+    size_t point_count = points_of(skip, skip + strand_count);
+    auto slice = [](auto& array, size_t begin, size_t count, size_t components) {
+        if (array.empty()) return;
+        array.erase(array.begin() + (begin + count) * components, array.end());
+        array.erase(array.begin(), array.begin() + begin * components);
+    };
+    slice(model->segments, skip, strand_count, 1);
+    slice(model->points, point_begin, point_count, 3);
+    slice(model->thickness, point_begin, point_count, 1);
+    slice(model->transparency, point_begin, point_count, 1);
+    slice(model->colors, point_begin, point_count, 3);
+    model->hair_count = strand_count;
+    model->point_count = static_cast<unsigned int>(point_count);
+    return true;
+}
+
+bool HairCache::IsCacheFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    char signature[4] = {};
+    file.read(signature, 4);
+    return file.gcount() == 4 && std::string(signature, 4) == "CGCH";
+}
@@ -0,0 +1,400 @@
+#include "HairGrid.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+HairGrid::HairGrid(double cell_size) : cell_size(cell_size) {}
+
+void HairGrid::transfer(std::vector<DER>& strands, double dt) {
+    splat(strands);
+    solveVelocity();
+    applyForces(strands, dt);
+}
+
+int HairGrid::brickCount() const {
+    return static_cast<int>(brick_keys.size());
+}
+
+int64_t HairGrid::key(const Eigen::Vector3i& brick) {
+    return static_cast<int64_t>(brick.x()) | static_cast<int64_t>(brick.y()) << KEY_BITS | static_cast<int64_t>(brick.z()) << (2 * KEY_BITS);
+}
+
+Eigen::Vector3i HairGrid::brickOf(int64_t key) {
+    const int64_t mask = (int64_t(1) << KEY_BITS) - 1;
+    return Eigen::Vector3i(static_cast<int>(key & mask), static_cast<int>((key >> KEY_BITS) & mask), static_cast<int>(key >> (2 * KEY_BITS)));
+}
+
+namespace {
+
+// splitmix64 finalizer, the y and z bits of the key have to reach the low bits as well
+size_t hashKey(int64_t key, size_t mask) {
+    uint64_t h = static_cast<uint64_t>(key);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<size_t>(h ^ (h >> 31)) & mask;
+}
+
+} // namespace
+
+int HairGrid::findBrick(int64_t key) const {
+    if (table_keys.empty()) return -1;
+    size_t mask = table_keys.size() - 1;
+    for (size_t h = hashKey(key, mask);; h = (h + 1) & mask) {
+        if (table_keys[h] == key) return table_slots[h];
+        if (table_keys[h] < 0) return -1;
+    }
+}
+
+void HairGrid::addBrick(int64_t key) {
+    if (2 * (brick_keys.size() + 1) > table_keys.size()) {
+        // grow to keep the load factor below 1/2
+        table_keys.assign(std::max<size_t>(64, 2 * table_keys.size()), -1);
+        table_slots.assign(table_keys.size(), -1);
+        size_t mask = table_keys.size() - 1;
+        for (size_t slot = 0; slot < brick_keys.size(); slot++) {
+            size_t h = hashKey(brick_keys[slot], mask);
+            while (table_keys[h] >= 0) h = (h + 1) & mask;
+            table_keys[h] = brick_keys[slot];
+            table_slots[h] = static_cast<int>(slot);
+        }
+    }
+    size_t mask = table_keys.size() - 1;
+    size_t h = hashKey(key, mask);
+    for (; table_keys[h] >= 0; h = (h + 1) & mask) {
+        if (table_keys[h] == key) return;
+    }
+    table_keys[h] = key;
+    table_slots[h] = static_cast<int>(brick_keys.size());
+    brick_keys.push_back(key);
+}
+
+int HairGrid::findBrick(int64_t key, BrickCache& cache) const {
+    if (key != cache.key) {
+        cache.key = key;
+        cache.slot = findBrick(key);
+    }
+    return cache.slot;
+}
+
+int HairGrid::node(int slot, int i, int j, int k) const {
+    // -BRICK <= i, j, k < 2 * BRICK
+    int di = (i + BRICK) / BRICK - 1, dj = (j + BRICK) / BRICK - 1, dk = (k + BRICK) / BRICK - 1;
+    int neighbor = neighbors[slot * 27 + ((dk + 1) * 3 + (dj + 1)) * 3 + (di + 1)];
+    if (neighbor < 0) return -1;
+    int local = ((k - dk * BRICK) * BRICK + (j - dj * BRICK)) * BRICK + (i - di * BRICK);
+    return neighbor * BRICK_SIZE + local;
+}
+
+bool HairGrid::locate(const Eigen::Vector3d& p, Eigen::Vector3i& base, Eigen::Vector3d& frac) const {
+    // the +1 corner has to fit in a brick key as well
+    const double limit = double(BRICK) * (1 << KEY_BITS) - 1.0;
+    Eigen::Vector3d g = (p - origin) / cell_size;
+    for (int d = 0; d < 3; d++) {
+        if (!(g[d] >= 0.0 && g[d] < limit)) return false; // also NaN
+        double f = std::floor(g[d]);
+        base[d] = static_cast<int>(f);
+        frac[d] = g[d] - f;
+    }
+    return true;
+}
+
+bool HairGrid::stencil(const Eigen::Vector3d& p, int nodes[8], Eigen::Vector3d& frac, BrickCache& cache) const {
+    Eigen::Vector3i base;
+    if (!locate(p, base, frac)) return false;
+    Eigen::Vector3i brick = base / BRICK;
+    int slot = findBrick(key(brick), cache);
+    if (slot < 0) return false; // no mass can be near
+    Eigen::Vector3i local = base - brick * BRICK;
+    for (int corner = 0; corner < 8; corner++) {
+        nodes[corner] = node(slot, local.x() + (corner & 1), local.y() + ((corner >> 1) & 1), local.z() + ((corner >> 2) & 1));
+    }
+    return true;
+}
+
+void HairGrid::allocate(const std::vector<DER>& strands, std::vector<int>& vertex_slots) {
+    Eigen::Vector3d lo = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    std::mutex bounds_mutex;
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        Eigen::Vector3d chunk_lo = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+        for (int s = begin; s < end; s++) {
+            for (const Eigen::Vector3d& x : strands[s].getVertices()) {
+                if (x.allFinite()) chunk_lo = chunk_lo.cwiseMin(x);
+            }
+        }
+        std::lock_guard<std::mutex> lock(bounds_mutex);
+        lo = lo.cwiseMin(chunk_lo);
+    });
+    if (lo.x() == std::numeric_limits<double>::max()) {
+        lo = Eigen::Vector3d::Zero();
+    }
+    // 1セル分の余白を取り、-1側の隣接ブリックも負の座標にならないようにする
+    origin = lo - Eigen::Vector3d::Constant(cell_size);
+
+    int num_strands = static_cast<int>(strands.size());
+    std::vector<int> strand_offsets(num_strands + 1, 0);
+    for (int s = 0; s < num_strands; s++) {
+        strand_offsets[s + 1] = strand_offsets[s] + static_cast<int>(strands[s].getVertices().size());
+    }
+    std::vector<int64_t> vertex_keys(strand_offsets[num_strands]);
+    parallelFor(0, num_strands, [&](int begin, int end) {
+        Eigen::Vector3i base;
+        Eigen::Vector3d frac;
+        for (int s = begin; s < end; s++) {
+            const std::vector<Eigen::Vector3d>& x = strands[s].getVertices();
+            for (size_t i = 0; i < x.size(); i++) {
+                vertex_keys[strand_offsets[s] + i] = locate(x[i], base, frac) ? key(base / BRICK) : -1;
+            }
+        }
+    });
+
+    // bricks with vertices and the halo around them, which holds the +1 corners and the solver stencil
+    const int key_max = (1 << KEY_BITS) - 1;
+    brick_keys.clear();
+    table_keys.clear();
+    for (size_t v = 0; v < vertex_keys.size(); v++) {
+        if (vertex_keys[v] >= 0 && (v == 0 || vertex_keys[v] != vertex_keys[v - 1])) addBrick(vertex_keys[v]);
+    }
+    const int num_occupied = brickCount();
+    for (int slot = 0; slot < num_occupied; slot++) {
+        Eigen::Vector3i b = brickOf(brick_keys[slot]);
+        for (int n = 0; n < 27; n++) {
+            Eigen::Vector3i h = b + Eigen::Vector3i(n % 3 - 1, (n / 3) % 3 - 1, n / 9 - 1);
+            if ((h.array() >= 0).all() && (h.array() <= key_max).all()) addBrick(key(h));
+        }
+    }
+
+    int num_bricks = brickCount();
+    neighbors.assign(size_t(num_bricks) * 27, -1);
+    parallelFor(0, num_bricks, [&](int begin, int end) {
+        for (int slot = begin; slot < end; slot++) {
+            Eigen::Vector3i b = brickOf(brick_keys[slot]);
+            for (int n = 0; n < 27; n++) {
+                Eigen::Vector3i h = b + Eigen::Vector3i(n % 3 - 1, (n / 3) % 3 - 1, n / 9 - 1);
+                if ((h.array() >= 0).all() && (h.array() <= key_max).all()) neighbors[slot * 27 + n] = findBrick(key(h));
+            }
+        }
+    });
+
+    vertex_slots.resize(vertex_keys.size());
+    parallelFor(0, static_cast<int>(vertex_keys.size()), [&](int begin, int end) {
+        BrickCache cache;
+        for (int v = begin; v < end; v++) {
+            vertex_slots[v] = vertex_keys[v] < 0 ? -1 : findBrick(vertex_keys[v], cache);
+        }
+    });
+
+    size_t num_nodes = size_t(num_bricks) * BRICK_SIZE;
+    mass.assign(num_nodes, 0.0);
+    velocity.assign(num_nodes, Eigen::Vector3d::Zero());
+    pressure.assign(num_nodes, 0.0);
+}
+
+void HairGrid::splat(const std::vector<DER>& strands) {
+    // vertices that cannot be placed in the grid (not finite or too far out) are ignored
+    std::vector<int> vertex_slots;
+    allocate(strands, vertex_slots);
+
+    // counting sort of the vertices by brick
+    int num_bricks = brickCount();
+    brick_offsets.assign(num_bricks + 1, 0);
+    for (int slot : vertex_slots) {
+        if (slot >= 0) brick_offsets[slot + 1]++;
+    }
+    for (int b = 0; b < num_bricks; b++) {
+        brick_offsets[b + 1] += brick_offsets[b];
+    }
+
+    int num_sorted = brick_offsets[num_bricks];
+    sorted_positions.resize(num_sorted);
+    sorted_momenta.resize(num_sorted);
+    sorted_masses.resize(num_sorted);
+    std::vector<int> cursor(brick_offsets.begin(), brick_offsets.end() - 1);
+    size_t v_index = 0;
+    for (const DER& strand : strands) {
+        const std::vector<Eigen::Vector3d>& x = strand.getVertices();
+        const std::vector<Eigen::Vector3d>& v = strand.getVelocities();
+        const std::vector<double>& m = strand.getMasses();
+        for (size_t i = 0; i < x.size(); i++, v_index++) {
+            int slot = vertex_slots[v_index];
+            if (slot < 0) continue;
+            int dst = cursor[slot]++;
+            sorted_positions[dst] = x[i];
+            sorted_momenta[dst] = m[i] * v[i];
+            sorted_masses[dst] = m[i];
+        }
+    }
+
+    // bricks with the same parity in every axis never touch the same nodes
+    std::vector<int> color_bricks[8];
+    for (int b = 0; b < num_bricks; b++) {
+        if (brick_offsets[b] == brick_offsets[b + 1]) continue;
+        Eigen::Vector3i brick = brickOf(brick_keys[b]);
+        color_bricks[(brick.x() & 1) | (brick.y() & 1) << 1 | (brick.z() & 1) << 2].push_back(b);
+    }
+    for (int color = 0; color < 8; color++) {
+        const std::vector<int>& same_color = color_bricks[color];
+        parallelFor(0, static_cast<int>(same_color.size()), [&](int begin, int end) {
+            Eigen::Vector3i base;
+            Eigen::Vector3d frac;
+            for (int c = begin; c < end; c++) {
+                int b = same_color[c];
+                Eigen::Vector3i first = brickOf(brick_keys[b]) * BRICK;
+                for (int p = brick_offsets[b]; p < brick_offsets[b + 1]; p++) {
+                    locate(sorted_positions[p], base, frac);
+                    Eigen::Vector3i local = base - first;
+                    for (int corner = 0; corner < 8; corner++) {
+                        int di = corner & 1, dj = (corner >> 1) & 1, dk = (corner >> 2) & 1;
+                        double w = (di ? frac.x() : 1.0 - frac.x())
+                                 * (dj ? frac.y() : 1.0 - frac.y())
+                                 * (dk ? frac.z() : 1.0 - frac.z());
+                        int n = node(b, local.x() + di, local.y() + dj, local.z() + dk); // in the halo at the latest
+                        mass[n] += w * sorted_masses[p];
+                        velocity[n] += w * sorted_momenta[p];
+                    }
+                }
+            }
+        }, 1);
+    }
+
+    // momentum -> velocity
+    parallelFor(0, static_cast<int>(mass.size()), [&](int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            if (mass[n] > 0.0) {
+                velocity[n] /= mass[n];
+            }
+        }
+    });
+    splat_velocity = velocity;
+}
+
+void HairGrid::solveVelocity() {
+    // Pressure smoothing: solve lap(p) = div(v) inside the hair volume with p = 0 outside,
+    // then subtract grad(p). Only allocated bricks are visited, brick by brick to keep the stencil in cache.
+    // stencil[6 * n + f] is the f-th axis neighbor (-x, +x, -y, +y, -z, +z) of node n, -1 for nodes that
+    // are outside the volume or lack a neighbor (only possible at the halo's border, where there is no mass).
+    std::fill(pressure.begin(), pressure.end(), 0.0);
+    if (pressure_iterations <= 0) return; // p = 0, the velocity stays as splatted
+    std::vector<int> stencil(mass.size() * 6, -1);
+    parallelFor(0, brickCount(), [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            for (int local = 0; local < BRICK_SIZE; local++) {
+                int n = b * BRICK_SIZE + local;
+                if (mass[n] <= 0.0) continue;
+                int i = local % BRICK, j = (local / BRICK) % BRICK, k = local / (BRICK * BRICK);
+                int faces[6] = {node(b, i - 1, j, k), node(b, i + 1, j, k), node(b, i, j - 1, k),
+                                node(b, i, j + 1, k), node(b, i, j, k - 1), node(b, i, j, k + 1)};
+                if (std::find(std::begin(faces), std::end(faces), -1) != std::end(faces)) continue;
+                std::copy(std::begin(faces), std::end(faces), stencil.begin() + 6 * n);
+            }
+        }
+    });
+    auto forEachNode = [&](const std::function<void(int, const int*)>& func) {
+        parallelFor(0, brickCount(), [&](int begin, int end) {
+            for (int n = begin * BRICK_SIZE; n < end * BRICK_SIZE; n++) {
+                if (stencil[6 * n] >= 0) func(n, &stencil[6 * n]);
+            }
+        });
+    };
+
+    std::vector<double> divergence(mass.size(), 0.0);
+    forEachNode([&](int n, const int* f) {
+        divergence[n] = (velocity[f[1]].x() - velocity[f[0]].x()
+                       + velocity[f[3]].y() - velocity[f[2]].y()
+                       + velocity[f[5]].z() - velocity[f[4]].z()) / (2.0 * cell_size);
+    });
+
+    std::vector<double> next_pressure(pressure.size(), 0.0);
+    double h2 = cell_size * cell_size;
+    for (int iter = 0; iter < pressure_iterations; iter++) {
+        forEachNode([&](int n, const int* f) {
+            double sum = pressure[f[0]] + pressure[f[1]] + pressure[f[2]] + pressure[f[3]] + pressure[f[4]] + pressure[f[5]];
+            next_pressure[n] = (sum - h2 * divergence[n]) / 6.0;
+        });
+        pressure.swap(next_pressure);
+    }
+
+    forEachNode([&](int n, const int* f) {
+        Eigen::Vector3d grad_p(pressure[f[1]] - pressure[f[0]], pressure[f[3]] - pressure[f[2]], pressure[f[5]] - pressure[f[4]]);
+        velocity[n] -= grad_p / (2.0 * cell_size);
+    });
+}
+
+void HairGrid::applyForces(std::vector<DER>& strands, double dt) const {
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        int nodes[8];
+        Eigen::Vector3d frac;
+        BrickCache cache;
+        const Eigen::Vector3d zero = Eigen::Vector3d::Zero();
+        for (int s = begin; s < end; s++) {
+            const std::vector<Eigen::Vector3d>& x = strands[s].getVertices();
+            const std::vector<Eigen::Vector3d>& v = strands[s].getVelocities();
+            const std::vector<double>& m = strands[s].getMasses();
+            std::vector<Eigen::Vector3d> forces(x.size(), zero);
+            for (size_t i = 0; i < x.size(); i++) {
+                if (!stencil(x[i], nodes, frac, cache)) continue;
+                Eigen::Vector3d v_pic = interpolate(velocity, nodes, frac, zero);
+                Eigen::Vector3d v_flip = v[i] + v_pic - interpolate(splat_velocity, nodes, frac, zero);
+                Eigen::Vector3d v_target = flip_ratio * v_flip + (1.0 - flip_ratio) * v_pic;
+                forces[i] = m[i] * (friction * (v_target - v[i]) / dt - repulsion * densityGradient(nodes, frac));
+            }
+            strands[s].addExternalForces(forces);
+        }
+    });
+}
+
+template <typename T>
+T HairGrid::interpolate(const std::vector<T>& field, const int nodes[8], const Eigen::Vector3d& frac, const T& zero) const {
+    T ret = zero;
+    for (int corner = 0; corner < 8; corner++) {
+        if (nodes[corner] < 0) continue;
+        int di = corner & 1, dj = (corner >> 1) & 1, dk = (corner >> 2) & 1;
+        double w = (di ? frac.x() : 1.0 - frac.x())
+                 * (dj ? frac.y() : 1.0 - frac.y())
+                 * (dk ? frac.z() : 1.0 - frac.z());
+        ret += w * field[nodes[corner]];
+    }
+    return ret;
+}
+
+Eigen::Vector3d HairGrid::densityGradient(const int nodes[8], const Eigen::Vector3d& frac) const {
+    // derivative of the trilinear weights
+    Eigen::Vector3d grad = Eigen::Vector3d::Zero();
+    for (int corner = 0; corner < 8; corner++) {
+        if (nodes[corner] < 0) continue;
+        int di = corner & 1, dj = (corner >> 1) & 1, dk = (corner >> 2) & 1;
+        double wx = di ? frac.x() : 1.0 - frac.x();
+        double wy = dj ? frac.y() : 1.0 - frac.y();
+        double wz = dk ? frac.z() : 1.0 - frac.z();
+        double sx = di ? 1.0 : -1.0, sy = dj ? 1.0 : -1.0, sz = dk ? 1.0 : -1.0;
+        grad += mass[nodes[corner]] * Eigen::Vector3d(sx * wy * wz, wx * sy * wz, wx * wy * sz);
+    }
+    return grad / (cell_size * cell_size * cell_size * cell_size);
+}
+
+double HairGrid::sampleDensity(const Eigen::Vector3d& p) const {
+    int nodes[8];
+    Eigen::Vector3d frac;
+    BrickCache cache;
+    if (!stencil(p, nodes, frac, cache)) return 0.0;
+    return interpolate(mass, nodes, frac, 0.0) / (cell_size * cell_size * cell_size);
+}
+
+Eigen::Vector3d HairGrid::sampleVelocity(const Eigen::Vector3d& p) const {
+    int nodes[8];
+    Eigen::Vector3d frac;
+    BrickCache cache;
+    const Eigen::Vector3d zero = Eigen::Vector3d::Zero();
+    if (!stencil(p, nodes, frac, cache)) return zero;
+    return interpolate(velocity, nodes, frac, zero);
+}
+
+Eigen::Vector3d HairGrid::sampleDensityGradient(const Eigen::Vector3d& p) const {
+    int nodes[8];
+    Eigen::Vector3d frac;
+    BrickCache cache;
+    if (!stencil(p, nodes, frac, cache)) return Eigen::Vector3d::Zero();
+    return densityGradient(nodes, frac);
+}
@@ -1,7 +1,128 @@
 #include "HairLoader.h"
+#include "HairCache.h"
+#include "Trace.h"
+#include <algorithm>
 #include <fstream>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// File read at explicit offsets, safe to share between threads (pread / overlapped ReadFile)
+class PositionalFile {
+public:
+    explicit PositionalFile(const std::string& filename) {
+#ifdef _WIN32
+        handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        fd = open(filename.c_str(), O_RDONLY);
+#endif
+    }
+
+    ~PositionalFile() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+#else
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+    bool isOpen() const {
+#ifdef _WIN32
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    uint64_t size() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        return GetFileSizeEx(handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+        struct stat st;
+        return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+    }
+
+    bool read(uint64_t offset, void* data, size_t bytes) const {
+        char* out = static_cast<char*>(data);
+        while (bytes > 0) {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD n = 0;
+            if (!ReadFile(handle, out, static_cast<DWORD>(std::min<size_t>(bytes, 1u << 30)), &n, &overlapped) || n == 0) return false;
+#else
+            ssize_t n = pread(fd, out, bytes, static_cast<off_t>(offset));
+            if (n <= 0) return false;
+#endif
+            out += n;
+            offset += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
+
+constexpr size_t async_block_bytes = 4 << 20; // unit of work of the loader threads
+
+// Points of all strands, sum of segments[i] + 1. Widened to 32-bit lanes in blocks short enough that
+// no lane can overflow (2^14 values below 2^16 each), then into 64 bits.
+uint64_t strandPointCount(const unsigned short* segments, size_t count) {
+    uint64_t sum = count;
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    while (count - i >= 8) {
+        size_t end = i + std::min<size_t>((count - i) & ~size_t(7), size_t(1) << 16);
+        __m128i acc = zero;
+        for (; i < end; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(segments + i));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        sum += uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+#elif defined(__ARM_NEON)
+    while (count - i >= 8) {
+        size_t end = i + std::min<size_t>((count - i) & ~size_t(7), size_t(1) << 16);
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; i < end; i += 8) acc = vpadalq_u16(acc, vld1q_u16(segments + i));
+        sum += vaddlvq_u32(acc);
+    }
+#endif
+    for (; i < count; i++) sum += segments[i];
+    return sum;
+}
+
+} // namespace
 
 bool HairLoader::LoadFromFile(HairModel* model, std::string* err, std::string* warn, const std::string& filename) {
+    CGC_TRACE_SCOPE("HairLoader::LoadFromFile");
+    if (warn) warn->clear();
     std::ifstream file(filename, std::ios::binary);
     if (!file) {
         if (err) *err = "Cannot open file";
@@ -9,6 +130,11 @@ bool HairLoader::LoadFromFile(HairModel* model, std::string* err, std::string* w
     }
 
     file.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    if (file.gcount() >= 4 && std::string(header.signature, 4) == "CGCH") {
+        file.close();
+        HairCache cache;
+        return cache.LoadFromFile(model, err, filename);
+    }
     if (file.gcount() < sizeof(Header)) {
         if (err) *err = "Failed to read header";
         return false;
@@ -21,6 +147,29 @@ bool HairLoader::LoadFromFile(HairModel* model, std::string* err, std::string* w
         return false;
     }
 
+    // the header sizes every array, check them against the file before anything is allocated
+    file.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(sizeof(Header));
+    uint64_t points = header.point_count;
+    uint64_t required = sizeof(Header);
+    if (header.arrays & HAIR_FILE_SEGMENTS_BIT) required += header.hair_count * uint64_t(sizeof(unsigned short));
+    if (header.arrays & HAIR_FILE_POINTS_BIT) required += 3 * points * sizeof(float);
+    if (header.arrays & HAIR_FILE_THICKNESS_BIT) required += points * sizeof(float);
+    if (header.arrays & HAIR_FILE_TRANSPARENCY_BIT) required += points * sizeof(float);
+    if (header.arrays & HAIR_FILE_COLORS_BIT) required += 3 * points * sizeof(float);
+    if (required > file_size) {
+        if (err) *err = "File is smaller than its header requires";
+        return false;
+    }
+
+    std::string warnings;
+    auto addWarning = [&](const std::string& message) {
+        warnings += (warnings.empty() ? "" : "\n") + message;
+    };
+    if (required < file_size) addWarning(std::to_string(file_size - required) + " bytes after the last array are ignored");
+    if (!(header.arrays & HAIR_FILE_POINTS_BIT) && header.point_count > 0) addWarning("File has no points array");
+
     model->hair_count = header.hair_count;
     model->point_count = header.point_count;
     model->arrays = header.arrays;
@@ -28,26 +177,38 @@ bool HairLoader::LoadFromFile(HairModel* model, std::string* err, std::string* w
     model->d_thickness = header.d_thickness;
     model->d_transparency = header.d_transparency;
     std::copy(std::begin(header.d_color), std::end(header.d_color), std::begin(model->d_color));
+    model->segments.clear();
+    model->points.clear();
+    model->thickness.clear();
+    model->transparency.clear();
+    model->colors.clear();
 
     if (header.arrays & HAIR_FILE_SEGMENTS_BIT) {
         model->segments.resize(header.hair_count);
         file.read(reinterpret_cast<char*>(model->segments.data()), header.hair_count * sizeof(unsigned short));
     }
+    // strands index into the point arrays, so they have to cover them exactly
+    uint64_t strand_points = (header.arrays & HAIR_FILE_SEGMENTS_BIT) ? strandPointCount(model->segments.data(), model->segments.size())
+                                                                      : header.hair_count * (uint64_t(header.d_segments) + 1);
+    if (file && strand_points != points) {
+        if (err) *err = "Segments do not add up to point_count";
+        return false;
+    }
     if (header.arrays & HAIR_FILE_POINTS_BIT) {
-        model->points.resize(header.point_count * 3);
-        file.read(reinterpret_cast<char*>(model->points.data()), header.point_count * 3 * sizeof(float));
+        model->points.resize(header.point_count * size_t(3));
+        file.read(reinterpret_cast<char*>(model->points.data()), points * 3 * sizeof(float));
     }
     if (header.arrays & HAIR_FILE_THICKNESS_BIT) {
         model->thickness.resize(header.point_count);
-        file.read(reinterpret_cast<char*>(model->thickness.data()), header.point_count * sizeof(float));
+        file.read(reinterpret_cast<char*>(model->thickness.data()), points * sizeof(float));
     }
     if (header.arrays & HAIR_FILE_TRANSPARENCY_BIT) {
         model->transparency.resize(header.point_count);
-        file.read(reinterpret_cast<char*>(model->transparency.data()), header.point_count * sizeof(float));
+        file.read(reinterpret_cast<char*>(model->transparency.data()), points * sizeof(float));
     }
     if (header.arrays & HAIR_FILE_COLORS_BIT) {
-        model->colors.resize(header.point_count * 3);
-        file.read(reinterpret_cast<char*>(model->colors.data()), header.point_count * 3 * sizeof(float));
+        model->colors.resize(header.point_count * size_t(3));
+        file.read(reinterpret_cast<char*>(model->colors.data()), points * 3 * sizeof(float));
     }
 
     if (!file) {
@@ -55,5 +216,247 @@ bool HairLoader::LoadFromFile(HairModel* model, std::string* err, std::string* w
         return false;
     }
 
+    if (warn) *warn = warnings;
+    return true;
+}
+std::unique_ptr<HairLoader::AsyncLoad> HairLoader::LoadFromFileAsync(const std::string& filename, ProgressCallback progress, unsigned int proxy_strands, unsigned int threads) {
+    std::unique_ptr<AsyncLoad> load(new AsyncLoad());
+    load->filename = filename;
+    load->progress = std::move(progress);
+    load->proxy_strands = proxy_strands;
+    load->threads = threads > 0 ? threads : std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+    load->loader = std::thread(&AsyncLoad::run, load.get());
+    return load;
+}
+
+HairLoader::AsyncLoad::~AsyncLoad() {
+    Cancel();
+    if (loader.joinable()) loader.join();
+}
+
+bool HairLoader::AsyncLoad::IsReady() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return done;
+}
+
+float HairLoader::AsyncLoad::GetProgress() const {
+    return static_cast<float>(static_cast<double>(bytes_read.load()) / bytes_total.load());
+}
+
+void HairLoader::AsyncLoad::Cancel() {
+    canceled = true;
+}
+
+bool HairLoader::AsyncLoad::GetProxy(HairModel* out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!proxy_ready) return false;
+    *out = proxy;
+    return true;
+}
+
+bool HairLoader::AsyncLoad::Get(HairModel* out, std::string* out_err, std::string* out_warn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&] { return done; });
+    if (out_err) *out_err = err;
+    if (out_warn) *out_warn = warn;
+    if (!ok) return false;
+    *out = std::move(model);
+    ok = false; // moved out
+    return true;
+}
+
+void HairLoader::AsyncLoad::run() {
+    bool result = load();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ok = result;
+        done = true;
+    }
+    done_cv.notify_all();
+}
+
+bool HairLoader::AsyncLoad::load() {
+    CGC_TRACE_THREAD_NAME("hair loader");
+    CGC_TRACE_SCOPE("HairLoader::AsyncLoad");
+    PositionalFile file(filename);
+    if (!file.isOpen()) {
+        err = "Cannot open file";
+        return false;
+    }
+    char signature[4];
+    if (file.read(0, signature, 4) && std::string(signature, 4) == "CGCH") {
+        // compact caches are small, decoded in one go without proxy or block progress
+        HairCache cache;
+        if (!cache.LoadFromFile(&model, &err, filename)) return false;
+        if (canceled) {
+            err = "Canceled";
+            return false;
+        }
+        bytes_read = bytes_total.load();
+        if (progress) progress(1.0f);
+        return true;
+    }
+    Header header;
+    if (!file.read(0, &header, sizeof(Header))) {
+        err = "Failed to read header";
+        return false;
+    }
+    if (std::string(header.signature, 4) != "HAIR") {
+        err = "Invalid file signature";
+        return false;
+    }
+
+    // where each array lives, checked against the file size before anything is allocated
+    struct Array {
+        int bit;
+        void* data;
+        uint64_t offset;
+        uint64_t bytes;
+    };
+    uint64_t points = header.point_count;
+    uint64_t sizes[] = {header.hair_count * uint64_t(sizeof(unsigned short)), 3 * points * sizeof(float), points * sizeof(float), points * sizeof(float), 3 * points * sizeof(float)};
+    int bits[] = {HAIR_FILE_SEGMENTS_BIT, HAIR_FILE_POINTS_BIT, HAIR_FILE_THICKNESS_BIT, HAIR_FILE_TRANSPARENCY_BIT, HAIR_FILE_COLORS_BIT};
+    std::vector<Array> arrays;
+    uint64_t offset = sizeof(Header);
+    for (int a = 0; a < 5; a++) {
+        if (!(header.arrays & bits[a])) continue;
+        arrays.push_back({bits[a], nullptr, offset, sizes[a]});
+        offset += sizes[a];
+    }
+    if (offset > file.size()) {
+        err = "File is smaller than its header requires";
+        return false;
+    }
+    if (offset < file.size()) warn = std::to_string(file.size() - offset) + " bytes after the last array are ignored";
+
+    model.hair_count = header.hair_count;
+    model.point_count = header.point_count;
+    model.arrays = header.arrays;
+    model.d_segments = header.d_segments;
+    model.d_thickness = header.d_thickness;
+    model.d_transparency = header.d_transparency;
+    std::copy(std::begin(header.d_color), std::end(header.d_color), std::begin(model.d_color));
+
+    // segments first, the proxy needs the strand offsets
+    std::vector<uint64_t> strand_offsets;
+    if (header.arrays & HAIR_FILE_SEGMENTS_BIT) {
+        model.segments.resize(header.hair_count);
+        if (!file.read(arrays[0].offset, model.segments.data(), arrays[0].bytes)) {
+            err = "Error reading data arrays";
+            return false;
+        }
+        bytes_read += arrays[0].bytes;
+    }
+    uint64_t strand_points = model.segments.empty() ? header.hair_count * (uint64_t(header.d_segments) + 1)
+                                                    : strandPointCount(model.segments.data(), model.segments.size());
+    if (strand_points != points) {
+        err = "Segments do not add up to point_count";
+        return false;
+    }
+    if (proxy_strands > 0 && header.hair_count > proxy_strands) {
+        strand_offsets.resize(header.hair_count + 1, 0);
+        for (unsigned int s = 0; s < header.hair_count; s++) {
+            strand_offsets[s + 1] = strand_offsets[s] + (model.segments.empty() ? header.d_segments : model.segments[s]) + 1;
+        }
+    }
+
+    uint64_t total = 0;
+    for (const Array& array : arrays) total += array.bytes;
+    bytes_total = std::max<uint64_t>(total, 1);
+
+    if (!strand_offsets.empty()) {
+        CGC_TRACE_SCOPE("HairLoader proxy");
+        unsigned int stride = (header.hair_count + proxy_strands - 1) / proxy_strands;
+        HairModel preview = model;
+        preview.segments.clear();
+        std::vector<unsigned int> picked;
+        for (unsigned int s = 0; s < header.hair_count; s += stride) picked.push_back(s);
+        // the counts follow the strands actually read, so that the proxy is consistent at every point
+        preview.hair_count = 0;
+        preview.point_count = 0;
+        for (unsigned int s : picked) {
+            if (canceled) {
+                err = "Canceled";
+                return false; // a partial proxy is never published
+            }
+            uint64_t first = strand_offsets[s], count = strand_offsets[s + 1] - first;
+            if (!model.segments.empty()) preview.segments.push_back(model.segments[s]);
+            for (const Array& array : arrays) {
+                std::vector<float>* target = array.bit == HAIR_FILE_POINTS_BIT ? &preview.points
+                                           : array.bit == HAIR_FILE_THICKNESS_BIT ? &preview.thickness
+                                           : array.bit == HAIR_FILE_TRANSPARENCY_BIT ? &preview.transparency
+                                           : array.bit == HAIR_FILE_COLORS_BIT ? &preview.colors : nullptr;
+                if (!target) continue;
+                int components = array.bit == HAIR_FILE_POINTS_BIT || array.bit == HAIR_FILE_COLORS_BIT ? 3 : 1;
+                size_t at = target->size();
+                target->resize(at + components * count);
+                if (!file.read(array.offset + components * first * sizeof(float), target->data() + at, components * count * sizeof(float))) {
+                    err = "Error reading data arrays";
+                    return false;
+                }
+            }
+            preview.hair_count++;
+            preview.point_count += static_cast<unsigned int>(count);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        proxy = std::move(preview);
+        proxy_ready = true;
+    }
+
+    // the remaining arrays in blocks, handed out to the loader threads through an atomic counter
+    struct Block {
+        char* data;
+        uint64_t offset;
+        size_t bytes;
+    };
+    std::vector<Block> blocks;
+    for (Array& array : arrays) {
+        char* data = nullptr;
+        switch (array.bit) {
+            case HAIR_FILE_POINTS_BIT: model.points.resize(3 * points); data = reinterpret_cast<char*>(model.points.data()); break;
+            case HAIR_FILE_THICKNESS_BIT: model.thickness.resize(points); data = reinterpret_cast<char*>(model.thickness.data()); break;
+            case HAIR_FILE_TRANSPARENCY_BIT: model.transparency.resize(points); data = reinterpret_cast<char*>(model.transparency.data()); break;
+            case HAIR_FILE_COLORS_BIT: model.colors.resize(3 * points); data = reinterpret_cast<char*>(model.colors.data()); break;
+            default: continue; // segments, already read
+        }
+        for (uint64_t at = 0; at < array.bytes; at += async_block_bytes) {
+            blocks.push_back({data + at, array.offset + at, static_cast<size_t>(std::min<uint64_t>(async_block_bytes, array.bytes - at))});
+        }
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex progress_mutex;
+    auto work = [&]() {
+        while (!canceled && !failed) {
+            size_t b = next.fetch_add(1);
+            if (b >= blocks.size()) break;
+            CGC_TRACE_SCOPE("HairLoader block");
+            if (!file.read(blocks[b].offset, blocks[b].data, blocks[b].bytes)) {
+                failed = true;
+                break;
+            }
+            uint64_t read = bytes_read.fetch_add(blocks[b].bytes) + blocks[b].bytes;
+            if (progress) {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                progress(static_cast<float>(static_cast<double>(read) / bytes_total.load()));
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < std::min<size_t>(threads, blocks.size()); t++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) worker.join();
+
+    if (failed) {
+        err = "Error reading data arrays";
+        return false;
+    }
+    if (canceled) {
+        err = "Canceled";
+        return false;
+    }
     return true;
-}
\ No newline at end of file
+}
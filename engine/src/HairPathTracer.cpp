@@ -0,0 +1,292 @@
+#include "HairPathTracer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include "Camera.h"
+#include "Parallel.h"
+
+namespace {
+
+constexpr float pi = 3.14159265358979323846f;
+constexpr int max_crossings = 64; // transparent strands passed through by one ray
+constexpr unsigned int roulette_bounce = 2; // paths may end randomly after this many bounces
+
+uint64_t splitmix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+float sinToTangent(const Eigen::Vector3f& tangent, const Eigen::Vector3f& w) {
+    float c = tangent.dot(w);
+    return std::sqrt(std::max(0.0f, 1.0f - c * c));
+}
+
+// Kajiya-Kay fiber scattering, both directions pointing away from the fiber. The diffuse lobe is
+// normalized by pi^2, the integral of the fiber "cosine" (sine to the tangent) over all directions.
+// The white specular lobe is a cone around the mirror directions of `in` about the tangent: cone is the
+// cosine of the angle to it, the same all around the fiber, and cone^n is about a Gaussian of width
+// 1 / sqrt(n), which the normalization divides out.
+Eigen::Vector3f scatter(const HairPathTracer::Settings& settings, const Eigen::Vector3f& color, const Eigen::Vector3f& tangent,
+                        const Eigen::Vector3f& in, const Eigen::Vector3f& out) {
+    float ti = tangent.dot(in), to = tangent.dot(out);
+    float cone = sinToTangent(tangent, in) * sinToTangent(tangent, out) - ti * to;
+    float norm = std::sqrt(settings.shininess / (2.0f * pi)) / (2.0f * pi);
+    float specular = cone > 0.0f ? settings.specular * norm * std::pow(cone, settings.shininess) : 0.0f;
+    return (settings.diffuse / (pi * pi)) * color + Eigen::Vector3f::Constant(specular);
+}
+
+unsigned char toSrgb(float linear) {
+    linear = std::min(std::max(linear, 0.0f), 1.0f);
+    float c = linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(c * 255.0f + 0.5f);
+}
+
+} // namespace
+
+// PCG32
+struct HairPathTracer::Random {
+    uint64_t state = 0;
+
+    Random() = default;
+    Random(uint64_t pixel, uint64_t pass) : state(splitmix(pixel ^ (pass << 40))) {}
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t x = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+        uint32_t r = static_cast<uint32_t>(old >> 59);
+        return (x >> r) | (x << ((32 - r) & 31));
+    }
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); } // [0, 1)
+    Eigen::Vector3f sphere() {
+        float z = 1.0f - 2.0f * uniform();
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float phi = 2.0f * pi * uniform();
+        return Eigen::Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+    }
+};
+
+void HairPathTracer::setModel(const HairModel& model) {
+    setModel(model, Settings());
+}
+
+void HairPathTracer::setModel(const HairModel& model, const Settings& settings) {
+    this->settings = settings;
+    this->settings.width = std::max(settings.width, 1u);
+    this->settings.height = std::max(settings.height, 1u);
+    this->settings.tile_size = std::max((settings.tile_size + 1) & ~1u, 2u);
+    this->settings.light_direction = settings.light_direction.normalized();
+    bvh.build(model, settings.bvh);
+
+    size_t point_count = model.points.size() / 3;
+    first_point.resize(model.hair_count);
+    unsigned int first = 0;
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        first_point[s] = first;
+        first += (model.segments.empty() ? model.d_segments : model.segments[s]) + 1;
+    }
+    if (model.colors.size() == 3 * point_count) {
+        colors = model.colors;
+    } else {
+        colors.resize(3 * point_count);
+        for (size_t v = 0; v < point_count; v++) std::copy(model.d_color, model.d_color + 3, &colors[3 * v]);
+    }
+    transparency.clear();
+    if (model.transparency.size() == point_count) {
+        if (std::any_of(model.transparency.begin(), model.transparency.end(), [](float a) { return a > 0.0f; })) transparency = model.transparency;
+    } else if (model.d_transparency > 0.0f) {
+        transparency.assign(point_count, model.d_transparency);
+    }
+    clear();
+}
+
+void HairPathTracer::setCamera(const Camera& camera) {
+    auto vec = [](const glm::vec3& v) { return Eigen::Vector3f(v.x, v.y, v.z); };
+    view.position = vec(camera.Position);
+    view.front = vec(camera.Front);
+    view.right = vec(camera.Right);
+    view.up = vec(camera.Up);
+    view.tan_half = std::tan(0.5f * camera.Zoom * pi / 180.0f);
+    clear();
+}
+
+void HairPathTracer::clear() {
+    accum.assign(3 * static_cast<size_t>(settings.width) * settings.height, 0.0f);
+    pass_count = 0;
+    rays = 0;
+    seconds = 0.0;
+}
+
+void HairPathTracer::renderPass() {
+    if (accum.empty()) clear(); // no model yet: an image of the sky
+    auto start = std::chrono::steady_clock::now();
+    unsigned int tile = settings.tile_size;
+    unsigned int tiles_x = (settings.width + tile - 1) / tile, tiles_y = (settings.height + tile - 1) / tile;
+    std::atomic<uint64_t> traced{0};
+    parallelFor(0, static_cast<int>(tiles_x * tiles_y), [&](int begin, int end) {
+        uint64_t count = 0;
+        for (int t = begin; t < end; t++) {
+            unsigned int x0 = (t % tiles_x) * tile, y0 = (t / tiles_x) * tile;
+            renderTile(x0, y0, std::min(x0 + tile, settings.width), std::min(y0 + tile, settings.height), &count);
+        }
+        traced += count;
+    }, 1);
+    pass_count++;
+    rays += traced;
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void HairPathTracer::renderTile(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, uint64_t* ray_count) {
+    float aspect = static_cast<float>(settings.width) / static_cast<float>(settings.height);
+    // 2x2 pixels per packet, lanes outside the image get an empty direction and never hit
+    for (unsigned int y = y0; y < y1; y += 2) {
+        for (unsigned int x = x0; x < x1; x += 2) {
+            StrandBVH::Ray rays4[4];
+            StrandBVH::Hit hits[4];
+            bool found[4];
+            Random random[4];
+            bool inside[4] = {false, false, false, false};
+            for (int k = 0; k < 4; k++) {
+                unsigned int px = x + (k & 1), py = y + (k >> 1);
+                rays4[k].origin = view.position;
+                rays4[k].direction = Eigen::Vector3f::Zero();
+                if (px >= x1 || py >= y1) continue;
+                inside[k] = true;
+                random[k] = Random(static_cast<uint64_t>(py) * settings.width + px, pass_count);
+                float ndc_x = 2.0f * (px + random[k].uniform()) / settings.width - 1.0f;
+                float ndc_y = 1.0f - 2.0f * (py + random[k].uniform()) / settings.height;
+                // as Camera::GetRayDirection
+                rays4[k].direction = (view.front + view.right * (ndc_x * aspect * view.tan_half) + view.up * (ndc_y * view.tan_half)).normalized();
+                (*ray_count)++;
+            }
+            bvh.intersect4(rays4, hits, found);
+            for (int k = 0; k < 4; k++) {
+                if (!inside[k]) continue;
+                Eigen::Vector3f color = radiance(rays4[k], found[k], hits[k], random[k], ray_count);
+                size_t pixel = static_cast<size_t>(y + (k >> 1)) * settings.width + x + (k & 1);
+                for (int c = 0; c < 3; c++) accum[3 * pixel + c] += color[c];
+            }
+        }
+    }
+}
+
+Eigen::Vector3f HairPathTracer::radiance(StrandBVH::Ray ray, bool found, StrandBVH::Hit hit, Random& random, uint64_t* ray_count) const {
+    const std::vector<float>& points = bvh.pointPositions();
+    const std::vector<float>& radii = bvh.pointRadii();
+    Eigen::Vector3f result = Eigen::Vector3f::Zero(), throughput = Eigen::Vector3f::Ones();
+    unsigned int bounce = 0;
+    int crossings = 0;
+    while (true) {
+        if (!found) {
+            result += settings.sky_intensity * throughput;
+            break;
+        }
+        unsigned int a = first_point[hit.strand] + hit.segment;
+        float u = hit.u;
+        if (!transparency.empty() && crossings < max_crossings
+            && random.uniform() < transparency[a] + u * (transparency[a + 1] - transparency[a])) {
+            // t is where the ray passes closest to the axis, the same segment is not found again past it
+            crossings++;
+            ray.t_min = std::nextafter(hit.t, std::numeric_limits<float>::infinity());
+            found = bvh.intersect(ray, &hit);
+            (*ray_count)++;
+            continue;
+        }
+
+        Eigen::Map<const Eigen::Vector3f> pa(&points[3 * a]), pb(&points[3 * a + 3]);
+        Eigen::Vector3f tangent = (pb - pa).normalized();
+        Eigen::Vector3f color = (1.0f - u) * Eigen::Map<const Eigen::Vector3f>(&colors[3 * a]) + u * Eigen::Map<const Eigen::Vector3f>(&colors[3 * a + 3]);
+        Eigen::Vector3f position = ray.origin + hit.t * ray.direction;
+        Eigen::Vector3f out = -ray.direction;
+        // leave the capsule that was hit before looking for the next one
+        float offset = 1.5f * (radii[a] + u * (radii[a + 1] - radii[a])) + 1e-4f;
+
+        StrandBVH::Ray shadow;
+        shadow.origin = position;
+        shadow.direction = settings.light_direction;
+        shadow.t_min = offset;
+        if (!blocked(shadow, random, ray_count)) {
+            result += settings.light_intensity * sinToTangent(tangent, shadow.direction)
+                * throughput.cwiseProduct(scatter(settings, color, tangent, shadow.direction, out));
+        }
+        if (bounce++ == settings.max_bounces) break;
+
+        // uniform directions, pdf 1 / (4 pi)
+        Eigen::Vector3f in = random.sphere();
+        throughput = throughput.cwiseProduct(scatter(settings, color, tangent, in, out)) * (4.0f * pi * sinToTangent(tangent, in));
+        if (bounce > roulette_bounce) {
+            float survive = std::min(throughput.maxCoeff(), 0.95f);
+            if (random.uniform() >= survive) break;
+            throughput /= survive;
+        }
+        ray.origin = position;
+        ray.direction = in;
+        ray.t_min = offset;
+        ray.t_max = std::numeric_limits<float>::infinity();
+        found = bvh.intersect(ray, &hit);
+        (*ray_count)++;
+    }
+    return result;
+}
+
+bool HairPathTracer::blocked(StrandBVH::Ray ray, Random& random, uint64_t* ray_count) const {
+    (*ray_count)++;
+    if (transparency.empty()) return bvh.occluded(ray);
+    StrandBVH::Hit hit;
+    for (int crossings = 0; bvh.intersect(ray, &hit); crossings++) {
+        unsigned int a = first_point[hit.strand] + hit.segment;
+        if (crossings == max_crossings || random.uniform() >= transparency[a] + hit.u * (transparency[a + 1] - transparency[a])) return true;
+        ray.t_min = std::nextafter(hit.t, std::numeric_limits<float>::infinity());
+        (*ray_count)++;
+    }
+    return false;
+}
+
+unsigned int HairPathTracer::passes() const {
+    return pass_count;
+}
+
+void HairPathTracer::resolve(std::vector<float>* rgb) const {
+    rgb->resize(accum.size());
+    float scale = pass_count > 0 ? 1.0f / pass_count : 0.0f;
+    for (size_t i = 0; i < accum.size(); i++) (*rgb)[i] = accum[i] * scale;
+}
+
+bool HairPathTracer::saveImage(const std::string& filename, std::string* err) const {
+    std::vector<float> rgb;
+    resolve(&rgb);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    size_t row = 3 * static_cast<size_t>(settings.width);
+    bool pfm = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".pfm") == 0;
+    if (pfm) {
+        // little-endian floats, rows from the bottom
+        file << "PF\n" << settings.width << " " << settings.height << "\n-1.0\n";
+        for (size_t y = settings.height; y-- > 0;) file.write(reinterpret_cast<const char*>(&rgb[y * row]), row * sizeof(float));
+    } else {
+        file << "P6\n" << settings.width << " " << settings.height << "\n255\n";
+        std::vector<unsigned char> bytes(rgb.size());
+        std::transform(rgb.begin(), rgb.end(), bytes.begin(), toSrgb);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    if (!file) {
+        if (err) *err = "Error writing image";
+        return false;
+    }
+    return true;
+}
+
+uint64_t HairPathTracer::rayCount() const {
+    return rays;
+}
+
+double HairPathTracer::renderSeconds() const {
+    return seconds;
+}
@@ -1,4 +1,5 @@
 #include "HairRenderer.h"
+#include "Trace.h"
 
 HairRenderer::~HairRenderer() {
     for (const auto& pair : vaoMap) {
@@ -7,6 +8,13 @@ HairRenderer::~HairRenderer() {
 }
 
 void HairRenderer::CreateVAO(const HairModel& model) {
+    CGC_TRACE_SCOPE("HairRenderer::CreateVAO");
+    auto existing = vaoMap.find(&model);
+    if (existing != vaoMap.end()) {
+        deleteVAOData(existing->second); // re-upload, e.g. after the model changed
+        vaoMap.erase(existing);
+    }
+
     VAOData data;
     glGenVertexArrays(1, &data.VAO);
     glGenBuffers(1, &data.VBO);
@@ -15,7 +23,7 @@ void HairRenderer::CreateVAO(const HairModel& model) {
 
     // Points
     glBindBuffer(GL_ARRAY_BUFFER, data.VBO);
-    glBufferData(GL_ARRAY_BUFFER, model.points.size() * sizeof(float), model.points.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, model.points.size() * sizeof(float), model.points.data(), GL_DYNAMIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
@@ -54,6 +62,7 @@ void HairRenderer::CreateVAO(const HairModel& model) {
 }
 
 void HairRenderer::Draw(Shader& shader) const {
+    CGC_TRACE_SCOPE("HairRenderer::Draw");
     if (!currentModel) {
         return; // currentModelが設定されていない場合は描画しない
     }
@@ -88,6 +97,30 @@ void HairRenderer::Draw(Shader& shader) const {
     glBindVertexArray(0);
 }
 
+GLuint HairRenderer::GetPositionBuffer(const HairModel& model) const {
+    auto it = vaoMap.find(&model);
+    return it != vaoMap.end() ? it->second.VBO : 0;
+}
+
+bool HairRenderer::StreamFrame(const HairModel& model, GroomAnimation& animation, unsigned int frame) {
+    CGC_TRACE_SCOPE("HairRenderer::StreamFrame");
+    auto it = vaoMap.find(&model);
+    if (it == vaoMap.end() || animation.GetModel().point_count != model.point_count || model.point_count == 0) {
+        return false;
+    }
+
+    // invalidating lets the driver hand out fresh memory instead of waiting for draws of the previous frame
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(model.point_count) * 3 * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, it->second.VBO);
+    void* positions = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    bool ok = positions && animation.ReadFrame(frame, static_cast<float*>(positions));
+    if (positions && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+        ok = false; // contents were lost, e.g. on a mode switch; the next frame uploads again
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return ok;
+}
+
 void HairRenderer::deleteVAOData(const VAOData& data) {
     glDeleteBuffers(1, &data.VBO);
     glDeleteBuffers(1, &data.TBO);
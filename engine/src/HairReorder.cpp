@@ -0,0 +1,142 @@
+#include "HairReorder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include "Parallel.h"
+
+namespace {
+
+// spreads the low 21 bits of v to every third bit
+uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// first point of every strand, plus the total at the end
+std::vector<size_t> strandOffsets(const HairModel& model) {
+    std::vector<size_t> offsets(model.hair_count + 1, 0);
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        offsets[s + 1] = offsets[s] + (model.segments.empty() ? model.d_segments : model.segments[s]) + 1;
+    }
+    return offsets;
+}
+
+} // namespace
+
+std::vector<unsigned int> mortonStrandOrder(const HairModel& model, StrandKey key) {
+    int n = static_cast<int>(model.hair_count);
+    std::vector<size_t> offsets = strandOffsets(model);
+    std::vector<unsigned int> order(n);
+    for (int i = 0; i < n; i++) order[i] = i;
+    if (model.points.size() != 3 * offsets[n]) return order; // nothing to sort by
+
+    std::vector<float> keys(3 * static_cast<size_t>(n));
+    parallelFor(0, n, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            size_t first = offsets[s], count = offsets[s + 1] - first;
+            for (int c = 0; c < 3; c++) {
+                float value = model.points[3 * first + c];
+                if (key == StrandKey::Centroid) {
+                    double sum = 0.0;
+                    for (size_t v = first; v < first + count; v++) sum += model.points[3 * v + c];
+                    value = static_cast<float>(sum / count);
+                }
+                keys[3 * s + c] = value;
+            }
+        }
+    });
+
+    // bounds of the finite keys; a NaN or infinite coordinate (a broken strand) has no place on the curve
+    std::vector<char> finite(n);
+    float lo[3] = {0.0f, 0.0f, 0.0f}, hi[3] = {0.0f, 0.0f, 0.0f};
+    bool first = true;
+    for (int s = 0; s < n; s++) {
+        const float* k = &keys[3 * s];
+        finite[s] = std::isfinite(k[0]) && std::isfinite(k[1]) && std::isfinite(k[2]);
+        if (!finite[s]) continue;
+        for (int c = 0; c < 3; c++) {
+            lo[c] = first ? k[c] : std::min(lo[c], k[c]);
+            hi[c] = first ? k[c] : std::max(hi[c], k[c]);
+        }
+        first = false;
+    }
+    double scale[3];
+    for (int c = 0; c < 3; c++) scale[c] = hi[c] > lo[c] ? 2097151.0 / (static_cast<double>(hi[c]) - lo[c]) : 0.0;
+
+    std::vector<std::pair<uint64_t, unsigned int>> codes(n);
+    parallelFor(0, n, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            uint64_t code = std::numeric_limits<uint64_t>::max(); // after every 63-bit code
+            if (finite[s]) {
+                code = 0;
+                for (int c = 0; c < 3; c++) {
+                    double q = std::min(std::max((static_cast<double>(keys[3 * s + c]) - lo[c]) * scale[c], 0.0), 2097151.0);
+                    code |= spreadBits(static_cast<uint64_t>(q)) << c;
+                }
+            }
+            codes[s] = {code, static_cast<unsigned int>(s)};
+        }
+    });
+    std::sort(codes.begin(), codes.end()); // equal codes keep their original order
+
+    for (int i = 0; i < n; i++) order[i] = codes[i].second;
+    return order;
+}
+
+bool isStrandOrder(const std::vector<unsigned int>& order, unsigned int count) {
+    if (order.size() != count) return false;
+    std::vector<char> seen(count, 0);
+    for (unsigned int strand : order) {
+        if (strand >= count || seen[strand]) return false;
+        seen[strand] = 1;
+    }
+    return true;
+}
+
+bool reorderStrands(HairModel& model, const std::vector<unsigned int>& order) {
+    int n = static_cast<int>(model.hair_count);
+    if (!isStrandOrder(order, model.hair_count)) return false;
+    std::vector<size_t> offsets = strandOffsets(model);
+    std::vector<size_t> new_offsets(n + 1, 0);
+    for (int i = 0; i < n; i++) {
+        new_offsets[i + 1] = new_offsets[i] + (offsets[order[i] + 1] - offsets[order[i]]);
+    }
+
+    if (!model.segments.empty()) {
+        std::vector<unsigned short> segments(n);
+        for (int i = 0; i < n; i++) segments[i] = model.segments[order[i]];
+        model.segments = std::move(segments);
+    }
+
+    // arrays that are absent (or do not match point_count) are left alone
+    auto permute = [&](std::vector<float>& array, size_t components) {
+        if (array.empty() || array.size() != components * offsets[n]) return;
+        std::vector<float> permuted(array.size());
+        parallelFor(0, n, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                size_t first = offsets[order[i]], count = offsets[order[i] + 1] - first;
+                std::copy_n(array.begin() + components * first, components * count, permuted.begin() + components * new_offsets[i]);
+            }
+        });
+        array = std::move(permuted);
+    };
+    permute(model.points, 3);
+    permute(model.thickness, 1);
+    permute(model.transparency, 1);
+    permute(model.colors, 3);
+    return true;
+}
+
+std::vector<unsigned int> invertOrder(const std::vector<unsigned int>& order) {
+    if (!isStrandOrder(order, static_cast<unsigned int>(order.size()))) return {};
+    std::vector<unsigned int> inverse(order.size());
+    for (size_t i = 0; i < order.size(); i++) inverse[order[i]] = static_cast<unsigned int>(i);
+    return inverse;
+}
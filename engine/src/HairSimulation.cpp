@@ -0,0 +1,164 @@
+#include "HairSimulation.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include <algorithm>
+#include <numeric>
+
+HairSimulation::HairSimulation(const HairModel& model, const Parameters& params) : params(params) {
+    int num_strands = static_cast<int>(model.hair_count);
+    strand_offsets.resize(num_strands + 1, 0);
+    for (int s = 0; s < num_strands; s++) {
+        unsigned int segments = !model.segments.empty() ? model.segments[s] : model.d_segments;
+        strand_offsets[s + 1] = strand_offsets[s] + static_cast<int>(segments) + 1;
+    }
+
+    if (params.solver == Solver::DER) {
+        strands.reserve(num_strands);
+        for (int s = 0; s < num_strands; s++) {
+            std::vector<Eigen::Vector3d> vertices;
+            for (int v = strand_offsets[s]; v < strand_offsets[s + 1]; v++) {
+                vertices.emplace_back(model.points[3 * v], model.points[3 * v + 1], model.points[3 * v + 2]);
+            }
+            std::vector<double> radii(vertices.size() - 1, params.radius);
+            strands.emplace_back(vertices, params.E, params.G, radii, radii, params.rho);
+            strands.back().setGravity(params.gravity);
+        }
+        substep_counts.assign(num_strands, params.substeps);
+        schedule.resize(num_strands);
+        std::iota(schedule.begin(), schedule.end(), 0);
+    } else {
+        xpbd = std::make_unique<XPBD>(model, params.E, params.G, params.radius, params.rho);
+        xpbd->setMode(params.solver == Solver::XPBD_Jacobi ? XPBD::Mode::Jacobi : XPBD::Mode::GaussSeidel);
+        xpbd->setIterations(params.iterations);
+        xpbd->setGravity(params.gravity);
+    }
+}
+
+void HairSimulation::update(double dt) {
+    CGC_TRACE_SCOPE("HairSimulation::update");
+    double h = dt / params.substeps;
+    if (xpbd) {
+        // small steps converge much better than more iterations for stiff strands
+        for (int step = 0; step < params.substeps; step++) {
+            xpbd->update(h);
+        }
+        return;
+    }
+
+    if (params.implicit) {
+        parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+            for (int s = begin; s < end; s++) {
+                for (int step = 0; step < params.substeps; step++) {
+                    strands[s].updateImplicit(h);
+                }
+            }
+        }, 4);
+        return;
+    }
+
+    if (params.adaptive) {
+        // Longest processing time first: strands that needed many substeps last frame start first,
+        // and the dynamic chunking of parallelFor fills the remaining threads with the cheap ones.
+        std::sort(schedule.begin(), schedule.end(), [&](int a, int b) {
+            return substep_counts[a] * strands[a].getVertices().size() > substep_counts[b] * strands[b].getVertices().size();
+        });
+        parallelFor(0, static_cast<int>(schedule.size()), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int s = schedule[i];
+                substep_counts[s] = strands[s].advance(dt, params.cfl, params.max_substeps);
+            }
+        }, 4);
+        return;
+    }
+
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            for (int step = 0; step < params.substeps; step++) {
+                strands[s].update(h);
+            }
+        }
+    });
+}
+
+void HairSimulation::solveStatics() {
+    CGC_TRACE_SCOPE("HairSimulation::solveStatics");
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            strands[s].solveStatic();
+        }
+    }, 1);
+}
+
+const std::vector<int>& HairSimulation::getSubstepCounts() const {
+    return substep_counts;
+}
+
+HairSimulation::Solver HairSimulation::getSolver() const {
+    return params.solver;
+}
+
+int HairSimulation::strandCount() const {
+    return static_cast<int>(strand_offsets.size()) - 1;
+}
+
+const std::vector<int>& HairSimulation::getStrandOffsets() const {
+    return strand_offsets;
+}
+
+std::vector<Eigen::Vector3d> HairSimulation::getPositions() const {
+    if (xpbd) {
+        return xpbd->getPositions();
+    }
+    std::vector<Eigen::Vector3d> positions(strand_offsets.back());
+    for (size_t s = 0; s < strands.size(); s++) {
+        const std::vector<Eigen::Vector3d>& x = strands[s].getVertices();
+        std::copy(x.begin(), x.end(), positions.begin() + strand_offsets[s]);
+    }
+    return positions;
+}
+
+void HairSimulation::setVelocities(const std::vector<Eigen::Vector3d>& velocities) {
+    if (xpbd) {
+        xpbd->setVelocities(velocities);
+        return;
+    }
+    for (size_t s = 0; s < strands.size(); s++) {
+        std::vector<Eigen::Vector3d> v(velocities.begin() + strand_offsets[s], velocities.begin() + strand_offsets[s + 1]);
+        strands[s].setState(strands[s].getVertices(), v);
+    }
+}
+
+void HairSimulation::writeToModel(HairModel& model) const {
+    std::vector<Eigen::Vector3d> positions = getPositions();
+    model.points.resize(positions.size() * 3);
+    for (size_t v = 0; v < positions.size(); v++) {
+        model.points[3 * v] = static_cast<float>(positions[v].x());
+        model.points[3 * v + 1] = static_cast<float>(positions[v].y());
+        model.points[3 * v + 2] = static_cast<float>(positions[v].z());
+    }
+}
+
+std::vector<Eigen::Vector3d> HairSimulation::getRoots() const {
+    std::vector<Eigen::Vector3d> positions = getPositions();
+    std::vector<Eigen::Vector3d> roots(strandCount());
+    for (int s = 0; s < strandCount(); s++) {
+        roots[s] = positions[strand_offsets[s]];
+    }
+    return roots;
+}
+
+void HairSimulation::setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations) {
+    if (xpbd) {
+        xpbd->setRootTransforms(rotations, translations);
+        return;
+    }
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            strands[s].setRootTransform(rotations[s], translations[s]);
+        }
+    });
+}
+
+std::vector<DER>& HairSimulation::getStrands() {
+    return strands;
+}
@@ -0,0 +1,174 @@
+#include "HairStreamReader.h"
+#include <algorithm>
+
+namespace {
+
+constexpr size_t segments_window = 1 << 16; // strands of the segments array read at once
+
+} // namespace
+
+HairStreamReader::~HairStreamReader() {
+    Close();
+}
+
+bool HairStreamReader::Open(const std::string& filename, std::string* err, size_t batch_points, int read_ahead) {
+    Close();
+    file.open(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    file.read(reinterpret_cast<char*>(&header), sizeof(HairLoader::Header));
+    if (file.gcount() < static_cast<std::streamsize>(sizeof(HairLoader::Header))) {
+        if (err) *err = "Failed to read header";
+        return false;
+    }
+    if (std::string(header.signature, 4) != "HAIR") {
+        if (err) *err = "Invalid file signature";
+        return false;
+    }
+    if (!(header.arrays & HAIR_FILE_POINTS_BIT)) {
+        if (err) *err = "File has no points";
+        return false;
+    }
+
+    uint64_t offset = sizeof(HairLoader::Header);
+    uint64_t points = header.point_count;
+    if (header.arrays & HAIR_FILE_SEGMENTS_BIT) {
+        segments_offset = offset;
+        offset += static_cast<uint64_t>(header.hair_count) * sizeof(unsigned short);
+    }
+    points_offset = offset;
+    offset += 3 * points * sizeof(float);
+    if (header.arrays & HAIR_FILE_THICKNESS_BIT) {
+        thickness_offset = offset;
+        offset += points * sizeof(float);
+    }
+    if (header.arrays & HAIR_FILE_TRANSPARENCY_BIT) {
+        transparency_offset = offset;
+        offset += points * sizeof(float);
+    }
+    if (header.arrays & HAIR_FILE_COLORS_BIT) {
+        colors_offset = offset;
+    }
+
+    this->batch_points = std::max<size_t>(batch_points, 1);
+    this->read_ahead = static_cast<size_t>(std::max(read_ahead, 1));
+    finished = false;
+    stopping = false;
+    error.clear();
+    reader = std::thread(&HairStreamReader::readLoop, this);
+    return true;
+}
+
+void HairStreamReader::Close() {
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        space_cv.notify_all();
+        reader.join();
+    }
+    queue.clear();
+    if (file.is_open()) file.close();
+    file.clear();
+    segments_offset = points_offset = thickness_offset = transparency_offset = colors_offset = 0;
+}
+
+const HairLoader::Header& HairStreamReader::GetHeader() const {
+    return header;
+}
+
+bool HairStreamReader::Next(Batch& batch, std::string* err) {
+    std::unique_lock<std::mutex> lock(mutex);
+    ready_cv.wait(lock, [&] { return !queue.empty() || finished; });
+    if (queue.empty()) {
+        if (err && !error.empty()) *err = error;
+        return false;
+    }
+    batch = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    space_cv.notify_one();
+    return true;
+}
+
+bool HairStreamReader::readRange(uint64_t offset, void* data, size_t bytes) {
+    if (bytes == 0) return true;
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(bytes));
+    return static_cast<size_t>(file.gcount()) == bytes;
+}
+
+bool HairStreamReader::readBatch(unsigned int first_strand, uint64_t first_point, std::vector<unsigned short>& window, size_t& window_begin, Batch& batch) {
+    batch.first_strand = first_strand;
+    batch.first_point = first_point;
+    batch.segments.clear();
+
+    // whole strands until the batch holds batch_points points
+    uint64_t points = 0;
+    for (unsigned int s = first_strand; s < header.hair_count && points < batch_points; s++) {
+        unsigned short segments = static_cast<unsigned short>(header.d_segments);
+        if (segments_offset) {
+            if (s >= window_begin + window.size()) {
+                window_begin = s;
+                window.resize(std::min<size_t>(segments_window, header.hair_count - s));
+                if (!readRange(segments_offset + static_cast<uint64_t>(s) * sizeof(unsigned short), window.data(), window.size() * sizeof(unsigned short))) {
+                    error = "Error reading segments";
+                    return false;
+                }
+            }
+            segments = window[s - window_begin];
+        }
+        batch.segments.push_back(segments);
+        points += segments + 1;
+    }
+    if (first_point + points > header.point_count) {
+        error = "Segments exceed point_count";
+        return false;
+    }
+
+    batch.points.resize(3 * points);
+    batch.thickness.resize(thickness_offset ? points : 0);
+    batch.transparency.resize(transparency_offset ? points : 0);
+    batch.colors.resize(colors_offset ? 3 * points : 0);
+    bool ok = readRange(points_offset + 3 * first_point * sizeof(float), batch.points.data(), batch.points.size() * sizeof(float));
+    if (ok && thickness_offset) ok = readRange(thickness_offset + first_point * sizeof(float), batch.thickness.data(), batch.thickness.size() * sizeof(float));
+    if (ok && transparency_offset) ok = readRange(transparency_offset + first_point * sizeof(float), batch.transparency.data(), batch.transparency.size() * sizeof(float));
+    if (ok && colors_offset) ok = readRange(colors_offset + 3 * first_point * sizeof(float), batch.colors.data(), batch.colors.size() * sizeof(float));
+    if (!ok) {
+        error = "Error reading data arrays";
+        return false;
+    }
+    return true;
+}
+
+void HairStreamReader::readLoop() {
+    std::vector<unsigned short> window;
+    size_t window_begin = 0;
+    unsigned int strand = 0;
+    uint64_t point = 0;
+    while (strand < header.hair_count) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space_cv.wait(lock, [&] { return queue.size() < read_ahead || stopping; });
+            if (stopping) break;
+        }
+        Batch batch;
+        bool ok = readBatch(strand, point, window, window_begin, batch);
+        if (!ok) break;
+        strand += batch.strandCount();
+        point += batch.pointCount();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(batch));
+        }
+        ready_cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    ready_cv.notify_all();
+}
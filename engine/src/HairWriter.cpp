@@ -0,0 +1,143 @@
+#include "HairWriter.h"
+#include "HairLoader.h"
+#include <algorithm>
+#include <fstream>
+#include <type_traits>
+
+namespace {
+
+HairLoader::Header fileHeader(const HairModel& model) {
+    HairLoader::Header header;
+    std::copy_n("HAIR", 4, header.signature);
+    header.hair_count = model.hair_count;
+    header.point_count = model.point_count;
+    header.arrays = model.arrays;
+    header.d_segments = model.d_segments;
+    header.d_thickness = model.d_thickness;
+    header.d_transparency = model.d_transparency;
+    std::copy(std::begin(model.d_color), std::end(model.d_color), std::begin(header.d_color));
+    return header;
+}
+
+template <typename T>
+bool writeArray(std::ofstream& file, const std::vector<T>& array, size_t expected, const char* name, std::string* err) {
+    if (array.size() != expected) {
+        if (err) *err = std::string("Size of the ") + name + " array does not match the header";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(T));
+    return true;
+}
+
+} // namespace
+
+bool HairWriter::SaveToFile(const HairModel& model, std::string* err, const std::string& filename) {
+    HairLoader::Header header = fileHeader(model);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    size_t points = model.point_count;
+    if ((model.arrays & HAIR_FILE_SEGMENTS_BIT) && !writeArray(file, model.segments, model.hair_count, "segments", err)) return false;
+    if ((model.arrays & HAIR_FILE_POINTS_BIT) && !writeArray(file, model.points, 3 * points, "points", err)) return false;
+    if ((model.arrays & HAIR_FILE_THICKNESS_BIT) && !writeArray(file, model.thickness, points, "thickness", err)) return false;
+    if ((model.arrays & HAIR_FILE_TRANSPARENCY_BIT) && !writeArray(file, model.transparency, points, "transparency", err)) return false;
+    if ((model.arrays & HAIR_FILE_COLORS_BIT) && !writeArray(file, model.colors, 3 * points, "colors", err)) return false;
+
+    if (!file) {
+        if (err) *err = "Error writing data arrays";
+        return false;
+    }
+    return true;
+}
+
+bool HairWriter::Open(const HairModel& model, std::string* err, const std::string& filename) {
+    HairLoader::Header header = fileHeader(model);
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // the arrays follow each other, a chunk goes into each of them at its own offset
+    arrays = model.arrays;
+    hair_count = model.hair_count;
+    point_count = model.point_count;
+    strands_written = 0;
+    points_written = 0;
+    segments_offset = sizeof(header);
+    points_offset = segments_offset + (arrays & HAIR_FILE_SEGMENTS_BIT ? hair_count * sizeof(unsigned short) : 0);
+    thickness_offset = points_offset + (arrays & HAIR_FILE_POINTS_BIT ? 3 * point_count * sizeof(float) : 0);
+    transparency_offset = thickness_offset + (arrays & HAIR_FILE_THICKNESS_BIT ? point_count * sizeof(float) : 0);
+    colors_offset = transparency_offset + (arrays & HAIR_FILE_TRANSPARENCY_BIT ? point_count * sizeof(float) : 0);
+    return true;
+}
+
+bool HairWriter::WriteStrands(const HairModel& chunk, unsigned int first_strand, uint64_t first_point, std::string* err) {
+    if (!file.is_open()) {
+        if (err) *err = "No file is open";
+        return false;
+    }
+    // the point count of the chunk is given by its first per-point array
+    uint64_t strands = arrays & HAIR_FILE_SEGMENTS_BIT ? chunk.segments.size() : 0;
+    uint64_t points = arrays & HAIR_FILE_POINTS_BIT ? chunk.points.size() / 3
+                    : arrays & HAIR_FILE_THICKNESS_BIT ? chunk.thickness.size()
+                    : arrays & HAIR_FILE_TRANSPARENCY_BIT ? chunk.transparency.size()
+                    : chunk.colors.size() / 3;
+    if (first_strand + strands > hair_count || first_point + points > point_count) {
+        if (err) *err = "Chunk lies outside the arrays of the header";
+        return false;
+    }
+
+    auto write = [&](unsigned int bit, uint64_t array_offset, uint64_t element, const auto& array, uint64_t expected, const char* name) {
+        if (!(arrays & bit)) return true;
+        if (array.size() != expected) {
+            if (err) *err = std::string("Size of the ") + name + " array does not match the chunk";
+            return false;
+        }
+        using T = typename std::decay_t<decltype(array)>::value_type;
+        file.seekp(static_cast<std::streamoff>(array_offset + element * sizeof(T)));
+        file.write(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(T));
+        return true;
+    };
+    if (!write(HAIR_FILE_SEGMENTS_BIT, segments_offset, first_strand, chunk.segments, strands, "segments")) return false;
+    if (!write(HAIR_FILE_POINTS_BIT, points_offset, 3 * first_point, chunk.points, 3 * points, "points")) return false;
+    if (!write(HAIR_FILE_THICKNESS_BIT, thickness_offset, first_point, chunk.thickness, points, "thickness")) return false;
+    if (!write(HAIR_FILE_TRANSPARENCY_BIT, transparency_offset, first_point, chunk.transparency, points, "transparency")) return false;
+    if (!write(HAIR_FILE_COLORS_BIT, colors_offset, 3 * first_point, chunk.colors, 3 * points, "colors")) return false;
+
+    if (!file) {
+        if (err) *err = "Error writing data arrays";
+        return false;
+    }
+    strands_written += strands;
+    points_written += points;
+    return true;
+}
+
+bool HairWriter::Close(std::string* err) {
+    if (!file.is_open()) {
+        if (err) *err = "No file is open";
+        return false;
+    }
+    file.close();
+    bool ok = !file.fail();
+    file.clear();
+    if (!ok) {
+        if (err) *err = "Error writing data arrays";
+        return false;
+    }
+    if (points_written != point_count || ((arrays & HAIR_FILE_SEGMENTS_BIT) && strands_written != hair_count)) {
+        if (err) {
+            *err = "Only " + std::to_string(points_written) + " of " + std::to_string(point_count) + " points";
+            if (arrays & HAIR_FILE_SEGMENTS_BIT) *err += " and " + std::to_string(strands_written) + " of " + std::to_string(hair_count) + " strands";
+            *err += " were written";
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,135 @@
+#include "Parallel.h"
+#include "Trace.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+thread_local bool inside_worker = false;
+
+// marks the calling thread as working on a job for as long as it lives, also when the job throws
+struct InsideWorker {
+    InsideWorker() { inside_worker = true; }
+    ~InsideWorker() { inside_worker = false; }
+};
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // 呼び出し元のスレッドも作業するので、ワーカーは1つ少なくてよい
+    for (unsigned int i = 1; i < num_threads; i++) {
+        workers.emplace_back([this, i] {
+            CGC_TRACE_THREAD_NAME("worker " + std::to_string(i));
+            workerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+unsigned int ThreadPool::size() const {
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& func) {
+    if (begin >= end) {
+        return;
+    }
+    grain = std::max(grain, 1);
+    if (inside_worker || workers.empty() || end - begin <= grain) {
+        func(begin, end);
+        return;
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> submit_lock(submit_mutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.func = &func;
+            job.end = end;
+            job.grain = grain;
+            job.next.store(begin);
+            job.error = nullptr;
+            busy = static_cast<unsigned int>(workers.size());
+            generation++;
+        }
+        start_cv.notify_all();
+
+        {
+            InsideWorker inside;
+            runChunks();
+        }
+
+        // the workers may still be inside func, which lives on this caller's stack
+        CGC_TRACE_SCOPE("parallelFor wait");
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this] { return busy == 0; });
+        job.func = nullptr;
+        error = job.error;
+        job.error = nullptr;
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::workerLoop() {
+    inside_worker = true;
+    unsigned long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        runChunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        done_cv.notify_one();
+    }
+}
+
+void ThreadPool::runChunks() {
+    while (true) {
+        int chunk_begin = job.next.fetch_add(job.grain);
+        if (chunk_begin >= job.end) {
+            break;
+        }
+        CGC_TRACE_SCOPE("parallelFor chunk");
+        try {
+            (*job.func)(chunk_begin, std::min(chunk_begin + job.grain, job.end));
+        } catch (...) {
+            // keep the first exception for the caller and hand out no further chunks
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!job.error) job.error = std::current_exception();
+            job.next.store(job.end);
+        }
+    }
+}
+
+void parallelFor(int begin, int end, const std::function<void(int, int)>& func, int grain) {
+    ThreadPool& pool = ThreadPool::instance();
+    if (grain <= 0) {
+        grain = std::max(1, (end - begin) / static_cast<int>(pool.size() * 8));
+    }
+    pool.parallelFor(begin, end, grain, func);
+}
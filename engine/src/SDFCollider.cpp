@@ -0,0 +1,407 @@
+#include "SDFCollider.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+namespace {
+
+int floorDiv(int x, int d) {
+    return x >= 0 ? x / d : -((-x + d - 1) / d);
+}
+
+// trilinear corner masks, corner c = x + 2y + 4z
+const Eigen::Array<float, 8, 1> MASK_X = (Eigen::Array<float, 8, 1>() << 0, 1, 0, 1, 0, 1, 0, 1).finished();
+const Eigen::Array<float, 8, 1> MASK_Y = (Eigen::Array<float, 8, 1>() << 0, 0, 1, 1, 0, 0, 1, 1).finished();
+const Eigen::Array<float, 8, 1> MASK_Z = (Eigen::Array<float, 8, 1>() << 0, 0, 0, 0, 1, 1, 1, 1).finished();
+
+}
+
+SDFCollider::SDFCollider(const std::vector<Eigen::Vector3d>& vertices, const std::vector<Eigen::Vector3i>& triangles, double voxel_size, double band)
+    : voxel_size(voxel_size), band(band), vertices(vertices), velocities(vertices.size(), Eigen::Vector3d::Zero()), triangles(triangles) {
+    computeNormals();
+
+    vertex_triangle_offsets.assign(vertices.size() + 1, 0);
+    for (const Eigen::Vector3i& tri : triangles) {
+        for (int k = 0; k < 3; k++) vertex_triangle_offsets[tri[k] + 1]++;
+    }
+    for (size_t v = 0; v < vertices.size(); v++) {
+        vertex_triangle_offsets[v + 1] += vertex_triangle_offsets[v];
+    }
+    vertex_triangles.resize(vertex_triangle_offsets.back());
+    std::vector<int> fill(vertex_triangle_offsets.begin(), vertex_triangle_offsets.end() - 1);
+    for (int t = 0; t < static_cast<int>(triangles.size()); t++) {
+        for (int k = 0; k < 3; k++) vertex_triangles[fill[triangles[t][k]]++] = t;
+    }
+
+    std::vector<char> dirty;
+    triangle_bricks.resize(triangles.size());
+    for (int t = 0; t < static_cast<int>(triangles.size()); t++) {
+        binTriangle(t, dirty);
+    }
+
+    parallelFor(0, static_cast<int>(bricks.size()), [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            voxelizeBrick(bricks[b]);
+        }
+    }, 1);
+    dirty_brick_count = static_cast<int>(bricks.size());
+}
+
+void SDFCollider::updateMesh(const std::vector<Eigen::Vector3d>& new_vertices, const std::vector<Eigen::Vector3d>& new_velocities, double tolerance) {
+    velocities = new_velocities;
+    moving = std::any_of(velocities.begin(), velocities.end(), [](const Eigen::Vector3d& v) { return !v.isZero(); });
+
+    // compared against the voxelized positions, not the last call, so drifts below the tolerance add up
+    std::vector<char> moved_vertices(vertices.size(), 0);
+    for (size_t v = 0; v < vertices.size(); v++) {
+        moved_vertices[v] = (new_vertices[v] - vertices[v]).squaredNorm() > tolerance * tolerance;
+    }
+
+    // the triangles of a moved vertex change their face normals, and with them the pseudonormals of
+    // every vertex and edge of theirs, which the triangles around those vertices use for the sign
+    std::vector<char> triangle_state(triangles.size(), 0); // 1 moved, 2 sign may change
+    std::vector<int> moved;
+    for (int t = 0; t < static_cast<int>(triangles.size()); t++) {
+        const Eigen::Vector3i& tri = triangles[t];
+        if (moved_vertices[tri[0]] || moved_vertices[tri[1]] || moved_vertices[tri[2]]) {
+            moved.push_back(t);
+            triangle_state[t] = 1;
+        }
+    }
+    std::vector<int> ring;
+    for (int t : moved) {
+        for (int k = 0; k < 3; k++) {
+            int v = triangles[t][k];
+            for (int i = vertex_triangle_offsets[v]; i < vertex_triangle_offsets[v + 1]; i++) {
+                if (triangle_state[vertex_triangles[i]] == 0) {
+                    triangle_state[vertex_triangles[i]] = 2;
+                    ring.push_back(vertex_triangles[i]);
+                }
+            }
+        }
+    }
+
+    std::vector<char> dirty(bricks.size(), 0);
+    for (int t : moved) {
+        unbinTriangle(t, dirty);
+    }
+    for (int t : ring) {
+        for (int b : triangle_bricks[t]) dirty[b] = 1;
+    }
+    for (size_t v = 0; v < vertices.size(); v++) {
+        if (moved_vertices[v]) vertices[v] = new_vertices[v];
+    }
+    computeNormals();
+    for (int t : moved) {
+        binTriangle(t, dirty);
+    }
+    freeEmptyBricks(dirty);
+
+    std::vector<int> dirty_bricks;
+    for (int b = 0; b < static_cast<int>(dirty.size()); b++) {
+        if (dirty[b]) dirty_bricks.push_back(b);
+    }
+    parallelFor(0, static_cast<int>(dirty_bricks.size()), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            voxelizeBrick(bricks[dirty_bricks[i]]);
+        }
+    }, 1);
+    dirty_brick_count = static_cast<int>(dirty_bricks.size());
+}
+
+long long SDFCollider::brickKey(const Eigen::Vector3i& coord) {
+    constexpr long long mask = (1 << 21) - 1;
+    return ((coord.x() & mask) << 42) | ((coord.y() & mask) << 21) | (coord.z() & mask);
+}
+
+void SDFCollider::computeNormals() {
+    // angle weighted pseudonormals (Baerentzen and Aanaes 2005) give the correct sign at edges and vertices
+    int num_triangles = static_cast<int>(triangles.size());
+    face_normals.resize(num_triangles);
+    vertex_normals.assign(vertices.size(), Eigen::Vector3d::Zero());
+    edge_normals.resize(num_triangles);
+
+    std::map<std::pair<int, int>, Eigen::Vector3d> edge_sum;
+    for (int t = 0; t < num_triangles; t++) {
+        const Eigen::Vector3i& tri = triangles[t];
+        Eigen::Vector3d n = (vertices[tri[1]] - vertices[tri[0]]).cross(vertices[tri[2]] - vertices[tri[0]]);
+        face_normals[t] = n.norm() > 0.0 ? n.normalized() : Eigen::Vector3d::Zero();
+        for (int k = 0; k < 3; k++) {
+            Eigen::Vector3d e0 = vertices[tri[(k + 1) % 3]] - vertices[tri[k]];
+            Eigen::Vector3d e1 = vertices[tri[(k + 2) % 3]] - vertices[tri[k]];
+            double angle = std::acos(std::clamp(e0.normalized().dot(e1.normalized()), -1.0, 1.0));
+            vertex_normals[tri[k]] += angle * face_normals[t];
+
+            int v0 = tri[k], v1 = tri[(k + 1) % 3];
+            auto key = std::make_pair(std::min(v0, v1), std::max(v0, v1));
+            auto it = edge_sum.find(key);
+            if (it == edge_sum.end()) {
+                edge_sum.emplace(key, face_normals[t]);
+            } else {
+                it->second += face_normals[t];
+            }
+        }
+    }
+    for (auto& n : vertex_normals) {
+        if (n.norm() > 0.0) n.normalize();
+    }
+    for (int t = 0; t < num_triangles; t++) {
+        const Eigen::Vector3i& tri = triangles[t];
+        for (int k = 0; k < 3; k++) {
+            int v0 = tri[k], v1 = tri[(k + 1) % 3];
+            Eigen::Vector3d n = edge_sum[std::make_pair(std::min(v0, v1), std::max(v0, v1))];
+            edge_normals[t].col(k) = n.norm() > 0.0 ? n.normalized() : face_normals[t];
+        }
+    }
+}
+
+void SDFCollider::binTriangle(int t, std::vector<char>& dirty) {
+    const Eigen::Vector3i& tri = triangles[t];
+    Eigen::Vector3d lo = vertices[tri[0]].cwiseMin(vertices[tri[1]]).cwiseMin(vertices[tri[2]]) - Eigen::Vector3d::Constant(band);
+    Eigen::Vector3d hi = vertices[tri[0]].cwiseMax(vertices[tri[1]]).cwiseMax(vertices[tri[2]]) + Eigen::Vector3d::Constant(band);
+    Eigen::Vector3i brick_lo, brick_hi;
+    for (int d = 0; d < 3; d++) {
+        brick_lo[d] = floorDiv(static_cast<int>(std::floor(lo[d] / voxel_size)), BRICK);
+        brick_hi[d] = floorDiv(static_cast<int>(std::floor(hi[d] / voxel_size)), BRICK);
+    }
+
+    for (int bz = brick_lo.z(); bz <= brick_hi.z(); bz++) {
+        for (int by = brick_lo.y(); by <= brick_hi.y(); by++) {
+            for (int bx = brick_lo.x(); bx <= brick_hi.x(); bx++) {
+                Eigen::Vector3i coord(bx, by, bz);
+                auto it = brick_lookup.find(brickKey(coord));
+                int b;
+                if (it == brick_lookup.end()) {
+                    b = static_cast<int>(bricks.size());
+                    bricks.push_back(Brick{coord, {}, std::vector<float>(BRICK_NODES * BRICK_NODES * BRICK_NODES, static_cast<float>(band))});
+                    brick_lookup.emplace(brickKey(coord), b);
+                    dirty.push_back(0);
+                } else {
+                    b = it->second;
+                }
+                bricks[b].triangles.push_back(t);
+                triangle_bricks[t].push_back(b);
+                dirty[b] = 1;
+            }
+        }
+    }
+}
+
+void SDFCollider::unbinTriangle(int t, std::vector<char>& dirty) {
+    for (int b : triangle_bricks[t]) {
+        std::vector<int>& list = bricks[b].triangles;
+        list.erase(std::remove(list.begin(), list.end(), t), list.end());
+        dirty[b] = 1;
+    }
+    triangle_bricks[t].clear();
+}
+
+void SDFCollider::freeEmptyBricks(std::vector<char>& dirty) {
+    // only bricks that lost triangles can be empty; the last brick takes the slot of a freed one.
+    // Going backwards, the last brick has been checked already when it moves.
+    for (int b = static_cast<int>(bricks.size()) - 1; b >= 0; b--) {
+        if (!dirty[b] || !bricks[b].triangles.empty()) continue;
+        brick_lookup.erase(brickKey(bricks[b].coord));
+        int last = static_cast<int>(bricks.size()) - 1;
+        if (b != last) {
+            bricks[b] = std::move(bricks[last]);
+            dirty[b] = dirty[last];
+            brick_lookup[brickKey(bricks[b].coord)] = b;
+            for (int t : bricks[b].triangles) {
+                std::replace(triangle_bricks[t].begin(), triangle_bricks[t].end(), last, b);
+            }
+        }
+        bricks.pop_back();
+        dirty.pop_back();
+    }
+}
+
+void SDFCollider::voxelizeBrick(Brick& brick) const {
+    Eigen::Vector3i origin = brick.coord * BRICK;
+    for (int k = 0; k < BRICK_NODES; k++) {
+        for (int j = 0; j < BRICK_NODES; j++) {
+            for (int i = 0; i < BRICK_NODES; i++) {
+                Eigen::Vector3d p = (origin + Eigen::Vector3i(i, j, k)).cast<double>() * voxel_size;
+                brick.values[(k * BRICK_NODES + j) * BRICK_NODES + i] = static_cast<float>(signedDistance(p, brick.triangles));
+            }
+        }
+    }
+}
+
+double SDFCollider::signedDistance(const Eigen::Vector3d& p, const std::vector<int>& candidates) const {
+    double best = band * band;
+    double sign = 1.0;
+    for (int t : candidates) {
+        const Eigen::Vector3i& tri = triangles[t];
+        TriangleFeature feature;
+        Eigen::Vector3d q = closestPointOnTriangle(p, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], feature);
+        double d2 = (p - q).squaredNorm();
+        if (d2 >= best) continue;
+        best = d2;
+
+        Eigen::Vector3d n;
+        switch (feature) {
+            case VERTEX_A: n = vertex_normals[tri[0]]; break;
+            case VERTEX_B: n = vertex_normals[tri[1]]; break;
+            case VERTEX_C: n = vertex_normals[tri[2]]; break;
+            case EDGE_AB: n = edge_normals[t].col(0); break;
+            case EDGE_BC: n = edge_normals[t].col(1); break;
+            case EDGE_CA: n = edge_normals[t].col(2); break;
+            default: n = face_normals[t]; break;
+        }
+        sign = (p - q).dot(n) < 0.0 ? -1.0 : 1.0;
+    }
+    return sign * std::sqrt(best);
+}
+
+bool SDFCollider::locate(const Eigen::Vector3d& p, Eigen::Vector3d& g, Eigen::Vector3i& cell) const {
+    // NaN or a point beyond the brick coordinates of brickKey would make the int cast undefined or alias a brick
+    g = p / voxel_size;
+    if (!g.allFinite() || g.cwiseAbs().maxCoeff() >= static_cast<double>(BRICK) * (1 << 20)) {
+        return false;
+    }
+    cell = g.array().floor().cast<int>();
+    return true;
+}
+
+Eigen::Vector3i SDFCollider::brickCoord(const Eigen::Vector3i& cell) {
+    return Eigen::Vector3i(floorDiv(cell.x(), BRICK), floorDiv(cell.y(), BRICK), floorDiv(cell.z(), BRICK));
+}
+
+const SDFCollider::Brick* SDFCollider::findBrick(const Eigen::Vector3i& coord) const {
+    auto it = brick_lookup.find(brickKey(coord));
+    return it == brick_lookup.end() ? nullptr : &bricks[it->second];
+}
+
+void SDFCollider::interpolate(const Brick& brick, const Eigen::Vector3d& g, const Eigen::Vector3i& cell, double& dist, Eigen::Vector3d& grad) const {
+    Eigen::Vector3i local = cell - brick.coord * BRICK;
+    Eigen::Vector3f f = (g - cell.cast<double>()).cast<float>();
+
+    // gather the 8 corners and evaluate value and gradient as 8-wide array operations
+    Eigen::Array<float, 8, 1> corners;
+    for (int c = 0; c < 8; c++) {
+        int i = local.x() + (c & 1), j = local.y() + ((c >> 1) & 1), k = local.z() + ((c >> 2) & 1);
+        corners[c] = brick.values[(k * BRICK_NODES + j) * BRICK_NODES + i];
+    }
+    Eigen::Array<float, 8, 1> wx = MASK_X * f.x() + (1.0f - MASK_X) * (1.0f - f.x());
+    Eigen::Array<float, 8, 1> wy = MASK_Y * f.y() + (1.0f - MASK_Y) * (1.0f - f.y());
+    Eigen::Array<float, 8, 1> wz = MASK_Z * f.z() + (1.0f - MASK_Z) * (1.0f - f.z());
+
+    dist = (wx * wy * wz * corners).sum();
+    grad = Eigen::Vector3d(((2.0f * MASK_X - 1.0f) * wy * wz * corners).sum(),
+                           ((2.0f * MASK_Y - 1.0f) * wx * wz * corners).sum(),
+                           ((2.0f * MASK_Z - 1.0f) * wx * wy * corners).sum()) / voxel_size;
+}
+
+bool SDFCollider::sample(const Eigen::Vector3d& p, double& dist, Eigen::Vector3d& grad) const {
+    Eigen::Vector3d g;
+    Eigen::Vector3i cell;
+    if (!locate(p, g, cell)) return false;
+    const Brick* brick = findBrick(brickCoord(cell));
+    if (!brick) return false;
+    interpolate(*brick, g, cell, dist, grad);
+    return true;
+}
+
+Eigen::Vector3d SDFCollider::surfaceVelocity(const Eigen::Vector3d& p) const {
+    Eigen::Vector3d g;
+    Eigen::Vector3i cell;
+    const Brick* brick = locate(p, g, cell) ? findBrick(brickCoord(cell)) : nullptr;
+    if (!brick) return Eigen::Vector3d::Zero();
+    // interpolated over the closest triangle, the one that determines the distance at p
+    double best = std::numeric_limits<double>::infinity();
+    Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+    for (int t : brick->triangles) {
+        const Eigen::Vector3i& tri = triangles[t];
+        TriangleFeature feature;
+        Eigen::Vector3d q = closestPointOnTriangle(p, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], feature);
+        double d2 = (p - q).squaredNorm();
+        if (d2 >= best) continue;
+        best = d2;
+        Eigen::Vector3d w = barycentric(q, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
+        velocity = w[0] * velocities[tri[0]] + w[1] * velocities[tri[1]] + w[2] * velocities[tri[2]];
+    }
+    return velocity;
+}
+
+void SDFCollider::query(const std::vector<Eigen::Vector3d>& points, std::vector<double>& distances, std::vector<Eigen::Vector3d>& normals) const {
+    distances.resize(points.size());
+    normals.resize(points.size());
+    // consecutive points of a strand mostly fall into the same brick, the hash lookup is done once per run of them
+    const Brick* brick = nullptr;
+    Eigen::Vector3i coord;
+    bool have_brick = false;
+    for (size_t i = 0; i < points.size(); i++) {
+        Eigen::Vector3d g, grad;
+        Eigen::Vector3i cell;
+        bool hit = false;
+        if (locate(points[i], g, cell)) {
+            Eigen::Vector3i point_coord = brickCoord(cell);
+            if (!have_brick || point_coord != coord) {
+                brick = findBrick(point_coord);
+                coord = point_coord;
+                have_brick = true;
+            }
+            if (brick) {
+                interpolate(*brick, g, cell, distances[i], grad);
+                hit = grad.norm() > 0.0;
+            }
+        }
+        if (hit) {
+            normals[i] = grad.normalized();
+        } else {
+            distances[i] = band;
+            normals[i] = Eigen::Vector3d::Zero();
+        }
+    }
+}
+
+double SDFCollider::distance(const Eigen::Vector3d& p) const {
+    double dist;
+    Eigen::Vector3d grad;
+    return sample(p, dist, grad) ? dist : band;
+}
+
+void SDFCollider::collide(std::vector<DER>& strands, double thickness, double friction) const {
+    parallelFor(0, static_cast<int>(strands.size()), [&](int begin, int end) {
+        std::vector<double> distances;
+        std::vector<Eigen::Vector3d> normals;
+        for (int s = begin; s < end; s++) {
+            query(strands[s].getVertices(), distances, normals);
+            if (*std::min_element(distances.begin(), distances.end()) >= thickness) {
+                continue;
+            }
+
+            std::vector<Eigen::Vector3d> x = strands[s].getVertices();
+            std::vector<Eigen::Vector3d> v = strands[s].getVelocities();
+            for (size_t i = 0; i < x.size(); i++) {
+                if (distances[i] >= thickness || normals[i].isZero()) continue;
+                const Eigen::Vector3d& n = normals[i];
+                // the response is relative to the surface, which may move with the mesh
+                Eigen::Vector3d surface = moving ? surfaceVelocity(x[i]) : Eigen::Vector3d::Zero();
+                x[i] += (thickness - distances[i]) * n;
+
+                Eigen::Vector3d v_rel = v[i] - surface;
+                double v_n = v_rel.dot(n);
+                if (v_n >= 0.0) continue;
+                Eigen::Vector3d v_t = v_rel - v_n * n;
+                double v_t_norm = v_t.norm();
+                // Coulomb friction: the tangential speed is reduced by friction * |v_n|
+                double scale = v_t_norm > 0.0 ? std::max(0.0, 1.0 - friction * -v_n / v_t_norm) : 0.0;
+                v[i] = surface + scale * v_t;
+            }
+            strands[s].setState(x, v);
+        }
+    });
+}
+
+int SDFCollider::brickCount() const {
+    return static_cast<int>(bricks.size());
+}
+
+int SDFCollider::lastDirtyBrickCount() const {
+    return dirty_brick_count;
+}
@@ -0,0 +1,67 @@
+#include "ScalpAttachment.h"
+#include "Geometry.h"
+#include "Parallel.h"
+#include <limits>
+
+ScalpAttachment::ScalpAttachment(const std::vector<Eigen::Vector3d>& rest_vertices, const std::vector<Eigen::Vector3i>& triangles, const std::vector<Eigen::Vector3d>& roots)
+    : triangles(triangles) {
+    int num_roots = static_cast<int>(roots.size());
+    bound_triangles.resize(num_roots);
+    bound_barycentrics.resize(num_roots);
+    rest_frames.resize(num_roots);
+    rest_points.resize(num_roots);
+
+    // brute force closest triangle, only done once at load time
+    parallelFor(0, num_roots, [&](int begin, int end) {
+        for (int r = begin; r < end; r++) {
+            double best = std::numeric_limits<double>::max();
+            Eigen::Vector3d best_point = roots[r];
+            int best_triangle = 0;
+            for (int t = 0; t < static_cast<int>(triangles.size()); t++) {
+                const Eigen::Vector3i& tri = triangles[t];
+                TriangleFeature feature;
+                Eigen::Vector3d q = closestPointOnTriangle(roots[r], rest_vertices[tri[0]], rest_vertices[tri[1]], rest_vertices[tri[2]], feature);
+                double d2 = (q - roots[r]).squaredNorm();
+                if (d2 < best) {
+                    best = d2;
+                    best_point = q;
+                    best_triangle = t;
+                }
+            }
+            const Eigen::Vector3i& tri = triangles[best_triangle];
+            bound_triangles[r] = best_triangle;
+            bound_barycentrics[r] = barycentric(best_point, rest_vertices[tri[0]], rest_vertices[tri[1]], rest_vertices[tri[2]]);
+            rest_frames[r] = triangleFrame(rest_vertices, best_triangle);
+            rest_points[r] = best_point;
+        }
+    }, 16);
+}
+
+Eigen::Matrix3d ScalpAttachment::triangleFrame(const std::vector<Eigen::Vector3d>& vertices, int t) const {
+    const Eigen::Vector3i& tri = triangles[t];
+    Eigen::Vector3d e1 = (vertices[tri[1]] - vertices[tri[0]]).normalized();
+    Eigen::Vector3d n = e1.cross(vertices[tri[2]] - vertices[tri[0]]).normalized();
+    Eigen::Matrix3d frame;
+    frame << e1, n.cross(e1), n;
+    return frame;
+}
+
+void ScalpAttachment::evaluate(const std::vector<Eigen::Vector3d>& scalp_vertices, std::vector<Eigen::Matrix3d>& rotations, std::vector<Eigen::Vector3d>& translations) const {
+    int num_roots = rootCount();
+    rotations.resize(num_roots);
+    translations.resize(num_roots);
+    parallelFor(0, num_roots, [&](int begin, int end) {
+        for (int r = begin; r < end; r++) {
+            const Eigen::Vector3i& tri = triangles[bound_triangles[r]];
+            const Eigen::Vector3d& w = bound_barycentrics[r];
+            Eigen::Vector3d p = w.x() * scalp_vertices[tri[0]] + w.y() * scalp_vertices[tri[1]] + w.z() * scalp_vertices[tri[2]];
+            // rest frame -> current frame, chosen so that the rest pose gives the identity
+            rotations[r] = triangleFrame(scalp_vertices, bound_triangles[r]) * rest_frames[r].transpose();
+            translations[r] = p - rotations[r] * rest_points[r];
+        }
+    });
+}
+
+int ScalpAttachment::rootCount() const {
+    return static_cast<int>(bound_triangles.size());
+}
@@ -1,6 +1,50 @@
 #include "Shader.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+std::string Shader::cacheDirectory;
+
+namespace {
+
+constexpr char cache_magic[4] = {'C', 'G', 'S', 'B'};
+
+// header of a cache entry, followed by `length` bytes of program binary
+struct CacheHeader {
+    char magic[4];
+    GLenum format;
+    uint64_t key;
+    uint64_t length;
+};
+
+// FNV-1a
+uint64_t hashString(uint64_t hash, const std::string& s) {
+    for (char c : s) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= 0xff; // separator, so that moving text from one string to the next changes the key
+    return hash * 0x100000001b3ull;
+}
+
+std::string glString(GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+bool programBinarySupported() {
+    if (!GLAD_GL_VERSION_4_1) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+} // namespace
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines) {
+    CGC_TRACE_SCOPE("Shader::Shader");
     // シェーダーのコードを読み込む
     std::string vertexCode;
     std::string fragmentCode;
@@ -27,14 +71,53 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
         // ファイルを閉じる
         vShaderFile.close();
         fShaderFile.close();
-    } catch (std::ifstream::failure e) {
+    } catch (const std::ifstream::failure& e) {
         std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
     }
 
+    build(InjectDefines(vertexCode, defines), InjectDefines(fragmentCode, defines));
+}
+
+std::string Shader::InjectDefines(const std::string& source, const std::vector<std::string>& defines) {
+    if (defines.empty()) return source;
+    std::string lines;
+    for (const std::string& define : defines) lines += "#define " + define + "\n";
+    // #version has to stay the first statement
+    size_t at = 0;
+    size_t version = source.find("#version");
+    if (version != std::string::npos) {
+        at = source.find('\n', version);
+        if (at == std::string::npos) return source + "\n" + lines;
+        at++;
+    }
+    return source.substr(0, at) + lines + source.substr(at);
+}
+
+void Shader::SetCacheDirectory(const std::string& directory) {
+    cacheDirectory = directory;
+}
+
+void Shader::build(const std::string& vertexCode, const std::string& fragmentCode) {
+    std::string cachePath;
+    uint64_t key = 0;
+    if (!cacheDirectory.empty() && programBinarySupported()) {
+        key = 0xcbf29ce484222325ull;
+        for (const std::string* s : {&vertexCode, &fragmentCode}) key = hashString(key, *s);
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) key = hashString(key, glString(name));
+        char file[32];
+        std::snprintf(file, sizeof(file), "%016llx.bin", static_cast<unsigned long long>(key));
+        cachePath = (std::filesystem::path(cacheDirectory) / file).string();
+        if (loadBinary(cachePath, key)) {
+            fromCache = true;
+            return;
+        }
+    }
+
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
     // シェーダーをコンパイルする
+    CGC_TRACE_SCOPE("Shader compile");
     GLuint vertex, fragment;
     
     // 頂点シェーダー
@@ -53,12 +136,67 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    if (!cachePath.empty()) glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
 
     // シェーダーを削除する
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    if (!cachePath.empty()) saveBinary(cachePath, key);
+}
+
+bool Shader::loadBinary(const std::string& path, uint64_t key) {
+    CGC_TRACE_SCOPE("Shader cache load");
+    std::ifstream file(path, std::ios::binary);
+    CacheHeader header;
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::string(header.magic, 4) != std::string(cache_magic, 4) || header.key != key || header.length > (1u << 30)) return false;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) return false;
+
+    // the driver may still reject the binary, e.g. after an update that kept the version string
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return false;
+    }
+    ID = program;
+    return true;
+}
+
+void Shader::saveBinary(const std::string& path, uint64_t key) {
+    GLint linked = GL_FALSE, length = 0;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!linked || length <= 0) return;
+    CacheHeader header;
+    std::copy(std::begin(cache_magic), std::end(cache_magic), header.magic);
+    header.key = key;
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    glGetProgramBinary(ID, length, &written, &header.format, binary.data());
+    header.length = static_cast<uint64_t>(written);
+
+    // written next to the entry and renamed, so that a concurrent run never reads half a file
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDirectory, ec);
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), written);
+        if (!file) {
+            std::cerr << "Warning: cannot write shader cache " << temp << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) std::filesystem::remove(temp, ec);
 }
 
 void Shader::use() {
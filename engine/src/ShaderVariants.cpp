@@ -0,0 +1,156 @@
+#include "ShaderVariants.h"
+#include "Trace.h"
+#include <algorithm>
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath, GLFWwindow* window)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath) {
+    if (!window) return;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "shader compiler", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        std::cerr << "Warning: no shared context for background shader compilation, compiling on the render thread" << std::endl;
+        return;
+    }
+    worker = std::thread(&ShaderVariants::compileLoop, this);
+}
+
+ShaderVariants::~ShaderVariants() {
+    Shutdown();
+}
+
+void ShaderVariants::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued_cv.notify_all();
+    if (worker.joinable()) worker.join();
+    if (context) {
+        glfwDestroyWindow(context);
+        context = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& pair : variants) {
+        if (pair.second.shader) glDeleteProgram(pair.second.shader->ID);
+    }
+    variants.clear();
+    queue.clear();
+}
+
+void ShaderVariants::Request(const Defines& defines) {
+    request(defines);
+}
+
+Shader* ShaderVariants::Get(const Defines& defines, const Defines& fallback) {
+    std::string k = request(defines);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Variant& variant = variants.at(k);
+        if (variant.state == READY) return variant.shader.get();
+    }
+    if (!Wait(fallback)) return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    return variants.at(key(fallback)).shader.get();
+}
+
+bool ShaderVariants::IsReady(const Defines& defines) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = variants.find(key(defines));
+    return it != variants.end() && it->second.state == READY;
+}
+
+bool ShaderVariants::Wait(const Defines& defines) {
+    std::string k = request(defines);
+    std::unique_lock<std::mutex> lock(mutex);
+    const Variant& variant = variants.at(k);
+    compiled_cv.wait(lock, [&] { return variant.state != QUEUED; });
+    return variant.state == READY;
+}
+
+int ShaderVariants::variantCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(variants.size());
+}
+
+bool ShaderVariants::compilesInBackground() const {
+    return worker.joinable();
+}
+
+std::string ShaderVariants::key(const Defines& defines) {
+    Defines sorted;
+    for (const std::string& define : defines) {
+        size_t first = define.find_first_not_of(" \t");
+        if (first == std::string::npos) continue;
+        sorted.push_back(define.substr(first, define.find_last_not_of(" \t") - first + 1));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::string k;
+    for (const std::string& define : sorted) k += define + "\n";
+    return k;
+}
+
+std::string ShaderVariants::request(const Defines& defines) {
+    std::string k = key(defines);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (variants.count(k)) return k;
+        Variant& variant = variants[k];
+        variant.defines = defines;
+        if (worker.joinable()) {
+            queue.push_back(k);
+            queued_cv.notify_one();
+            return k;
+        }
+    }
+    std::unique_ptr<Shader> shader = compile(defines);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Variant& variant = variants[k];
+        variant.state = shader ? READY : FAILED;
+        variant.shader = std::move(shader);
+    }
+    compiled_cv.notify_all();
+    return k;
+}
+
+std::unique_ptr<Shader> ShaderVariants::compile(const Defines& defines) const {
+    CGC_TRACE_SCOPE("ShaderVariants compile");
+    std::unique_ptr<Shader> shader(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(shader->ID, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(shader->ID);
+        return nullptr;
+    }
+    return shader;
+}
+
+void ShaderVariants::compileLoop() {
+    CGC_TRACE_THREAD_NAME("shader compiler");
+    glfwMakeContextCurrent(context);
+    while (true) {
+        Defines defines;
+        std::string k;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) break;
+            k = queue.front();
+            queue.pop_front();
+            defines = variants.at(k).defines;
+        }
+        std::unique_ptr<Shader> shader = compile(defines);
+        // the program has to be complete before the render context may use it
+        glFinish();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Variant& variant = variants.at(k);
+            variant.state = shader ? READY : FAILED;
+            variant.shader = std::move(shader);
+        }
+        compiled_cv.notify_all();
+    }
+    glfwMakeContextCurrent(nullptr);
+}
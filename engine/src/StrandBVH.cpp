@@ -0,0 +1,509 @@
+#include "StrandBVH.h"
+#include <algorithm>
+#include <mutex>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "Parallel.h"
+
+namespace {
+
+constexpr float inf = std::numeric_limits<float>::infinity();
+
+struct Box {
+    float lo[3] = {inf, inf, inf};
+    float hi[3] = {-inf, -inf, -inf};
+
+    void grow(const float* l, const float* h) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], l[c]);
+            hi[c] = std::max(hi[c], h[c]);
+        }
+    }
+    void grow(const Box& box) { grow(box.lo, box.hi); }
+    float area() const {
+        float d[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+        return d[0] < 0.0f ? 0.0f : 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+};
+
+// segment with the bounds and centroid the build sorts by
+struct Prim {
+    unsigned int point, strand, segment;
+    Box box;
+    float centroid[3];
+};
+
+struct Bin {
+    Box box;
+    unsigned int count = 0;
+};
+
+constexpr int max_bins = 64;
+constexpr unsigned int local_stack = 64;
+constexpr float traversal_cost = 1.0f; // of a node, relative to testing one segment
+
+// SAH bins of prims [begin, end) along `axis`, whose centroid extent must not be zero
+void binPrims(const std::vector<Prim>& prims, unsigned int begin, unsigned int end, const Box& centroids, int axis, int bins, bool parallel, Bin* out) {
+    std::fill(out, out + bins, Bin());
+    float scale = bins / (centroids.hi[axis] - centroids.lo[axis]);
+    auto accumulate = [&](unsigned int first, unsigned int last, Bin* into) {
+        for (unsigned int p = first; p < last; p++) {
+            int b = std::min(bins - 1, static_cast<int>((prims[p].centroid[axis] - centroids.lo[axis]) * scale));
+            into[b].box.grow(prims[p].box);
+            into[b].count++;
+        }
+    };
+    if (!parallel) {
+        accumulate(begin, end, out);
+        return;
+    }
+    std::mutex mutex;
+    parallelFor(static_cast<int>(begin), static_cast<int>(end), [&](int first, int last) {
+        Bin local[max_bins];
+        accumulate(first, last, local);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int b = 0; b < bins; b++) {
+            out[b].box.grow(local[b].box);
+            out[b].count += local[b].count;
+        }
+    }, 16384);
+}
+
+struct Range {
+    int node;
+    unsigned int begin, end;
+};
+
+} // namespace
+
+void StrandBVH::build(const HairModel& model) {
+    build(model, Settings());
+}
+
+void StrandBVH::build(const HairModel& model, const Settings& settings) {
+    this->settings = settings;
+    this->settings.bins = std::min(std::max(settings.bins, 2), max_bins);
+    this->settings.leaf_size = std::max(settings.leaf_size, 1);
+    depth = 0;
+    nodes.clear();
+    segments.clear();
+    points = model.points;
+    size_t point_count = points.size() / 3;
+    radii.resize(point_count);
+    for (size_t v = 0; v < point_count; v++) {
+        radii[v] = settings.radius_scale * (model.thickness.size() == point_count ? model.thickness[v] : model.d_thickness);
+    }
+
+    std::vector<Prim> prims;
+    unsigned int first = 0;
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        unsigned int count = model.segments.empty() ? model.d_segments : model.segments[s];
+        if (first + count + 1 > point_count) break; // points do not cover the strands
+        for (unsigned int i = 0; i < count; i++) prims.push_back({first + i, s, i, Box(), {0.0f, 0.0f, 0.0f}});
+        first += count + 1;
+    }
+    if (prims.empty()) return;
+    parallelFor(0, static_cast<int>(prims.size()), [&](int begin, int end) {
+        for (int p = begin; p < end; p++) {
+            Segment segment = {prims[p].point, prims[p].strand, prims[p].segment};
+            segmentBounds(segment, prims[p].box.lo, prims[p].box.hi);
+            for (int c = 0; c < 3; c++) prims[p].centroid[c] = 0.5f * (prims[p].box.lo[c] + prims[p].box.hi[c]);
+        }
+    });
+
+    // Splits one node into two children at the end of `out`, or makes it a leaf (returns false).
+    // Only the axis of the largest centroid extent is binned: for strands that costs next to nothing
+    // in ray queries and builds almost twice as fast as binning all three. `binned` holds `bins` entries.
+    auto split = [&](std::vector<Node>& out, const Range& range, bool parallel, Bin* binned, Range children[2]) {
+        unsigned int begin = range.begin, end = range.end, count = end - begin;
+        Box centroids;
+        for (unsigned int p = begin; p < end; p++) centroids.grow(prims[p].centroid, prims[p].centroid);
+        int axis = 0;
+        for (int c = 1; c < 3; c++) {
+            if (centroids.hi[c] - centroids.lo[c] > centroids.hi[axis] - centroids.lo[axis]) axis = c;
+        }
+        int bins = this->settings.bins;
+        bool binned_any = count > 1 && centroids.hi[axis] > centroids.lo[axis];
+        if (binned_any) binPrims(prims, begin, end, centroids, axis, bins, parallel, binned);
+
+        // the bins hold every segment once
+        Box bounds;
+        if (binned_any) {
+            for (int b = 0; b < bins; b++) bounds.grow(binned[b].box);
+        } else {
+            for (unsigned int p = begin; p < end; p++) bounds.grow(prims[p].box);
+        }
+        Node& node = out[range.node];
+        std::copy(bounds.lo, bounds.lo + 3, node.lo);
+        std::copy(bounds.hi, bounds.hi + 3, node.hi);
+        node.index = begin;
+        node.count = count;
+        if (count <= 1) return false;
+
+        float best_cost = inf;
+        int best_bin = -1;
+        if (binned_any) {
+            // areas and counts of everything right of each split plane
+            float right_area[max_bins];
+            unsigned int right_count[max_bins];
+            Box box;
+            unsigned int n = 0;
+            for (int b = bins - 1; b > 0; b--) {
+                box.grow(binned[b].box);
+                n += binned[b].count;
+                right_area[b] = box.area();
+                right_count[b] = n;
+            }
+            box = Box();
+            n = 0;
+            for (int b = 0; b < bins - 1; b++) {
+                box.grow(binned[b].box);
+                n += binned[b].count;
+                float cost = box.area() * n + right_area[b + 1] * right_count[b + 1];
+                if (n > 0 && right_count[b + 1] > 0 && cost < best_cost) {
+                    best_cost = cost;
+                    best_bin = b;
+                }
+            }
+        }
+
+        unsigned int middle;
+        if (best_bin >= 0) {
+            // SAH: a split pays for one more node test wherever the parent is entered
+            float leaf_cost = bounds.area() * count;
+            if (count <= static_cast<unsigned int>(this->settings.leaf_size) && best_cost + traversal_cost * bounds.area() >= leaf_cost) return false;
+            float scale = bins / (centroids.hi[axis] - centroids.lo[axis]);
+            Prim* mid = std::partition(prims.data() + begin, prims.data() + end, [&](const Prim& p) {
+                int b = std::min(bins - 1, static_cast<int>((p.centroid[axis] - centroids.lo[axis]) * scale));
+                return b <= best_bin;
+            });
+            middle = static_cast<unsigned int>(mid - prims.data());
+        } else {
+            // all centroids coincide, only the leaf size forces a split
+            if (count <= static_cast<unsigned int>(this->settings.leaf_size)) return false;
+            middle = begin + count / 2;
+        }
+
+        unsigned int left = static_cast<unsigned int>(out.size());
+        out[range.node].index = left;
+        out[range.node].count = 0;
+        out.resize(out.size() + 2);
+        children[0] = {static_cast<int>(left), begin, middle};
+        children[1] = {static_cast<int>(left + 1), middle, end};
+        return true;
+    };
+
+    // top levels with parallel binning, the subtrees below parallel_size are left for the second pass
+    size_t parallel_size = std::max<size_t>(4096, prims.size() / (8 * ThreadPool::instance().size()));
+    std::vector<Range> subtrees;
+    std::vector<Bin> binned(this->settings.bins);
+    std::vector<Range> stack = {{0, 0, static_cast<unsigned int>(prims.size())}};
+    nodes.resize(1);
+    while (!stack.empty()) {
+        Range range = stack.back();
+        stack.pop_back();
+        if (range.end - range.begin <= parallel_size) {
+            subtrees.push_back(range);
+            continue;
+        }
+        Range children[2];
+        if (split(nodes, range, true, binned.data(), children)) {
+            stack.push_back(children[1]);
+            stack.push_back(children[0]);
+        }
+    }
+
+    // every subtree into its own node array, spliced in afterwards
+    std::vector<std::vector<Node>> built(subtrees.size());
+    parallelFor(0, static_cast<int>(subtrees.size()), [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            std::vector<Node>& local = built[t];
+            local.resize(1);
+            std::vector<Bin> scratch(this->settings.bins);
+            std::vector<Range> pending = {{0, subtrees[t].begin, subtrees[t].end}};
+            while (!pending.empty()) {
+                Range range = pending.back();
+                pending.pop_back();
+                Range children[2];
+                if (split(local, range, false, scratch.data(), children)) {
+                    pending.push_back(children[1]);
+                    pending.push_back(children[0]);
+                }
+            }
+        }
+    }, 1);
+    for (size_t t = 0; t < subtrees.size(); t++) {
+        unsigned int base = static_cast<unsigned int>(nodes.size()) - 1; // local node i > 0 goes to base + i
+        for (Node& node : built[t]) {
+            if (node.count == 0) node.index += base;
+        }
+        nodes[subtrees[t].node] = built[t][0];
+        nodes.insert(nodes.end(), built[t].begin() + 1, built[t].end());
+    }
+
+    segments.resize(prims.size());
+    for (size_t p = 0; p < prims.size(); p++) segments[p] = {prims[p].point, prims[p].strand, prims[p].segment};
+
+    std::vector<unsigned int> level(nodes.size(), 0);
+    for (size_t n = 0; n < nodes.size(); n++) {
+        depth = std::max(depth, level[n]);
+        if (nodes[n].count == 0) level[nodes[n].index] = level[nodes[n].index + 1] = level[n] + 1;
+    }
+}
+
+void StrandBVH::refit(const float* new_points) {
+    if (nodes.empty()) return;
+    std::copy(new_points, new_points + points.size(), points.begin());
+    parallelFor(0, static_cast<int>(nodes.size()), [&](int begin, int end) {
+        for (int n = begin; n < end; n++) {
+            Node& node = nodes[n];
+            if (node.count == 0) continue;
+            Box box;
+            for (unsigned int s = node.index; s < node.index + node.count; s++) {
+                float lo[3], hi[3];
+                segmentBounds(segments[s], lo, hi);
+                box.grow(lo, hi);
+            }
+            std::copy(box.lo, box.lo + 3, node.lo);
+            std::copy(box.hi, box.hi + 3, node.hi);
+        }
+    });
+    // children come after their parents, so one backwards pass sees them updated
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        if (node.count != 0) continue;
+        const Node& a = nodes[node.index];
+        const Node& b = nodes[node.index + 1];
+        for (int c = 0; c < 3; c++) {
+            node.lo[c] = std::min(a.lo[c], b.lo[c]);
+            node.hi[c] = std::max(a.hi[c], b.hi[c]);
+        }
+    }
+}
+
+bool StrandBVH::intersect(const Ray& ray, Hit* hit) const {
+    return traverse(ray, 0.0f, false, hit);
+}
+
+bool StrandBVH::pick(const Ray& ray, float radius, Hit* hit) const {
+    return traverse(ray, radius, false, hit);
+}
+
+bool StrandBVH::occluded(const Ray& ray) const {
+    return traverse(ray, 0.0f, true, nullptr);
+}
+
+const std::vector<float>& StrandBVH::pointPositions() const {
+    return points;
+}
+
+const std::vector<float>& StrandBVH::pointRadii() const {
+    return radii;
+}
+
+size_t StrandBVH::segmentCount() const {
+    return segments.size();
+}
+
+size_t StrandBVH::nodeCount() const {
+    return nodes.size();
+}
+
+bool StrandBVH::empty() const {
+    return nodes.empty();
+}
+
+void StrandBVH::segmentBounds(const Segment& s, float lo[3], float hi[3]) const {
+    const float* a = &points[3 * s.point];
+    const float* b = a + 3;
+    float r = std::max(radii[s.point], radii[s.point + 1]);
+    for (int c = 0; c < 3; c++) {
+        lo[c] = std::min(a[c], b[c]) - r;
+        hi[c] = std::max(a[c], b[c]) + r;
+    }
+}
+
+bool StrandBVH::hitSegment(const Segment& s, const Ray& ray, float dd, float extra_radius, float best, float* t_out, float* u_out) const {
+    const Eigen::Vector3f& o = ray.origin;
+    const Eigen::Vector3f& d = ray.direction;
+    Eigen::Map<const Eigen::Vector3f> a(&points[3 * s.point]);
+    Eigen::Map<const Eigen::Vector3f> b(&points[3 * s.point + 3]);
+    // closest points of the ray line and the segment, clamped to the segment
+    Eigen::Vector3f e = b - a, w = o - a;
+    float de = d.dot(e), ee = e.squaredNorm(), dw = d.dot(w), ew = e.dot(w);
+    float denom = dd * ee - de * de;
+    float u = denom > 1e-12f * dd * ee ? (dd * ew - de * dw) / denom : 0.0f;
+    u = std::min(std::max(u, 0.0f), 1.0f);
+    float t = (de * u - dw) / dd;
+    if (ee > 0.0f) u = std::min(std::max((t * de + ew) / ee, 0.0f), 1.0f);
+    float r = radii[s.point] + u * (radii[s.point + 1] - radii[s.point]) + extra_radius;
+    if (t < ray.t_min || t >= best) return false;
+    if ((o + t * d - (a + u * e)).squaredNorm() > r * r) return false;
+    *t_out = t;
+    *u_out = u;
+    return true;
+}
+
+bool StrandBVH::traverse(const Ray& ray, float extra_radius, bool any, Hit* hit) const {
+    if (nodes.empty()) return false;
+    const Eigen::Vector3f& o = ray.origin;
+    const Eigen::Vector3f& d = ray.direction;
+    Eigen::Vector3f inv_d = d.cwiseInverse();
+    float dd = d.squaredNorm();
+    if (!(dd > 0.0f)) return false;
+
+    // entry distance into a node box grown by extra_radius, inf if missed
+    auto enter = [&](const Node& node, float t_max) {
+        float t0 = ray.t_min, t1 = t_max;
+        for (int c = 0; c < 3; c++) {
+            float a = (node.lo[c] - extra_radius - o[c]) * inv_d[c];
+            float b = (node.hi[c] + extra_radius - o[c]) * inv_d[c];
+            if (a > b) std::swap(a, b);
+            // NaN (origin on a slab of a parallel ray) leaves the interval unchanged
+            t0 = a > t0 ? a : t0;
+            t1 = b < t1 ? b : t1;
+        }
+        return t0 <= t1 ? t0 : inf;
+    };
+
+    float best = ray.t_max;
+    bool found = false;
+    // a depth-first walk holds at most one pending node per level
+    unsigned int local[local_stack];
+    std::vector<unsigned int> heap(depth < local_stack ? 0 : depth + 1);
+    unsigned int* stack = heap.empty() ? local : heap.data();
+    int top = 0;
+    if (enter(nodes[0], best) < inf) stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (enter(node, best) == inf) continue; // best got closer since it was pushed
+        if (node.count == 0) {
+            float t_left = enter(nodes[node.index], best);
+            float t_right = enter(nodes[node.index + 1], best);
+            // nearer child on top
+            if (t_left <= t_right) {
+                if (t_right < inf) stack[top++] = node.index + 1;
+                if (t_left < inf) stack[top++] = node.index;
+            } else {
+                if (t_left < inf) stack[top++] = node.index;
+                stack[top++] = node.index + 1;
+            }
+            continue;
+        }
+        for (unsigned int i = node.index; i < node.index + node.count; i++) {
+            float t, u;
+            if (!hitSegment(segments[i], ray, dd, extra_radius, best, &t, &u)) continue;
+            if (any) return true;
+            best = t;
+            found = true;
+            if (hit) {
+                hit->strand = segments[i].strand;
+                hit->segment = segments[i].segment;
+                hit->t = t;
+                hit->u = u;
+            }
+        }
+    }
+    return found;
+}
+
+void StrandBVH::intersect4(const Ray rays[4], Hit hits[4], bool found[4]) const {
+    float dd[4];
+    alignas(16) float o[3][4], inv_d[3][4], t_min[4], best[4];
+    for (int k = 0; k < 4; k++) {
+        found[k] = false;
+        dd[k] = rays[k].direction.squaredNorm();
+        for (int c = 0; c < 3; c++) {
+            o[c][k] = rays[k].origin[c];
+            inv_d[c][k] = 1.0f / rays[k].direction[c];
+        }
+        t_min[k] = rays[k].t_min;
+        // degenerate rays never enter a box
+        best[k] = dd[k] > 0.0f ? rays[k].t_max : -inf;
+    }
+    if (nodes.empty()) return;
+
+    // entry distances of the four rays into a node box, returns the mask of the rays that enter it
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128 o4[3], inv_d4[3];
+    for (int c = 0; c < 3; c++) {
+        o4[c] = _mm_load_ps(o[c]);
+        inv_d4[c] = _mm_load_ps(inv_d[c]);
+    }
+    __m128 t_min4 = _mm_load_ps(t_min);
+    auto enter = [&](const Node& node, float entry[4]) {
+        __m128 t0 = t_min4, t1 = _mm_load_ps(best);
+        for (int c = 0; c < 3; c++) {
+            __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.lo[c]), o4[c]), inv_d4[c]);
+            __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.hi[c]), o4[c]), inv_d4[c]);
+            // min/max return their second operand for NaN, so NaN leaves the interval unchanged as in traverse
+            t0 = _mm_max_ps(_mm_min_ps(a, b), t0);
+            t1 = _mm_min_ps(_mm_max_ps(a, b), t1);
+        }
+        _mm_storeu_ps(entry, t0);
+        return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+    };
+#else
+    auto enter = [&](const Node& node, float entry[4]) {
+        int mask = 0;
+        for (int k = 0; k < 4; k++) {
+            float t0 = t_min[k], t1 = best[k];
+            for (int c = 0; c < 3; c++) {
+                float a = (node.lo[c] - o[c][k]) * inv_d[c][k];
+                float b = (node.hi[c] - o[c][k]) * inv_d[c][k];
+                if (a > b) std::swap(a, b);
+                t0 = a > t0 ? a : t0;
+                t1 = b < t1 ? b : t1;
+            }
+            entry[k] = t0;
+            if (t0 <= t1) mask |= 1 << k;
+        }
+        return mask;
+    };
+#endif
+    // nearest entry among the rays of a mask
+    auto nearest = [](const float entry[4], int mask) {
+        float t = inf;
+        for (int k = 0; k < 4; k++) {
+            if (mask & (1 << k)) t = std::min(t, entry[k]);
+        }
+        return t;
+    };
+
+    unsigned int local[local_stack];
+    std::vector<unsigned int> heap(depth < local_stack ? 0 : depth + 1);
+    unsigned int* stack = heap.empty() ? local : heap.data();
+    int top = 0;
+    float entry[4], entry_left[4], entry_right[4];
+    if (enter(nodes[0], entry)) stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        int mask = enter(node, entry);
+        if (!mask) continue;
+        if (node.count == 0) {
+            int left = enter(nodes[node.index], entry_left);
+            int right = enter(nodes[node.index + 1], entry_right);
+            if (nearest(entry_left, left) <= nearest(entry_right, right)) {
+                if (right) stack[top++] = node.index + 1;
+                if (left) stack[top++] = node.index;
+            } else {
+                if (left) stack[top++] = node.index;
+                if (right) stack[top++] = node.index + 1;
+            }
+            continue;
+        }
+        for (unsigned int i = node.index; i < node.index + node.count; i++) {
+            for (int k = 0; k < 4; k++) {
+                float t, u;
+                if (!(mask & (1 << k)) || !hitSegment(segments[i], rays[k], dd[k], 0.0f, best[k], &t, &u)) continue;
+                best[k] = t;
+                found[k] = true;
+                hits[k].strand = segments[i].strand;
+                hits[k].segment = segments[i].segment;
+                hits[k].t = t;
+                hits[k].u = u;
+            }
+        }
+    }
+}
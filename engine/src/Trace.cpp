@@ -0,0 +1,123 @@
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+struct Buffer {
+    std::unique_ptr<Event[]> events{new Event[Trace::buffer_events]};
+    std::atomic<uint64_t> written{0}; // events ever written, the last buffer_events of them are kept
+    unsigned int tid = 0;
+    std::string name; // guarded by Registry::mutex
+};
+
+// buffers outlive their threads, Save still finds them
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Buffer>> buffers;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+Buffer& localBuffer() {
+    thread_local std::shared_ptr<Buffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<Buffer>();
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        buffer->tid = static_cast<unsigned int>(r.buffers.size()) + 1;
+        r.buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+#ifdef CGC_TRACE
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+#endif
+
+} // namespace
+
+uint64_t Trace::now() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::record(const char* name, uint64_t start, uint64_t end) {
+    Buffer& buffer = localBuffer();
+    uint64_t i = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[i % buffer_events] = {name, start, end - start};
+    buffer.written.store(i + 1, std::memory_order_release);
+}
+
+void Trace::SetThreadName(const std::string& name) {
+    Buffer& buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+void Trace::Clear() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& buffer : r.buffers) buffer->written.store(0, std::memory_order_relaxed);
+}
+
+bool Trace::Save(const std::string& filename, std::string* err) {
+#ifndef CGC_TRACE
+    (void)filename;
+    if (err) *err = "cgc was built without tracing (CGC_TRACE)";
+    return false;
+#else
+    std::ofstream file(filename);
+    if (!file) {
+        if (err) *err = "Cannot open file";
+        return false;
+    }
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    char buffer[128];
+    for (const auto& b : r.buffers) {
+        if (!b->name.empty()) {
+            file << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b->tid
+                 << ", \"args\": {\"name\": " << jsonString(b->name) << "}}";
+            first = false;
+        }
+        uint64_t written = b->written.load(std::memory_order_acquire);
+        for (uint64_t i = written > buffer_events ? written - buffer_events : 0; i < written; i++) {
+            const Event& e = b->events[i % buffer_events];
+            // microseconds, with the nanoseconds kept as decimals
+            std::snprintf(buffer, sizeof(buffer), "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}", e.start * 1e-3, e.duration * 1e-3, b->tid);
+            file << (first ? "\n" : ",\n") << "{\"name\": " << jsonString(e.name) << ", \"ph\": \"X\", " << buffer;
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    if (!file) {
+        if (err) *err = "Error writing trace";
+        return false;
+    }
+    return true;
+#endif
+}
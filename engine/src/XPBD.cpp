@@ -0,0 +1,308 @@
+#include "XPBD.h"
+#include "Parallel.h"
+#include <algorithm>
+
+constexpr double PI = 3.141592653589793;
+
+XPBD::XPBD(const HairModel& model, double E, double G, double radius, double rho) {
+    int num_strands = static_cast<int>(model.hair_count);
+    strand_offsets.resize(num_strands + 1, 0);
+    for (int s = 0; s < num_strands; s++) {
+        unsigned int segments = !model.segments.empty() ? model.segments[s] : model.d_segments;
+        strand_offsets[s + 1] = strand_offsets[s] + static_cast<int>(segments) + 1;
+    }
+    int num_vertices = strand_offsets[num_strands];
+    int num_edges = num_vertices - num_strands;
+
+    positions.resize(num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        positions[v] = Eigen::Vector3d(model.points[3 * v], model.points[3 * v + 1], model.points[3 * v + 2]);
+    }
+    predicted = positions;
+    velocities.assign(num_vertices, Eigen::Vector3d::Zero());
+    inv_masses.assign(num_vertices, 0.0);
+
+    orientations.resize(num_edges);
+    inv_inertias.resize(num_edges);
+    rest_lengths.resize(num_edges);
+    rest_darboux.assign(num_edges, Eigen::Quaterniond::Identity());
+    stretch_compliance.resize(num_edges);
+    bend_twist_compliance.assign(num_edges, Eigen::Vector3d::Zero());
+    stretch_lambdas.assign(num_edges, Eigen::Vector3d::Zero());
+    bend_twist_lambdas.assign(num_edges, Eigen::Vector3d::Zero());
+    stretch_dp0.resize(num_edges);
+    stretch_dp1.resize(num_edges);
+    stretch_dq.resize(num_edges);
+    bend_dq0.resize(num_edges);
+    bend_dq1.resize(num_edges);
+
+    // same material model as DER: circular cross-section, lumped masses
+    double area = PI * radius * radius;
+    double B = E * area * radius * radius / 4.0; // bending stiffness
+    double beta = G * area * (2.0 * radius * radius) / 4.0; // twisting stiffness
+
+    parallelFor(0, num_strands, [&](int begin, int end) {
+        for (int s = begin; s < end; s++) {
+            int v0 = strand_offsets[s];
+            int n = strand_offsets[s + 1] - v0 - 1;
+            for (int i = 0; i < n; i++) {
+                int e = edgeIndex(s, i);
+                Eigen::Vector3d edge = positions[v0 + i + 1] - positions[v0 + i];
+                rest_lengths[e] = edge.norm();
+                double m = rho * area * rest_lengths[e];
+                inv_masses[v0 + i] += 0.5 * m;
+                inv_masses[v0 + i + 1] += 0.5 * m;
+                // 回転の慣性は位置と同程度に補正が分配されるようにスケールする
+                inv_inertias[e] = 1.0 / (m * rest_lengths[e] * rest_lengths[e]);
+                stretch_compliance[e] = 1.0 / (E * area * rest_lengths[e]);
+
+                // parallel transport of the first frame along the strand
+                Eigen::Vector3d t = edge.normalized();
+                if (i == 0) {
+                    Eigen::Vector3d d1 = Eigen::Vector3d::UnitX();
+                    if (d1.cross(t).isZero()) d1 = Eigen::Vector3d::UnitY();
+                    Eigen::Vector3d d2 = t.cross(d1).normalized();
+                    d1 = d2.cross(t);
+                    Eigen::Matrix3d frame;
+                    frame << d1, d2, t;
+                    orientations[e] = Eigen::Quaterniond(frame);
+                } else {
+                    Eigen::Vector3d t_prev = orientations[e - 1] * Eigen::Vector3d::UnitZ();
+                    orientations[e] = (Eigen::Quaterniond::FromTwoVectors(t_prev, t) * orientations[e - 1]).normalized();
+                }
+            }
+            for (int i = 0; i + 1 < n; i++) {
+                int e = edgeIndex(s, i);
+                rest_darboux[e] = orientations[e].conjugate() * orientations[e + 1];
+                double voronoi = 0.5 * (rest_lengths[e] + rest_lengths[e + 1]);
+                bend_twist_compliance[e] = Eigen::Vector3d(voronoi / (4.0 * B), voronoi / (4.0 * B), voronoi / (4.0 * beta));
+            }
+            for (int v = v0; v < strand_offsets[s + 1]; v++) {
+                inv_masses[v] = inv_masses[v] > 0.0 ? 1.0 / inv_masses[v] : 0.0;
+            }
+        }
+    });
+
+    rest_root_positions.resize(2 * num_strands);
+    rest_root_orientations.resize(num_strands);
+    for (int s = 0; s < num_strands; s++) {
+        int v0 = strand_offsets[s];
+        bool has_edge = strand_offsets[s + 1] - v0 > 1;
+        rest_root_positions[2 * s] = positions[v0];
+        rest_root_positions[2 * s + 1] = has_edge ? positions[v0 + 1] : positions[v0];
+        rest_root_orientations[s] = has_edge ? orientations[edgeIndex(s, 0)] : Eigen::Quaterniond::Identity();
+    }
+}
+
+void XPBD::setRootTransforms(const std::vector<Eigen::Matrix3d>& rotations, const std::vector<Eigen::Vector3d>& translations) {
+    root_rotations = rotations;
+    root_translations = translations;
+    if (root_clamped) return;
+
+    // kinematic roots have infinite mass
+    root_clamped = true;
+    for (int s = 0; s < strandCount(); s++) {
+        int v0 = strand_offsets[s];
+        if (strand_offsets[s + 1] - v0 < 2) continue;
+        inv_masses[v0] = 0.0;
+        inv_masses[v0 + 1] = 0.0;
+        inv_inertias[edgeIndex(s, 0)] = 0.0;
+    }
+}
+
+int XPBD::edgeIndex(int s, int local) const {
+    return strand_offsets[s] - s + local;
+}
+
+void XPBD::setMode(Mode m) {
+    mode = m;
+}
+
+void XPBD::setIterations(int n) {
+    iterations = n;
+}
+
+void XPBD::setGravity(const Eigen::Vector3d& g) {
+    gravity = g;
+}
+
+void XPBD::setRelaxation(double omega) {
+    relaxation = omega;
+}
+
+int XPBD::strandCount() const {
+    return static_cast<int>(strand_offsets.size()) - 1;
+}
+
+const std::vector<int>& XPBD::getStrandOffsets() const {
+    return strand_offsets;
+}
+
+const std::vector<Eigen::Vector3d>& XPBD::getPositions() const {
+    return positions;
+}
+
+const std::vector<Eigen::Vector3d>& XPBD::getVelocities() const {
+    return velocities;
+}
+
+void XPBD::setVelocities(const std::vector<Eigen::Vector3d>& new_velocities) {
+    velocities = new_velocities;
+}
+
+void XPBD::update(double dt) {
+    int num_vertices = static_cast<int>(positions.size());
+    parallelFor(0, num_vertices, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            if (inv_masses[v] > 0.0) {
+                velocities[v] += dt * gravity;
+            }
+            predicted[v] = positions[v] + dt * velocities[v];
+        }
+    });
+    if (root_clamped) {
+        parallelFor(0, strandCount(), [&](int begin, int end) {
+            for (int s = begin; s < end; s++) {
+                int v0 = strand_offsets[s];
+                if (strand_offsets[s + 1] - v0 < 2) continue;
+                predicted[v0] = root_rotations[s] * rest_root_positions[2 * s] + root_translations[s];
+                predicted[v0 + 1] = root_rotations[s] * rest_root_positions[2 * s + 1] + root_translations[s];
+                orientations[edgeIndex(s, 0)] = (Eigen::Quaterniond(root_rotations[s]) * rest_root_orientations[s]).normalized();
+            }
+        });
+    }
+    std::fill(stretch_lambdas.begin(), stretch_lambdas.end(), Eigen::Vector3d::Zero());
+    std::fill(bend_twist_lambdas.begin(), bend_twist_lambdas.end(), Eigen::Vector3d::Zero());
+
+    if (mode == Mode::GaussSeidel) {
+        solveGaussSeidel(dt);
+    } else {
+        solveJacobi(dt);
+    }
+
+    parallelFor(0, num_vertices, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            velocities[v] = (predicted[v] - positions[v]) / dt;
+            positions[v] = predicted[v];
+        }
+    });
+}
+
+void XPBD::solveStretchShear(int e, int v0, double dt2, Eigen::Vector3d& dp0, Eigen::Vector3d& dp1, Eigen::Quaterniond& dq) {
+    const Eigen::Vector3d& p0 = predicted[v0];
+    const Eigen::Vector3d& p1 = predicted[v0 + 1];
+    const Eigen::Quaterniond& q = orientations[e];
+    double l = rest_lengths[e];
+    double w0 = inv_masses[v0], w1 = inv_masses[v0 + 1], wq = inv_inertias[e];
+
+    // C = (p1 - p0) / l - d3(q)
+    Eigen::Vector3d d3 = q * Eigen::Vector3d::UnitZ();
+    Eigen::Vector3d C = (p1 - p0) / l - d3;
+    double alpha = stretch_compliance[e] / dt2;
+    Eigen::Vector3d dlambda = (-C - alpha * stretch_lambdas[e]) / ((w0 + w1) / (l * l) + 4.0 * wq + alpha);
+    stretch_lambdas[e] += dlambda;
+
+    dp0 = -w0 / l * dlambda;
+    dp1 = w1 / l * dlambda;
+    // q * conj(e3)
+    Eigen::Quaterniond q_e3_bar(q.z(), -q.y(), q.x(), -q.w());
+    dq = Eigen::Quaterniond(0.0, dlambda.x(), dlambda.y(), dlambda.z()) * q_e3_bar;
+    dq.coeffs() *= -2.0 * wq;
+}
+
+void XPBD::solveBendTwist(int e, double dt2, Eigen::Quaterniond& dq0, Eigen::Quaterniond& dq1) {
+    const Eigen::Quaterniond& q0 = orientations[e];
+    const Eigen::Quaterniond& q1 = orientations[e + 1];
+    double w0 = inv_inertias[e], w1 = inv_inertias[e + 1];
+
+    // C = Im(Omega - s Omega_0), s picks the closer of the two rest quaternions
+    Eigen::Quaterniond omega = q0.conjugate() * q1;
+    Eigen::Vector4d diff = omega.coeffs() - rest_darboux[e].coeffs();
+    Eigen::Vector4d sum = omega.coeffs() + rest_darboux[e].coeffs();
+    Eigen::Vector3d C = diff.squaredNorm() > sum.squaredNorm() ? sum.head<3>() : diff.head<3>();
+
+    Eigen::Vector3d alpha = bend_twist_compliance[e] / dt2;
+    Eigen::Vector3d dlambda = (-C - alpha.cwiseProduct(bend_twist_lambdas[e])).cwiseQuotient(Eigen::Vector3d::Constant(w0 + w1) + alpha);
+    bend_twist_lambdas[e] += dlambda;
+
+    Eigen::Quaterniond dl(0.0, dlambda.x(), dlambda.y(), dlambda.z());
+    dq0 = q1 * dl;
+    dq0.coeffs() *= -w0;
+    dq1 = q0 * dl;
+    dq1.coeffs() *= w1;
+}
+
+void XPBD::solveGaussSeidel(double dt) {
+    double dt2 = dt * dt;
+    parallelFor(0, strandCount(), [&](int begin, int end) {
+        Eigen::Vector3d dp0, dp1;
+        Eigen::Quaterniond dq, dq0, dq1;
+        for (int s = begin; s < end; s++) {
+            int v0 = strand_offsets[s];
+            int n = strand_offsets[s + 1] - v0 - 1;
+            for (int iter = 0; iter < iterations; iter++) {
+                for (int i = 0; i < n; i++) {
+                    int e = edgeIndex(s, i);
+                    solveStretchShear(e, v0 + i, dt2, dp0, dp1, dq);
+                    predicted[v0 + i] += dp0;
+                    predicted[v0 + i + 1] += dp1;
+                    orientations[e].coeffs() += dq.coeffs();
+                    orientations[e].normalize();
+                }
+                for (int i = 0; i + 1 < n; i++) {
+                    int e = edgeIndex(s, i);
+                    solveBendTwist(e, dt2, dq0, dq1);
+                    orientations[e].coeffs() += dq0.coeffs();
+                    orientations[e + 1].coeffs() += dq1.coeffs();
+                    orientations[e].normalize();
+                    orientations[e + 1].normalize();
+                }
+            }
+        }
+    });
+}
+
+void XPBD::solveJacobi(double dt) {
+    double dt2 = dt * dt;
+    int num_strands = strandCount();
+    for (int iter = 0; iter < iterations; iter++) {
+        // every constraint reads the state of the previous iteration
+        parallelFor(0, num_strands, [&](int begin, int end) {
+            for (int s = begin; s < end; s++) {
+                int v0 = strand_offsets[s];
+                int n = strand_offsets[s + 1] - v0 - 1;
+                for (int i = 0; i < n; i++) {
+                    int e = edgeIndex(s, i);
+                    solveStretchShear(e, v0 + i, dt2, stretch_dp0[e], stretch_dp1[e], stretch_dq[e]);
+                    if (i + 1 < n) {
+                        solveBendTwist(e, dt2, bend_dq0[e], bend_dq1[e]);
+                    }
+                }
+            }
+        }, 64);
+
+        // constraint averaging with over-relaxation
+        parallelFor(0, num_strands, [&](int begin, int end) {
+            for (int s = begin; s < end; s++) {
+                int v0 = strand_offsets[s];
+                int n = strand_offsets[s + 1] - v0 - 1;
+                for (int i = 0; i <= n; i++) {
+                    Eigen::Vector3d dp = Eigen::Vector3d::Zero();
+                    int count = 0;
+                    if (i > 0) { dp += stretch_dp1[edgeIndex(s, i - 1)]; count++; }
+                    if (i < n) { dp += stretch_dp0[edgeIndex(s, i)]; count++; }
+                    if (count > 0) predicted[v0 + i] += relaxation / count * dp;
+                }
+                for (int i = 0; i < n; i++) {
+                    int e = edgeIndex(s, i);
+                    Eigen::Vector4d dq = stretch_dq[e].coeffs();
+                    int count = 1;
+                    if (i > 0) { dq += bend_dq1[e - 1].coeffs(); count++; }
+                    if (i + 1 < n) { dq += bend_dq0[e].coeffs(); count++; }
+                    orientations[e].coeffs() += relaxation / count * dq;
+                    orientations[e].normalize();
+                }
+            }
+        }, 64);
+    }
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "AlembicCurves.h"
+#include "GroomGenerator.h"
+#include "HairLoader.h"
+#include "HairSimulation.h"
+#include "HairWriter.h"
+
+// Round-trips a synthetic groom through an Alembic curves cache and compares the timings with the .hair path,
+// then writes a DER simulation to an animated cache and reports how long the simulation waited for the writer.
+// usage: abcroundtrip [--strands N] [--segments N] [--frames N] [--substeps N] [--encode-threads N] [--queue-frames N] [dir]
+// The files are written to dir (default: the working directory) as roundtrip.hair, roundtrip.abc and sim.abc.
+// Exits with 1 when a round trip is not identical or the cache does not read back as simulated, so that it also
+// serves as the Alembic test (tests/CMakeLists.txt).
+
+namespace {
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double fileSize(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<double>(file.tellg()) : 0.0;
+}
+
+bool same(const HairModel& a, const HairModel& b) {
+    return a.hair_count == b.hair_count && a.point_count == b.point_count && a.arrays == b.arrays && a.segments == b.segments
+        && a.points == b.points && a.thickness == b.thickness && a.transparency == b.transparency && a.colors == b.colors;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    GroomGenerator::Settings groom;
+    groom.strands = 10000;
+    groom.segments = 32;
+    groom.segment_jitter = 4;
+    groom.curliness = 0.05f;
+    groom.arrays = GroomGenerator::SEGMENTS | GroomGenerator::POINTS | GroomGenerator::THICKNESS
+        | GroomGenerator::TRANSPARENCY | GroomGenerator::COLORS;
+    int frames = 48, substeps = 10;
+    AlembicCurvesWriter::Settings settings;
+    std::string dir = ".";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--strands" && has_value) groom.strands = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--segments" && has_value) groom.segments = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--frames" && has_value) frames = std::atoi(argv[++i]);
+        else if (arg == "--substeps" && has_value) substeps = std::atoi(argv[++i]);
+        else if (arg == "--encode-threads" && has_value) settings.encode_threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--queue-frames" && has_value) settings.queue_frames = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg.compare(0, 2, "--") != 0) dir = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (groom.strands < 1 || groom.segments < 1 || frames < 1 || substeps < 1) {
+        std::cerr << "usage: abcroundtrip [options] [dir]" << std::endl;
+        return 1;
+    }
+    groom.segment_jitter = std::min(groom.segment_jitter, groom.segments - 1);
+    HairModel model = GroomGenerator(groom).generate();
+    std::string err, warn;
+
+    // static groom: .hair against .abc
+    std::string hair_file = dir + "/roundtrip.hair", abc_file = dir + "/roundtrip.abc";
+    auto start = std::chrono::steady_clock::now();
+    HairWriter hair_writer;
+    if (!hair_writer.SaveToFile(model, &err, hair_file)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double hair_save = seconds(start);
+    start = std::chrono::steady_clock::now();
+    HairLoader loader;
+    HairModel hair_model;
+    if (!loader.LoadFromFile(&hair_model, &err, &warn, hair_file)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double hair_load = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    if (!AlembicCurvesWriter::SaveToFile(model, &err, abc_file)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double abc_save = seconds(start);
+    start = std::chrono::steady_clock::now();
+    HairModel abc_model;
+    if (!AlembicCurvesReader::LoadFromFile(&abc_model, &err, abc_file)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double abc_load = seconds(start);
+
+    bool ok = same(model, hair_model) && same(model, abc_model);
+    std::cout << model.hair_count << " strands, " << model.point_count << " points" << std::endl;
+    std::cout << ".hair: " << fileSize(hair_file) / (1 << 20) << " MB, save " << hair_save << " s, load " << hair_load << " s, "
+              << (same(model, hair_model) ? "identical" : "DIFFERENT") << std::endl;
+    std::cout << ".abc:  " << fileSize(abc_file) / (1 << 20) << " MB, save " << abc_save << " s, load " << abc_load << " s, "
+              << (same(model, abc_model) ? "identical" : "DIFFERENT") << std::endl;
+
+    // simulation: every frame written per frame as .hair on the simulation thread, or queued to the Alembic writer
+    HairSimulation::Parameters params;
+    params.substeps = substeps;
+    std::vector<Eigen::Vector3d> roots;
+    auto simulate = [&](HairSimulation& sim, int frame) {
+        double angle = 0.4 * std::sin(2.0 * 3.14159265358979323846 * frame / 24.0);
+        Eigen::Matrix3d rotation = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitY()).toRotationMatrix();
+        sim.setRootTransforms(std::vector<Eigen::Matrix3d>(roots.size(), rotation), std::vector<Eigen::Vector3d>(roots.size(), Eigen::Vector3d::Zero()));
+        sim.update(1.0 / 24.0);
+    };
+
+    double sim_seconds = 0.0, hair_seconds = 0.0;
+    {
+        HairSimulation sim(model, params);
+        roots = sim.getRoots();
+        HairModel frame_model = model;
+        for (int f = 0; f < frames; f++) {
+            start = std::chrono::steady_clock::now();
+            if (f > 0) simulate(sim, f);
+            std::vector<Eigen::Vector3d> x = sim.getPositions();
+            sim_seconds += seconds(start);
+            start = std::chrono::steady_clock::now();
+            for (size_t v = 0; v < x.size(); v++) {
+                for (int c = 0; c < 3; c++) frame_model.points[3 * v + c] = static_cast<float>(x[v][c]);
+            }
+            if (!hair_writer.SaveToFile(frame_model, &err, dir + "/sim.hair")) {
+                std::cerr << "Error: " << err << std::endl;
+                return 1;
+            }
+            hair_seconds += seconds(start);
+        }
+    }
+
+    std::string sim_file = dir + "/sim.abc";
+    AlembicCurvesWriter writer;
+    if (!writer.Open(model, &err, sim_file, 24.0f, settings)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    HairSimulation sim(model, params);
+    double abc_seconds = 0.0;
+    for (int f = 0; f < frames; f++) {
+        if (f > 0) simulate(sim, f);
+        std::vector<Eigen::Vector3d> x = sim.getPositions();
+        start = std::chrono::steady_clock::now();
+        if (!writer.AddFrame(std::move(x), &err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        abc_seconds += seconds(start);
+    }
+    start = std::chrono::steady_clock::now();
+    if (!writer.Close(&err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double close_seconds = seconds(start);
+
+    std::cout << "simulation: " << frames << " frames, " << 1e3 * sim_seconds / frames << " ms/frame" << std::endl;
+    std::cout << ".hair per frame: " << 1e3 * hair_seconds / frames << " ms/frame on the simulation thread" << std::endl;
+    std::cout << ".abc queued: " << 1e3 * abc_seconds / frames << " ms/frame on the simulation thread ("
+              << 1e3 * writer.stallSeconds() / frames << " ms/frame waiting), close " << close_seconds << " s, "
+              << fileSize(sim_file) / (1 << 20) << " MB" << std::endl;
+
+    // the last frame of the cache against the simulation
+    AlembicCurvesReader reader;
+    HairModel last;
+    if (!reader.Open(sim_file, &err) || !reader.ReadFrame(reader.frameCount() - 1, &last, &err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    std::vector<Eigen::Vector3d> x = sim.getPositions();
+    double max_error = 0.0;
+    for (size_t v = 0; v < x.size() && 3 * v + 2 < last.points.size(); v++) {
+        for (int c = 0; c < 3; c++) max_error = std::max(max_error, std::abs(last.points[3 * v + c] - x[v][c]));
+    }
+    // widths are written with the first sample only and have to read back at every frame
+    bool widths = last.thickness == model.thickness;
+    std::cout << "read back: " << reader.frameCount() << " frames at " << reader.frameRate() << " fps, last frame max error " << max_error
+              << ", widths " << (widths ? "identical" : "DIFFERENT") << std::endl;
+    ok = ok && widths && reader.frameCount() == static_cast<unsigned int>(frames) && max_error <= 1e-5 * std::max(1.0f, groom.length);
+    return ok ? 0 : 1;
+}
@@ -1,20 +1,233 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "ComputeShader.h"
+#include "GPUSimulation.h"
+#include "GroomGenerator.h"
 #include "HairLoader.h"
 #include "HairModel.h"
+#include "HairSimulation.h"
+#include "Parallel.h"
+#include "util.h"
+#ifdef CGC_CUDA
+#include <cuda_runtime.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
-int main(){
-    HairLoader loader;
-    HairModel model;
-    std::string err, warn;
+// Simulation benchmark of a groom on the available backends, reported as one JSON object on stdout
+// so that runs on different machines can be collected and compared.
+//   cpu: HairSimulation on the thread pool
+//   gl:  GPUSimulation, OpenGL 4.3 compute shaders (also Mesa)
+// The default backend is cpu; CUDA devices are listed when the target was built with CUDA.
+// usage: cuda [--backend cpu|gl] [--solver der|der-implicit|xpbd] [--frames N] [--substeps N]
+//             [--strands N] [--segments N] [file.hair]
+// Without a file a synthetic groom (GroomGenerator) of --strands x --segments is simulated.
+// memory_bytes_per_strand is the growth of the peak resident set over setup and simulation, driver allocations included.
+
+struct Options {
+    std::string backend = "cpu";
+    std::string solver = "der";
+    std::string file;
+    int frames = 60;
+    int substeps = 100;
+    int strands = 1000;
+    int segments = 16;
+};
+
+// peak resident set size of the process in bytes, 0 if unknown
+double peakMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<double>(counters.PeakWorkingSetSize);
+    }
+    return 0.0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#ifdef __APPLE__
+    return static_cast<double>(usage.ru_maxrss); // bytes
+#else
+    return 1024.0 * usage.ru_maxrss; // kilobytes
+#endif
+#endif
+}
+
+std::string jsonString(const std::string& s) {
+    std::string ret = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') ret += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+std::vector<std::string> cudaDevices() {
+    std::vector<std::string> names;
+#ifdef CGC_CUDA
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess) return names;
+    for (int d = 0; d < count; d++) {
+        cudaDeviceProp prop;
+        if (cudaGetDeviceProperties(&prop, d) == cudaSuccess) names.push_back(prop.name);
+    }
+#endif
+    return names;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--backend" && has_value) options.backend = argv[++i];
+        else if (arg == "--solver" && has_value) options.solver = argv[++i];
+        else if (arg == "--frames" && has_value) options.frames = std::atoi(argv[++i]);
+        else if (arg == "--substeps" && has_value) options.substeps = std::atoi(argv[++i]);
+        else if (arg == "--strands" && has_value) options.strands = std::atoi(argv[++i]);
+        else if (arg == "--segments" && has_value) options.segments = std::atoi(argv[++i]);
+        else if (arg.compare(0, 2, "--") != 0) options.file = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (options.backend != "cpu" && options.backend != "gl") {
+        std::cerr << "Unknown backend: " << options.backend << std::endl;
+        return false;
+    }
+    if (options.solver != "der" && options.solver != "der-implicit" && options.solver != "xpbd") {
+        std::cerr << "Unknown solver: " << options.solver << std::endl;
+        return false;
+    }
+    if (options.backend == "gl" && options.solver != "der") {
+        std::cerr << "The gl backend only runs the explicit DER solver" << std::endl;
+        return false;
+    }
+    if (options.frames < 1 || options.substeps < 1 || options.strands < 1 || options.segments < 1) {
+        std::cerr << "frames, substeps, strands and segments must be positive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    const double dt = 1.0 / 60.0;
 
-    bool ret = loader.LoadFromFile(&model, &err, &warn, MODEL_DIR "/straight.hair");
-    if (!ret) {
-        std::cerr << "Error: " << err << std::endl;
+    // the GL context comes first so that its memory is not counted per strand
+    GLFWwindow* window = nullptr;
+    std::string device = "cpu";
+    if (options.backend == "gl") {
+        if (!initializeGLFW(4, 3)) return 1;
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = createWindow(64, 64, "cuda");
+        if (!window) return 1;
+        if (!initializeGLAD()) return 1;
+        if (!ComputeShader::isSupported()) {
+            std::cerr << "OpenGL 4.3 is required for the gl backend" << std::endl;
+            cleanup(window);
+            return 1;
+        }
+        device = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    }
+
+    HairModel model;
+    double file_bytes = 0.0;
+    auto load_start = std::chrono::steady_clock::now();
+    if (!options.file.empty()) {
+        HairLoader loader;
+        std::string err, warn;
+        if (!loader.LoadFromFile(&model, &err, &warn, options.file)) {
+            std::cerr << "Error: " << err << std::endl;
+            if (window) cleanup(window);
+            return 1;
+        }
         if (!warn.empty()) {
             std::cerr << "Warning: " << warn << std::endl;
         }
+        std::ifstream file(options.file, std::ios::binary | std::ios::ate);
+        file_bytes = static_cast<double>(file.tellg());
     } else {
-        std::cout << "Hair model loaded successfully." << std::endl;
+        GroomGenerator::Settings settings;
+        settings.strands = options.strands;
+        settings.segments = options.segments;
+        settings.curliness = 0.05f; // bending and twisting active
+        model = GroomGenerator(settings).generate();
+    }
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+    if (model.points.empty() || model.hair_count == 0) {
+        std::cerr << "Error: the groom has no points" << std::endl;
+        if (window) cleanup(window);
+        return 1;
     }
 
+    HairSimulation::Parameters params;
+    params.substeps = options.substeps;
+    if (options.solver == "xpbd") params.solver = HairSimulation::Solver::XPBD_GaussSeidel;
+    params.implicit = options.solver == "der-implicit";
+
+    double memory_before = peakMemory();
+    auto setup_start = std::chrono::steady_clock::now();
+    std::unique_ptr<HairSimulation> cpu;
+    std::unique_ptr<GPUSimulation> gpu;
+    if (options.backend == "gl") {
+        gpu = std::make_unique<GPUSimulation>(model, params, SHADER_DIR "/der_compute.glsl");
+        glFinish();
+    } else {
+        cpu = std::make_unique<HairSimulation>(model, params);
+    }
+    double setup_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setup_start).count();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < options.frames; f++) {
+        if (gpu) gpu->update(dt);
+        else cpu->update(dt);
+    }
+    if (gpu) glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double memory_per_strand = (peakMemory() - memory_before) / model.hair_count;
+
+    double steps = static_cast<double>(options.frames) * options.substeps;
+    std::ostringstream devices;
+    std::vector<std::string> cuda_devices = cudaDevices();
+    for (size_t d = 0; d < cuda_devices.size(); d++) {
+        devices << (d ? ", " : "") << jsonString(cuda_devices[d]);
+    }
+
+    std::cout << "{"
+              << "\"backend\": " << jsonString(options.backend)
+              << ", \"device\": " << jsonString(device)
+              << ", \"threads\": " << (gpu ? 1u : ThreadPool::instance().size())
+              << ", \"cuda_devices\": [" << devices.str() << "]"
+              << ", \"solver\": " << jsonString(options.solver)
+              << ", \"source\": " << jsonString(options.file.empty() ? "synthetic" : options.file)
+              << ", \"strands\": " << model.hair_count
+              << ", \"vertices\": " << model.points.size() / 3
+              << ", \"load_seconds\": " << load_seconds
+              << ", \"load_mb_per_second\": " << (file_bytes > 0.0 && load_seconds > 0.0 ? file_bytes / (1024.0 * 1024.0) / load_seconds : 0.0)
+              << ", \"setup_seconds\": " << setup_seconds
+              << ", \"frames\": " << options.frames
+              << ", \"substeps\": " << options.substeps
+              << ", \"seconds\": " << seconds
+              << ", \"steps_per_second\": " << steps / seconds
+              << ", \"strand_steps_per_second\": " << steps * model.hair_count / seconds
+              << ", \"memory_bytes_per_strand\": " << memory_per_strand
+              << "}" << std::endl;
+
+    if (window) cleanup(window);
     return 0;
-}
\ No newline at end of file
+}
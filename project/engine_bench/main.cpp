@@ -0,0 +1,574 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <benchmark/benchmark.h>
+#include "DER.h"
+#include "Geometry.h"
+#include "GroomGenerator.h"
+#include "HairGrid.h"
+#include "HairLoader.h"
+#include "HairModel.h"
+#include "HairPathTracer.h"
+#include "HairRenderer.h"
+#include "HairReorder.h"
+#include "HairSimulation.h"
+#include "HairWriter.h"
+#include "Parallel.h"
+#include "Shader.h"
+#include "StrandBVH.h"
+#include "util.h"
+
+// Microbenchmarks of the engine hot paths on a synthetic groom, with Google Benchmark.
+// usage: engine_bench [--strands=N] [--segments=N] [--save_baseline=FILE] [--baseline=FILE]
+//                     [--regression_threshold=X] [--benchmark_* flags]
+// A baseline holds the real time per iteration of every benchmark. With --baseline the run fails (exit code 1)
+// if a benchmark got slower than its baseline by more than the threshold (default 0.15, i.e. 15%).
+// Baselines only compare on the same machine and groom size.
+
+namespace {
+
+int num_strands = 1000;
+int num_segments = 16;
+GLFWwindow* window = nullptr; // null if no OpenGL context could be created
+std::string hair_file; // the groom as a .hair file, written by the first loader benchmark
+
+const HairModel& groom() {
+    static HairModel model = [] {
+        GroomGenerator::Settings settings;
+        settings.strands = num_strands;
+        settings.segments = num_segments;
+        settings.curliness = 0.05f; // bending and twisting active
+        settings.arrays = GroomGenerator::THICKNESS | GroomGenerator::COLORS;
+        return GroomGenerator(settings).generate();
+    }();
+    return model;
+}
+
+std::vector<Eigen::Vector3d> strandVertices(const HairModel& model, int s) {
+    std::vector<Eigen::Vector3d> vertices(model.d_segments + 1);
+    int first = s * (model.d_segments + 1);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const float* p = &model.points[3 * (first + i)];
+        vertices[i] = Eigen::Vector3d(p[0], p[1], p[2]);
+    }
+    return vertices;
+}
+
+std::vector<DER> makeStrands(const HairModel& model) {
+    std::vector<DER> strands;
+    strands.reserve(model.hair_count);
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        std::vector<Eigen::Vector3d> vertices = strandVertices(model, s);
+        std::vector<double> radii(vertices.size() - 1, 0.005);
+        strands.emplace_back(vertices, 1.0e7, 4.0e6, radii, radii);
+    }
+    return strands;
+}
+
+const std::string& hairFile() {
+    if (!hair_file.empty()) return hair_file;
+    const HairModel& model = groom();
+    std::string path = (std::filesystem::temp_directory_path() / "engine_bench.hair").string();
+    std::string err;
+    if (!HairWriter().SaveToFile(model, &err, path)) {
+        std::cerr << "Cannot write " << path << ": " << err << std::endl;
+        std::exit(1);
+    }
+    hair_file = path;
+    return hair_file;
+}
+
+void BM_LoadFromFile(benchmark::State& state) {
+    const std::string& path = hairFile();
+    double bytes = static_cast<double>(std::filesystem::file_size(path));
+    for (auto _ : state) {
+        HairLoader loader;
+        HairModel model;
+        std::string err, warn;
+        if (!loader.LoadFromFile(&model, &err, &warn, path)) {
+            state.SkipWithError(err.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(model.points.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes) * state.iterations());
+}
+
+void BM_CreateVAO(benchmark::State& state) {
+    if (!window) {
+        state.SkipWithError("no OpenGL context");
+        return;
+    }
+    const HairModel& model = groom();
+    HairRenderer renderer;
+    double bytes = (model.points.size() + model.thickness.size() + model.colors.size()) * sizeof(float);
+    for (auto _ : state) {
+        renderer.CreateVAO(model);
+        glFinish(); // the upload itself, not only queuing it
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes) * state.iterations());
+}
+
+void BM_Draw(benchmark::State& state) {
+    if (!window) {
+        state.SkipWithError("no OpenGL context");
+        return;
+    }
+    const HairModel& model = groom();
+    HairRenderer renderer;
+    renderer.CreateVAO(model);
+    Shader shader(SHADER_DIR "/hair_vertex.glsl", SHADER_DIR "/hair_fragment.glsl");
+    shader.use();
+
+    // an own render target, so that the result does not depend on the (hidden) window
+    GLuint fbo, color;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &color);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 512, 512);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glViewport(0, 0, 512, 512);
+
+    for (auto _ : state) {
+        renderer.Draw(shader);
+        // submission only, the GPU work is drained outside the timing
+        state.PauseTiming();
+        glFinish();
+        state.ResumeTiming();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &color);
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(model.hair_count) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// hair shader startup, compiled from source or loaded from the program binary cache
+void BM_ShaderBuild(benchmark::State& state, bool cached) {
+    if (!window) {
+        state.SkipWithError("no OpenGL context");
+        return;
+    }
+    std::string directory = (std::filesystem::temp_directory_path() / "engine_bench_shader_cache").string();
+    Shader::SetCacheDirectory(cached ? directory : "");
+    if (cached) {
+        Shader warm(SHADER_DIR "/hair_vertex.glsl", SHADER_DIR "/hair_fragment.glsl");
+        glDeleteProgram(warm.ID);
+    }
+    bool hit = true;
+    for (auto _ : state) {
+        Shader shader(SHADER_DIR "/hair_vertex.glsl", SHADER_DIR "/hair_fragment.glsl");
+        hit = hit && shader.loadedFromCache();
+        glDeleteProgram(shader.ID);
+    }
+    Shader::SetCacheDirectory("");
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+    if (cached && !hit) state.SkipWithError("program binaries are not supported by the driver");
+}
+
+void BM_DERConstruct(benchmark::State& state) {
+    const HairModel& model = groom();
+    std::vector<std::vector<Eigen::Vector3d>> vertices(model.hair_count);
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        vertices[s] = strandVertices(model, s);
+    }
+    std::vector<double> radii(model.d_segments, 0.005);
+    size_t s = 0;
+    for (auto _ : state) {
+        DER strand(vertices[s], 1.0e7, 4.0e6, radii, radii);
+        benchmark::DoNotOptimize(&strand);
+        s = (s + 1) % vertices.size();
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+void BM_DERUpdate(benchmark::State& state) {
+    std::vector<DER> strands = makeStrands(groom());
+    size_t s = 0;
+    for (auto _ : state) {
+        strands[s].update(1.0e-5);
+        s = (s + 1) % strands.size();
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+void BM_SimulationFrame(benchmark::State& state) {
+    HairSimulation::Parameters params;
+    params.substeps = 1;
+    HairSimulation simulation(groom(), params);
+    for (auto _ : state) {
+        simulation.update(1.0e-5); // one solver step of the whole groom on the thread pool
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(simulation.strandCount()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// energy and gradient reuse the per-step caches, so every evaluation follows a move of the strand
+template <typename Evaluate>
+void evaluateMoved(benchmark::State& state, Evaluate evaluate) {
+    const HairModel& model = groom();
+    std::vector<DER> strands = makeStrands(model);
+    std::vector<std::vector<Eigen::Vector3d>> moved(strands.size());
+    for (size_t s = 0; s < strands.size(); s++) {
+        moved[s] = strands[s].getVertices();
+        for (size_t i = 0; i < moved[s].size(); i++) {
+            moved[s][i].x() += 1.0e-3 * std::sin(static_cast<double>(i));
+        }
+    }
+    std::vector<Eigen::Vector3d> rest_velocities(model.d_segments + 1, Eigen::Vector3d::Zero());
+    size_t s = 0;
+    int iteration = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        DER& strand = strands[s];
+        strand.setState(iteration % 2 ? strandVertices(model, static_cast<int>(s)) : moved[s], rest_velocities);
+        state.ResumeTiming();
+        evaluate(strand);
+        s = (s + 1) % strands.size();
+        if (s == 0) iteration++;
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+void BM_DEREnergy(benchmark::State& state) {
+    evaluateMoved(state, [](DER& strand) { benchmark::DoNotOptimize(strand.computeTotalEnergy()); });
+}
+
+void BM_DERGradient(benchmark::State& state) {
+    evaluateMoved(state, [](DER& strand) { benchmark::DoNotOptimize(strand.computeEnergyGradient()); });
+}
+
+// reference frames transported along the edges of the groom, as in the DER frame updates
+struct TransportInput {
+    std::vector<Eigen::Vector3d> from, to, d1;
+};
+
+TransportInput transportInput() {
+    const HairModel& model = groom();
+    TransportInput input;
+    for (unsigned int s = 0; s < model.hair_count; s++) {
+        std::vector<Eigen::Vector3d> vertices = strandVertices(model, s);
+        for (size_t i = 1; i + 1 < vertices.size(); i++) {
+            Eigen::Vector3d t0 = (vertices[i] - vertices[i - 1]).normalized();
+            input.from.push_back(t0);
+            input.to.push_back((vertices[i + 1] - vertices[i]).normalized());
+            input.d1.push_back(t0.unitOrthogonal());
+        }
+    }
+    return input;
+}
+
+void BM_ParallelTransport(benchmark::State& state) {
+    TransportInput input = transportInput();
+    std::vector<Eigen::Vector3d> out(input.d1.size());
+    for (auto _ : state) {
+        for (size_t e = 0; e < out.size(); e++) {
+            out[e] = parallelTransport(input.d1[e], input.from[e], input.to[e]);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["edges"] = benchmark::Counter(static_cast<double>(out.size()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// baseline: the quaternion transport DER used before the closed form
+void BM_ParallelTransportQuaternion(benchmark::State& state) {
+    TransportInput input = transportInput();
+    std::vector<Eigen::Vector3d> out(input.d1.size());
+    for (auto _ : state) {
+        for (size_t e = 0; e < out.size(); e++) {
+            out[e] = Eigen::Quaterniond::FromTwoVectors(input.from[e], input.to[e]) * input.d1[e];
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["edges"] = benchmark::Counter(static_cast<double>(out.size()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void BM_ParallelTransportFrames(benchmark::State& state) {
+    TransportInput input = transportInput();
+    std::vector<Eigen::Vector3d> d1, d2(input.d1.size());
+    for (auto _ : state) {
+        d1 = input.d1;
+        parallelTransport(input.from, input.to, d1, d2);
+        benchmark::DoNotOptimize(d2.data());
+    }
+    state.counters["edges"] = benchmark::Counter(static_cast<double>(d1.size()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// baseline: the per-edge quaternion frame update with its three normalizations, as DER did before
+void BM_ParallelTransportFramesQuaternion(benchmark::State& state) {
+    TransportInput input = transportInput();
+    std::vector<Eigen::Vector3d> d2_start(input.d1.size());
+    for (size_t e = 0; e < d2_start.size(); e++) d2_start[e] = input.from[e].cross(input.d1[e]);
+    std::vector<Eigen::Vector3d> d1, d2;
+    for (auto _ : state) {
+        d1 = input.d1;
+        d2 = d2_start;
+        for (size_t e = 0; e < d1.size(); e++) {
+            Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors(input.from[e], input.to[e]);
+            d1[e] = q * d1[e];
+            d2[e] = q * d2[e];
+            d1[e].normalize();
+            d2[e] = (d2[e] - d2[e].dot(input.to[e]) * input.to[e]).normalized();
+            d1[e] = d2[e].cross(input.to[e]).normalized();
+        }
+        benchmark::DoNotOptimize(d1.data());
+        benchmark::DoNotOptimize(d2.data());
+    }
+    state.counters["edges"] = benchmark::Counter(static_cast<double>(d1.size()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+enum class GroomOrder {
+    Generated, // GroomGenerator walks a spiral over the scalp, already fairly coherent
+    Shuffled, // stand-in for authoring order
+    Morton // shuffled, then mortonStrandOrder
+};
+
+HairModel orderedGroom(GroomOrder order) {
+    HairModel model = groom();
+    if (order == GroomOrder::Generated) return model;
+    std::vector<unsigned int> shuffle(model.hair_count);
+    std::iota(shuffle.begin(), shuffle.end(), 0u);
+    std::shuffle(shuffle.begin(), shuffle.end(), std::mt19937(1));
+    reorderStrands(model, shuffle);
+    if (order == GroomOrder::Morton) reorderStrands(model, mortonStrandOrder(model));
+    return model;
+}
+
+void BM_MortonReorder(benchmark::State& state) {
+    HairModel shuffled = orderedGroom(GroomOrder::Shuffled);
+    for (auto _ : state) {
+        state.PauseTiming();
+        HairModel model = shuffled;
+        state.ResumeTiming();
+        reorderStrands(model, mortonStrandOrder(model));
+        benchmark::DoNotOptimize(model.points.data());
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(shuffled.hair_count) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// splat, pressure solve and force feedback of the whole groom, whose vertex scatter follows the strand order
+void BM_GridTransfer(benchmark::State& state, GroomOrder order) {
+    std::vector<DER> strands = makeStrands(orderedGroom(order));
+    HairGrid grid(1.0);
+    grid.pressure_iterations = 0; // node-only work, independent of the strand order
+    for (auto _ : state) {
+        grid.transfer(strands, 1.0e-5);
+    }
+    state.counters["strands"] = benchmark::Counter(static_cast<double>(strands.size()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+void BM_BVHBuild(benchmark::State& state) {
+    const HairModel& model = groom();
+    StrandBVH bvh;
+    for (auto _ : state) {
+        bvh.build(model);
+    }
+    state.counters["segments"] = benchmark::Counter(static_cast<double>(bvh.segmentCount()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// after a simulation step, the points move a little every frame
+void BM_BVHRefit(benchmark::State& state) {
+    const HairModel& model = groom();
+    StrandBVH bvh;
+    bvh.build(model);
+    std::vector<float> moved = model.points;
+    for (size_t i = 0; i < moved.size(); i += 3) moved[i] += 0.5f * std::sin(0.1f * moved[i + 1]);
+    for (auto _ : state) {
+        bvh.refit(moved.data());
+    }
+    state.counters["segments"] = benchmark::Counter(static_cast<double>(bvh.segmentCount()) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// rays from a camera in front of the groom towards random points of its bounding box
+void BM_BVHIntersect(benchmark::State& state) {
+    const HairModel& model = groom();
+    StrandBVH bvh;
+    bvh.build(model);
+    Eigen::Vector3f lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::max()), hi = -lo;
+    for (size_t v = 0; v < model.points.size(); v += 3) {
+        Eigen::Vector3f p(model.points[v], model.points[v + 1], model.points[v + 2]);
+        lo = lo.cwiseMin(p);
+        hi = hi.cwiseMax(p);
+    }
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<StrandBVH::Ray> rays(4096);
+    for (StrandBVH::Ray& ray : rays) {
+        ray.origin = 0.5f * (lo + hi) + Eigen::Vector3f(0.0f, 0.0f, 2.0f * (hi.z() - lo.z()));
+        Eigen::Vector3f target = lo + Eigen::Vector3f(unit(random), unit(random), unit(random)).cwiseProduct(hi - lo);
+        ray.direction = target - ray.origin;
+    }
+    size_t r = 0, hits = 0;
+    for (auto _ : state) {
+        StrandBVH::Hit hit;
+        hits += bvh.intersect(rays[r], &hit);
+        r = (r + 1) % rays.size();
+    }
+    state.counters["rays"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+    state.counters["hit_rate"] = static_cast<double>(hits) / std::max<int64_t>(state.iterations(), 1);
+}
+
+// one pass of a 256x256 image from hairview's starting camera, rays/s per core compares across machines
+void BM_PathTrace(benchmark::State& state) {
+    const HairModel& model = groom();
+    HairPathTracer::Settings settings;
+    settings.width = 256;
+    settings.height = 256;
+    HairPathTracer tracer;
+    tracer.setModel(model, settings);
+    for (auto _ : state) {
+        tracer.renderPass();
+    }
+    double seconds = std::max(tracer.renderSeconds(), 1e-9);
+    state.counters["rays/s"] = static_cast<double>(tracer.rayCount()) / seconds;
+    state.counters["rays/s/core"] = static_cast<double>(tracer.rayCount()) / (seconds * ThreadPool::instance().size());
+}
+
+// Records the real time per iteration next to the console output.
+class BaselineReporter : public benchmark::ConsoleReporter {
+public:
+    std::map<std::string, double> nanoseconds;
+
+    void ReportRuns(const std::vector<Run>& runs) override {
+        for (const Run& run : runs) {
+            if (run.error_occurred || run.run_type != Run::RT_Iteration) continue;
+            nanoseconds[run.benchmark_name()] = run.GetAdjustedRealTime() * 1.0e9 / benchmark::GetTimeUnitMultiplier(run.time_unit);
+        }
+        ConsoleReporter::ReportRuns(runs);
+    }
+};
+
+std::string groomKey() {
+    return std::to_string(num_strands) + "x" + std::to_string(num_segments);
+}
+
+// one "name nanoseconds" pair per line, after a "groom StrandsxSegments" line
+bool saveBaseline(const std::string& path, const std::map<std::string, double>& results) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Cannot write baseline " << path << std::endl;
+        return false;
+    }
+    file << "groom " << groomKey() << "\n";
+    for (const auto& result : results) {
+        file << result.first << " " << result.second << "\n";
+    }
+    return true;
+}
+
+// returns the number of regressions, -1 if the baseline cannot be used
+int compareBaseline(const std::string& path, const std::map<std::string, double>& results, double threshold) {
+    std::ifstream file(path);
+    std::string key, groom_key;
+    if (!(file >> key >> groom_key) || key != "groom") {
+        std::cerr << "Cannot read baseline " << path << std::endl;
+        return -1;
+    }
+    if (groom_key != groomKey()) {
+        std::cerr << "Baseline " << path << " was recorded on a " << groom_key << " groom, not " << groomKey() << std::endl;
+        return -1;
+    }
+    int regressions = 0;
+    std::string name;
+    double baseline;
+    while (file >> name >> baseline) {
+        auto it = results.find(name);
+        if (it == results.end()) continue;
+        double ratio = it->second / baseline;
+        if (ratio > 1.0 + threshold) {
+            std::cerr << "REGRESSION " << name << ": " << it->second << " ns, baseline " << baseline << " ns (" << ratio << "x)" << std::endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string save_baseline, baseline;
+    double threshold = 0.15;
+    // our flags are removed before Google Benchmark sees the rest
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&](const char* flag) -> const char* {
+            size_t n = std::char_traits<char>::length(flag);
+            return arg.compare(0, n, flag) == 0 ? argv[i] + n : nullptr;
+        };
+        if (const char* v = value("--strands=")) num_strands = std::atoi(v);
+        else if (const char* v = value("--segments=")) num_segments = std::atoi(v);
+        else if (const char* v = value("--save_baseline=")) save_baseline = v;
+        else if (const char* v = value("--baseline=")) baseline = v;
+        else if (const char* v = value("--regression_threshold=")) threshold = std::atof(v);
+        else argv[kept++] = argv[i];
+    }
+    argc = kept;
+    if (num_strands < 1 || num_segments < 2) {
+        std::cerr << "--strands must be positive and --segments at least 2" << std::endl;
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::AddCustomContext("groom", groomKey() + " (strands x segments)");
+
+    // hidden window for the renderer benchmarks, they are skipped without one
+    if (initializeGLFW()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = createWindow(64, 64, "engine_bench");
+        if (window && !initializeGLAD()) {
+            cleanup(window);
+            window = nullptr;
+        }
+    }
+
+    benchmark::RegisterBenchmark("HairLoader/LoadFromFile", BM_LoadFromFile)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("HairRenderer/CreateVAO", BM_CreateVAO)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("HairRenderer/Draw", BM_Draw)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Shader/compile", BM_ShaderBuild, false)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("Shader/cached", BM_ShaderBuild, true)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("DER/construct", BM_DERConstruct)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("DER/update", BM_DERUpdate)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("DER/energy", BM_DEREnergy)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("DER/gradient", BM_DERGradient)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("HairSimulation/update", BM_SimulationFrame)->Unit(benchmark::kMillisecond)->UseRealTime();
+    benchmark::RegisterBenchmark("Geometry/parallelTransport", BM_ParallelTransport)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Geometry/parallelTransportQuaternion", BM_ParallelTransportQuaternion)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Geometry/parallelTransportFrames", BM_ParallelTransportFrames)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("Geometry/parallelTransportFramesQuaternion", BM_ParallelTransportFramesQuaternion)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("HairReorder/morton", BM_MortonReorder)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("StrandBVH/build", BM_BVHBuild)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("StrandBVH/refit", BM_BVHRefit)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("StrandBVH/intersect", BM_BVHIntersect)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("HairPathTracer/pass", BM_PathTrace)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("HairGrid/transfer/generated", BM_GridTransfer, GroomOrder::Generated)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("HairGrid/transfer/shuffled", BM_GridTransfer, GroomOrder::Shuffled)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("HairGrid/transfer/morton", BM_GridTransfer, GroomOrder::Morton)->Unit(benchmark::kMillisecond);
+
+    BaselineReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    if (window) cleanup(window);
+    if (!hair_file.empty()) std::remove(hair_file.c_str());
+
+    if (!save_baseline.empty() && !saveBaseline(save_baseline, reporter.nanoseconds)) return 1;
+    if (!baseline.empty()) {
+        int regressions = compareBaseline(baseline, reporter.nanoseconds, threshold);
+        if (regressions != 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include "ComputeShader.h"
+#include "GPUSimulation.h"
+#include "GroomGenerator.h"
+#include "HairModel.h"
+#include "HairSimulation.h"
+#include "util.h"
+
+// Runs the compute shader DER next to the CPU DER and compares the strands.
+// Works on software drivers too, e.g. LIBGL_ALWAYS_SOFTWARE=1 gpucheck for Mesa llvmpipe.
+// Returns 1 if the relative RMS error exceeds the tolerance of single precision. The root motion is gentle on
+// purpose: strongly swinging strands amplify any rounding difference, between two CPU runs just as well.
+// usage: gpucheck [strands] [segments] [frames]
+
+double relativeRMS(const std::vector<Eigen::Vector3d>& a, const std::vector<Eigen::Vector3d>& b, double length) {
+    double err = 0.0;
+    for (size_t v = 0; v < a.size(); v++) {
+        err += (a[v] - b[v]).squaredNorm();
+    }
+    return std::sqrt(err / a.size()) / length;
+}
+
+int main(int argc, char** argv) {
+    int strands = argc > 1 ? std::atoi(argv[1]) : 256;
+    int segments = argc > 2 ? std::atoi(argv[2]) : 16;
+    int frames = argc > 3 ? std::atoi(argv[3]) : 10;
+    const double length = 10.0;
+    const double dt = 1.0 / 60.0;
+    const double tolerance = 1e-4; // single precision rounding accumulates over the substeps
+
+    if (!initializeGLFW(4, 3)) return -1;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = createWindow(64, 64, "gpucheck");
+    if (!window) return -1;
+    if (!initializeGLAD()) return -1;
+    if (!ComputeShader::isSupported()) {
+        std::cerr << "OpenGL 4.3 is required for compute shaders" << std::endl;
+        cleanup(window);
+        return -1;
+    }
+    std::cout << glGetString(GL_RENDERER) << std::endl;
+
+    GroomGenerator::Settings groom;
+    groom.strands = strands;
+    groom.segments = segments;
+    groom.length = static_cast<float>(length);
+    // roots near the axis of the root rotation, strands hanging down right from their root, so that they barely swing
+    groom.scalp_radius = 1.0f;
+    groom.droop = 10.0f;
+    // gently curled (a helix of radius length / 50 over 1.6 turns), so that bending and twisting are active
+    groom.curliness = 0.2f;
+    groom.curl_turns = 1.6f;
+    HairModel model = GroomGenerator(groom).generate();
+    HairSimulation::Parameters params;
+    params.substeps = 500;
+
+    HairSimulation cpu(model, params);
+    GPUSimulation gpu(model, params, SHADER_DIR "/der_compute.glsl");
+
+    // clamped roots swaying slightly, so that the root clamp is exercised as well
+    std::vector<Eigen::Matrix3d> rotations(strands);
+    std::vector<Eigen::Vector3d> translations(strands);
+    int failed = 0;
+    for (int f = 0; f < frames; f++) {
+        double angle = 0.02 * std::sin(0.5 * f);
+        for (int s = 0; s < strands; s++) {
+            rotations[s] = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+            translations[s] = Eigen::Vector3d(0.5 * angle, 0.0, 0.0);
+        }
+        cpu.setRootTransforms(rotations, translations);
+        gpu.setRootTransforms(rotations, translations);
+        cpu.update(dt);
+        gpu.update(dt);
+
+        double err = relativeRMS(gpu.getPositions(), cpu.getPositions(), length);
+        std::cout << "frame " << f << ": rel. RMS error " << err << std::endl;
+        if (!(err <= tolerance)) failed = 1;
+    }
+
+    cleanup(window);
+    std::cout << (failed ? "FAILED" : "OK") << std::endl;
+    return failed;
+}
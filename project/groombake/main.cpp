@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "GroomAnimation.h"
+#include "GroomGenerator.h"
+#include "HairLoader.h"
+#include "HairSimulation.h"
+
+// Bakes a simulated groom into an animated groom cache (.cgca, see GroomAnimation) and times its playback.
+// The roots turn back and forth about the vertical axis like a shaking head.
+// usage: groombake [--frames N] [--fps F] [--substeps N] [--solver der|der-implicit|xpbd] [--keyframe-interval N]
+//                  [--error X] [--strands N] [--segments N] [--verify] [in.hair] out.cgca
+// Without an input a synthetic groom (GroomGenerator) of --strands x --segments is baked.
+// --verify simulates again and reports the largest error of every decoded frame relative to the groom extent.
+
+namespace {
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+class Bake {
+public:
+    Bake(const HairModel& model, const HairSimulation::Parameters& params, double fps) : sim(model, params), fps(fps) {
+        roots = sim.getRoots();
+        points.resize(model.points.size());
+    }
+
+    // positions of the next frame, frame 0 is the rest pose
+    const std::vector<float>& next() {
+        if (frame > 0) {
+            double angle = 0.4 * std::sin(2.0 * 3.14159265358979323846 * frame / fps);
+            Eigen::Matrix3d rotation = Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitY()).toRotationMatrix();
+            std::vector<Eigen::Matrix3d> rotations(roots.size(), rotation);
+            std::vector<Eigen::Vector3d> translations(roots.size(), Eigen::Vector3d::Zero());
+            sim.setRootTransforms(rotations, translations);
+            sim.update(1.0 / fps);
+        }
+        std::vector<Eigen::Vector3d> x = sim.getPositions();
+        for (size_t v = 0; v < x.size(); v++) {
+            for (int c = 0; c < 3; c++) points[3 * v + c] = static_cast<float>(x[v][c]);
+        }
+        frame++;
+        return points;
+    }
+
+private:
+    HairSimulation sim;
+    double fps;
+    std::vector<Eigen::Vector3d> roots;
+    std::vector<float> points;
+    int frame = 0;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int frames = 120;
+    float fps = 30.0f;
+    int substeps = 10;
+    std::string solver = "der-implicit";
+    GroomAnimationWriter::Settings settings;
+    unsigned int strands = 1000, segments = 16;
+    bool verify = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value) frames = std::atoi(argv[++i]);
+        else if (arg == "--fps" && has_value) fps = std::strtof(argv[++i], nullptr);
+        else if (arg == "--substeps" && has_value) substeps = std::atoi(argv[++i]);
+        else if (arg == "--solver" && has_value) solver = argv[++i];
+        else if (arg == "--keyframe-interval" && has_value) settings.keyframe_interval = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--error" && has_value) settings.error_bound = std::strtof(argv[++i], nullptr);
+        else if (arg == "--strands" && has_value) strands = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--segments" && has_value) segments = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--verify") verify = true;
+        else if (arg.compare(0, 2, "--") != 0 && files.size() < 2) files.push_back(arg);
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (files.empty() || frames < 1 || fps <= 0.0f || substeps < 1) {
+        std::cerr << "usage: groombake [options] [in.hair] out.cgca" << std::endl;
+        return 1;
+    }
+    if (solver != "der" && solver != "der-implicit" && solver != "xpbd") {
+        std::cerr << "Unknown solver: " << solver << std::endl;
+        return 1;
+    }
+    std::string output = files.back();
+
+    HairModel model;
+    if (files.size() == 2) {
+        HairLoader loader;
+        std::string err, warn;
+        if (!loader.LoadFromFile(&model, &err, &warn, files[0])) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        if (!warn.empty()) std::cerr << "Warning: " << warn << std::endl;
+    } else {
+        GroomGenerator::Settings groom;
+        groom.strands = strands;
+        groom.segments = segments;
+        groom.curliness = 0.05f;
+        model = GroomGenerator(groom).generate();
+    }
+    if (model.points.empty() || model.hair_count == 0) {
+        std::cerr << "Error: the groom has no points" << std::endl;
+        return 1;
+    }
+
+    HairSimulation::Parameters params;
+    params.substeps = substeps;
+    if (solver == "xpbd") params.solver = HairSimulation::Solver::XPBD_GaussSeidel;
+    params.implicit = solver == "der-implicit";
+
+    // bake
+    auto start = std::chrono::steady_clock::now();
+    Bake bake(model, params, fps);
+    model.points = bake.next();
+    GroomAnimationWriter writer;
+    std::string err;
+    if (!writer.Open(model, &err, output, fps, settings)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    for (int f = 1; f < frames; f++) {
+        if (!writer.AddFrame(bake.next().data(), &err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+    }
+    unsigned int keyframes = writer.keyframeCount();
+    if (!writer.Close(&err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double bake_seconds = seconds(start);
+
+    std::ifstream file(output, std::ios::binary | std::ios::ate);
+    double bytes = static_cast<double>(file.tellg());
+    double raw_bytes = static_cast<double>(frames) * model.point_count * 3 * sizeof(float);
+    std::cout << output << ": " << frames << " frames (" << keyframes << " keyframes) of " << model.hair_count << " strands, "
+              << bytes / (1 << 20) << " MB (" << raw_bytes / bytes << "x smaller than float frames), bake " << bake_seconds << " s" << std::endl;
+
+    // playback
+    GroomAnimation animation;
+    if (!animation.Open(output, &err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    std::vector<float> positions(3 * static_cast<size_t>(model.point_count));
+    start = std::chrono::steady_clock::now();
+    for (unsigned int f = 0; f < animation.frameCount(); f++) {
+        animation.ReadFrame(f, positions.data());
+    }
+    double sequential = seconds(start) / animation.frameCount();
+    std::mt19937 random(1);
+    std::uniform_int_distribution<unsigned int> pick(0, animation.frameCount() - 1);
+    const int random_reads = 100;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < random_reads; r++) {
+        animation.ReadFrame(pick(random), positions.data());
+    }
+    double random_access = seconds(start) / random_reads;
+    std::cout << "playback: sequential " << 1e3 * sequential << " ms/frame, random access " << 1e3 * random_access << " ms/frame" << std::endl;
+
+    if (verify) {
+        Bake reference(animation.GetModel(), params, fps);
+        HairModel first = animation.GetModel();
+        float lo[3], hi[3];
+        for (int c = 0; c < 3; c++) lo[c] = hi[c] = first.points[c];
+        for (size_t i = 0; i < first.points.size(); i++) {
+            lo[i % 3] = std::min(lo[i % 3], first.points[i]);
+            hi[i % 3] = std::max(hi[i % 3], first.points[i]);
+        }
+        double extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+        double max_error = 0.0;
+        for (unsigned int f = 0; f < animation.frameCount(); f++) {
+            const std::vector<float>& expected = reference.next();
+            animation.ReadFrame(f, positions.data());
+            for (size_t i = 0; i < positions.size(); i++) {
+                max_error = std::max(max_error, std::abs(static_cast<double>(positions[i]) - expected[i]));
+            }
+        }
+        std::cout << "verify: max error " << max_error / extent << " of the groom extent" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "GroomGenerator.h"
+
+// Writes a synthetic groom as a .hair file, see GroomGenerator.
+// usage: groomgen [--strands N] [--segments N] [--segment-jitter N] [--length X] [--length-jitter X]
+//                 [--scalp-radius X] [--droop X] [--curliness X] [--curl-turns X] [--thickness X]
+//                 [--color R G B] [--arrays MASK] [--seed N] out.hair
+// MASK is the .hair array bitmask: 1 segments, 2 points, 4 thickness, 8 transparency, 16 colors.
+
+int main(int argc, char** argv) {
+    GroomGenerator::Settings settings;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--strands") settings.strands = static_cast<unsigned int>(std::strtoul(next(), nullptr, 10));
+        else if (arg == "--segments") settings.segments = static_cast<unsigned int>(std::strtoul(next(), nullptr, 10));
+        else if (arg == "--segment-jitter") settings.segment_jitter = static_cast<unsigned int>(std::strtoul(next(), nullptr, 10));
+        else if (arg == "--length") settings.length = std::strtof(next(), nullptr);
+        else if (arg == "--length-jitter") settings.length_jitter = std::strtof(next(), nullptr);
+        else if (arg == "--scalp-radius") settings.scalp_radius = std::strtof(next(), nullptr);
+        else if (arg == "--droop") settings.droop = std::strtof(next(), nullptr);
+        else if (arg == "--curliness") settings.curliness = std::strtof(next(), nullptr);
+        else if (arg == "--curl-turns") settings.curl_turns = std::strtof(next(), nullptr);
+        else if (arg == "--thickness") settings.thickness = std::strtof(next(), nullptr);
+        else if (arg == "--color") {
+            for (int c = 0; c < 3; c++) settings.color[c] = std::strtof(next(), nullptr);
+        }
+        else if (arg == "--arrays") settings.arrays = static_cast<unsigned int>(std::strtoul(next(), nullptr, 0));
+        else if (arg == "--seed") settings.seed = std::strtoull(next(), nullptr, 10);
+        else if (arg.compare(0, 2, "--") != 0 && output.empty()) output = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (output.empty()) {
+        std::cerr << "usage: groomgen [options] out.hair" << std::endl;
+        return 1;
+    }
+    std::string err;
+    if (!GroomGenerator::validate(settings, &err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GroomGenerator generator(settings);
+    if (!generator.writeHairFile(output, &err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << output << ": " << generator.strandCount() << " strands, " << generator.pointCount() << " points, arrays "
+              << generator.arrays() << ", " << seconds << " s" << std::endl;
+    return 0;
+}
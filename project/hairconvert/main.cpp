@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "HairCache.h"
+#include "HairLoader.h"
+#include "HairReorder.h"
+#include "HairWriter.h"
+
+// Converts between .hair and the compact cache (.cgch); the output format follows the output extension.
+// usage: hairconvert [--error X] [--chunk-strands N] [--reorder root|centroid [--order FILE]] [--restore-order FILE] [--verify]
+//                    in.(hair|cgch) out.(hair|cgch)
+// --reorder sorts the strands along a Morton curve of their roots or centroids (see HairReorder) and writes the
+// order to FILE, out.order by default: one line per output strand, holding the index of the input strand it came from.
+// --restore-order reads such a file and puts the strands of a reordered groom back into their original order.
+// --verify reloads the output and reports the largest position error relative to the strand bounding box.
+
+namespace {
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+double fileSize(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<double>(file.tellg()) : 0.0;
+}
+
+double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool writeOrder(const std::vector<unsigned int>& order, const std::string& path) {
+    std::ofstream file(path);
+    for (unsigned int strand : order) file << strand << '\n';
+    return static_cast<bool>(file);
+}
+
+// fails unless the file holds an order of `strands` strands (isStrandOrder)
+bool readOrder(std::vector<unsigned int>& order, const std::string& path, unsigned int strands, std::string* err) {
+    std::ifstream file(path);
+    if (!file) {
+        *err = "Cannot open " + path;
+        return false;
+    }
+    order.clear();
+    unsigned long strand;
+    while (order.size() <= strands && file >> strand) {
+        order.push_back(strand < strands ? static_cast<unsigned int>(strand) : strands);
+    }
+    if (!(file.eof() && isStrandOrder(order, strands))) {
+        *err = path + " is not an order of " + std::to_string(strands) + " strands";
+        return false;
+    }
+    return true;
+}
+
+void verify(const HairModel& a, const HairModel& b) {
+    if (a.hair_count != b.hair_count || a.point_count != b.point_count || a.arrays != b.arrays || a.segments != b.segments) {
+        std::cout << "verify: topology differs" << std::endl;
+        return;
+    }
+    double position_error = 0.0;
+    if (!a.points.empty()) {
+        size_t first = 0;
+        for (unsigned int s = 0; s < a.hair_count; s++) {
+            size_t n = (a.segments.empty() ? a.d_segments : a.segments[s]) + 1;
+            float lo[3], hi[3];
+            for (int c = 0; c < 3; c++) lo[c] = hi[c] = a.points[3 * first + c];
+            for (size_t v = first; v < first + n; v++) {
+                for (int c = 0; c < 3; c++) {
+                    lo[c] = std::min(lo[c], a.points[3 * v + c]);
+                    hi[c] = std::max(hi[c], a.points[3 * v + c]);
+                }
+            }
+            double extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+            for (size_t i = 3 * first; i < 3 * (first + n); i++) {
+                double e = std::abs(static_cast<double>(a.points[i]) - b.points[i]);
+                position_error = std::max(position_error, extent > 0.0 ? e / extent : e);
+            }
+            first += n;
+        }
+    }
+    auto max_error = [](const std::vector<float>& x, const std::vector<float>& y) {
+        double e = 0.0;
+        for (size_t i = 0; i < x.size(); i++) e = std::max(e, std::abs(static_cast<double>(x[i]) - y[i]));
+        return e;
+    };
+    std::cout << "verify: position error " << position_error << " of the strand extent, thickness " << max_error(a.thickness, b.thickness)
+              << ", transparency " << max_error(a.transparency, b.transparency) << ", colors " << max_error(a.colors, b.colors) << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    HairCache::Settings settings;
+    bool check = false;
+    std::string input, output, reorder, order_path, restore_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--error" && i + 1 < argc) settings.error_bound = std::strtof(argv[++i], nullptr);
+        else if (arg == "--chunk-strands" && i + 1 < argc) settings.chunk_strands = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--reorder" && i + 1 < argc) reorder = argv[++i];
+        else if (arg == "--order" && i + 1 < argc) order_path = argv[++i];
+        else if (arg == "--restore-order" && i + 1 < argc) restore_path = argv[++i];
+        else if (arg == "--verify") check = true;
+        else if (arg.compare(0, 2, "--") != 0 && input.empty()) input = arg;
+        else if (arg.compare(0, 2, "--") != 0 && output.empty()) output = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (input.empty() || output.empty()) {
+        std::cerr << "usage: hairconvert [--error X] [--chunk-strands N] [--reorder root|centroid [--order FILE]] [--restore-order FILE] [--verify] "
+                     "in.(hair|cgch) out.(hair|cgch)" << std::endl;
+        return 1;
+    }
+    if (!reorder.empty() && reorder != "root" && reorder != "centroid") {
+        std::cerr << "Unknown strand key: " << reorder << std::endl;
+        return 1;
+    }
+    if (!reorder.empty() && !restore_path.empty()) {
+        std::cerr << "--reorder and --restore-order exclude each other" << std::endl;
+        return 1;
+    }
+    if (order_path.empty()) order_path = output + ".order";
+
+    HairLoader loader;
+    HairModel model;
+    std::string err, warn;
+    auto start = std::chrono::steady_clock::now();
+    if (!loader.LoadFromFile(&model, &err, &warn, input)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (!warn.empty()) std::cerr << "Warning: " << warn << std::endl;
+    double load_seconds = seconds(start);
+
+    if (!reorder.empty()) {
+        start = std::chrono::steady_clock::now();
+        std::vector<unsigned int> order = mortonStrandOrder(model, reorder == "root" ? StrandKey::Root : StrandKey::Centroid);
+        reorderStrands(model, order);
+        std::cout << "reorder: " << seconds(start) << " s" << std::endl;
+        if (!writeOrder(order, order_path)) {
+            std::cerr << "Error: cannot write " << order_path << std::endl;
+            return 1;
+        }
+        std::cout << "order: " << order_path << std::endl;
+    }
+    if (!restore_path.empty()) {
+        std::vector<unsigned int> order;
+        if (!readOrder(order, restore_path, model.hair_count, &err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        reorderStrands(model, invertOrder(order));
+    }
+
+    start = std::chrono::steady_clock::now();
+    HairCache cache;
+    HairWriter writer;
+    bool saved = endsWith(output, ".cgch") ? cache.SaveToFile(model, &err, output, settings) : writer.SaveToFile(model, &err, output);
+    if (!saved) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double save_seconds = seconds(start);
+
+    double in_size = fileSize(input), out_size = fileSize(output);
+    std::cout << input << " -> " << output << ": " << model.hair_count << " strands, " << model.point_count << " points, "
+              << in_size / (1 << 20) << " MB -> " << out_size / (1 << 20) << " MB (" << in_size / std::max(out_size, 1.0) << "x), load "
+              << load_seconds << " s, save " << save_seconds << " s" << std::endl;
+
+    if (check) {
+        HairModel reloaded;
+        start = std::chrono::steady_clock::now();
+        if (!loader.LoadFromFile(&reloaded, &err, &warn, output)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        std::cout << "verify: reload " << seconds(start) << " s" << std::endl;
+        verify(model, reloaded);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "HairStreamReader.h"
+
+// Statistics of a .hair file, streamed in strand batches so that grooms larger than memory work too.
+// usage: hairstats [--batch-points N] [--read-ahead N] file.hair
+
+int main(int argc, char** argv) {
+    size_t batch_points = 1 << 20;
+    int read_ahead = 2;
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch-points" && i + 1 < argc) batch_points = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--read-ahead" && i + 1 < argc) read_ahead = std::atoi(argv[++i]);
+        else if (arg.compare(0, 2, "--") != 0 && path.empty()) path = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "usage: hairstats [--batch-points N] [--read-ahead N] file.hair" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    HairStreamReader reader;
+    std::string err;
+    if (!reader.Open(path, &err, batch_points, read_ahead)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    uint64_t strands = 0, points = 0, batches = 0;
+    size_t largest_batch = 0;
+    double total_length = 0.0, min_length = std::numeric_limits<double>::max(), max_length = 0.0;
+    float lo[3], hi[3];
+    std::fill(lo, lo + 3, std::numeric_limits<float>::max());
+    std::fill(hi, hi + 3, std::numeric_limits<float>::lowest());
+    HairStreamReader::Batch batch;
+    while (reader.Next(batch, &err)) {
+        size_t v = 0;
+        for (unsigned short segments : batch.segments) {
+            double length = 0.0;
+            for (unsigned int i = 0; i <= segments; i++, v++) {
+                const float* p = &batch.points[3 * v];
+                for (int c = 0; c < 3; c++) {
+                    lo[c] = std::min(lo[c], p[c]);
+                    hi[c] = std::max(hi[c], p[c]);
+                }
+                if (i > 0) {
+                    const float* q = p - 3;
+                    length += std::sqrt((p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]));
+                }
+            }
+            total_length += length;
+            min_length = std::min(min_length, length);
+            max_length = std::max(max_length, length);
+        }
+        strands += batch.strandCount();
+        points += batch.pointCount();
+        batches++;
+        largest_batch = std::max(largest_batch, batch.pointCount());
+    }
+    if (!err.empty()) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const HairLoader::Header& header = reader.GetHeader();
+    std::cout << path << std::endl;
+    std::cout << "  strands: " << strands << " (header " << header.hair_count << ")" << std::endl;
+    std::cout << "  points: " << points << " (header " << header.point_count << ")" << std::endl;
+    std::cout << "  arrays: " << header.arrays << std::endl;
+    if (strands > 0) {
+        std::cout << "  strand length: min " << min_length << ", mean " << total_length / strands << ", max " << max_length << std::endl;
+        std::cout << "  bounds: (" << lo[0] << ", " << lo[1] << ", " << lo[2] << ") - (" << hi[0] << ", " << hi[1] << ", " << hi[2] << ")" << std::endl;
+    }
+    std::cout << "  " << batches << " batches, largest " << largest_batch << " points, " << seconds << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "Camera.h"
+#include "GroomGenerator.h"
+#include "HairLoader.h"
+#include "HairPathTracer.h"
+#include "Parallel.h"
+
+// Renders a reference image of a groom on the CPU (see HairPathTracer), from hairview's starting camera
+// unless moved with the camera options. The image is saved every --save-every passes while it converges.
+// usage: hairtrace [--width N] [--height N] [--spp N] [--bounces N] [--tile N] [--save-every N]
+//                  [--position X Y Z] [--yaw DEG] [--pitch DEG] [--zoom DEG] [--output out.(ppm|pfm)] [in.(hair|cgch)]
+// Without an input file the synthetic groom hairview falls back to is rendered.
+
+int main(int argc, char** argv) {
+    HairPathTracer::Settings settings;
+    unsigned int spp = 64, save_every = 8;
+    float position[3] = {0.0f, 0.0f, 150.0f}, yaw = YAW, pitch = PITCH, zoom = ZOOM;
+    std::string input, output = "hairtrace.ppm";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--width" && has_value) settings.width = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--height" && has_value) settings.height = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--spp" && has_value) spp = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--bounces" && has_value) settings.max_bounces = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--tile" && has_value) settings.tile_size = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--save-every" && has_value) save_every = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--position" && i + 3 < argc) {
+            for (float& p : position) p = std::strtof(argv[++i], nullptr);
+        }
+        else if (arg == "--yaw" && has_value) yaw = std::strtof(argv[++i], nullptr);
+        else if (arg == "--pitch" && has_value) pitch = std::strtof(argv[++i], nullptr);
+        else if (arg == "--zoom" && has_value) zoom = std::strtof(argv[++i], nullptr);
+        else if (arg == "--output" && has_value) output = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0) input = arg;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (settings.width < 1 || settings.height < 1 || spp < 1) {
+        std::cerr << "usage: hairtrace [options] [in.hair]" << std::endl;
+        return 1;
+    }
+
+    HairModel model;
+    std::string err, warn;
+    if (!input.empty()) {
+        HairLoader loader;
+        if (!loader.LoadFromFile(&model, &err, &warn, input)) {
+            std::cerr << "Error: " << err << " (" << input << ")" << std::endl;
+            return 1;
+        }
+        if (!warn.empty()) std::cerr << "Warning: " << warn << std::endl;
+    } else {
+        GroomGenerator::Settings groom;
+        groom.strands = 10000;
+        groom.curliness = 0.1f;
+        groom.arrays = GroomGenerator::THICKNESS | GroomGenerator::COLORS;
+        model = GroomGenerator(groom).generate();
+    }
+
+    HairPathTracer tracer;
+    tracer.setModel(model, settings);
+    Camera camera(glm::vec3(position[0], position[1], position[2]), glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
+    camera.Zoom = zoom;
+    tracer.setCamera(camera);
+
+    unsigned int cores = ThreadPool::instance().size();
+    std::cout << model.hair_count << " strands, " << settings.width << "x" << settings.height << ", " << cores << " threads" << std::endl;
+    for (unsigned int pass = 1; pass <= spp; pass++) {
+        tracer.renderPass();
+        if (pass % std::max(save_every, 1u) != 0 && pass != spp) continue;
+        if (!tracer.saveImage(output, &err)) {
+            std::cerr << "Error: " << err << " (" << output << ")" << std::endl;
+            return 1;
+        }
+        double rays_per_second = tracer.rayCount() / std::max(tracer.renderSeconds(), 1e-9);
+        std::cout << pass << " spp, " << tracer.renderSeconds() << " s, " << rays_per_second * 1e-6 << " Mrays/s, "
+                  << rays_per_second * 1e-6 / cores << " Mrays/s per core" << std::endl;
+    }
+    return 0;
+}
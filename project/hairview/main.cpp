@@ -1,18 +1,29 @@
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 #include <Eigen/Dense>
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "util.h"
 #include "Camera.h"
+#include "FrameProfiler.h"
+#include "GroomAnimation.h"
+#include "GroomGenerator.h"
 #include "HairLoader.h"
 #include "HairModel.h"
 #include "HairRenderer.h"
+#include "StrandBVH.h"
+#include "Trace.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
 
 const unsigned int SCR_WIDTH = 800;
@@ -23,8 +34,13 @@ float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+bool pickRequested = false;
+bool overlayVisible = false;
+bool profileExportRequested = false;
+bool traceExportRequested = false;
+bool depthCue = false;
 
-int main(){
+int main(int argc, char** argv){
     if(!initializeGLFW()) return -1;
 
     GLFWwindow* window = createWindow(SCR_WIDTH, SCR_HEIGHT, "CGC");
@@ -40,57 +56,189 @@ int main(){
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     glEnable(GL_DEPTH_TEST);
 
-    Shader shader(SHADER_DIR "/hair_vertex.glsl", SHADER_DIR "/hair_fragment.glsl");
+    Shader::SetCacheDirectory("shader_cache"); // linked programs of earlier runs, in the working directory
+    // variants for the features toggled at runtime compile in the background, the plain one is needed right away
+    ShaderVariants hairShaders(SHADER_DIR "/hair_vertex.glsl", SHADER_DIR "/hair_fragment.glsl", window);
+    hairShaders.Wait({});
+    Shader overlayShader(SHADER_DIR "/overlay_vertex.glsl", SHADER_DIR "/overlay_fragment.glsl");
 
     HairLoader loader;
     HairModel model;
-    std::string err, warn;
+    HairRenderer renderer;
 
-    bool ret = loader.LoadFromFile(&model, &err, &warn, MODEL_DIR "/straight.hair");
-    if (!ret) {
-        std::cerr << "Error: " << err << std::endl;
-        if (!warn.empty()) {
-            std::cerr << "Warning: " << warn << std::endl;
+    // hairview [file.hair|file.cgch|file.cgca], falls back to a synthetic groom when the file cannot be loaded.
+    // The file loads in the background, a proxy of every n-th strand is shown until it is complete.
+    // Animated caches (.cgca) play in a loop, each frame streamed from the mapped file into the vertex buffer.
+    // A left click picks the strand under the screen center (the cursor is captured by the camera).
+    // F3 shows the frame timings per subsystem (CPU and GPU), F4 saves them to hairview_profile.csv/.json.
+    // F5 saves the trace events recorded so far to hairview_trace.json (builds with CGC_TRACE only).
+    // F6 toggles depth cueing, which darkens strands further back.
+    std::string path = argc > 1 ? argv[1] : MODEL_DIR "/straight.hair";
+    std::unique_ptr<HairLoader::AsyncLoad> load;
+    GroomAnimation animation;
+    bool playing = false;
+    if (GroomAnimation::IsAnimationFile(path)) {
+        std::string err;
+        playing = animation.Open(path, &err);
+        if (playing) {
+            model = animation.GetModel();
+            renderer.CreateVAO(model);
+        } else {
+            std::cerr << "Error: " << err << " (" << path << ")" << std::endl;
         }
-    } else {
-        std::cout << "Hair model loaded successfully." << std::endl;
     }
+    if (!playing) load = loader.LoadFromFileAsync(path);
+    bool showingProxy = false;
+    float playbackStart = glfwGetTime();
+    unsigned int animationFrame = 0;
+    StrandBVH bvh;
+    bool bvhDirty = true; // rebuilt on the next pick after the model changed
+    std::vector<float> framePoints;
+    FrameProfiler profiler;
+    ProfilerOverlay overlay;
 
-    HairRenderer renderer;
-    renderer.CreateVAO(model);
-
+    CGC_TRACE_THREAD_NAME("main");
     while (!glfwWindowShouldClose(window)) {
+        CGC_TRACE_SCOPE("frame");
+        profiler.BeginFrame();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        if (load && load->IsReady()) {
+            std::string err, warn;
+            bool loaded;
+            {
+                FrameProfiler::CPUScope loadScope(profiler, "load"); // waits for the loader threads
+                loaded = load->Get(&model, &err, &warn);
+            }
+            if (loaded) {
+                std::cout << "Hair model loaded successfully." << std::endl;
+            } else {
+                std::cerr << "Error: " << err << " (" << path << ")" << std::endl;
+                GroomGenerator::Settings settings;
+                settings.strands = 10000;
+                settings.curliness = 0.1f;
+                settings.arrays = GroomGenerator::THICKNESS | GroomGenerator::COLORS;
+                model = GroomGenerator(settings).generate();
+                std::cout << "Showing a synthetic groom instead." << std::endl;
+            }
+            if (!warn.empty()) {
+                std::cerr << "Warning: " << warn << std::endl;
+            }
+            FrameProfiler::CPUScope uploadScope(profiler, "upload");
+            renderer.CreateVAO(model);
+            bvhDirty = true;
+            glfwSetWindowTitle(window, "CGC");
+            load.reset();
+        } else if (load) {
+            if (!showingProxy && load->GetProxy(&model)) {
+                FrameProfiler::CPUScope uploadScope(profiler, "upload");
+                renderer.CreateVAO(model);
+                bvhDirty = true;
+                showingProxy = true;
+            }
+            std::string title = "CGC - loading " + std::to_string(static_cast<int>(100.0f * load->GetProgress())) + "%";
+            glfwSetWindowTitle(window, title.c_str());
+        }
+
+        if (playing && animation.frameCount() > 0) {
+            FrameProfiler::CPUScope animationScope(profiler, "animation");
+            animationFrame = static_cast<unsigned int>((currentFrame - playbackStart) * animation.frameRate()) % animation.frameCount();
+            renderer.StreamFrame(model, animation, animationFrame);
+        }
+
+        if (pickRequested) {
+            FrameProfiler::CPUScope pickScope(profiler, "pick");
+            pickRequested = false;
+            if (bvhDirty) {
+                bvh.build(model);
+                bvhDirty = false;
+            }
+            if (playing) {
+                // same topology every frame, refitting is enough
+                framePoints.resize(model.points.size());
+                animation.ReadFrame(animationFrame, framePoints.data());
+                bvh.refit(framePoints.data());
+            }
+            glm::vec3 direction = camera.GetRayDirection(0.0f, 0.0f, (float)SCR_WIDTH / (float)SCR_HEIGHT);
+            StrandBVH::Ray ray;
+            ray.origin = Eigen::Vector3f(camera.Position.x, camera.Position.y, camera.Position.z);
+            ray.direction = Eigen::Vector3f(direction.x, direction.y, direction.z);
+            StrandBVH::Hit hit;
+            if (bvh.pick(ray, 0.25f, &hit)) {
+                std::cout << "Picked strand " << hit.strand << ", segment " << hit.segment << " at distance " << hit.t << std::endl;
+            } else {
+                std::cout << "No strand under the cursor" << std::endl;
+            }
+        }
+
         processInput(window);
 
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        shader.use();
+        ShaderVariants::Defines hairDefines;
+        if (depthCue) hairDefines.push_back("DEPTH_CUE");
+        Shader* hairShader = hairShaders.Get(hairDefines); // the plain variant until this one is compiled
+        if (hairShader) {
+            Shader& shader = *hairShader;
+            FrameProfiler::CPUScope drawScope(profiler, "draw");
+            shader.use();
 
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 300.0f);
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
+            glm::mat4 view = camera.GetViewMatrix();
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 300.0f);
+            shader.setMat4("view", view);
+            shader.setMat4("projection", projection);
 
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("model", modelMatrix);
+            glm::mat4 modelMatrix = glm::mat4(1.0f);
+            modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
+            modelMatrix = glm::rotate(modelMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            shader.setMat4("model", modelMatrix);
 
-        renderer.Draw(shader);
+            FrameProfiler::GPUScope hairScope(profiler, "hair");
+            renderer.Draw(shader);
+        }
 
-        glfwSwapBuffers(window);
+        if (overlayVisible) {
+            FrameProfiler::CPUScope overlayScope(profiler, "overlay");
+            overlay.Draw(profiler, overlayShader, SCR_WIDTH, SCR_HEIGHT);
+        }
+        if (profileExportRequested) {
+            profileExportRequested = false;
+            std::string err;
+            if (profiler.SaveCSV("hairview_profile.csv", &err) && profiler.SaveJSON("hairview_profile.json", &err)) {
+                std::cout << "Saved the last " << std::min<uint64_t>(profiler.frameCount(), profiler.historySize())
+                          << " frames to hairview_profile.csv and hairview_profile.json" << std::endl;
+            } else {
+                std::cerr << "Error: " << err << std::endl;
+            }
+        }
+        if (traceExportRequested) {
+            traceExportRequested = false;
+            std::string err;
+            if (Trace::Save("hairview_trace.json", &err)) {
+                std::cout << "Saved the trace to hairview_trace.json (open it in chrome://tracing or ui.perfetto.dev)" << std::endl;
+            } else {
+                std::cerr << "Error: " << err << std::endl;
+            }
+        }
+
+        {
+            FrameProfiler::CPUScope swapScope(profiler, "swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        profiler.EndFrame();
     }
 
+    hairShaders.Shutdown(); // its worker and hidden context need GLFW
     glfwTerminate();
     return 0;
 }
@@ -121,6 +269,26 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
 
+// Callback function for mouse buttons, picking happens in the render loop
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
+}
+
+// Callback function for keys that toggle something once per press
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS)
+        return;
+    if (key == GLFW_KEY_F3)
+        overlayVisible = !overlayVisible;
+    if (key == GLFW_KEY_F4)
+        profileExportRequested = true;
+    if (key == GLFW_KEY_F5)
+        traceExportRequested = true;
+    if (key == GLFW_KEY_F6)
+        depthCue = !depthCue;
+}
+
 // Function to process input from keyboard
 void processInput(GLFWwindow *window) {
     bool shift = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+#include "GroomGenerator.h"
+#include "HairModel.h"
+#include "HairSimulation.h"
+
+// Compares the strand solvers on identical inputs.
+// Accuracy is the RMS vertex distance to a finely substepped DER reference, relative to the strand length.
+// XPBD configurations are named substeps x iterations.
+// usage: solverbench [strands] [segments] [frames]
+
+std::vector<Eigen::Vector3d> makeInitialVelocities(const HairSimulation& sim) {
+    // transverse wave along each strand
+    const std::vector<int>& offsets = sim.getStrandOffsets();
+    std::vector<Eigen::Vector3d> v(offsets.back());
+    for (int s = 0; s < sim.strandCount(); s++) {
+        int n = offsets[s + 1] - offsets[s];
+        for (int i = 0; i < n; i++) {
+            double u = static_cast<double>(i) / std::max(n - 1, 1);
+            v[offsets[s] + i] = Eigen::Vector3d(20.0 * std::sin(3.0 * u), 0.0, 10.0 * std::cos(5.0 * u));
+        }
+    }
+    return v;
+}
+
+struct Result {
+    std::vector<Eigen::Vector3d> positions;
+    double seconds;
+};
+
+Result run(const HairModel& model, const HairSimulation::Parameters& params, int frames, double dt) {
+    HairSimulation sim(model, params);
+    sim.setVelocities(makeInitialVelocities(sim));
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        sim.update(dt);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return {sim.getPositions(), std::chrono::duration<double>(stop - start).count()};
+}
+
+int main(int argc, char** argv) {
+    int strands = argc > 1 ? std::atoi(argv[1]) : 64;
+    int segments = argc > 2 ? std::atoi(argv[2]) : 16;
+    int frames = argc > 3 ? std::atoi(argv[3]) : 10;
+    const double length = 10.0;
+    const double dt = 1.0 / 60.0;
+
+    GroomGenerator::Settings groom;
+    groom.strands = strands;
+    groom.segments = segments;
+    groom.length = static_cast<float>(length);
+    // gently curled (a helix of radius length / 50 over 1.6 turns), so that bending and twisting are active
+    groom.curliness = 0.2f;
+    groom.curl_turns = 1.6f;
+    HairModel model = GroomGenerator(groom).generate();
+
+    HairSimulation::Parameters base;
+    base.gravity = Eigen::Vector3d::Zero();
+
+    HairSimulation::Parameters reference = base;
+    reference.solver = HairSimulation::Solver::DER;
+    reference.substeps = 2000;
+    Result ref = run(model, reference, frames, dt);
+
+    struct Config {
+        const char* name;
+        HairSimulation::Solver solver;
+        int substeps;
+        int iterations;
+        bool implicit; // DER backward Euler
+    };
+    std::vector<Config> configs = {
+        {"DER (500 substeps)", HairSimulation::Solver::DER, 500, 0, false},
+        {"DER implicit 1x", HairSimulation::Solver::DER, 1, 0, true},
+        {"DER implicit 4x", HairSimulation::Solver::DER, 4, 0, true},
+        {"XPBD Gauss-Seidel 1x4", HairSimulation::Solver::XPBD_GaussSeidel, 1, 4, false},
+        {"XPBD Gauss-Seidel 1x16", HairSimulation::Solver::XPBD_GaussSeidel, 1, 16, false},
+        {"XPBD Gauss-Seidel 10x1", HairSimulation::Solver::XPBD_GaussSeidel, 10, 1, false},
+        {"XPBD Jacobi 1x16", HairSimulation::Solver::XPBD_Jacobi, 1, 16, false},
+        {"XPBD Jacobi 10x4", HairSimulation::Solver::XPBD_Jacobi, 10, 4, false},
+    };
+
+    std::cout << strands << " strands x " << segments << " segments, " << frames << " frames" << std::endl;
+    std::cout << std::left << std::setw(28) << "solver" << std::setw(14) << "ms/frame" << std::setw(18) << "strand-frames/s" << "rel. RMS error" << std::endl;
+    for (const Config& config : configs) {
+        HairSimulation::Parameters params = base;
+        params.solver = config.solver;
+        params.substeps = config.substeps;
+        params.iterations = config.iterations;
+        params.implicit = config.implicit;
+        Result result = run(model, params, frames, dt);
+
+        double err = 0.0;
+        for (size_t v = 0; v < ref.positions.size(); v++) {
+            err += (result.positions[v] - ref.positions[v]).squaredNorm();
+        }
+        err = std::sqrt(err / ref.positions.size()) / length;
+
+        std::cout << std::left << std::setw(28) << config.name
+                  << std::setw(14) << 1000.0 * result.seconds / frames
+                  << std::setw(18) << strands * frames / result.seconds
+                  << err << std::endl;
+    }
+    return 0;
+}
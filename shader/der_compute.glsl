@@ -0,0 +1,282 @@
+#version 430 core
+// Discrete elastic rods, one invocation per strand. Mirrors DER::update (symplectic Euler,
+// time-parallel transported reference frames, quasistatic theta) in single precision.
+layout(local_size_x = 64) in;
+
+// the render VBO, tightly packed xyz
+layout(std430, binding = 0) buffer Positions { float positions[]; };
+layout(std430, binding = 1) buffer Velocities { vec4 velocities[]; };
+layout(std430, binding = 2) readonly buffer Offsets { int offsets[]; }; // first vertex of each strand, strand_count + 1 entries
+
+struct VertexData {
+    vec4 rest; // voronoi length, beta, mass, -
+    vec4 bending; // rest curvature (2), diagonal of B (2)
+};
+layout(std430, binding = 3) buffer Vertices { VertexData vertex_data[]; };
+
+struct EdgeData {
+    vec4 frame; // reference director d1 (d2 = t x d1), theta
+    vec4 tangent; // tangent, rest length
+};
+layout(std430, binding = 4) buffer Edges { EdgeData edge_data[]; };
+
+struct Scratch {
+    vec4 force;
+    vec4 theta; // hessian diagonal, gradient of the edge with the same index
+};
+layout(std430, binding = 5) buffer Scratches { Scratch scratch[]; };
+
+struct Root {
+    vec4 p0; // rest vertex 0
+    vec4 p1; // rest vertex 1
+    vec4 director; // rest material director of edge 0
+};
+layout(std430, binding = 6) buffer Roots { Root roots[]; };
+layout(std430, binding = 7) readonly buffer RootTransforms { mat4 root_transforms[]; }; // strand, see DER::setRootTransform
+
+uniform int stage; // 0: rest state and frames from the current positions, 1: simulate
+uniform int strand_count;
+uniform float E;
+uniform float G;
+uniform float radius;
+uniform float rho;
+uniform vec3 gravity;
+uniform float dt;
+uniform int substeps;
+uniform bool root_clamped;
+
+const float PI = 3.14159265358979;
+
+vec3 position(int v) {
+    return vec3(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+}
+
+void setPosition(int v, vec3 p) {
+    positions[3 * v] = p.x;
+    positions[3 * v + 1] = p.y;
+    positions[3 * v + 2] = p.z;
+}
+
+// same closed form as parallelTransport in Geometry.cpp
+vec3 transport(vec3 v, vec3 t0, vec3 t1) {
+    vec3 b = cross(t0, t1);
+    float c = dot(t0, t1);
+    if (1.0 + c < 1e-6) {
+        vec3 n = normalize(cross(t0, abs(t0.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0)));
+        return 2.0 * dot(n, v) * n - v;
+    }
+    return c * v + cross(b, v) + (dot(b, v) / (1.0 + c)) * b;
+}
+
+void materialFrame(int e, out vec3 m1, out vec3 m2) {
+    vec3 t = edge_data[e].tangent.xyz;
+    vec3 d1 = edge_data[e].frame.xyz;
+    vec3 d2 = cross(t, d1);
+    float theta = edge_data[e].frame.w;
+    m1 = cos(theta) * d1 + sin(theta) * d2;
+    m2 = -sin(theta) * d1 + cos(theta) * d2;
+}
+
+// everything a vertex between edges ep and en needs
+struct Bend {
+    vec3 tp, tn;
+    vec3 m1p, m2p, m1n, m2n;
+    vec3 kb;
+    vec2 kappa;
+    float twist;
+};
+
+Bend bendAt(int ep, int en) {
+    Bend b;
+    b.tp = edge_data[ep].tangent.xyz;
+    b.tn = edge_data[en].tangent.xyz;
+    materialFrame(ep, b.m1p, b.m2p);
+    materialFrame(en, b.m1n, b.m2n);
+    b.kb = 2.0 * cross(b.tp, b.tn) / (1.0 + dot(b.tp, b.tn));
+    b.kappa = vec2(0.5 * (dot(b.kb, b.m2p) + dot(b.kb, b.m2n)), -0.5 * (dot(b.kb, b.m1p) + dot(b.kb, b.m1n)));
+    vec3 d1 = transport(b.m1p, b.tp, b.tn);
+    b.twist = atan(dot(cross(d1, b.m1n), b.tn), dot(d1, b.m1n));
+    return b;
+}
+
+void initialize(int begin, int e0, int n) {
+    int ne = n - 1;
+    vec3 d1 = vec3(1.0, 0.0, 0.0);
+    for (int j = 0; j < ne; j++) {
+        vec3 e = position(begin + j + 1) - position(begin + j);
+        vec3 t = normalize(e);
+        if (j == 0) {
+            if (length(cross(d1, t)) < 1e-6) d1 = vec3(0.0, 1.0, 0.0);
+        } else {
+            d1 = transport(d1, edge_data[e0 + j - 1].tangent.xyz, t);
+        }
+        d1 = normalize(d1 - dot(d1, t) * t);
+        edge_data[e0 + j].frame = vec4(d1, 0.0);
+        edge_data[e0 + j].tangent = vec4(t, length(e));
+    }
+
+    float area = PI * radius * radius;
+    for (int i = 0; i < n; i++) {
+        int v = begin + i;
+        float mass = 0.0;
+        if (i > 0) mass += 0.5 * rho * area * edge_data[e0 + i - 1].tangent.w;
+        if (i < ne) mass += 0.5 * rho * area * edge_data[e0 + i].tangent.w;
+        vertex_data[v].rest = vec4(0.0, 0.0, mass, 0.0);
+        vertex_data[v].bending = vec4(0.0);
+        if (i > 0 && i < ne) {
+            float voronoi = 0.5 * (edge_data[e0 + i - 1].tangent.w + edge_data[e0 + i].tangent.w);
+            float beta = G * area * (2.0 * radius * radius) / 4.0;
+            float B = E * area * radius * radius / 4.0;
+            vertex_data[v].rest.xy = vec2(voronoi, beta);
+            vertex_data[v].bending = vec4(bendAt(e0 + i - 1, e0 + i).kappa, B, B);
+        }
+        velocities[v] = vec4(0.0);
+    }
+
+    int s = int(gl_GlobalInvocationID.x);
+    roots[s].p0 = vec4(position(begin), 1.0);
+    roots[s].p1 = vec4(position(begin + min(1, n - 1)), 1.0);
+    roots[s].director = vec4(ne > 0 ? edge_data[e0].frame.xyz : vec3(1.0, 0.0, 0.0), 0.0);
+}
+
+void computeForces(int begin, int e0, int n) {
+    int ne = n - 1;
+    for (int i = 0; i < n; i++) {
+        scratch[begin + i].force = vec4(vertex_data[begin + i].rest.z * gravity, 0.0);
+    }
+
+    float ks = E * PI * radius * radius;
+    for (int j = 0; j < ne; j++) {
+        float l = length(position(begin + j + 1) - position(begin + j));
+        vec3 f = ks * (l - edge_data[e0 + j].tangent.w) * edge_data[e0 + j].tangent.xyz;
+        scratch[begin + j].force.xyz += f;
+        scratch[begin + j + 1].force.xyz -= f;
+    }
+
+    for (int i = 1; i < ne; i++) {
+        Bend b = bendAt(e0 + i - 1, e0 + i);
+        float lp = length(position(begin + i) - position(begin + i - 1));
+        float ln = length(position(begin + i + 1) - position(begin + i));
+        vec4 rest = vertex_data[begin + i].rest;
+        vec4 bending = vertex_data[begin + i].bending;
+
+        // twisting, the reference twist changes with the centerline
+        float coeff = rest.y * b.twist / rest.x;
+        vec3 dm_prev = b.kb / (2.0 * lp);
+        vec3 dm_next = b.kb / (2.0 * ln);
+        vec3 grad_prev = -coeff * dm_prev;
+        vec3 grad_mid = coeff * (dm_prev - dm_next);
+        vec3 grad_next = coeff * dm_next;
+
+        // bending, Bergou et al. 2008
+        float chi = 1.0 + dot(b.tp, b.tn);
+        vec3 tilde_t = (b.tp + b.tn) / chi;
+        vec3 tilde_d1 = (b.m1p + b.m1n) / chi;
+        vec3 tilde_d2 = (b.m2p + b.m2n) / chi;
+        vec2 dE_dkappa = bending.zw * (b.kappa - bending.xy);
+        vec3 dE_de_prev = dE_dkappa.x * (-b.kappa.x * tilde_t + cross(b.tn, tilde_d2)) / lp
+                        + dE_dkappa.y * (-b.kappa.y * tilde_t - cross(b.tn, tilde_d1)) / lp;
+        vec3 dE_de_next = dE_dkappa.x * (-b.kappa.x * tilde_t - cross(b.tp, tilde_d2)) / ln
+                        + dE_dkappa.y * (-b.kappa.y * tilde_t + cross(b.tp, tilde_d1)) / ln;
+        grad_prev -= dE_de_prev;
+        grad_mid += dE_de_prev - dE_de_next;
+        grad_next += dE_de_next;
+
+        scratch[begin + i - 1].force.xyz -= grad_prev;
+        scratch[begin + i].force.xyz -= grad_mid;
+        scratch[begin + i + 1].force.xyz -= grad_next;
+    }
+}
+
+void clampRootTheta(int s, int e0) {
+    if (!root_clamped) return;
+    vec3 t = edge_data[e0].tangent.xyz;
+    vec3 d1 = edge_data[e0].frame.xyz;
+    vec3 director = mat3(root_transforms[s]) * roots[s].director.xyz;
+    edge_data[e0].frame.w = atan(dot(director, cross(t, d1)), dot(director, d1));
+}
+
+void updateThetas(int begin, int e0, int n) {
+    int ne = n - 1;
+    for (int j = 0; j < ne; j++) {
+        scratch[begin + j].theta.x = 0.0;
+    }
+    for (int i = 1; i < ne; i++) {
+        vec4 rest = vertex_data[begin + i].rest;
+        vec3 kb = bendAt(e0 + i - 1, e0 + i).kb;
+        float k = rest.y / rest.x + 0.25 * dot(kb, kb) * max(vertex_data[begin + i].bending.z, vertex_data[begin + i].bending.w);
+        scratch[begin + i - 1].theta.x += k;
+        scratch[begin + i].theta.x += k;
+    }
+
+    for (int iter = 0; iter < 10; iter++) {
+        for (int j = 0; j < ne; j++) {
+            scratch[begin + j].theta.y = 0.0;
+        }
+        for (int i = 1; i < ne; i++) {
+            Bend b = bendAt(e0 + i - 1, e0 + i);
+            vec4 rest = vertex_data[begin + i].rest;
+            vec4 bending = vertex_data[begin + i].bending;
+            float dE_dm = rest.y * b.twist / rest.x;
+            vec2 dE_dkappa = bending.zw * (b.kappa - bending.xy);
+            scratch[begin + i - 1].theta.y += -dE_dm + dot(dE_dkappa, vec2(-0.5 * dot(b.kb, b.m1p), -0.5 * dot(b.kb, b.m2p)));
+            scratch[begin + i].theta.y += dE_dm + dot(dE_dkappa, vec2(-0.5 * dot(b.kb, b.m1n), -0.5 * dot(b.kb, b.m2n)));
+        }
+        float max_step = 0.0;
+        for (int j = root_clamped ? 1 : 0; j < ne; j++) {
+            float h = scratch[begin + j].theta.x;
+            if (h <= 0.0) continue;
+            float step = scratch[begin + j].theta.y / h;
+            edge_data[e0 + j].frame.w -= step;
+            max_step = max(max_step, abs(step));
+        }
+        if (max_step < 1e-6) break;
+    }
+}
+
+void step(int s, int begin, int e0, int n) {
+    computeForces(begin, e0, n);
+
+    // symplectic Euler, clamped root vertices follow the root transform
+    for (int i = 0; i < n; i++) {
+        int v = begin + i;
+        vec3 x = position(v);
+        if (root_clamped && i < 2) {
+            vec3 target = (root_transforms[s] * (i == 0 ? roots[s].p0 : roots[s].p1)).xyz;
+            velocities[v] = vec4((target - x) / dt, 0.0);
+            setPosition(v, target);
+            continue;
+        }
+        vec3 vel = velocities[v].xyz + dt * scratch[v].force.xyz / vertex_data[v].rest.z;
+        velocities[v] = vec4(vel, 0.0);
+        setPosition(v, x + dt * vel);
+    }
+
+    // time parallel transport of the reference frames
+    for (int j = 0; j < n - 1; j++) {
+        vec3 t = normalize(position(begin + j + 1) - position(begin + j));
+        vec3 t_old = edge_data[e0 + j].tangent.xyz;
+        if (t == t_old) continue;
+        vec3 d1 = transport(edge_data[e0 + j].frame.xyz, t_old, t);
+        edge_data[e0 + j].frame.xyz = normalize(d1 - dot(d1, t) * t);
+        edge_data[e0 + j].tangent.xyz = t;
+    }
+    if (n > 1) clampRootTheta(s, e0);
+    updateThetas(begin, e0, n);
+}
+
+void main() {
+    int s = int(gl_GlobalInvocationID.x);
+    if (s >= strand_count) return;
+    int begin = offsets[s];
+    int n = offsets[s + 1] - begin;
+    int e0 = begin - s; // edges are stored like vertices, one fewer per strand
+
+    if (stage == 0) {
+        initialize(begin, e0, n);
+        return;
+    }
+    for (int k = 0; k < substeps; k++) {
+        step(s, begin, e0, n);
+    }
+}
@@ -2,9 +2,20 @@
 in float vThickness;
 in float vTransparency;
 in vec3 vColor;
+#ifdef DEPTH_CUE
+in float vDepth;
+#ifndef DEPTH_CUE_RANGE
+#define DEPTH_CUE_RANGE vec2(120.0, 180.0)
+#endif
+#endif
 
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(vColor, 1.0 - vTransparency);
+    vec3 color = vColor;
+#ifdef DEPTH_CUE
+    // strands further back are darker, which separates the layers of a dense groom
+    color *= mix(1.0, 0.35, smoothstep(DEPTH_CUE_RANGE.x, DEPTH_CUE_RANGE.y, vDepth));
+#endif
+    FragColor = vec4(color, 1.0 - vTransparency);
 }
@@ -7,6 +7,9 @@ layout(location = 3) in vec3 aColor;
 out float vThickness;
 out float vTransparency;
 out vec3 vColor;
+#ifdef DEPTH_CUE
+out float vDepth;
+#endif
 
 uniform bool useDefaultThickness;
 uniform bool useDefaultTransparency;
@@ -23,5 +26,9 @@ void main() {
     vThickness = useDefaultThickness ? defaultThickness : aThickness;
     vTransparency = useDefaultTransparency ? defaultTransparency : aTransparency;
     vColor = useDefaultColor ? defaultColor : aColor;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 viewPos = view * model * vec4(aPos, 1.0);
+#ifdef DEPTH_CUE
+    vDepth = -viewPos.z;
+#endif
+    gl_Position = projection * viewPos;
 }
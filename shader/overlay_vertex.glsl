@@ -0,0 +1,12 @@
+#version 410 core
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec4 aColor;
+
+out vec4 vColor;
+
+uniform mat4 projection;
+
+void main() {
+    vColor = aColor;
+    gl_Position = projection * vec4(aPos, 0.0, 1.0);
+}
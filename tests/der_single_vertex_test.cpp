@@ -0,0 +1,38 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "DER.h"
+
+// A strand of a single vertex, which the constructor accepts: it has no edge and no mass, so every update
+// (explicit, adaptive, implicit, static) has to leave it where it is instead of reading the missing edges.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+    if (!ok) failures++;
+}
+
+} // namespace
+
+int main() {
+    const Eigen::Vector3d position(1.0, 2.0, 3.0);
+    DER strand({position}, 1.0e5, 4.0e4, {}, {});
+    strand.setGravity(Eigen::Vector3d(0.0, 0.0, -9.8));
+    auto unmoved = [&] { return strand.getVertices().size() == 1 && strand.getVertices()[0] == position; };
+
+    check(std::isinf(strand.computeStableTimestep(0.5)), "the stable timestep is unlimited");
+    check(strand.advance(1.0e-2, 0.5, 10) == 0 && unmoved(), "advance takes no substep");
+    strand.update(1.0e-2);
+    check(unmoved(), "update leaves it in place");
+    DER::NewtonStats implicit = strand.updateImplicit(1.0e-2);
+    check(implicit.converged && implicit.factorizations == 0 && unmoved(), "updateImplicit leaves it in place");
+    DER::NewtonStats equilibrium = strand.solveStatic();
+    check(equilibrium.converged && equilibrium.factorizations == 0 && unmoved(), "solveStatic converges without a solve");
+    check(strand.computeTotalEnergy() == 0.0, "it has no elastic energy");
+    return failures == 0 ? 0 : 1;
+}
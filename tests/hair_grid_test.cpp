@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "DER.h"
+#include "HairGrid.h"
+
+// Checks the grid transfer and the pressure projection of HairGrid on a block of straight strands:
+// a uniform velocity comes back unchanged, the projection removes most of the divergence of an expanding
+// flow, and a stray strand far away allocates only a few bricks instead of the space in between.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+    if (!ok) failures++;
+}
+
+std::vector<DER> makeBlock(int side, int vertices, double spacing, const Eigen::Vector3d& offset) {
+    std::vector<DER> strands;
+    for (int s = 0; s < side * side; s++) {
+        std::vector<Eigen::Vector3d> x;
+        for (int i = 0; i < vertices; i++) {
+            x.push_back(offset + Eigen::Vector3d((s % side) * spacing, -i * spacing, (s / side) * spacing));
+        }
+        std::vector<double> radii(vertices - 1, 0.005);
+        strands.emplace_back(x, 1.0e7, 4.0e6, radii, radii);
+    }
+    return strands;
+}
+
+void setVelocities(std::vector<DER>& strands, const std::function<Eigen::Vector3d(const Eigen::Vector3d&)>& field) {
+    for (DER& strand : strands) {
+        std::vector<Eigen::Vector3d> x = strand.getVertices(), v;
+        for (const Eigen::Vector3d& p : x) v.push_back(field(p));
+        strand.setState(x, v);
+    }
+}
+
+// mean |div v| of the grid velocity at the vertices more than `margin` inside the block
+double meanDivergence(const HairGrid& grid, const std::vector<DER>& strands, const Eigen::Vector3d& lo, const Eigen::Vector3d& hi, double margin, double h) {
+    double sum = 0.0;
+    int count = 0;
+    for (const DER& strand : strands) {
+        for (const Eigen::Vector3d& p : strand.getVertices()) {
+            if (((p - lo).array() < margin).any() || ((hi - p).array() < margin).any()) continue;
+            double div = 0.0;
+            for (int d = 0; d < 3; d++) {
+                Eigen::Vector3d e = Eigen::Vector3d::Unit(d) * h;
+                div += (grid.sampleVelocity(p + e)[d] - grid.sampleVelocity(p - e)[d]) / (2.0 * h);
+            }
+            sum += std::abs(div);
+            count++;
+        }
+    }
+    return count > 0 ? sum / count : 0.0;
+}
+
+} // namespace
+
+int main() {
+    const double cell = 1.0, spacing = 0.45;
+    const int side = 24, vertices = 24;
+    std::vector<DER> strands = makeBlock(side, vertices, spacing, Eigen::Vector3d::Zero());
+    Eigen::Vector3d lo(0.0, -(vertices - 1) * spacing, 0.0), hi((side - 1) * spacing, 0.0, (side - 1) * spacing);
+
+    // transfer: every node touched by a vertex carries the same velocity, so interpolation returns it exactly
+    const Eigen::Vector3d uniform(0.3, -1.2, 0.7);
+    setVelocities(strands, [&](const Eigen::Vector3d&) { return uniform; });
+    HairGrid grid(cell);
+    grid.splat(strands);
+    double worst = 0.0;
+    for (const DER& strand : strands) {
+        for (const Eigen::Vector3d& p : strand.getVertices()) worst = std::max(worst, (grid.sampleVelocity(p) - uniform).norm());
+    }
+    check(worst < 1e-12, "uniform velocity survives the splat (error " + std::to_string(worst) + ")");
+    check(grid.sampleDensity(0.5 * (lo + hi)) > 0.0 && grid.sampleDensity(hi + Eigen::Vector3d::Constant(10.0)) == 0.0, "density inside and outside the block");
+
+    // projection: an expanding flow is divergent everywhere, the smoothed field much less so inside
+    Eigen::Vector3d center = 0.5 * (lo + hi);
+    setVelocities(strands, [&](const Eigen::Vector3d& p) { return Eigen::Vector3d(0.1 * (p - center)); });
+    grid.pressure_iterations = 400;
+    grid.splat(strands);
+    double before = meanDivergence(grid, strands, lo, hi, 3.0 * cell, cell);
+    grid.solveVelocity();
+    double after = meanDivergence(grid, strands, lo, hi, 3.0 * cell, cell);
+    check(before > 0.2 && after < 0.1 * before, "projection reduces the divergence from " + std::to_string(before) + " to " + std::to_string(after));
+
+    // sparsity: a strand 10000 cells away costs its own bricks and their halo, not the bounding box
+    int bricks = grid.brickCount();
+    std::vector<DER> stray = makeBlock(1, vertices, spacing, Eigen::Vector3d(1.0e4, 0.0, 0.0));
+    strands.push_back(stray[0]);
+    grid.splat(strands);
+    check(grid.brickCount() <= bricks + 3 * 3 * 6, "stray strand adds " + std::to_string(grid.brickCount() - bricks) + " bricks to " + std::to_string(bricks));
+    check(grid.sampleDensity(Eigen::Vector3d(1.0e4, -1.0, 0.0)) > 0.0, "stray strand is on the grid");
+
+    return failures == 0 ? 0 : 1;
+}
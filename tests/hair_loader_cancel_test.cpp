@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "GroomGenerator.h"
+#include "HairLoader.h"
+
+// Cancels HairLoader::AsyncLoad while it reads the proxy: a groom with a proxy of half its strands, read one
+// strand at a time, is canceled right after the load starts. The load has to fail with "Canceled", and a proxy,
+// if one was published at all, must be complete: its counts have to match its arrays, or drawing it reads past them.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+    if (!ok) failures++;
+}
+
+bool consistent(const HairModel& model) {
+    if (model.segments.size() != model.hair_count) return false;
+    uint64_t points = 0;
+    for (unsigned short segments : model.segments) points += segments + 1;
+    return points == model.point_count && model.points.size() == 3 * points && model.thickness.size() == points;
+}
+
+} // namespace
+
+int main() {
+    GroomGenerator::Settings settings;
+    settings.strands = 40000;
+    settings.segment_jitter = 4;
+    settings.arrays = GroomGenerator::SEGMENTS | GroomGenerator::POINTS | GroomGenerator::THICKNESS;
+    GroomGenerator generator(settings);
+    const std::string path = "hair_loader_cancel_test.hair";
+    std::string err, warn;
+    if (!generator.writeHairFile(path, &err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    HairLoader loader;
+    const unsigned int proxy_strands = settings.strands / 2;
+    {
+        std::unique_ptr<HairLoader::AsyncLoad> load = loader.LoadFromFileAsync(path, nullptr, proxy_strands);
+        HairModel model, proxy;
+        bool loaded = load->Get(&model, &err, &warn);
+        check(loaded, "an uncanceled load succeeds (" + err + ")");
+        check(load->GetProxy(&proxy) && proxy.hair_count == proxy_strands && consistent(proxy),
+              "its proxy holds every other strand and matches its arrays");
+    }
+
+    const int trials = 20;
+    int canceled = 0, partial = 0;
+    for (int trial = 0; trial < trials; trial++) {
+        std::unique_ptr<HairLoader::AsyncLoad> load = loader.LoadFromFileAsync(path, nullptr, proxy_strands);
+        load->Cancel();
+        HairModel model, proxy;
+        err.clear();
+        bool loaded = load->Get(&model, &err, &warn);
+        if (!loaded && err == "Canceled") canceled++;
+        if (load->GetProxy(&proxy) && !(proxy.hair_count == proxy_strands && consistent(proxy))) partial++;
+    }
+    check(canceled == trials, "every canceled load fails with Canceled (" + std::to_string(canceled) + " of " + std::to_string(trials) + ")");
+    check(partial == 0, "no partial proxy is published (" + std::to_string(partial) + " of " + std::to_string(trials) + ")");
+
+    std::remove(path.c_str());
+    return failures == 0 ? 0 : 1;
+}
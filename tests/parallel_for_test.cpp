@@ -0,0 +1,72 @@
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "Parallel.h"
+
+// Exceptions thrown from ThreadPool::parallelFor chunks, on the calling thread and on a worker: they have to
+// reach the caller instead of terminating the program, and the pool has to stay usable, still running later
+// jobs on all of its threads.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+    if (!ok) failures++;
+}
+
+// threads that ran a chunk of a job whose chunks take a while, so that every thread gets some
+std::set<std::thread::id> threadsUsed(ThreadPool& pool) {
+    std::mutex mutex;
+    std::set<std::thread::id> used;
+    pool.parallelFor(0, 64, 1, [&](int, int) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        std::lock_guard<std::mutex> lock(mutex);
+        used.insert(std::this_thread::get_id());
+    });
+    return used;
+}
+
+// runs a job whose chunks throw on the threads `throws` picks, true when the exception reached the caller
+template <typename Predicate>
+bool throwsToCaller(ThreadPool& pool, Predicate throws) {
+    try {
+        pool.parallelFor(0, 64, 1, [&](int, int) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            if (throws(std::this_thread::get_id())) throw std::runtime_error("chunk failed");
+        });
+    } catch (const std::runtime_error& e) {
+        return std::string(e.what()) == "chunk failed";
+    }
+    return false;
+}
+
+} // namespace
+
+int main() {
+    ThreadPool pool(4);
+    const std::thread::id caller = std::this_thread::get_id();
+
+    check(threadsUsed(pool).size() > 1, "a job runs on several threads");
+
+    check(throwsToCaller(pool, [&](std::thread::id id) { return id == caller; }), "an exception on the calling thread reaches the caller");
+    check(threadsUsed(pool).size() > 1, "later jobs still run on several threads");
+
+    check(throwsToCaller(pool, [&](std::thread::id id) { return id != caller; }), "an exception on a worker reaches the caller");
+    check(threadsUsed(pool).size() > 1, "the workers keep running jobs");
+
+    check(throwsToCaller(pool, [](std::thread::id) { return true; }), "exceptions on every thread reach the caller once");
+    int sum = 0;
+    pool.parallelFor(0, 1000, 10, [&](int begin, int end) {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = begin; i < end; i++) sum += i;
+    });
+    check(sum == 999 * 1000 / 2, "the next job covers its whole range");
+    return failures == 0 ? 0 : 1;
+}